@@ -28,10 +28,21 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 #include "benchmark/benchmark.h"
 #include "benchmarks.pb.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/struct.pb.h"
+#include "google/protobuf/text_format.h"
+#include "google/protobuf/util/json_util.h"
+#include "google/protobuf/util/message_differencer.h"
 #include "datasets/google_message1/proto2/benchmark_message1_proto2.pb.h"
 #include "datasets/google_message1/proto3/benchmark_message1_proto3.pb.h"
 #include "datasets/google_message2/benchmark_message2.pb.h"
@@ -46,8 +57,19 @@ using benchmarks::BenchmarkDataset;
 using google::protobuf::Arena;
 using google::protobuf::Descriptor;
 using google::protobuf::DescriptorPool;
+using google::protobuf::DynamicMessageFactory;
+using google::protobuf::FieldDescriptor;
 using google::protobuf::Message;
 using google::protobuf::MessageFactory;
+using google::protobuf::Reflection;
+using google::protobuf::Struct;
+using google::protobuf::TextFormat;
+using google::protobuf::io::ArrayOutputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::StringOutputStream;
+using google::protobuf::util::JsonStringToMessage;
+using google::protobuf::util::MessageDifferencer;
+using google::protobuf::util::MessageToJsonString;
 
 class Fixture : public benchmark::Fixture {
  public:
@@ -156,39 +178,557 @@ class ParseReuseFixture : public Fixture {
   }
 };
 
+// Base for benchmarks that operate on already-parsed messages.  Every case
+// reports the size of the binary payloads it processed, so that bytes/sec is
+// comparable across operations.
 template <class T>
-class SerializeFixture : public Fixture {
+class MessageFixture : public Fixture {
  public:
-  SerializeFixture(const BenchmarkDataset& dataset)
-      : Fixture(dataset, "_serialize") {
+  MessageFixture(const BenchmarkDataset& dataset, const std::string& suffix)
+      : Fixture(dataset, suffix) {
     for (size_t i = 0; i < payloads_.size(); i++) {
       message_.push_back(new T);
       message_.back()->ParseFromString(payloads_[i]);
     }
   }
 
-  ~SerializeFixture() {
+  ~MessageFixture() {
     for (size_t i = 0; i < message_.size(); i++) {
       delete message_[i];
     }
   }
 
+ protected:
+  std::vector<T*> message_;
+};
+
+template <class T>
+class SerializeFixture : public MessageFixture<T> {
+ public:
+  SerializeFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_serialize") {}
+
   virtual void BenchmarkCase(benchmark::State& state) {
     size_t total = 0;
     std::string str;
-    WrappingCounter i(payloads_.size());
+    WrappingCounter i(this->payloads_.size());
 
     while (state.KeepRunning()) {
       str.clear();
-      message_[i.Next()]->SerializeToString(&str);
+      this->message_[i.Next()]->SerializeToString(&str);
       total += str.size();
     }
 
+    state.SetBytesProcessed(total);
+  }
+};
+
+template <class T>
+class SerializeToArrayFixture : public MessageFixture<T> {
+ public:
+  SerializeToArrayFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_serialize_array") {
+    size_t max_size = 0;
+    for (size_t i = 0; i < this->payloads_.size(); i++) {
+      max_size = std::max(max_size, this->message_[i]->ByteSizeLong());
+    }
+    buffer_.resize(max_size + 1);
+  }
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    WrappingCounter i(this->payloads_.size());
+
+    while (state.KeepRunning()) {
+      T* m = this->message_[i.Next()];
+      m->SerializeToArray(&buffer_[0], buffer_.size());
+      total += m->GetCachedSize();
+    }
+
     state.SetBytesProcessed(total);
   }
 
  private:
-  std::vector<T*> message_;
+  std::vector<char> buffer_;
+};
+
+template <class T>
+class SerializeToStreamFixture : public MessageFixture<T> {
+ public:
+  SerializeToStreamFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_serialize_stream") {}
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    std::string str;
+    WrappingCounter i(this->payloads_.size());
+
+    while (state.KeepRunning()) {
+      str.clear();
+      StringOutputStream output(&str);
+      this->message_[i.Next()]->SerializeToZeroCopyStream(&output);
+      total += output.ByteCount();
+    }
+
+    state.SetBytesProcessed(total);
+  }
+};
+
+template <class T>
+class SerializeDeterministicFixture : public MessageFixture<T> {
+ public:
+  SerializeDeterministicFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_serialize_deterministic") {}
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    std::string str;
+    WrappingCounter i(this->payloads_.size());
+
+    while (state.KeepRunning()) {
+      str.clear();
+      {
+        StringOutputStream output(&str);
+        CodedOutputStream coded(&output);
+        coded.SetSerializationDeterministic(true);
+        this->message_[i.Next()]->SerializeToCodedStream(&coded);
+      }
+      total += str.size();
+    }
+
+    state.SetBytesProcessed(total);
+  }
+};
+
+// None of the datasets has map fields, so deterministic serialization of
+// maps, which sorts their keys, is measured on a google.protobuf.Struct with
+// many string keys, nested one level deep.
+class MapSerializeFixture : public benchmark::Fixture {
+ public:
+  MapSerializeFixture(bool deterministic) : deterministic_(deterministic) {
+    for (int i = 0; i < 100; i++) {
+      Struct* nested =
+          (*message_.mutable_fields())["struct_" + std::to_string(i)]
+              .mutable_struct_value();
+      for (int j = 0; j < 10; j++) {
+        (*nested->mutable_fields())["number_" + std::to_string(j)]
+            .set_number_value(i * j);
+      }
+    }
+    for (int i = 0; i < 1000; i++) {
+      (*message_.mutable_fields())["string_" + std::to_string(i)]
+          .set_string_value("value_" + std::to_string(i));
+    }
+    SetName(deterministic ? "struct_map_serialize_deterministic"
+                          : "struct_map_serialize");
+  }
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    std::string str;
+
+    while (state.KeepRunning()) {
+      str.clear();
+      {
+        StringOutputStream output(&str);
+        CodedOutputStream coded(&output);
+        coded.SetSerializationDeterministic(deterministic_);
+        message_.SerializeToCodedStream(&coded);
+      }
+      total += str.size();
+    }
+
+    state.SetBytesProcessed(total);
+  }
+
+ private:
+  bool deterministic_;
+  Struct message_;
+};
+
+template <class T>
+class ByteSizeFixture : public MessageFixture<T> {
+ public:
+  ByteSizeFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_bytesize") {}
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    WrappingCounter i(this->payloads_.size());
+
+    while (state.KeepRunning()) {
+      total += this->message_[i.Next()]->ByteSizeLong();
+    }
+
+    state.SetBytesProcessed(total);
+  }
+};
+
+template <class T>
+class MergeFromFixture : public MessageFixture<T> {
+ public:
+  MergeFromFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_merge_from") {}
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    WrappingCounter i(this->payloads_.size());
+
+    while (state.KeepRunning()) {
+      size_t index = i.Next();
+      T m;
+      m.MergeFrom(*this->message_[index]);
+      total += this->payloads_[index].size();
+    }
+
+    state.SetBytesProcessed(total);
+  }
+};
+
+template <class T>
+class CopyFromFixture : public MessageFixture<T> {
+ public:
+  CopyFromFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_copy_from") {}
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    T m;
+    WrappingCounter i(this->payloads_.size());
+
+    while (state.KeepRunning()) {
+      size_t index = i.Next();
+      m.CopyFrom(*this->message_[index]);
+      total += this->payloads_[index].size();
+    }
+
+    state.SetBytesProcessed(total);
+  }
+};
+
+// Reads every set field of |message| through reflection, recursing into
+// submessages, and returns a value depending on all of them so that the reads
+// are not optimized away.
+size_t ReadFieldsWithReflection(const Message& message) {
+  const Reflection* reflection = message.GetReflection();
+  std::vector<const FieldDescriptor*> fields;
+  reflection->ListFields(message, &fields);
+  size_t result = 0;
+  for (size_t i = 0; i < fields.size(); i++) {
+    const FieldDescriptor* field = fields[i];
+    bool repeated = field->is_repeated();
+    int count = repeated ? reflection->FieldSize(message, field) : 1;
+    for (int j = 0; j < count; j++) {
+      switch (field->cpp_type()) {
+#define HANDLE_TYPE(CPPTYPE, METHOD)                               \
+  case FieldDescriptor::CPPTYPE_##CPPTYPE:                         \
+    result += static_cast<size_t>(                                 \
+        repeated ? reflection->GetRepeated##METHOD(message, field, j) \
+                 : reflection->Get##METHOD(message, field));       \
+    break;
+
+        HANDLE_TYPE(INT32, Int32)
+        HANDLE_TYPE(INT64, Int64)
+        HANDLE_TYPE(UINT32, UInt32)
+        HANDLE_TYPE(UINT64, UInt64)
+        HANDLE_TYPE(DOUBLE, Double)
+        HANDLE_TYPE(FLOAT, Float)
+        HANDLE_TYPE(BOOL, Bool)
+#undef HANDLE_TYPE
+        case FieldDescriptor::CPPTYPE_ENUM:
+          result += repeated
+                        ? reflection->GetRepeatedEnumValue(message, field, j)
+                        : reflection->GetEnumValue(message, field);
+          break;
+        case FieldDescriptor::CPPTYPE_STRING:
+          result += repeated
+                        ? reflection->GetRepeatedString(message, field, j)
+                              .size()
+                        : reflection->GetString(message, field).size();
+          break;
+        case FieldDescriptor::CPPTYPE_MESSAGE:
+          result += ReadFieldsWithReflection(
+              repeated ? reflection->GetRepeatedMessage(message, field, j)
+                       : reflection->GetMessage(message, field));
+          break;
+      }
+    }
+  }
+  return result;
+}
+
+// Copies every set field of |from| into the empty message |to| through
+// reflection setters, recursing into submessages.
+void WriteFieldsWithReflection(const Message& from, Message* to) {
+  const Reflection* from_reflection = from.GetReflection();
+  const Reflection* to_reflection = to->GetReflection();
+  std::vector<const FieldDescriptor*> fields;
+  from_reflection->ListFields(from, &fields);
+  for (size_t i = 0; i < fields.size(); i++) {
+    const FieldDescriptor* field = fields[i];
+    if (field->is_repeated()) {
+      int count = from_reflection->FieldSize(from, field);
+      for (int j = 0; j < count; j++) {
+        switch (field->cpp_type()) {
+#define HANDLE_TYPE(CPPTYPE, METHOD)                                   \
+  case FieldDescriptor::CPPTYPE_##CPPTYPE:                             \
+    to_reflection->Add##METHOD(                                        \
+        to, field, from_reflection->GetRepeated##METHOD(from, field, j)); \
+    break;
+
+          HANDLE_TYPE(INT32, Int32)
+          HANDLE_TYPE(INT64, Int64)
+          HANDLE_TYPE(UINT32, UInt32)
+          HANDLE_TYPE(UINT64, UInt64)
+          HANDLE_TYPE(DOUBLE, Double)
+          HANDLE_TYPE(FLOAT, Float)
+          HANDLE_TYPE(BOOL, Bool)
+          HANDLE_TYPE(ENUM, EnumValue)
+          HANDLE_TYPE(STRING, String)
+#undef HANDLE_TYPE
+          case FieldDescriptor::CPPTYPE_MESSAGE:
+            WriteFieldsWithReflection(
+                from_reflection->GetRepeatedMessage(from, field, j),
+                to_reflection->AddMessage(to, field));
+            break;
+        }
+      }
+    } else {
+      switch (field->cpp_type()) {
+#define HANDLE_TYPE(CPPTYPE, METHOD)                                    \
+  case FieldDescriptor::CPPTYPE_##CPPTYPE:                              \
+    to_reflection->Set##METHOD(to, field,                               \
+                               from_reflection->Get##METHOD(from, field)); \
+    break;
+
+        HANDLE_TYPE(INT32, Int32)
+        HANDLE_TYPE(INT64, Int64)
+        HANDLE_TYPE(UINT32, UInt32)
+        HANDLE_TYPE(UINT64, UInt64)
+        HANDLE_TYPE(DOUBLE, Double)
+        HANDLE_TYPE(FLOAT, Float)
+        HANDLE_TYPE(BOOL, Bool)
+        HANDLE_TYPE(ENUM, EnumValue)
+        HANDLE_TYPE(STRING, String)
+#undef HANDLE_TYPE
+        case FieldDescriptor::CPPTYPE_MESSAGE:
+          WriteFieldsWithReflection(from_reflection->GetMessage(from, field),
+                                    to_reflection->MutableMessage(to, field));
+          break;
+      }
+    }
+  }
+}
+
+template <class T>
+class ReflectionGetFixture : public MessageFixture<T> {
+ public:
+  ReflectionGetFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_reflection_get") {}
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    WrappingCounter i(this->payloads_.size());
+
+    while (state.KeepRunning()) {
+      size_t index = i.Next();
+      benchmark::DoNotOptimize(
+          ReadFieldsWithReflection(*this->message_[index]));
+      total += this->payloads_[index].size();
+    }
+
+    state.SetBytesProcessed(total);
+  }
+};
+
+template <class T>
+class ReflectionSetFixture : public MessageFixture<T> {
+ public:
+  ReflectionSetFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_reflection_set") {}
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    T m;
+    WrappingCounter i(this->payloads_.size());
+
+    while (state.KeepRunning()) {
+      size_t index = i.Next();
+      m.Clear();
+      WriteFieldsWithReflection(*this->message_[index], &m);
+      total += this->payloads_[index].size();
+    }
+
+    state.SetBytesProcessed(total);
+  }
+};
+
+class ParseDynamicFixture : public Fixture {
+ public:
+  ParseDynamicFixture(const BenchmarkDataset& dataset)
+      : Fixture(dataset, "_parse_dynamic") {}
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    // Built from the same descriptor as the generated type, but parsed with
+    // the reflection-based DynamicMessage implementation.
+    DynamicMessageFactory factory;
+    std::unique_ptr<Message> m(
+        factory.GetPrototype(prototype_->GetDescriptor())->New());
+    WrappingCounter i(payloads_.size());
+    size_t total = 0;
+
+    while (state.KeepRunning()) {
+      const std::string& payload = payloads_[i.Next()];
+      total += payload.size();
+      m->ParseFromString(payload);
+    }
+
+    state.SetBytesProcessed(total);
+  }
+};
+
+template <class T>
+class TextPrintFixture : public MessageFixture<T> {
+ public:
+  TextPrintFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_text_print") {}
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    std::string str;
+    WrappingCounter i(this->payloads_.size());
+
+    while (state.KeepRunning()) {
+      size_t index = i.Next();
+      TextFormat::PrintToString(*this->message_[index], &str);
+      total += this->payloads_[index].size();
+    }
+
+    state.SetBytesProcessed(total);
+  }
+};
+
+template <class T>
+class TextParseFixture : public MessageFixture<T> {
+ public:
+  TextParseFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_text_parse") {
+    for (size_t i = 0; i < this->payloads_.size(); i++) {
+      text_.push_back(std::string());
+      TextFormat::PrintToString(*this->message_[i], &text_.back());
+    }
+  }
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    T m;
+    WrappingCounter i(this->payloads_.size());
+
+    while (state.KeepRunning()) {
+      size_t index = i.Next();
+      TextFormat::ParseFromString(text_[index], &m);
+      total += this->payloads_[index].size();
+    }
+
+    state.SetBytesProcessed(total);
+  }
+
+ private:
+  std::vector<std::string> text_;
+};
+
+template <class T>
+class JsonPrintFixture : public MessageFixture<T> {
+ public:
+  JsonPrintFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_json_print") {}
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    std::string str;
+    WrappingCounter i(this->payloads_.size());
+
+    while (state.KeepRunning()) {
+      size_t index = i.Next();
+      str.clear();
+      if (!MessageToJsonString(*this->message_[index], &str).ok()) {
+        state.SkipWithError("MessageToJsonString failed");
+        break;
+      }
+      total += this->payloads_[index].size();
+    }
+
+    state.SetBytesProcessed(total);
+  }
+};
+
+template <class T>
+class JsonParseFixture : public MessageFixture<T> {
+ public:
+  JsonParseFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_json_parse") {
+    for (size_t i = 0; i < this->payloads_.size(); i++) {
+      json_.push_back(std::string());
+      MessageToJsonString(*this->message_[i], &json_.back());
+    }
+  }
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    T m;
+    WrappingCounter i(this->payloads_.size());
+
+    while (state.KeepRunning()) {
+      size_t index = i.Next();
+      if (!JsonStringToMessage(json_[index], &m).ok()) {
+        state.SkipWithError("JsonStringToMessage failed");
+        break;
+      }
+      total += this->payloads_[index].size();
+    }
+
+    state.SetBytesProcessed(total);
+  }
+
+ private:
+  std::vector<std::string> json_;
+};
+
+template <class T>
+class EqualsFixture : public MessageFixture<T> {
+ public:
+  EqualsFixture(const BenchmarkDataset& dataset)
+      : MessageFixture<T>(dataset, "_differencer_equals") {
+    for (size_t i = 0; i < this->payloads_.size(); i++) {
+      copy_.push_back(new T(*this->message_[i]));
+    }
+  }
+
+  ~EqualsFixture() {
+    for (size_t i = 0; i < copy_.size(); i++) {
+      delete copy_[i];
+    }
+  }
+
+  virtual void BenchmarkCase(benchmark::State& state) {
+    size_t total = 0;
+    WrappingCounter i(this->payloads_.size());
+
+    while (state.KeepRunning()) {
+      size_t index = i.Next();
+      if (!MessageDifferencer::Equals(*this->message_[index],
+                                      *copy_[index])) {
+        state.SkipWithError("MessageDifferencer::Equals returned false");
+        break;
+      }
+      total += this->payloads_[index].size();
+    }
+
+    state.SetBytesProcessed(total);
+  }
+
+ private:
+  std::vector<T*> copy_;
 };
 
 std::string ReadFile(const std::string& name) {
@@ -211,6 +751,34 @@ void RegisterBenchmarksForType(const BenchmarkDataset& dataset) {
       new ParseNewArenaFixture<T>(dataset));
   ::benchmark::internal::RegisterBenchmarkInternal(
       new SerializeFixture<T>(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new SerializeToArrayFixture<T>(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new SerializeToStreamFixture<T>(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new SerializeDeterministicFixture<T>(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new ByteSizeFixture<T>(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new MergeFromFixture<T>(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new CopyFromFixture<T>(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new ReflectionGetFixture<T>(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new ReflectionSetFixture<T>(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new ParseDynamicFixture(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new TextPrintFixture<T>(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new TextParseFixture<T>(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new JsonPrintFixture<T>(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new JsonParseFixture<T>(dataset));
+  ::benchmark::internal::RegisterBenchmarkInternal(
+      new EqualsFixture<T>(dataset));
 }
 
 void RegisterBenchmarks(const std::string& dataset_bytes) {
@@ -248,6 +816,10 @@ int main(int argc, char *argv[]) {
     for (int i = 1; i < argc; i++) {
       RegisterBenchmarks(ReadFile(argv[i]));
     }
+    ::benchmark::internal::RegisterBenchmarkInternal(
+        new MapSerializeFixture(false));
+    ::benchmark::internal::RegisterBenchmarkInternal(
+        new MapSerializeFixture(true));
   }
 
   ::benchmark::RunSpecifiedBenchmarks();
@@ -0,0 +1,290 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmarks that run the same operation on 1..N threads at once, to find
+// where shared state (arenas, descriptor pools, message factories) stops
+// scaling.  Every case reports both the aggregate throughput and the average
+// throughput of a single thread; with perfect scaling the latter is constant.
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>  // NOLINT
+#include <vector>
+#include "benchmark/benchmark.h"
+#include "benchmarks.pb.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/text_format.h"
+
+using benchmarks::BenchmarkDataset;
+using google::protobuf::Arena;
+using google::protobuf::Descriptor;
+using google::protobuf::DescriptorPool;
+using google::protobuf::DynamicMessageFactory;
+using google::protobuf::FileDescriptor;
+using google::protobuf::Message;
+using google::protobuf::MessageFactory;
+using google::protobuf::TextFormat;
+
+// Upper bound on the payload bytes parsed into the shared arena in one run of
+// the arena benchmark.  The arena cannot be reset while other threads use it,
+// so its iteration count is fixed to keep memory bounded.
+static const size_t kSharedArenaBytesPerRun = 256 << 20;
+
+class WrappingCounter {
+ public:
+  WrappingCounter(size_t limit) : value_(0), limit_(limit) {}
+
+  size_t Next() {
+    size_t ret = value_;
+    if (++value_ == limit_) {
+      value_ = 0;
+    }
+    return ret;
+  }
+
+ private:
+  size_t value_;
+  size_t limit_;
+};
+
+// State shared by all threads of all benchmarks for one dataset.  Everything
+// here is read-only once the benchmarks start.
+struct Dataset {
+  std::string name;
+  const Message* prototype;
+  std::vector<std::string> payloads;
+  std::vector<std::unique_ptr<Message> > messages;
+  // Full names of every message type in the dataset's file and its
+  // dependencies, for the lookup benchmarks.
+  std::vector<std::string> type_names;
+  std::vector<const Descriptor*> types;
+};
+
+void AddTypes(const Descriptor* descriptor, Dataset* dataset) {
+  dataset->type_names.push_back(descriptor->full_name());
+  dataset->types.push_back(descriptor);
+  for (int i = 0; i < descriptor->nested_type_count(); i++) {
+    AddTypes(descriptor->nested_type(i), dataset);
+  }
+}
+
+void AddTypes(const FileDescriptor* file, Dataset* dataset) {
+  for (int i = 0; i < file->message_type_count(); i++) {
+    AddTypes(file->message_type(i), dataset);
+  }
+  for (int i = 0; i < file->dependency_count(); i++) {
+    AddTypes(file->dependency(i), dataset);
+  }
+}
+
+// Reports |total| bytes and the average per-thread rate.
+void ReportThroughput(benchmark::State& state, size_t total) {
+  state.SetBytesProcessed(total);
+  state.counters["bytes_per_second_per_thread"] = benchmark::Counter(
+      total, benchmark::Counter::kIsRate | benchmark::Counter::kAvgThreads);
+}
+
+// Reports |total| items and the average per-thread rate.
+void ReportItems(benchmark::State& state, size_t total) {
+  state.SetItemsProcessed(total);
+  state.counters["items_per_second_per_thread"] = benchmark::Counter(
+      total, benchmark::Counter::kIsRate | benchmark::Counter::kAvgThreads);
+}
+
+// All threads parse into one arena, so every thread goes through
+// ArenaImpl::GetSerialArenaFallback() once and then allocates from its own
+// SerialArena in the arena's shared list.
+void BM_ParseSharedArena(benchmark::State& state, const Dataset* dataset) {
+  static Arena* arena = NULL;
+  if (state.thread_index == 0) {
+    arena = new Arena;
+  }
+  WrappingCounter i(dataset->payloads.size());
+  size_t total = 0;
+
+  while (state.KeepRunning()) {
+    const std::string& payload = dataset->payloads[i.Next()];
+    Message* m = dataset->prototype->New(arena);
+    m->ParseFromString(payload);
+    total += payload.size();
+  }
+
+  ReportThroughput(state, total);
+  if (state.thread_index == 0) {
+    // KeepRunning() returns false on all threads only after they have all
+    // finished, so no thread uses the arena any more.
+    delete arena;
+    arena = NULL;
+  }
+}
+
+void BM_GeneratedPoolLookup(benchmark::State& state, const Dataset* dataset) {
+  const DescriptorPool* pool = DescriptorPool::generated_pool();
+  WrappingCounter i(dataset->type_names.size());
+  size_t total = 0;
+
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(
+        pool->FindMessageTypeByName(dataset->type_names[i.Next()]));
+    total++;
+  }
+
+  ReportItems(state, total);
+}
+
+void BM_DynamicGetPrototype(benchmark::State& state, const Dataset* dataset) {
+  // Shared by all threads; the prototypes are built during the first
+  // iterations and looked up afterwards.
+  static DynamicMessageFactory* factory = NULL;
+  if (state.thread_index == 0) {
+    factory = new DynamicMessageFactory;
+  }
+  WrappingCounter i(dataset->types.size());
+  size_t total = 0;
+
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(factory->GetPrototype(dataset->types[i.Next()]));
+    total++;
+  }
+
+  ReportItems(state, total);
+  if (state.thread_index == 0) {
+    delete factory;
+    factory = NULL;
+  }
+}
+
+void BM_TextFormatPrint(benchmark::State& state, const Dataset* dataset) {
+  WrappingCounter i(dataset->messages.size());
+  std::string str;
+  size_t total = 0;
+
+  while (state.KeepRunning()) {
+    size_t index = i.Next();
+    TextFormat::PrintToString(*dataset->messages[index], &str);
+    total += dataset->payloads[index].size();
+  }
+
+  ReportThroughput(state, total);
+}
+
+std::string ReadFile(const std::string& name) {
+  std::ifstream file(name.c_str());
+  GOOGLE_CHECK(file.is_open()) << "Couldn't find file '" << name <<
+                                  "', please make sure you are running "
+                                  "this command from the benchmarks/ "
+                                  "directory.\n";
+  return std::string((std::istreambuf_iterator<char>(file)),
+                     std::istreambuf_iterator<char>());
+}
+
+// Thread counts to run: powers of two up to the number of hardware threads,
+// plus that number itself.
+std::vector<int> ThreadCounts() {
+  int max_threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<int> counts;
+  for (int threads = 1; threads < max_threads; threads *= 2) {
+    counts.push_back(threads);
+  }
+  counts.push_back(max_threads);
+  return counts;
+}
+
+void RegisterBenchmarks(const std::string& dataset_bytes) {
+  BenchmarkDataset dataset;
+  GOOGLE_CHECK(dataset.ParseFromString(dataset_bytes));
+
+  const Descriptor* d =
+      DescriptorPool::generated_pool()->FindMessageTypeByName(
+          dataset.message_name());
+  if (!d) {
+    std::cerr << "Unknown message type: " << dataset.message_name();
+    exit(1);
+  }
+
+  // Intentionally leaked: registered benchmarks refer to it until exit.
+  Dataset* data = new Dataset;
+  data->name = dataset.name();
+  data->prototype = MessageFactory::generated_factory()->GetPrototype(d);
+  size_t max_payload_size = 1;
+  for (int i = 0; i < dataset.payload_size(); i++) {
+    data->payloads.push_back(dataset.payload(i));
+    data->messages.emplace_back(data->prototype->New());
+    data->messages.back()->ParseFromString(dataset.payload(i));
+    max_payload_size = std::max(max_payload_size, dataset.payload(i).size());
+  }
+  AddTypes(d->file(), data);
+
+  std::vector<int> thread_counts = ThreadCounts();
+  for (size_t i = 0; i < thread_counts.size(); i++) {
+    int threads = thread_counts[i];
+    size_t arena_iterations = std::max<size_t>(
+        1, kSharedArenaBytesPerRun / max_payload_size / threads);
+    benchmark::RegisterBenchmark(
+        (data->name + "_parse_shared_arena").c_str(), BM_ParseSharedArena,
+        data)
+        ->Threads(threads)
+        ->Iterations(arena_iterations)
+        ->UseRealTime();
+    benchmark::RegisterBenchmark(
+        (data->name + "_generated_pool_lookup").c_str(),
+        BM_GeneratedPoolLookup, data)
+        ->Threads(threads)
+        ->UseRealTime();
+    benchmark::RegisterBenchmark(
+        (data->name + "_dynamic_get_prototype").c_str(),
+        BM_DynamicGetPrototype, data)
+        ->Threads(threads)
+        ->UseRealTime();
+    benchmark::RegisterBenchmark(
+        (data->name + "_text_print").c_str(), BM_TextFormatPrint, data)
+        ->Threads(threads)
+        ->UseRealTime();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  ::benchmark::Initialize(&argc, argv);
+  if (argc == 1) {
+    std::cerr << "Usage: ./cpp-threading-benchmark <input data>" << std::endl;
+    std::cerr << "input data is in the format of \"benchmarks.proto\""
+        << std::endl;
+    return 1;
+  } else {
+    for (int i = 1; i < argc; i++) {
+      RegisterBenchmarks(ReadFile(argv[i]));
+    }
+  }
+
+  ::benchmark::RunSpecifiedBenchmarks();
+}
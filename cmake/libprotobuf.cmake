@@ -36,6 +36,7 @@ set(libprotobuf_files
   ${protobuf_source_dir}/src/google/protobuf/util/field_mask_util.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/datapiece.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/default_value_objectwriter.cc
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/delimited_objectwriter.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/error_listener.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/field_mask_utility.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/json_escaping.cc
@@ -45,8 +46,11 @@ set(libprotobuf_files
   ${protobuf_source_dir}/src/google/protobuf/util/internal/proto_writer.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/protostream_objectsource.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/protostream_objectwriter.cc
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/reflection_objectsource.cc
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/reflection_objectwriter.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/type_info.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/type_info_test_helper.cc
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/type_resolver_cache.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/utility.cc
   ${protobuf_source_dir}/src/google/protobuf/util/json_util.cc
   ${protobuf_source_dir}/src/google/protobuf/util/message_differencer.cc
@@ -92,6 +96,7 @@ set(libprotobuf_includes
   ${protobuf_source_dir}/src/google/protobuf/util/field_mask_util.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/datapiece.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/default_value_objectwriter.h
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/delimited_objectwriter.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/error_listener.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/field_mask_utility.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/json_escaping.h
@@ -101,8 +106,11 @@ set(libprotobuf_includes
   ${protobuf_source_dir}/src/google/protobuf/util/internal/proto_writer.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/protostream_objectsource.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/protostream_objectwriter.h
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/reflection_objectsource.h
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/reflection_objectwriter.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/type_info.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/type_info_test_helper.h
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/type_resolver_cache.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/utility.h
   ${protobuf_source_dir}/src/google/protobuf/util/json_util.h
   ${protobuf_source_dir}/src/google/protobuf/util/message_differencer.h
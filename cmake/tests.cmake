@@ -84,6 +84,14 @@ set(tests_protos
   google/protobuf/util/message_differencer_unittest.proto
 )
 
+# Parsed by the table-driven parser.
+set(table_driven_test_protos
+  google/protobuf/unittest_table_driven.proto
+  google/protobuf/unittest_table_driven_proto3.proto
+)
+
+# Any extra argument is passed as the parameter of --cpp_out, e.g.
+# "table_driven:".
 macro(compile_proto_file filename)
   get_filename_component(dirname ${filename} PATH)
   get_filename_component(basename ${filename} NAME_WE)
@@ -92,7 +100,7 @@ macro(compile_proto_file filename)
     DEPENDS protoc ${protobuf_source_dir}/src/${dirname}/${basename}.proto
     COMMAND protoc ${protobuf_source_dir}/src/${dirname}/${basename}.proto
         --proto_path=${protobuf_source_dir}/src
-        --cpp_out=${protobuf_source_dir}/src
+        --cpp_out=${ARGN}${protobuf_source_dir}/src
   )
 endmacro(compile_proto_file)
 
@@ -112,6 +120,13 @@ foreach(proto_file ${tests_protos})
       ${protobuf_source_dir}/src/${pb_file})
 endforeach(proto_file)
 
+foreach(proto_file ${table_driven_test_protos})
+  compile_proto_file(${proto_file} table_driven:)
+  string(REPLACE .proto .pb.cc pb_file ${proto_file})
+  set(tests_proto_files ${tests_proto_files}
+      ${protobuf_source_dir}/src/${pb_file})
+endforeach(proto_file)
+
 set(common_test_files
   ${protobuf_source_dir}/src/google/protobuf/arena_test_util.cc
   ${protobuf_source_dir}/src/google/protobuf/map_test_util.cc
@@ -155,6 +170,7 @@ set(tests_files
   ${protobuf_source_dir}/src/google/protobuf/dynamic_message_unittest.cc
   ${protobuf_source_dir}/src/google/protobuf/extension_set_unittest.cc
   ${protobuf_source_dir}/src/google/protobuf/generated_message_reflection_unittest.cc
+  ${protobuf_source_dir}/src/google/protobuf/generated_message_table_driven_unittest.cc
   ${protobuf_source_dir}/src/google/protobuf/io/coded_stream_unittest.cc
   ${protobuf_source_dir}/src/google/protobuf/io/printer_unittest.cc
   ${protobuf_source_dir}/src/google/protobuf/io/tokenizer_unittest.cc
@@ -174,6 +190,7 @@ set(tests_files
   ${protobuf_source_dir}/src/google/protobuf/repeated_field_unittest.cc
   ${protobuf_source_dir}/src/google/protobuf/stubs/bytestream_unittest.cc
   ${protobuf_source_dir}/src/google/protobuf/stubs/common_unittest.cc
+  ${protobuf_source_dir}/src/google/protobuf/stubs/float_conversion_unittest.cc
   ${protobuf_source_dir}/src/google/protobuf/stubs/int128_unittest.cc
   ${protobuf_source_dir}/src/google/protobuf/stubs/io_win32_unittest.cc
   ${protobuf_source_dir}/src/google/protobuf/stubs/status_test.cc
@@ -194,7 +211,9 @@ set(tests_files
   ${protobuf_source_dir}/src/google/protobuf/util/internal/json_stream_parser_test.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/protostream_objectsource_test.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/protostream_objectwriter_test.cc
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/type_info_test.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/type_info_test_helper.cc
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/type_resolver_cache_test.cc
   ${protobuf_source_dir}/src/google/protobuf/util/json_util_test.cc
   ${protobuf_source_dir}/src/google/protobuf/util/message_differencer_unittest.cc
   ${protobuf_source_dir}/src/google/protobuf/util/time_util_test.cc
@@ -33,6 +33,8 @@
 #include <algorithm>
 #include <limits>
 
+#include <google/protobuf/stubs/mutex.h>
+
 
 #ifdef ADDRESS_SANITIZER
 #include <sanitizer/asan_interface.h>
@@ -47,6 +49,98 @@ namespace google {
 namespace protobuf {
 namespace internal {
 
+namespace {
+
+// Per-thread cache of freed arena blocks, kept in one free list per
+// power-of-two size class.  While a block sits in the cache its first word
+// links it to the next cached block of the same size.
+class ArenaBlockCache {
+ public:
+  // Sizes outside of [2^kMinSizeLg2, 2^kMaxSizeLg2] are never cached.
+  static const int kMinSizeLg2 = 8;
+  static const int kMaxSizeLg2 = 26;
+
+  ArenaBlockCache() : cached_bytes_(0), destroyed_(false) {
+    for (int i = 0; i < kNumSizeClasses; i++) {
+      free_lists_[i] = NULL;
+    }
+  }
+
+  ~ArenaBlockCache() {
+    for (int i = 0; i < kNumSizeClasses; i++) {
+      while (free_lists_[i] != NULL) {
+        FreeBlock* next = free_lists_[i]->next;
+        arena_free(free_lists_[i], size_t{1} << (i + kMinSizeLg2));
+        free_lists_[i] = next;
+      }
+    }
+    cached_bytes_ = 0;
+    // Arenas destroyed later during thread exit must not touch the cache.
+    destroyed_ = true;
+  }
+
+  // Returns the size class of |size| if blocks of that size may be cached,
+  // rounding |*size| up to the size of that class, or -1.
+  static int SizeClass(size_t* size) {
+    if (*size > (size_t{1} << kMaxSizeLg2)) return -1;
+    int lg2 = kMinSizeLg2;
+    while ((size_t{1} << lg2) < *size) lg2++;
+    *size = size_t{1} << lg2;
+    return lg2 - kMinSizeLg2;
+  }
+
+  void* Get(int size_class) {
+    if (destroyed_) return NULL;
+    FreeBlock* block = free_lists_[size_class];
+    if (block != NULL) {
+      free_lists_[size_class] = block->next;
+      cached_bytes_ -= size_t{1} << (size_class + kMinSizeLg2);
+    }
+    return block;
+  }
+
+  // Takes ownership of |mem| if there is room for it under |max_bytes|.
+  bool Put(void* mem, size_t size, size_t max_bytes) {
+    if (destroyed_ || cached_bytes_ + size > max_bytes) return false;
+    size_t class_size = size;
+    int size_class = SizeClass(&class_size);
+    if (size_class < 0 || class_size != size) return false;
+    FreeBlock* block = static_cast<FreeBlock*>(mem);
+    block->next = free_lists_[size_class];
+    free_lists_[size_class] = block;
+    cached_bytes_ += size;
+    return true;
+  }
+
+ private:
+  static const int kNumSizeClasses = kMaxSizeLg2 - kMinSizeLg2 + 1;
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  FreeBlock* free_lists_[kNumSizeClasses];
+  size_t cached_bytes_;
+  bool destroyed_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ArenaBlockCache);
+};
+
+ArenaBlockCache* GetThreadBlockCache() {
+#if defined(GOOGLE_PROTOBUF_NO_THREADLOCAL)
+  static internal::ThreadLocalStorage<ArenaBlockCache>* block_cache_ =
+      new internal::ThreadLocalStorage<ArenaBlockCache>();
+  return block_cache_->Get();
+#else
+  // Needs a non-trivial destructor to release the cached blocks on thread
+  // exit, which GOOGLE_THREAD_LOCAL does not support.
+  static thread_local ArenaBlockCache block_cache_;
+  return &block_cache_;
+#endif
+}
+
+}  // namespace
+
 
 std::atomic<int64> ArenaImpl::lifecycle_id_generator_;
 #if defined(GOOGLE_PROTOBUF_NO_THREADLOCAL)
@@ -64,42 +158,65 @@ ArenaImpl::ThreadCache& ArenaImpl::thread_cache() {
 GOOGLE_THREAD_LOCAL ArenaImpl::ThreadCache ArenaImpl::thread_cache_ = {-1, NULL};
 #endif
 
-void ArenaImpl::Init() {
+void ArenaImpl::Init(Block* retained) {
   lifecycle_id_ =
       lifecycle_id_generator_.fetch_add(1, std::memory_order_relaxed);
+  // Cached blocks are interchangeable between arenas, so only blocks that come
+  // from (and would go back to) the default allocator may be cached.
+  use_block_cache_ =
+      options_.block_cache_max_bytes > 0 &&
+      options_.block_alloc == static_cast<void* (*)(size_t)>(&::operator new) &&
+      options_.block_dealloc == &arena_free;
   hint_.store(nullptr, std::memory_order_relaxed);
   threads_.store(nullptr, std::memory_order_relaxed);
 
+  size_t space_allocated = 0;
+  for (Block* b = retained; b; b = b->next()) {
+    space_allocated += b->size();
+  }
+
+  Block* first_block = NULL;
   if (initial_block_) {
+    new (initial_block_) Block(options_.initial_block_size, NULL);
+    space_allocated += options_.initial_block_size;
+    first_block = initial_block_;
+  } else if (retained) {
+    // Reuse the largest retained block in place of a new first block.
+    first_block = retained;
+    retained = retained->next();
+    first_block->set_next(NULL);
+  }
+
+  spare_blocks_ = retained;
+  spare_owner_ = NULL;
+  if (first_block) {
     // Thread which calls Init() owns the first block. This allows the
     // single-threaded case to allocate on the first block without having to
     // perform atomic operations.
-    new (initial_block_) Block(options_.initial_block_size, NULL);
-    SerialArena* serial =
-        SerialArena::New(initial_block_, &thread_cache(), this);
+    SerialArena* serial = SerialArena::New(first_block, &thread_cache(), this);
     serial->set_next(NULL);
     threads_.store(serial, std::memory_order_relaxed);
-    space_allocated_.store(options_.initial_block_size,
-                           std::memory_order_relaxed);
+    spare_owner_ = serial;
     CacheSerialArena(serial);
-  } else {
-    space_allocated_.store(0, std::memory_order_relaxed);
   }
+  space_allocated_.store(space_allocated, std::memory_order_relaxed);
 }
 
 ArenaImpl::~ArenaImpl() {
   // Have to do this in a first pass, because some of the destructors might
   // refer to memory in other blocks.
   CleanupList();
-  FreeBlocks();
+  FreeBlocks(NULL);
 }
 
 uint64 ArenaImpl::Reset() {
   // Have to do this in a first pass, because some of the destructors might
   // refer to memory in other blocks.
   CleanupList();
-  uint64 space_allocated = FreeBlocks();
-  Init();
+  Block* retained = NULL;
+  uint64 space_allocated =
+      FreeBlocks(options_.reset_retain_bytes > 0 ? &retained : NULL);
+  Init(retained);
 
   return space_allocated;
 }
@@ -113,15 +230,48 @@ ArenaImpl::Block* ArenaImpl::NewBlock(Block* last_block, size_t min_bytes) {
     size = options_.start_block_size;
   }
   // Verify that min_bytes + kBlockHeaderSize won't overflow.
-  GOOGLE_CHECK_LE(min_bytes, std::numeric_limits<size_t>::max() - kBlockHeaderSize);
+  GOOGLE_CHECK_LE(min_bytes,
+                  std::numeric_limits<size_t>::max() - kBlockHeaderSize);
   size = std::max(size, kBlockHeaderSize + min_bytes);
 
-  void* mem = options_.block_alloc(size);
+  void* mem = AllocateBlockMemory(&size);
   Block* b = new (mem) Block(size, last_block);
   space_allocated_.fetch_add(size, std::memory_order_relaxed);
   return b;
 }
 
+void* ArenaImpl::AllocateBlockMemory(size_t* size) {
+  if (use_block_cache_) {
+    int size_class = ArenaBlockCache::SizeClass(size);
+    if (size_class >= 0) {
+      void* mem = GetThreadBlockCache()->Get(size_class);
+      if (options_.block_cache_stats != NULL) {
+        ArenaBlockCacheStats* stats = options_.block_cache_stats;
+        std::atomic<uint64>* counter =
+            mem != NULL ? &stats->hits : &stats->misses;
+        counter->fetch_add(1, std::memory_order_relaxed);
+      }
+      if (mem != NULL) return mem;
+    }
+  }
+  return options_.block_alloc(*size);
+}
+
+void ArenaImpl::DeallocateBlockMemory(void* mem, size_t size) {
+  if (use_block_cache_) {
+    bool recycled = GetThreadBlockCache()->Put(
+        mem, size, options_.block_cache_max_bytes);
+    if (options_.block_cache_stats != NULL) {
+      std::atomic<uint64>* counter =
+          recycled ? &options_.block_cache_stats->recycled
+                   : &options_.block_cache_stats->released;
+      counter->fetch_add(1, std::memory_order_relaxed);
+    }
+    if (recycled) return;
+  }
+  options_.block_dealloc(mem, size);
+}
+
 ArenaImpl::Block::Block(size_t size, Block* next)
     : next_(next), pos_(kBlockHeaderSize), size_(size) {}
 
@@ -223,7 +373,13 @@ void* ArenaImpl::SerialArena::AllocateAlignedFallback(size_t n) {
   // Sync back to current's pos.
   head_->set_pos(head_->size() - (limit_ - ptr_));
 
-  head_ = arena_->NewBlock(head_, n);
+  Block* spare = arena_->TakeSpareBlock(this, n);
+  if (spare != NULL) {
+    spare->set_next(head_);
+    head_ = spare;
+  } else {
+    head_ = arena_->NewBlock(head_, n);
+  }
   ptr_ = head_->Pointer(head_->pos());
   limit_ = head_->Pointer(head_->size());
 
@@ -259,7 +415,7 @@ uint64 ArenaImpl::SerialArena::SpaceUsed() const {
   return space_used;
 }
 
-uint64 ArenaImpl::FreeBlocks() {
+uint64 ArenaImpl::FreeBlocks(Block** retained) {
   uint64 space_allocated = 0;
   // By omitting an Acquire barrier we ensure that any user code that doesn't
   // properly synchronize Reset() or the destructor will throw a TSAN warning.
@@ -268,18 +424,26 @@ uint64 ArenaImpl::FreeBlocks() {
   while (serial) {
     // This is inside a block we are freeing, so we need to read it now.
     SerialArena* next = serial->next();
-    space_allocated += ArenaImpl::SerialArena::Free(serial, initial_block_,
-                                                    options_.block_dealloc);
+    space_allocated +=
+        ArenaImpl::SerialArena::Free(serial, initial_block_, this, retained);
     // serial is dead now.
     serial = next;
   }
 
+  for (Block* b = spare_blocks_; b; ) {
+    Block* next_block = b->next();
+    space_allocated += b->size();
+    ReleaseBlock(b, retained);
+    b = next_block;
+  }
+  spare_blocks_ = NULL;
+
   return space_allocated;
 }
 
 uint64 ArenaImpl::SerialArena::Free(ArenaImpl::SerialArena* serial,
-                                    Block* initial_block,
-                                    void (*block_dealloc)(void*, size_t)) {
+                                    Block* initial_block, ArenaImpl* arena,
+                                    Block** retained) {
   uint64 space_allocated = 0;
 
   // We have to be careful in this function, since we will be freeing the Block
@@ -297,7 +461,7 @@ uint64 ArenaImpl::SerialArena::Free(ArenaImpl::SerialArena* serial,
 #endif  // ADDRESS_SANITIZER
 
     if (b != initial_block) {
-      block_dealloc(b, b->size());
+      arena->ReleaseBlock(b, retained);
     }
 
     b = next_block;
@@ -306,6 +470,66 @@ uint64 ArenaImpl::SerialArena::Free(ArenaImpl::SerialArena* serial,
   return space_allocated;
 }
 
+void ArenaImpl::ReleaseBlock(Block* b, Block** retained) {
+  if (retained != NULL) {
+    RetainBlock(b, retained);
+  } else {
+    DeallocateBlockMemory(b, b->size());
+  }
+}
+
+void ArenaImpl::RetainBlock(Block* b, Block** retained) {
+  size_t size = b->size();
+  if (size > options_.reset_retain_bytes ||
+      size < kBlockHeaderSize + kSerialArenaSize) {
+    // Too large to keep, or too small to hold a SerialArena.
+    DeallocateBlockMemory(b, size);
+    return;
+  }
+
+  Block* prev = NULL;
+  Block* cur = *retained;
+  while (cur != NULL && cur->size() >= size) {
+    prev = cur;
+    cur = cur->next();
+  }
+  new (b) Block(size, cur);
+  if (prev != NULL) {
+    prev->set_next(b);
+  } else {
+    *retained = b;
+  }
+
+  // Keep the longest prefix that fits and free the rest.
+  size_t retained_bytes = 0;
+  prev = NULL;
+  for (cur = *retained; cur != NULL; prev = cur, cur = cur->next()) {
+    if (retained_bytes + cur->size() > options_.reset_retain_bytes) break;
+    retained_bytes += cur->size();
+  }
+  if (prev != NULL) {
+    prev->set_next(NULL);
+  } else {
+    *retained = NULL;
+  }
+  while (cur != NULL) {
+    Block* next = cur->next();
+    DeallocateBlockMemory(cur, cur->size());
+    cur = next;
+  }
+}
+
+ArenaImpl::Block* ArenaImpl::TakeSpareBlock(SerialArena* serial, size_t n) {
+  // Spare blocks are sorted largest first, so only the first can fit.
+  Block* b = spare_blocks_;
+  if (serial != spare_owner_ || b == NULL ||
+      b->size() - kBlockHeaderSize < n) {
+    return NULL;
+  }
+  spare_blocks_ = b->next();
+  return b;
+}
+
 void ArenaImpl::CleanupList() {
   // By omitting an Acquire barrier we ensure that any user code that doesn't
   // properly synchronize Reset() or the destructor will throw a TSAN warning.
@@ -108,6 +108,24 @@ inline void arena_free(void* object, size_t size) {
 
 }  // namespace internal
 
+// Counters describing how an arena's blocks were obtained and released when
+// the per-thread block cache is enabled (see
+// ArenaOptions::block_cache_max_bytes). Counters may be updated concurrently by
+// all threads allocating from arenas that share this object.
+struct ArenaBlockCacheStats {
+  // Blocks that were served from the per-thread cache.
+  std::atomic<uint64> hits;
+  // Blocks that had to be requested from block_alloc.
+  std::atomic<uint64> misses;
+  // Freed blocks that were returned to the per-thread cache.
+  std::atomic<uint64> recycled;
+  // Freed blocks that were passed to block_dealloc because the cache was full
+  // or the block size was not cacheable.
+  std::atomic<uint64> released;
+
+  ArenaBlockCacheStats() : hits(0), misses(0), recycled(0), released(0) {}
+};
+
 // ArenaOptions provides optional additional parameters to arena construction
 // that control its block-allocation behavior.
 struct ArenaOptions {
@@ -141,6 +159,27 @@ struct ArenaOptions {
   // calls free.
   void (*block_dealloc)(void*, size_t);
 
+  // If non-zero, blocks freed by the arena (on Reset() or destruction) are kept
+  // in a per-thread cache holding up to this many bytes, and later arenas on
+  // the same thread take blocks from that cache before calling block_alloc.
+  // This removes nearly all allocator traffic for short-lived arenas that are
+  // created and destroyed on the same thread. Block sizes are rounded up to a
+  // power of two while the cache is in use. The cache is only used with the
+  // default block_alloc and block_dealloc; it is ignored otherwise.
+  size_t block_cache_max_bytes;
+
+  // If non-NULL, the arena records block cache statistics here. The object
+  // must outlive the arena.
+  ArenaBlockCacheStats* block_cache_stats;
+
+  // If non-zero, Reset() keeps the largest blocks allocated by the arena, up
+  // to this many bytes in total, instead of freeing them. The thread calling
+  // Reset() then allocates from the retained blocks, largest first, before
+  // requesting new ones, so an arena reused in a loop reaches a steady state
+  // without any allocator calls. Retained blocks count towards
+  // SpaceAllocated() and are freed when the arena is destroyed.
+  size_t reset_retain_bytes;
+
   ArenaOptions()
       : start_block_size(kDefaultStartBlockSize),
         max_block_size(kDefaultMaxBlockSize),
@@ -148,6 +187,9 @@ struct ArenaOptions {
         initial_block_size(0),
         block_alloc(&::operator new),
         block_dealloc(&internal::arena_free),
+        block_cache_max_bytes(0),
+        block_cache_stats(NULL),
+        reset_retain_bytes(0),
         on_arena_init(NULL),
         on_arena_reset(NULL),
         on_arena_destruction(NULL),
@@ -370,7 +412,8 @@ class PROTOBUF_EXPORT Arena {
   // registered with OwnDestructor() and freeing objects registered with Own().
   // Any objects allocated on this arena are unusable after this call. It also
   // returns the total space used by the arena which is the sums of the sizes
-  // of the allocated blocks. This method is not thread-safe.
+  // of the allocated blocks. Blocks may be kept for reuse as configured by
+  // ArenaOptions::reset_retain_bytes. This method is not thread-safe.
   PROTOBUF_NOINLINE uint64 Reset() {
     // Call the reset hook
     if (on_arena_reset_ != NULL) {
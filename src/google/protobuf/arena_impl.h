@@ -48,6 +48,9 @@
 
 namespace google {
 namespace protobuf {
+
+struct ArenaBlockCacheStats;  // defined in arena.h
+
 namespace internal {
 
 inline size_t AlignUpTo8(size_t n) {
@@ -70,6 +73,9 @@ class PROTOBUF_EXPORT ArenaImpl {
     size_t initial_block_size;
     void* (*block_alloc)(size_t);
     void (*block_dealloc)(void*, size_t);
+    size_t block_cache_max_bytes;
+    ArenaBlockCacheStats* block_cache_stats;
+    size_t reset_retain_bytes;
 
     template <typename O>
     explicit Options(const O& options)
@@ -78,7 +84,10 @@ class PROTOBUF_EXPORT ArenaImpl {
         initial_block(options.initial_block),
         initial_block_size(options.initial_block_size),
         block_alloc(options.block_alloc),
-        block_dealloc(options.block_dealloc) {}
+        block_dealloc(options.block_dealloc),
+        block_cache_max_bytes(options.block_cache_max_bytes),
+        block_cache_stats(options.block_cache_stats),
+        reset_retain_bytes(options.reset_retain_bytes) {}
   };
 
   template <typename O>
@@ -91,7 +100,7 @@ class PROTOBUF_EXPORT ArenaImpl {
       initial_block_ = NULL;
     }
 
-    Init();
+    Init(NULL);
   }
 
   // Destructor deletes all owned heap allocated objects, and destructs objects
@@ -146,10 +155,11 @@ class PROTOBUF_EXPORT ArenaImpl {
     // Creates a new SerialArena inside Block* and returns it.
     static SerialArena* New(Block* b, void* owner, ArenaImpl* arena);
 
-    // Destroys this SerialArena, freeing all blocks with the given dealloc
-    // function, except any block equal to |initial_block|.
+    // Destroys this SerialArena, returning all blocks to |arena|, except any
+    // block equal to |initial_block|.  If |retained| is non-NULL, blocks may be
+    // kept in that list instead (see ArenaImpl::RetainBlock()).
     static uint64 Free(SerialArena* serial, Block* initial_block,
-                       void (*block_dealloc)(void*, size_t));
+                       ArenaImpl* arena, Block** retained);
 
     void CleanupList();
     uint64 SpaceUsed() const;
@@ -225,6 +235,7 @@ class PROTOBUF_EXPORT ArenaImpl {
     size_t pos() const { return pos_; }
     size_t size() const { return size_; }
     void set_pos(size_t pos) { pos_ = pos; }
+    void set_next(Block* next) { next_ = next; }
 
    private:
     Block* next_;   // Next block for this thread.
@@ -261,11 +272,22 @@ class PROTOBUF_EXPORT ArenaImpl {
   static ThreadCache& thread_cache() { return thread_cache_; }
 #endif
 
-  void Init();
+  // Starts a new lifecycle. |retained| is a list of blocks kept from the
+  // previous lifecycle, largest first, for the calling thread to allocate from.
+  void Init(Block* retained);
 
   // Free all blocks and return the total space used which is the sums of sizes
-  // of the all the allocated blocks.
-  uint64 FreeBlocks();
+  // of the all the allocated blocks.  If |retained| is non-NULL, the largest
+  // blocks are kept there instead, as allowed by options_.reset_retain_bytes.
+  uint64 FreeBlocks(Block** retained);
+  // Adds |b| to |retained| if non-NULL, else frees it.
+  void ReleaseBlock(Block* b, Block** retained);
+  // Adds |b| to |retained|, keeping the list sorted largest first, then frees
+  // the smallest blocks until the list fits in options_.reset_retain_bytes.
+  void RetainBlock(Block* b, Block** retained);
+  // Removes and returns the first spare block if |serial| may allocate from
+  // the spare blocks and it has room for |n| bytes, else returns NULL.
+  Block* TakeSpareBlock(SerialArena* serial, size_t n);
   // Delete or Destruct all objects owned by the arena.
   void CleanupList();
 
@@ -288,8 +310,21 @@ class PROTOBUF_EXPORT ArenaImpl {
   Block *initial_block_;     // If non-NULL, points to the block that came from
                              // user data.
 
+  // Blocks kept by Reset() that are not in use yet, largest first.  Only
+  // |spare_owner_|, the SerialArena created by Init(), allocates from them.
+  Block* spare_blocks_;
+  SerialArena* spare_owner_;
+
   Block* NewBlock(Block* last_block, size_t min_bytes);
 
+  // Obtains memory for a block of at least |*size| bytes, from the per-thread
+  // block cache if enabled, else from block_alloc.  May round |*size| up.
+  void* AllocateBlockMemory(size_t* size);
+  // Releases a block's memory to the per-thread block cache if enabled and
+  // there is room, else to block_dealloc.
+  void DeallocateBlockMemory(void* mem, size_t size);
+  bool use_block_cache_;  // True if options_ allow the per-thread block cache.
+
   SerialArena* GetSerialArena();
   bool GetSerialArenaFast(SerialArena** arena);
   SerialArena* GetSerialArenaFallback(void* me);
@@ -34,6 +34,7 @@
 #include <cstring>
 #include <memory>
 #include <string>
+#include <thread>  // NOLINT
 #include <type_traits>
 #include <typeinfo>
 #include <vector>
@@ -1318,6 +1319,129 @@ TEST(ArenaTest, BlockSizeSmallerThanAllocation) {
   }
 }
 
+// The block cache is per-thread, so each test runs on a fresh thread to start
+// from an empty cache.
+template <typename F>
+void RunWithEmptyBlockCache(F f) {
+  std::thread(f).join();
+}
+
+TEST(ArenaTest, BlockCacheRecyclesBlocks) {
+  RunWithEmptyBlockCache([] {
+    ArenaBlockCacheStats stats;
+    ArenaOptions options;
+    options.block_cache_max_bytes = 1 << 20;
+    options.block_cache_stats = &stats;
+    {
+      Arena arena(options);
+      Arena::CreateArray<char>(&arena, 100);
+      Arena::CreateArray<char>(&arena, 1000);
+    }
+    EXPECT_EQ(0, stats.hits.load());
+    EXPECT_EQ(2, stats.misses.load());
+    EXPECT_EQ(2, stats.recycled.load());
+    EXPECT_EQ(0, stats.released.load());
+
+    for (int i = 0; i < 10; i++) {
+      Arena arena(options);
+      Arena::CreateArray<char>(&arena, 100);
+      Arena::CreateArray<char>(&arena, 1000);
+      // Block sizes are rounded up to a power of two.
+      EXPECT_EQ(256 + 1024, arena.SpaceAllocated());
+    }
+    EXPECT_EQ(20, stats.hits.load());
+    EXPECT_EQ(2, stats.misses.load());
+    EXPECT_EQ(0, stats.released.load());
+  });
+}
+
+TEST(ArenaTest, BlockCacheIsBounded) {
+  RunWithEmptyBlockCache([] {
+    ArenaBlockCacheStats stats;
+    ArenaOptions options;
+    options.start_block_size = 1024;
+    options.block_cache_max_bytes = 1024;
+    options.block_cache_stats = &stats;
+    {
+      Arena arena(options);
+      Arena::CreateArray<char>(&arena, 100);
+      Arena::CreateArray<char>(&arena, 1000);
+    }
+    EXPECT_EQ(1, stats.recycled.load());
+    EXPECT_EQ(1, stats.released.load());
+  });
+}
+
+TEST(ArenaTest, BlockCacheIgnoredWithCustomAllocator) {
+  RunWithEmptyBlockCache([] {
+    ArenaBlockCacheStats stats;
+    ArenaOptions options;
+    options.block_alloc = &::malloc;
+    options.block_dealloc = [](void* p, size_t) { ::free(p); };
+    options.block_cache_max_bytes = 1 << 20;
+    options.block_cache_stats = &stats;
+    {
+      Arena arena(options);
+      Arena::CreateArray<char>(&arena, 100);
+    }
+    EXPECT_EQ(0, stats.hits + stats.misses + stats.recycled + stats.released);
+  });
+}
+
+int retain_test_block_allocs = 0;
+
+void* CountingBlockAlloc(size_t size) {
+  ++retain_test_block_allocs;
+  return ::operator new(size);
+}
+
+TEST(ArenaTest, ResetRetainsBlocks) {
+  ArenaOptions options;
+  options.block_alloc = &CountingBlockAlloc;
+  options.reset_retain_bytes = 1 << 20;
+  Arena arena(options);
+  retain_test_block_allocs = 0;
+  for (int i = 0; i < 10; i++) {
+    Arena::CreateArray<char>(&arena, 1000);
+  }
+  int block_allocs = retain_test_block_allocs;
+  uint64 space_allocated = arena.SpaceAllocated();
+  EXPECT_LT(0, block_allocs);
+  EXPECT_EQ(space_allocated, arena.Reset());
+
+  for (int iteration = 0; iteration < 5; iteration++) {
+    // All blocks are kept, so no further allocations are needed.
+    EXPECT_EQ(space_allocated, arena.SpaceAllocated());
+    EXPECT_EQ(0, arena.SpaceUsed());
+    for (int i = 0; i < 10; i++) {
+      Arena::CreateArray<char>(&arena, 1000);
+    }
+    EXPECT_EQ(10 * Align8(1000), arena.SpaceUsed());
+    EXPECT_EQ(space_allocated, arena.Reset());
+  }
+  EXPECT_EQ(block_allocs, retain_test_block_allocs);
+}
+
+TEST(ArenaTest, ResetRetainsLargestBlocksUpToLimit) {
+  ArenaOptions options;
+  options.start_block_size = 1024;
+  options.max_block_size = 4096;
+  options.reset_retain_bytes = 8192;
+  Arena arena(options);
+  for (int i = 0; i < 20; i++) {
+    Arena::CreateArray<char>(&arena, 1000);
+  }
+  EXPECT_LT(8192, arena.SpaceAllocated());
+  arena.Reset();
+  // Two of the 4096 byte blocks are kept.
+  EXPECT_EQ(8192, arena.SpaceAllocated());
+  EXPECT_EQ(0, arena.SpaceUsed());
+
+  Arena::CreateArray<char>(&arena, 3000);
+  Arena::CreateArray<char>(&arena, 3000);
+  EXPECT_EQ(8192, arena.SpaceAllocated());
+}
+
 TEST(ArenaTest, GetArenaShouldReturnTheArenaForArenaAllocatedMessages) {
   Arena arena;
   ArenaMessage* message = Arena::CreateMessage<ArenaMessage>(&arena);
@@ -437,19 +437,16 @@ void RepeatedEnumFieldGenerator::GenerateSerializeWithCachedSizes(
         "    output);\n"
         "  output->WriteVarint32(_$name$_cached_byte_size_.load(\n"
         "      std::memory_order_relaxed));\n"
+        "  ::$proto_ns$::internal::WireFormatLite::WriteEnumArray(\n"
+        "    this->$name$().data(), this->$name$_size(), output);\n"
         "}\n");
-  }
-  format("for (int i = 0, n = this->$name$_size(); i < n; i++) {\n");
-  if (descriptor_->is_packed()) {
-    format(
-        "  ::$proto_ns$::internal::WireFormatLite::WriteEnumNoTag(\n"
-        "    this->$name$(i), output);\n");
   } else {
     format(
+        "for (int i = 0, n = this->$name$_size(); i < n; i++) {\n"
         "  ::$proto_ns$::internal::WireFormatLite::WriteEnum(\n"
-        "    $number$, this->$name$(i), output);\n");
+        "    $number$, this->$name$(i), output);\n"
+        "}\n");
   }
-  format("}\n");
 }
 
 void RepeatedEnumFieldGenerator::GenerateSerializeWithCachedSizesToArray(
@@ -111,7 +111,13 @@ bool CppGenerator::Generate(const FileDescriptor* file,
         file_options.num_cc_files = strto32(options[i].second.c_str(),
                                             NULL, 10);
       }
-    } else if (options[i].first == "table_driven_parsing") {
+    } else if (options[i].first == "table_driven" ||
+               options[i].first == "table_driven_parsing") {
+      // Messages share the generic table-driven parse loop instead of each
+      // getting its own switch-based MergePartialFromCodedStream, which
+      // trades a little speed for much smaller code.  Unlike
+      // table_driven_serialization, this works per file, so it can be used
+      // regardless of how the imported files were generated.
       file_options.table_driven_parsing = true;
     } else if (options[i].first == "table_driven_serialization") {
       file_options.table_driven_serialization = true;
@@ -187,7 +187,8 @@ GenerateMergeFromCodedStream(io::Printer* printer) const {
       "    ::$proto_ns$::internal::WireFormatLite::$val_wire_type$,\n"
       "    $default_enum_value$ >,\n"
       "  ::$proto_ns$::Map< $key_cpp$, $val_cpp$ > >"
-      " parser(&$name$_);\n");
+      " parser(&$name$_);\n"
+      "parser.ReserveForEntries(input, $tag$u);\n");
   if (IsProto3Field(descriptor_) ||
       value_field->type() != FieldDescriptor::TYPE_ENUM) {
     format(
@@ -290,13 +290,9 @@ bool TableDrivenParsingEnabled(const Descriptor* descriptor,
     return false;
   }
 
-  // Consider table-driven parsing.  We only do this if:
-  // - We have has_bits for fields.  This avoids a check on every field we set
-  //   when are present (the common case).
-  if (!HasFieldPresence(descriptor->file())) {
-    return false;
-  }
-
+  // Consider table-driven parsing.  Messages without field presence are
+  // fine: the parser sets has_bits in a scratch word for them.  We only do
+  // this if:
   const double table_sparseness = 0.5;
   int max_field_number = 0;
   for (auto field : FieldRange(descriptor)) {
@@ -313,6 +309,17 @@ bool TableDrivenParsingEnabled(const Descriptor* descriptor,
     if (IsLazy(field, options)) {
       return false;
     }
+
+    // - No map field must fail the parse on invalid UTF-8: ParseMap() doesn't
+    //   check the strings of the entries.
+    if (field->is_map()) {
+      for (auto entry_field : FieldRange(field->message_type())) {
+        if (entry_field->type() == FieldDescriptor::TYPE_STRING &&
+            GetUtf8CheckMode(entry_field, options) == STRICT) {
+          return false;
+        }
+      }
+    }
   }
 
   // - There range of field numbers is "small"
@@ -2111,6 +2118,11 @@ size_t MessageGenerator::GenerateParseOffsets(io::Printer* printer) {
     }
 
     processing_type = static_cast<unsigned>(field->type());
+    if (field->type() == FieldDescriptor::TYPE_ENUM &&
+        HasPreservingUnknownEnumSemantics(field->file())) {
+      // Open enums accept every value, which is exactly how int32 is parsed.
+      processing_type = static_cast<unsigned>(FieldDescriptor::TYPE_INT32);
+    }
     const FieldGenerator& generator = field_generators_.get(field);
     if (field->type() == FieldDescriptor::TYPE_STRING) {
       switch (EffectiveStringCType(field, options_)) {
@@ -2119,6 +2131,10 @@ size_t MessageGenerator::GenerateParseOffsets(io::Printer* printer) {
             processing_type = internal::TYPE_STRING_INLINED;
             break;
           }
+          // Inlined strings need field presence, so they are never strict.
+          if (GetUtf8CheckMode(field, options_) == STRICT) {
+            processing_type = internal::TYPE_STRING_STRICT;
+          }
           break;
         case FieldOptions::CORD:
           processing_type = internal::TYPE_STRING_CORD;
@@ -2163,7 +2179,10 @@ size_t MessageGenerator::GenerateParseOffsets(io::Printer* printer) {
           SimpleItoa(field->containing_oneof()->index());
     } else {
       vars["name"] = FieldName(field);
-      vars["presence"] = SimpleItoa(has_bit_indices_[field->index()]);
+      // Without field presence there are no has_bits; the parser sets bit 0
+      // of a scratch word instead.
+      vars["presence"] = SimpleItoa(
+          has_bit_indices_.empty() ? 0 : has_bit_indices_[field->index()]);
     }
     vars["nwtype"] = SimpleItoa(normal_wiretype);
     vars["pwtype"] = SimpleItoa(packed_wiretype);
@@ -393,7 +393,6 @@ GenerateMergeFromCodedStreamWithPacking(io::Printer* printer) const {
 void RepeatedPrimitiveFieldGenerator::
 GenerateSerializeWithCachedSizes(io::Printer* printer) const {
   Formatter format(printer, variables_);
-  bool array_written = false;
   if (descriptor_->is_packed()) {
     // Write the tag and the size.
     format(
@@ -405,31 +404,20 @@ GenerateSerializeWithCachedSizes(io::Printer* printer) const {
         "  output->WriteVarint32(_$name$_cached_byte_size_.load(\n"
         "      std::memory_order_relaxed));\n");
 
-    if (FixedSize(descriptor_->type()) > 0) {
-      // TODO(ckennelly): Use RepeatedField<T>::unsafe_data() via
-      // WireFormatLite to access the contents of this->$name$_ to save a branch
-      // here.
-      format(
-          "  "
-          "::$proto_ns$::internal::WireFormatLite::Write$declared_type$Array(\n"
-          "    this->$name$().data(), this->$name$_size(), output);\n");
-      array_written = true;  // Wrote array all at once
-    }
-    format("}\n");
-  }
-  if (!array_written) {
-    format("for (int i = 0, n = this->$name$_size(); i < n; i++) {\n");
-    if (descriptor_->is_packed()) {
-      format(
-          "  "
-          "::$proto_ns$::internal::WireFormatLite::Write$declared_type$NoTag(\n"
-          "    this->$name$(i), output);\n");
-    } else {
-      format(
-          "  ::$proto_ns$::internal::WireFormatLite::Write$declared_type$(\n"
-          "    $number$, this->$name$(i), output);\n");
-    }
-    format("}\n");
+    // TODO(ckennelly): Use RepeatedField<T>::unsafe_data() via
+    // WireFormatLite to access the contents of this->$name$_ to save a branch
+    // here.
+    format(
+        "  "
+        "::$proto_ns$::internal::WireFormatLite::Write$declared_type$Array(\n"
+        "    this->$name$().data(), this->$name$_size(), output);\n"
+        "}\n");
+  } else {
+    format(
+        "for (int i = 0, n = this->$name$_size(); i < n; i++) {\n"
+        "  ::$proto_ns$::internal::WireFormatLite::Write$declared_type$(\n"
+        "    $number$, this->$name$(i), output);\n"
+        "}\n");
   }
 }
 
@@ -579,6 +579,10 @@ class DescriptorPool::Tables {
   // set of extensions numbers from fallback_database_.
   HASH_SET<const Descriptor*> extensions_loaded_from_db_;
 
+  // Callbacks to run when the pool is destroyed.  Guarded by
+  // DestructionCallbacksMutex(), since they are added through a const pool.
+  std::vector<std::function<void()> > destruction_callbacks_;
+
   // -----------------------------------------------------------------
   // Finding items.
 
@@ -928,6 +932,15 @@ inline Symbol FileDescriptorTables::FindNestedSymbolOfType(
 
 Symbol DescriptorPool::Tables::FindByNameHelper(
     const DescriptorPool* pool, const string& name) {
+  // A faster path to reduce lock contention in finding symbols that are
+  // already in this pool, which is the common case.
+  if (pool->mutex_ != NULL) {
+    ReaderMutexLock lock(pool->mutex_);
+    Symbol result = FindSymbol(name);
+    if (!result.IsNull()) {
+      return result;
+    }
+  }
   MutexLockMaybe lock(pool->mutex_);
   if (pool->fallback_database_ != NULL) {
     known_bad_symbols_.clear();
@@ -1287,10 +1300,33 @@ DescriptorPool::DescriptorPool(const DescriptorPool* underlay)
     enforce_weak_(false),
     disallow_enforce_utf8_(false) {}
 
+namespace {
+internal::WrappedMutex* DestructionCallbacksMutex() {
+  static internal::WrappedMutex mutex;
+  return &mutex;
+}
+}  // namespace
+
 DescriptorPool::~DescriptorPool() {
+  // Nothing else can be using the pool anymore, so the callbacks run without
+  // holding the mutex, which they may need themselves.
+  std::vector<std::function<void()> > destruction_callbacks;
+  {
+    MutexLock lock(DestructionCallbacksMutex());
+    destruction_callbacks.swap(tables_->destruction_callbacks_);
+  }
+  for (int i = 0; i < destruction_callbacks.size(); i++) {
+    destruction_callbacks[i]();
+  }
   if (mutex_ != NULL) delete mutex_;
 }
 
+void DescriptorPool::InternalAddDestructionCallback(
+    std::function<void()> callback) const {
+  MutexLock lock(DestructionCallbacksMutex());
+  tables_->destruction_callbacks_.push_back(std::move(callback));
+}
+
 // DescriptorPool::BuildFile() defined later.
 // DescriptorPool::BuildFileCollectingErrors() defined later.
 
@@ -54,6 +54,7 @@
 #ifndef GOOGLE_PROTOBUF_DESCRIPTOR_H__
 #define GOOGLE_PROTOBUF_DESCRIPTOR_H__
 
+#include <functional>
 #include <memory>
 #include <set>
 #include <string>
@@ -1742,6 +1743,11 @@ class PROTOBUF_EXPORT DescriptorPool {
   // lazy descriptor initialization behavior.
   bool InternalIsFileLoaded(const std::string& filename) const;
 
+  // For internal use only:  Runs 'callback' when this pool is destroyed,
+  // before any of its descriptors are.  Lets caches keyed by pool drop their
+  // entries.  Thread-safe.
+  void InternalAddDestructionCallback(std::function<void()> callback) const;
+
 
   // Add a file to unused_import_track_files_. DescriptorBuilder will log
   // warnings for those files if there is any unused import.
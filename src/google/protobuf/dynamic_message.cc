@@ -67,6 +67,7 @@
 #include <unordered_map>
 
 #include <google/protobuf/stubs/hash.h>
+#include <google/protobuf/stubs/map_util.h>
 
 #include <google/protobuf/descriptor.pb.h>
 #include <google/protobuf/descriptor.h>
@@ -633,7 +634,17 @@ DynamicMessageFactory::~DynamicMessageFactory() {
 }
 
 const Message* DynamicMessageFactory::GetPrototype(const Descriptor* type) {
-  MutexLock lock(&prototypes_mutex_);
+  // Fast path for prototypes that were already built: these only need the
+  // reader lock, so concurrent callers do not serialize.
+  {
+    ReaderMutexLock lock(&prototypes_mutex_);
+    const DynamicMessage::TypeInfo* type_info =
+        FindPtrOrNull(prototypes_->map_, type);
+    if (type_info != NULL) {
+      return type_info->prototype;
+    }
+  }
+  WriterMutexLock lock(&prototypes_mutex_);
   return GetPrototypeNoLock(type);
 }
 
@@ -75,9 +75,11 @@ enum ProcessingTypes {
   TYPE_STRING_INLINED = 23,
   TYPE_BYTES_INLINED = 24,
   TYPE_MAP = 25,
+  // A string field whose invalid UTF-8 fails the parse (proto3).
+  TYPE_STRING_STRICT = 26,
 };
 
-static_assert(TYPE_MAP < kRepeatedMask, "Invalid enum");
+static_assert(TYPE_STRING_STRICT < kRepeatedMask, "Invalid enum");
 
 // TODO(ckennelly):  Add a static assertion to ensure that these masks do not
 // conflict with wiretypes.
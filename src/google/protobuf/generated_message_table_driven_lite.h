@@ -72,6 +72,15 @@ enum Cardinality {
   Cardinality_ONEOF = 3
 };
 
+// How the UTF-8 of a string field is checked, as in the switch-based parsers.
+enum Utf8Validation {
+  Utf8Validation_NONE = 0,
+  // Invalid UTF-8 is logged if GOOGLE_PROTOBUF_UTF8_VALIDATION_ENABLED.
+  Utf8Validation_VERIFY = 1,
+  // Invalid UTF-8 fails the parse (proto3).
+  Utf8Validation_STRICT = 2
+};
+
 template <typename Type>
 inline Type* Raw(MessageLite* msg, int64 offset) {
   return reinterpret_cast<Type*>(reinterpret_cast<uint8*>(msg) + offset);
@@ -160,6 +169,7 @@ inline void SetOneofField(MessageLite* msg, uint32* oneof_case,
 inline void ClearOneofField(const ParseTableField& field, Arena* arena,
                      MessageLite* msg) {
   switch (field.processing_type & kTypeMask) {
+    case WireFormatLite::TYPE_GROUP:
     case WireFormatLite::TYPE_MESSAGE:
       if (arena == NULL) {
         delete *Raw<MessageLite*>(msg, field.offset);
@@ -168,6 +178,7 @@ inline void ClearOneofField(const ParseTableField& field, Arena* arena,
 
     case WireFormatLite::TYPE_STRING:
     case WireFormatLite::TYPE_BYTES:
+    case TYPE_STRING_STRICT:
       Raw<ArenaStringPtr>(msg, field.offset)
           ->Destroy(&GetEmptyStringAlreadyInited(), arena);
       break;
@@ -222,16 +233,14 @@ inline void ResetOneofField(const ParseTable& table, int field_number,
   }
 }
 
-template <Cardinality cardinality, bool validate, StringType ctype>
+template <Cardinality cardinality, Utf8Validation validate, StringType ctype>
 static inline bool HandleString(io::CodedInputStream* input, MessageLite* msg,
                                 Arena* arena, uint32* has_bits,
                                 uint32 has_bit_index, int64 offset,
                                 const void* default_ptr,
                                 const char* field_name) {
-#ifdef GOOGLE_PROTOBUF_UTF8_VALIDATION_ENABLED
   const char* sdata;
   size_t size;
-#endif
 
   switch (ctype) {
     case StringType_INLINED: {
@@ -256,10 +265,8 @@ static inline bool HandleString(io::CodedInputStream* input, MessageLite* msg,
         return false;
       }
 
-#ifdef GOOGLE_PROTOBUF_UTF8_VALIDATION_ENABLED
       sdata = value->data();
       size = value->size();
-#endif
       break;
     }
     case StringType_STRING: {
@@ -285,20 +292,28 @@ static inline bool HandleString(io::CodedInputStream* input, MessageLite* msg,
         return false;
       }
 
-#ifdef GOOGLE_PROTOBUF_UTF8_VALIDATION_ENABLED
       sdata = value->data();
       size = value->size();
-#endif
       break;
     }
   }
 
+  switch (validate) {
+    case Utf8Validation_STRICT:
+      if (PROTOBUF_PREDICT_FALSE(!WireFormatLite::VerifyUtf8String(
+              sdata, size, WireFormatLite::PARSE, field_name))) {
+        return false;
+      }
+      break;
+    case Utf8Validation_VERIFY:
 #ifdef GOOGLE_PROTOBUF_UTF8_VALIDATION_ENABLED
-  if (validate) {
-    WireFormatLite::VerifyUtf8String(sdata, size, WireFormatLite::PARSE,
-                                     field_name);
-  }
+      WireFormatLite::VerifyUtf8String(sdata, size, WireFormatLite::PARSE,
+                                       field_name);
 #endif
+      break;
+    case Utf8Validation_NONE:
+      break;
+  }
 
   return true;
 }
@@ -374,13 +389,15 @@ class MergePartialFromCodedStreamHelper {
 template <typename UnknownFieldHandler, typename InternalMetadata>
 bool MergePartialFromCodedStreamImpl(MessageLite* msg, const ParseTable& table,
                                      io::CodedInputStream* input) {
-  // We require that has_bits are present, as to avoid having to check for them
-  // for every field.
+  // Messages without field presence have no has_bits.  Their fields all use
+  // presence index 0, so point has_bits at a scratch word rather than checking
+  // for them on every field.
   //
   // TODO(ckennelly):  Make this a compile-time parameter with templates.
-  GOOGLE_DCHECK_GE(table.has_bits_offset, 0);
-  uint32* has_bits = Raw<uint32>(msg, table.has_bits_offset);
-  GOOGLE_DCHECK(has_bits != NULL);
+  uint32 unused_has_bits = 0;
+  uint32* has_bits = table.has_bits_offset >= 0
+                         ? Raw<uint32>(msg, table.has_bits_offset)
+                         : &unused_has_bits;
 
   while (true) {
     uint32 tag = input->ReadTag();
@@ -482,8 +499,9 @@ bool MergePartialFromCodedStreamImpl(MessageLite* msg, const ParseTable& table,
               GetArena<InternalMetadata>(msg, table.arena_offset);
           const void* default_ptr = table.aux[field_number].strings.default_ptr;
 
-          if (PROTOBUF_PREDICT_FALSE((
-                  !HandleString<Cardinality_SINGULAR, false, StringType_STRING>(
+          if (PROTOBUF_PREDICT_FALSE(
+                  (!HandleString<Cardinality_SINGULAR, Utf8Validation_NONE,
+                                 StringType_STRING>(
                       input, msg, arena, has_bits, presence_index, offset,
                       default_ptr, NULL)))) {
             return false;
@@ -499,10 +517,11 @@ bool MergePartialFromCodedStreamImpl(MessageLite* msg, const ParseTable& table,
               GetArena<InternalMetadata>(msg, table.arena_offset);
           const void* default_ptr = table.aux[field_number].strings.default_ptr;
 
-          if (PROTOBUF_PREDICT_FALSE((!HandleString<Cardinality_SINGULAR, false,
-                                                    StringType_INLINED>(
-                  input, msg, arena, has_bits, presence_index, offset,
-                  default_ptr, NULL)))) {
+          if (PROTOBUF_PREDICT_FALSE(
+                  (!HandleString<Cardinality_SINGULAR, Utf8Validation_NONE,
+                                 StringType_INLINED>(
+                      input, msg, arena, has_bits, presence_index, offset,
+                      default_ptr, NULL)))) {
             return false;
           }
           break;
@@ -522,7 +541,8 @@ bool MergePartialFromCodedStreamImpl(MessageLite* msg, const ParseTable& table,
               offset, default_ptr);
 
           if (PROTOBUF_PREDICT_FALSE(
-                  (!HandleString<Cardinality_ONEOF, false, StringType_STRING>(
+                  (!HandleString<Cardinality_ONEOF, Utf8Validation_NONE,
+                                 StringType_STRING>(
                       input, msg, arena, has_bits, presence_index, offset,
                       default_ptr, NULL)))) {
             return false;
@@ -541,8 +561,9 @@ bool MergePartialFromCodedStreamImpl(MessageLite* msg, const ParseTable& table,
           const void* default_ptr =
               table.aux[field_number].strings.default_ptr;
 
-          if (PROTOBUF_PREDICT_FALSE((
-                  !HandleString<Cardinality_REPEATED, false, StringType_STRING>(
+          if (PROTOBUF_PREDICT_FALSE(
+                  (!HandleString<Cardinality_REPEATED, Utf8Validation_NONE,
+                                 StringType_STRING>(
                       input, msg, arena, has_bits, presence_index, offset,
                       default_ptr, NULL)))) {
             return false;
@@ -557,7 +578,8 @@ bool MergePartialFromCodedStreamImpl(MessageLite* msg, const ParseTable& table,
           const char* field_name = table.aux[field_number].strings.field_name;
 
           if (PROTOBUF_PREDICT_FALSE(
-                  (!HandleString<Cardinality_SINGULAR, true, StringType_STRING>(
+                  (!HandleString<Cardinality_SINGULAR, Utf8Validation_VERIFY,
+                                 StringType_STRING>(
                       input, msg, arena, has_bits, presence_index, offset,
                       default_ptr, field_name)))) {
             return false;
@@ -572,7 +594,8 @@ bool MergePartialFromCodedStreamImpl(MessageLite* msg, const ParseTable& table,
           const char* field_name = table.aux[field_number].strings.field_name;
 
           if (PROTOBUF_PREDICT_FALSE(
-                  (!HandleString<Cardinality_REPEATED, true, StringType_STRING>(
+                  (!HandleString<Cardinality_REPEATED, Utf8Validation_VERIFY,
+                                 StringType_STRING>(
                       input, msg, arena, has_bits, presence_index, offset,
                       default_ptr, field_name)))) {
             return false;
@@ -591,7 +614,8 @@ bool MergePartialFromCodedStreamImpl(MessageLite* msg, const ParseTable& table,
               offset, default_ptr);
 
           if (PROTOBUF_PREDICT_FALSE(
-                  (!HandleString<Cardinality_ONEOF, true, StringType_STRING>(
+                  (!HandleString<Cardinality_ONEOF, Utf8Validation_VERIFY,
+                                 StringType_STRING>(
                       input, msg, arena, has_bits, presence_index, offset,
                       default_ptr, field_name)))) {
             return false;
@@ -599,6 +623,56 @@ bool MergePartialFromCodedStreamImpl(MessageLite* msg, const ParseTable& table,
           break;
         }
 #endif
+        case TYPE_STRING_STRICT: {
+          Arena* const arena =
+              GetArena<InternalMetadata>(msg, table.arena_offset);
+          const void* default_ptr = table.aux[field_number].strings.default_ptr;
+          const char* field_name = table.aux[field_number].strings.field_name;
+
+          if (PROTOBUF_PREDICT_FALSE(
+                  (!HandleString<Cardinality_SINGULAR, Utf8Validation_STRICT,
+                                 StringType_STRING>(
+                      input, msg, arena, has_bits, presence_index, offset,
+                      default_ptr, field_name)))) {
+            return false;
+          }
+          break;
+        }
+        case TYPE_STRING_STRICT | kRepeatedMask: {
+          Arena* const arena =
+              GetArena<InternalMetadata>(msg, table.arena_offset);
+          const void* default_ptr = table.aux[field_number].strings.default_ptr;
+          const char* field_name = table.aux[field_number].strings.field_name;
+
+          if (PROTOBUF_PREDICT_FALSE(
+                  (!HandleString<Cardinality_REPEATED, Utf8Validation_STRICT,
+                                 StringType_STRING>(
+                      input, msg, arena, has_bits, presence_index, offset,
+                      default_ptr, field_name)))) {
+            return false;
+          }
+          break;
+        }
+        case TYPE_STRING_STRICT | kOneofMask: {
+          Arena* const arena =
+              GetArena<InternalMetadata>(msg, table.arena_offset);
+          uint32* oneof_case = Raw<uint32>(msg, table.oneof_case_offset);
+          const void* default_ptr = table.aux[field_number].strings.default_ptr;
+          const char* field_name = table.aux[field_number].strings.field_name;
+
+          ResetOneofField<ProcessingType_STRING>(
+              table, field_number, arena, msg, oneof_case + presence_index,
+              offset, default_ptr);
+
+          if (PROTOBUF_PREDICT_FALSE(
+                  (!HandleString<Cardinality_ONEOF, Utf8Validation_STRICT,
+                                 StringType_STRING>(
+                      input, msg, arena, has_bits, presence_index, offset,
+                      default_ptr, field_name)))) {
+            return false;
+          }
+          break;
+        }
         case WireFormatLite::TYPE_ENUM: {
           if (PROTOBUF_PREDICT_FALSE(
                   (!HandleEnum<UnknownFieldHandler, InternalMetadata,
@@ -667,6 +741,23 @@ bool MergePartialFromCodedStreamImpl(MessageLite* msg, const ParseTable& table,
 
           break;
         }
+        case WireFormatLite::TYPE_GROUP | kOneofMask: {
+          Arena* const arena =
+              GetArena<InternalMetadata>(msg, table.arena_offset);
+          uint32* oneof_case = Raw<uint32>(msg, table.oneof_case_offset);
+          MessageLite** submsg_holder = Raw<MessageLite*>(msg, offset);
+          ResetOneofField<ProcessingType_MESSAGE>(
+              table, field_number, arena, msg, oneof_case + presence_index,
+              offset, NULL);
+          MessageLite* submsg = *submsg_holder;
+
+          if (PROTOBUF_PREDICT_FALSE(
+                  !WireFormatLite::ReadGroup(field_number, input, submsg))) {
+            return false;
+          }
+
+          break;
+        }
         case WireFormatLite::TYPE_MESSAGE: {
           MessageLite** submsg_holder =
               MutableField<MessageLite*>(msg, has_bits, presence_index, offset);
@@ -735,8 +826,9 @@ bool MergePartialFromCodedStreamImpl(MessageLite* msg, const ParseTable& table,
           const void* default_ptr = table.aux[field_number].strings.default_ptr;
           const char* field_name = table.aux[field_number].strings.field_name;
 
-          if (PROTOBUF_PREDICT_FALSE((
-                  !HandleString<Cardinality_SINGULAR, true, StringType_INLINED>(
+          if (PROTOBUF_PREDICT_FALSE(
+                  (!HandleString<Cardinality_SINGULAR, Utf8Validation_VERIFY,
+                                 StringType_INLINED>(
                       input, msg, arena, has_bits, presence_index, offset,
                       default_ptr, field_name)))) {
             return false;
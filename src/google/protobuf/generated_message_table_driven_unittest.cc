@@ -0,0 +1,351 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Tests for messages generated with --cpp_out=table_driven:, which are parsed
+// by the shared table-driven parser instead of generated code.
+
+#include <string>
+#include <vector>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/unittest_table_driven.pb.h>
+#include <google/protobuf/unittest_table_driven_proto3.pb.h>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <google/protobuf/testing/googletest.h>
+#include <gtest/gtest.h>
+
+namespace google {
+namespace protobuf {
+namespace {
+
+using internal::WireFormatLite;
+using protobuf_unittest::TestTableDrivenExtensions;
+using protobuf_unittest::TestTableDrivenMap;
+using protobuf_unittest::TestTableDrivenOneofGroup;
+using protobuf_unittest::TestTableDrivenProto3;
+
+// Merges the message encoded in data into message.
+bool MergeFromString(const string& data, MessageLite* message) {
+  io::CodedInputStream input(reinterpret_cast<const uint8*>(data.data()),
+                             data.size());
+  return message->MergeFromCodedStream(&input) &&
+         input.ConsumedEntireMessage();
+}
+
+// Returns fields 20 to 24, of every wire type, none of which is known to the
+// test messages.
+string UnknownFields() {
+  string data;
+  {
+    io::StringOutputStream output(&data);
+    io::CodedOutputStream coded_output(&output);
+    WireFormatLite::WriteUInt64(20, 300, &coded_output);
+    WireFormatLite::WriteFixed32(21, 301, &coded_output);
+    WireFormatLite::WriteFixed64(22, 302, &coded_output);
+    WireFormatLite::WriteString(23, "unknown", &coded_output);
+    WireFormatLite::WriteTag(24, WireFormatLite::WIRETYPE_START_GROUP,
+                             &coded_output);
+    WireFormatLite::WriteInt32(1, 303, &coded_output);
+    WireFormatLite::WriteTag(24, WireFormatLite::WIRETYPE_END_GROUP,
+                             &coded_output);
+  }
+  return data;
+}
+
+// Returns the encoding of a length-delimited field.
+string LengthDelimited(int number, const string& value) {
+  string data;
+  {
+    io::StringOutputStream output(&data);
+    io::CodedOutputStream coded_output(&output);
+    WireFormatLite::WriteBytes(number, value, &coded_output);
+  }
+  return data;
+}
+
+TEST(TableDrivenProto3Test, RoundTrip) {
+  TestTableDrivenProto3 message;
+  message.set_optional_int32(101);
+  message.set_optional_string("\xc3\xa9t\xc3\xa9");
+  message.set_optional_bytes("\xff\xfe");
+  message.set_optional_enum(TestTableDrivenProto3::TWO);
+  message.mutable_child()->set_optional_string("child");
+  message.add_repeated_string("a");
+  message.add_repeated_string("b");
+  message.add_repeated_enum(TestTableDrivenProto3::ONE);
+  message.add_repeated_enum(TestTableDrivenProto3::ZERO);
+  message.set_oneof_uint32(7);
+
+  const string data = message.SerializeAsString();
+  TestTableDrivenProto3 parsed;
+  ASSERT_TRUE(parsed.ParseFromString(data));
+  EXPECT_EQ(message.DebugString(), parsed.DebugString());
+  EXPECT_EQ(data, parsed.SerializeAsString());
+
+  // Fields set to their defaults are not on the wire, and parse back as
+  // defaults.
+  parsed.set_optional_int32(0);
+  parsed.clear_child();
+  ASSERT_TRUE(parsed.ParseFromString(parsed.SerializeAsString()));
+  EXPECT_EQ(0, parsed.optional_int32());
+  EXPECT_FALSE(parsed.has_child());
+}
+
+TEST(TableDrivenProto3Test, InvalidUtf8FailsTheParse) {
+  const string kInvalid = "\xff";
+  // optional_string, repeated_string and oneof_string.
+  const int kNumbers[] = {2, 6, 8};
+  for (int number : kNumbers) {
+    const FieldDescriptor* field =
+        TestTableDrivenProto3::descriptor()->FindFieldByNumber(number);
+    std::vector<string> errors;
+    {
+      ScopedMemoryLog log;
+      TestTableDrivenProto3 message;
+      EXPECT_FALSE(message.ParseFromString(LengthDelimited(number, kInvalid)))
+          << field->name();
+      errors = log.GetMessages(ERROR);
+    }
+    ASSERT_EQ(1, errors.size()) << field->name();
+    EXPECT_NE(string::npos, errors[0].find(field->full_name()));
+  }
+
+  // Bytes fields are not checked.
+  TestTableDrivenProto3 message;
+  EXPECT_TRUE(message.ParseFromString(LengthDelimited(3, kInvalid)));
+  EXPECT_EQ(kInvalid, message.optional_bytes());
+}
+
+TEST(TableDrivenProto3Test, OpenEnumsKeepUnknownValues) {
+  string data;
+  {
+    io::StringOutputStream output(&data);
+    io::CodedOutputStream coded_output(&output);
+    WireFormatLite::WriteEnum(4, 5, &coded_output);
+    // Packed, as proto3 serializes repeated enums.
+    WireFormatLite::WriteTag(7, WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+                             &coded_output);
+    coded_output.WriteVarint32(2);
+    coded_output.WriteVarint32(1);
+    coded_output.WriteVarint32(9);
+    // Not packed, which parsers must accept as well.
+    WireFormatLite::WriteEnum(7, 10, &coded_output);
+  }
+
+  TestTableDrivenProto3 message;
+  ASSERT_TRUE(message.ParseFromString(data));
+  EXPECT_EQ(5, message.optional_enum());
+  ASSERT_EQ(3, message.repeated_enum_size());
+  EXPECT_EQ(TestTableDrivenProto3::ONE, message.repeated_enum(0));
+  EXPECT_EQ(9, message.repeated_enum(1));
+  EXPECT_EQ(10, message.repeated_enum(2));
+
+  // The values are in the fields, not in the unknown fields.
+  EXPECT_EQ(0,
+            message.GetReflection()->GetUnknownFields(message).field_count());
+  TestTableDrivenProto3 reparsed;
+  ASSERT_TRUE(reparsed.ParseFromString(message.SerializeAsString()));
+  EXPECT_EQ(message.DebugString(), reparsed.DebugString());
+}
+
+TEST(TableDrivenOneofGroupTest, ParsesGroupInOneof) {
+  TestTableDrivenOneofGroup message;
+  message.mutable_foogroup()->set_a(1);
+  message.mutable_foogroup()->set_b("b");
+  message.set_bar(2);
+
+  TestTableDrivenOneofGroup parsed;
+  ASSERT_TRUE(parsed.ParseFromString(message.SerializeAsString()));
+  ASSERT_EQ(TestTableDrivenOneofGroup::kFoogroup, parsed.foo_case());
+  EXPECT_EQ(1, parsed.foogroup().a());
+  EXPECT_EQ("b", parsed.foogroup().b());
+  EXPECT_EQ(2, parsed.bar());
+
+  // A second group on the wire is merged into the first.
+  TestTableDrivenOneofGroup more;
+  more.mutable_foogroup()->set_a(3);
+  ASSERT_TRUE(MergeFromString(more.SerializeAsString(), &parsed));
+  ASSERT_EQ(TestTableDrivenOneofGroup::kFoogroup, parsed.foo_case());
+  EXPECT_EQ(3, parsed.foogroup().a());
+  EXPECT_EQ("b", parsed.foogroup().b());
+}
+
+// Switching the oneof away from the group must free the group; the heap
+// checkers catch it if it doesn't.
+void ExpectGroupReplaced(Arena* arena) {
+  TestTableDrivenOneofGroup* message =
+      Arena::CreateMessage<TestTableDrivenOneofGroup>(arena);
+  TestTableDrivenOneofGroup with_group;
+  with_group.mutable_foogroup()->set_b("a string that is not inlined");
+  TestTableDrivenOneofGroup with_int;
+  with_int.set_foo_int(4);
+  TestTableDrivenOneofGroup with_message;
+  with_message.mutable_foo_message()->mutable_foogroup()->set_a(5);
+
+  ASSERT_TRUE(message->ParseFromString(with_group.SerializeAsString()));
+  ASSERT_TRUE(MergeFromString(with_int.SerializeAsString(), message));
+  EXPECT_EQ(TestTableDrivenOneofGroup::kFooInt, message->foo_case());
+  EXPECT_EQ(4, message->foo_int());
+
+  ASSERT_TRUE(MergeFromString(with_group.SerializeAsString(), message));
+  ASSERT_TRUE(MergeFromString(with_message.SerializeAsString(), message));
+  EXPECT_EQ(TestTableDrivenOneofGroup::kFooMessage, message->foo_case());
+  EXPECT_EQ(5, message->foo_message().foogroup().a());
+
+  ASSERT_TRUE(MergeFromString(with_group.SerializeAsString(), message));
+  EXPECT_EQ(TestTableDrivenOneofGroup::kFoogroup, message->foo_case());
+  EXPECT_EQ(with_group.foogroup().b(), message->foogroup().b());
+  if (arena == NULL) delete message;
+}
+
+TEST(TableDrivenOneofGroupTest, SwitchingAwayFromGroup) {
+  ExpectGroupReplaced(NULL);
+  Arena arena;
+  ExpectGroupReplaced(&arena);
+}
+
+TEST(TableDrivenProto3Test, KeepsUnknownFields) {
+  TestTableDrivenProto3 message;
+  message.set_optional_int32(1);
+  message.add_repeated_string("a");
+  // Unknown fields are serialized after the known ones.
+  const string data = message.SerializeAsString() + UnknownFields();
+
+  TestTableDrivenProto3 parsed;
+  ASSERT_TRUE(parsed.ParseFromString(data));
+  EXPECT_EQ(1, parsed.optional_int32());
+  EXPECT_EQ(data, parsed.SerializeAsString());
+}
+
+TEST(TableDrivenOneofGroupTest, KeepsUnknownFields) {
+  TestTableDrivenOneofGroup message;
+  message.mutable_foogroup()->set_a(1);
+  message.set_bar(2);
+  const string data = message.SerializeAsString() + UnknownFields();
+
+  TestTableDrivenOneofGroup parsed;
+  ASSERT_TRUE(parsed.ParseFromString(data));
+  EXPECT_EQ(1, parsed.foogroup().a());
+  EXPECT_EQ(2, parsed.bar());
+  EXPECT_EQ(data, parsed.SerializeAsString());
+}
+
+TEST(TableDrivenMapTest, RoundTrip) {
+  TestTableDrivenMap message;
+  for (int i = 0; i < 100; ++i) {
+    (*message.mutable_int32_to_int32())[i] = -i;
+    (*message.mutable_string_to_string())["key" + SimpleItoa(i)] =
+        "value" + SimpleItoa(i);
+  }
+  (*message.mutable_int32_to_message())[1].set_foo_int(2);
+  (*message.mutable_int32_to_message())[3].mutable_foogroup()->set_b("b");
+  message.set_after(4);
+
+  TestTableDrivenMap parsed;
+  ASSERT_TRUE(parsed.ParseFromString(message.SerializeAsString()));
+  ASSERT_EQ(100, parsed.int32_to_int32().size());
+  ASSERT_EQ(100, parsed.string_to_string().size());
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(-i, parsed.int32_to_int32().at(i));
+    EXPECT_EQ("value" + SimpleItoa(i),
+              parsed.string_to_string().at("key" + SimpleItoa(i)));
+  }
+  ASSERT_EQ(2, parsed.int32_to_message().size());
+  EXPECT_EQ(2, parsed.int32_to_message().at(1).foo_int());
+  EXPECT_EQ("b", parsed.int32_to_message().at(3).foogroup().b());
+  EXPECT_EQ(4, parsed.after());
+}
+
+TEST(TableDrivenMapTest, EntriesWithMissingOrRepeatedFields) {
+  string data;
+  {
+    io::StringOutputStream output(&data);
+    io::CodedOutputStream coded_output(&output);
+    // An empty entry: key 0, value 0.
+    WireFormatLite::WriteTag(1, WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+                             &coded_output);
+    coded_output.WriteVarint32(0);
+  }
+  // A key that appears twice: the last value wins.
+  TestTableDrivenMap first;
+  (*first.mutable_int32_to_int32())[5] = 1;
+  TestTableDrivenMap second;
+  (*second.mutable_int32_to_int32())[5] = 2;
+  data += first.SerializeAsString() + second.SerializeAsString();
+  // An entry with an unknown field, which is dropped.
+  data += LengthDelimited(2, LengthDelimited(1, "k") + UnknownFields() +
+                                 LengthDelimited(2, "v"));
+
+  TestTableDrivenMap parsed;
+  ASSERT_TRUE(parsed.ParseFromString(data));
+  ASSERT_EQ(2, parsed.int32_to_int32().size());
+  EXPECT_EQ(0, parsed.int32_to_int32().at(0));
+  EXPECT_EQ(2, parsed.int32_to_int32().at(5));
+  ASSERT_EQ(1, parsed.string_to_string().size());
+  EXPECT_EQ("v", parsed.string_to_string().at("k"));
+}
+
+TEST(TableDrivenExtensionsTest, RoundTrip) {
+  TestTableDrivenExtensions message;
+  message.set_a(1);
+  message.set_b("b");
+  message.SetExtension(protobuf_unittest::table_driven_int32_extension, 2);
+  message.AddExtension(protobuf_unittest::table_driven_string_extension, "c");
+  message.AddExtension(protobuf_unittest::table_driven_string_extension, "d");
+  message.MutableExtension(protobuf_unittest::table_driven_message_extension)
+      ->mutable_foogroup()
+      ->set_a(3);
+  const string data = message.SerializeAsString() + UnknownFields();
+
+  TestTableDrivenExtensions parsed;
+  ASSERT_TRUE(parsed.ParseFromString(data));
+  EXPECT_EQ(1, parsed.a());
+  EXPECT_EQ("b", parsed.b());
+  EXPECT_EQ(2, parsed.GetExtension(
+                   protobuf_unittest::table_driven_int32_extension));
+  ASSERT_EQ(2, parsed.ExtensionSize(
+                   protobuf_unittest::table_driven_string_extension));
+  EXPECT_EQ("d", parsed.GetExtension(
+                     protobuf_unittest::table_driven_string_extension, 1));
+  EXPECT_EQ(3, parsed
+                   .GetExtension(
+                       protobuf_unittest::table_driven_message_extension)
+                   .foogroup()
+                   .a());
+  EXPECT_EQ(data, parsed.SerializeAsString());
+}
+
+}  // namespace
+}  // namespace protobuf
+}  // namespace google
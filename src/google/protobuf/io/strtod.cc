@@ -37,6 +37,7 @@
 
 #include <google/protobuf/stubs/logging.h>
 #include <google/protobuf/stubs/common.h>
+#include <google/protobuf/stubs/float_conversion.h>
 
 namespace google {
 namespace protobuf {
@@ -82,8 +83,18 @@ double NoLocaleStrtod(const char* text, char** original_endptr) {
   // pretty good hint that we're actually in some other locale in which
   // '.' is not the radix character.
 
+  // Plain decimal numbers, which is almost all of them, are parsed without
+  // strtod() and hence without the locale.
+  double result;
+  const char* end = internal::ParseDecimalDouble(text, &result);
+  if (end != NULL) {
+    // const_cast is necessary to match the strtod() interface.
+    if (original_endptr != NULL) *original_endptr = const_cast<char*>(end);
+    return result;
+  }
+
   char* temp_endptr;
-  double result = strtod(text, &temp_endptr);
+  result = strtod(text, &temp_endptr);
   if (original_endptr != NULL) *original_endptr = temp_endptr;
   if (*temp_endptr != '.') return result;
 
@@ -38,9 +38,14 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #endif
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#include <limits.h>
 #include <errno.h>
 #include <iostream>
 #include <algorithm>
+#include <limits>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/stubs/common.h>
 #include <google/protobuf/stubs/logging.h>
@@ -175,6 +180,133 @@ int FileInputStream::CopyingFileInputStream::Skip(int count) {
 
 // ===================================================================
 
+MmapInputStream::MmapInputStream(int file_descriptor, int64 offset,
+                                 int64 length, int block_size)
+  : mapping_(NULL),
+    mapping_size_(0),
+    data_(NULL),
+    size_(0),
+    block_size_(block_size > 0 ? block_size : INT_MAX),
+    position_(0),
+    last_returned_size_(0),
+    errno_(0) {
+#ifdef _WIN32
+  errno_ = ENOSYS;
+#else
+  if (offset < 0) {
+    errno_ = EINVAL;
+    return;
+  }
+  // Never map past the end of the file: touching those pages would raise
+  // SIGBUS instead of ending the stream.
+  struct stat info;
+  if (fstat(file_descriptor, &info) != 0) {
+    errno_ = errno;
+    return;
+  }
+  const int64 available = std::max<int64>(0, info.st_size - offset);
+  if (length < 0 || length > available) length = available;
+  if (length == 0) return;  // mmap() rejects empty mappings.
+  if (static_cast<uint64>(length) > std::numeric_limits<size_t>::max()) {
+    errno_ = EFBIG;
+    return;
+  }
+
+  // The mapping itself has to start at a page boundary.
+  const int64 page_size = sysconf(_SC_PAGESIZE);
+  const int64 map_offset = offset - offset % page_size;
+  const size_t lead = static_cast<size_t>(offset - map_offset);
+  void* mapping = mmap(NULL, lead + static_cast<size_t>(length), PROT_READ,
+                       MAP_SHARED, file_descriptor, map_offset);
+  if (mapping == MAP_FAILED) {
+    errno_ = errno;
+    return;
+  }
+  mapping_ = mapping;
+  mapping_size_ = lead + static_cast<size_t>(length);
+  data_ = static_cast<const uint8*>(mapping) + lead;
+  size_ = length;
+#endif
+}
+
+MmapInputStream::~MmapInputStream() {
+#ifndef _WIN32
+  if (mapping_ != NULL && munmap(mapping_, mapping_size_) != 0) {
+    GOOGLE_LOG(ERROR) << "munmap() failed: " << strerror(errno);
+  }
+#endif
+}
+
+bool MmapInputStream::Advise(Advice advice) {
+#ifdef _WIN32
+  errno_ = ENOSYS;
+  return false;
+#else
+  if (mapping_ == NULL) return true;
+  int hint;
+  switch (advice) {
+    case ADVICE_SEQUENTIAL:
+      hint = POSIX_MADV_SEQUENTIAL;
+      break;
+    case ADVICE_WILLNEED:
+      hint = POSIX_MADV_WILLNEED;
+      break;
+    default:
+      hint = POSIX_MADV_NORMAL;
+      break;
+  }
+  // posix_madvise() returns the error number instead of setting errno.
+  int result = posix_madvise(mapping_, mapping_size_, hint);
+  if (result != 0) {
+    errno_ = result;
+    return false;
+  }
+  return true;
+#endif
+}
+
+bool MmapInputStream::Next(const void** data, int* size) {
+  if (position_ < size_) {
+    last_returned_size_ =
+        static_cast<int>(std::min<int64>(block_size_, size_ - position_));
+    *data = data_ + position_;
+    *size = last_returned_size_;
+    position_ += last_returned_size_;
+    return true;
+  } else {
+    // We're at the end of the mapping.
+    last_returned_size_ = 0;   // Don't let caller back up.
+    return false;
+  }
+}
+
+void MmapInputStream::BackUp(int count) {
+  GOOGLE_CHECK_GT(last_returned_size_, 0)
+      << "BackUp() can only be called after a successful Next().";
+  GOOGLE_CHECK_LE(count, last_returned_size_);
+  GOOGLE_CHECK_GE(count, 0);
+  position_ -= count;
+  last_returned_size_ = 0;  // Don't let caller back up further.
+}
+
+bool MmapInputStream::Skip(int count) {
+  GOOGLE_CHECK_GE(count, 0);
+  last_returned_size_ = 0;   // Don't let caller back up.
+  if (count > size_ - position_) {
+    position_ = size_;
+    return false;
+  } else {
+    position_ += count;
+    return true;
+  }
+}
+
+int64 MmapInputStream::ByteCount() const {
+  return position_;
+}
+
+// ===================================================================
+
 FileOutputStream::FileOutputStream(int file_descriptor, int block_size)
   : copying_output_(file_descriptor),
     impl_(&copying_output_, block_size) {
@@ -132,6 +132,67 @@ class PROTOBUF_EXPORT FileInputStream : public ZeroCopyInputStream {
 
 // ===================================================================
 
+// A ZeroCopyInputStream which reads from a memory-mapped file.
+//
+// Unlike FileInputStream, Next() returns pointers straight into the mapping,
+// so a CodedInputStream parsing from this stream reads the page cache
+// directly, with no intermediate copy.  By default each call to Next()
+// returns as much of the file as fits in an int, so files larger than
+// INT_MAX bytes are returned in several chunks.
+//
+// Memory mapping is not supported on Windows; there, construction fails
+// with GetErrno() == ENOSYS and the stream is empty.
+class PROTOBUF_EXPORT MmapInputStream : public ZeroCopyInputStream {
+ public:
+  // Hints about how the mapping will be accessed, passed to madvise().
+  enum Advice {
+    ADVICE_NORMAL,      // No special treatment.
+    ADVICE_SEQUENTIAL,  // Read ahead aggressively; pages may be dropped soon
+                        // after they have been read.
+    ADVICE_WILLNEED,    // Start reading the whole range into memory now.
+  };
+
+  // Maps |length| bytes of the given file, starting at byte |offset|.  If
+  // |length| is negative or runs past the end of the file, maps everything
+  // from |offset| to the end of the file.  If a block_size is given, it
+  // limits the number of bytes returned by each call to Next().  The file
+  // descriptor is not used after the constructor returns and may be closed
+  // by the caller.
+  explicit MmapInputStream(int file_descriptor, int64 offset = 0,
+                           int64 length = -1, int block_size = -1);
+  ~MmapInputStream() override;
+
+  // Passes an access pattern hint for the mapped range to the kernel.
+  // Returns false and sets GetErrno() if the hint is rejected.
+  bool Advise(Advice advice);
+
+  // If mapping the file or an Advise() call failed, this is the errno from
+  // that error.  Otherwise, this is zero.  If the mapping failed, the stream
+  // is empty.
+  int GetErrno() const { return errno_; }
+
+  // implements ZeroCopyInputStream ----------------------------------
+  bool Next(const void** data, int* size) override;
+  void BackUp(int count) override;
+  bool Skip(int count) override;
+  int64 ByteCount() const override;
+
+ private:
+  void* mapping_;         // Start of the page-aligned mapping.
+  size_t mapping_size_;   // Size of the mapping, for munmap().
+  const uint8* data_;     // Start of the requested range within the mapping.
+  int64 size_;            // Size of the requested range.
+  const int block_size_;  // How many bytes to return at a time.
+  int64 position_;
+  int last_returned_size_;  // How many bytes we returned last time Next()
+                            // was called (used for error checking only).
+  int errno_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(MmapInputStream);
+};
+
+// ===================================================================
+
 // A ZeroCopyOutputStream which writes to a file descriptor.
 //
 // FileOutputStream is preferred over using an ofstream with
@@ -749,6 +749,85 @@ TEST_F(IoTest, FileIo) {
   }
 }
 
+#ifndef _WIN32
+TEST_F(IoTest, MmapIo) {
+  string filename = TestTempDir() + "/zero_copy_stream_test_file";
+
+  for (int i = 0; i < kBlockSizeCount; i++) {
+    // Make a temporary file.
+    int file =
+      open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0777);
+    ASSERT_GE(file, 0);
+
+    {
+      FileOutputStream output(file);
+      WriteStuff(&output);
+      EXPECT_EQ(0, output.GetErrno());
+    }
+
+    {
+      MmapInputStream input(file, 0, -1, kBlockSizes[i]);
+      EXPECT_EQ(0, input.GetErrno());
+      EXPECT_TRUE(input.Advise(MmapInputStream::ADVICE_SEQUENTIAL));
+      ReadStuff(&input);
+    }
+
+    close(file);
+  }
+}
+
+TEST_F(IoTest, MmapIoRange) {
+  string filename = TestTempDir() + "/zero_copy_stream_test_file";
+  int file =
+    open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0777);
+  ASSERT_GE(file, 0);
+
+  // Large enough that the range starts past the first page.
+  string contents = string(10000, 'x') + "Hello world!" + string(10, 'y');
+  {
+    FileOutputStream output(file);
+    WriteString(&output, contents);
+  }
+
+  {
+    MmapInputStream input(file, 10000, 5);
+    EXPECT_EQ(0, input.GetErrno());
+    ReadString(&input, "Hello");
+    EXPECT_EQ(5, input.ByteCount());
+    uint8 byte;
+    EXPECT_EQ(ReadFromInput(&input, &byte, 1), 0);
+  }
+
+  {
+    // Ranges running past the end of the file are truncated.
+    MmapInputStream input(file, contents.size() - 10, 1000);
+    EXPECT_TRUE(input.Advise(MmapInputStream::ADVICE_WILLNEED));
+    ReadString(&input, string(10, 'y'));
+    uint8 byte;
+    EXPECT_EQ(ReadFromInput(&input, &byte, 1), 0);
+  }
+
+  {
+    // An offset past the end of the file produces an empty stream.
+    MmapInputStream input(file, contents.size() + 1);
+    EXPECT_EQ(0, input.GetErrno());
+    const void* data;
+    int size;
+    EXPECT_FALSE(input.Next(&data, &size));
+  }
+
+  close(file);
+}
+
+TEST_F(IoTest, MmapIoBadFile) {
+  MmapInputStream input(-1);
+  EXPECT_EQ(EBADF, input.GetErrno());
+  const void* data;
+  int size;
+  EXPECT_FALSE(input.Next(&data, &size));
+}
+#endif  // !_WIN32
+
 #if HAVE_ZLIB
 TEST_F(IoTest, GzipFileIo) {
   string filename = TestTempDir() + "/zero_copy_stream_test_file";
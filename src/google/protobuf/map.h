@@ -37,10 +37,12 @@
 #ifndef GOOGLE_PROTOBUF_MAP_H__
 #define GOOGLE_PROTOBUF_MAP_H__
 
+#include <string.h>
 #include <initializer_list>
 #include <iterator>
 #include <limits>  // To support Visual Studio 2008
-#include <set>
+#include <new>
+#include <type_traits>
 #include <utility>
 
 #include <google/protobuf/stubs/common.h>
@@ -48,6 +50,11 @@
 #include <google/protobuf/generated_enum_util.h>
 #include <google/protobuf/map_type_handler.h>
 #include <google/protobuf/stubs/hash.h>
+#include <google/protobuf/stubs/stringpiece.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #ifdef SWIG
 #error "You cannot SWIG proto headers"
@@ -82,6 +89,113 @@ class TypeDefinedMapFieldBase;
 class DynamicMapField;
 
 class GeneratedMessageReflection;
+
+template <typename Derived, typename Base, typename Key, typename Value,
+          WireFormatLite::FieldType kKeyFieldType,
+          WireFormatLite::FieldType kValueFieldType, int default_enum_value>
+class MapEntryImpl;
+
+// Returns the SipHash-1-3 of size bytes at data, keyed by seed.  Unlike
+// hash<std::string>, which is easy to make collide whatever the seed is
+// mixed in afterwards, it can't be made to collide without knowing the seed.
+inline uint64 MapStringHash(uint64 seed, const char* data, size_t size) {
+#define PROTOBUF_SIP_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define PROTOBUF_SIP_ROUND              \
+  do {                                  \
+    v0 += v1;                           \
+    v1 = PROTOBUF_SIP_ROTL(v1, 13);     \
+    v1 ^= v0;                           \
+    v0 = PROTOBUF_SIP_ROTL(v0, 32);     \
+    v2 += v3;                           \
+    v3 = PROTOBUF_SIP_ROTL(v3, 16);     \
+    v3 ^= v2;                           \
+    v0 += v3;                           \
+    v3 = PROTOBUF_SIP_ROTL(v3, 21);     \
+    v3 ^= v0;                           \
+    v2 += v1;                           \
+    v1 = PROTOBUF_SIP_ROTL(v1, 17);     \
+    v1 ^= v2;                           \
+    v2 = PROTOBUF_SIP_ROTL(v2, 32);     \
+  } while (0)
+  const uint64 k0 = seed;
+  const uint64 k1 = seed ^ PROTOBUF_ULONGLONG(0x9e3779b97f4a7c15);
+  uint64 v0 = k0 ^ PROTOBUF_ULONGLONG(0x736f6d6570736575);
+  uint64 v1 = k1 ^ PROTOBUF_ULONGLONG(0x646f72616e646f6d);
+  uint64 v2 = k0 ^ PROTOBUF_ULONGLONG(0x6c7967656e657261);
+  uint64 v3 = k1 ^ PROTOBUF_ULONGLONG(0x7465646279746573);
+  const char* end = data + (size & ~static_cast<size_t>(7));
+  for (; data != end; data += 8) {
+    // The byte order doesn't matter, hashes never leave the process.
+    uint64 m;
+    memcpy(&m, data, sizeof(m));
+    v3 ^= m;
+    PROTOBUF_SIP_ROUND;
+    v0 ^= m;
+  }
+  uint64 b = static_cast<uint64>(size) << 56;
+  switch (size & 7) {
+    case 7:
+      b |= static_cast<uint64>(static_cast<uint8>(data[6])) << 48;
+      PROTOBUF_FALLTHROUGH_INTENDED;
+    case 6:
+      b |= static_cast<uint64>(static_cast<uint8>(data[5])) << 40;
+      PROTOBUF_FALLTHROUGH_INTENDED;
+    case 5:
+      b |= static_cast<uint64>(static_cast<uint8>(data[4])) << 32;
+      PROTOBUF_FALLTHROUGH_INTENDED;
+    case 4:
+      b |= static_cast<uint64>(static_cast<uint8>(data[3])) << 24;
+      PROTOBUF_FALLTHROUGH_INTENDED;
+    case 3:
+      b |= static_cast<uint64>(static_cast<uint8>(data[2])) << 16;
+      PROTOBUF_FALLTHROUGH_INTENDED;
+    case 2:
+      b |= static_cast<uint64>(static_cast<uint8>(data[1])) << 8;
+      PROTOBUF_FALLTHROUGH_INTENDED;
+    case 1:
+      b |= static_cast<uint64>(static_cast<uint8>(data[0]));
+  }
+  v3 ^= b;
+  PROTOBUF_SIP_ROUND;
+  v0 ^= b;
+  v2 ^= 0xff;
+  PROTOBUF_SIP_ROUND;
+  PROTOBUF_SIP_ROUND;
+  PROTOBUF_SIP_ROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
+#undef PROTOBUF_SIP_ROUND
+#undef PROTOBUF_SIP_ROTL
+}
+
+// The seeded hash that Map<Key, T> uses for a key of type K.  By default it
+// scrambles hash<K> with the seed.  hash<K> doesn't collide for integer
+// keys, so neither does the result.  String keys are hashed with
+// MapStringHash() instead, so that crafted keys, e.g. from a parsed message,
+// can't all land on one probe sequence.
+template <typename K>
+struct MapKeyHasher {
+  static uint64 Hash(uint64 seed, const K& k) {
+    uint64 h = hash<K>()(k);
+    h = (h + seed) * PROTOBUF_ULONGLONG(0x9e3779b97f4a7c15);
+    return h ^ (h >> 32);
+  }
+};
+
+template <>
+struct MapKeyHasher<std::string> {
+  static uint64 Hash(uint64 seed, const std::string& k) {
+    return MapStringHash(seed, k.data(), k.size());
+  }
+};
+
+// For lookups of std::string keys without a copy.
+template <>
+struct MapKeyHasher<StringPiece> {
+  static uint64 Hash(uint64 seed, StringPiece k) {
+    return MapStringHash(seed, k.data(), k.size());
+  }
+};
+
 }  // namespace internal
 
 // This is the class for Map's internal value_type. Instead of using
@@ -186,6 +300,19 @@ class Map {
     elements_ = Arena::Create<InnerMap>(arena_, 0u, hasher(), Allocator(arena_));
   }
 
+  // Whether K is a lookup key other than key_type, see operator[].  Lookup
+  // keys are converted to StringPiece, which hashes and compares like the
+  // std::string keys.
+  template <typename K>
+  struct IsLookupKey
+      : std::integral_constant<
+            bool, std::is_same<Key, std::string>::value &&
+                      !std::is_same<K, std::string>::value &&
+                      std::is_convertible<const K&, StringPiece>::value> {};
+  template <typename K>
+  using EnableIfLookupKey =
+      typename std::enable_if<IsLookupKey<K>::value>::type;
+
   // re-implement std::allocator to use arena allocator for memory allocation.
   // Used for Map implementation. Users should not use this class
   // directly.
@@ -283,55 +410,139 @@ class Map {
     Arena* const arena_;
   };
 
-  // InnerMap's key type is Key and its value type is value_type*.  We use a
-  // custom class here and for Node, below, to ensure that k_ is at offset 0,
-  // allowing safe conversion from pointer to Node to pointer to Key, and vice
-  // versa when appropriate.
-  class KeyValuePair {
+  typedef MapAllocator<value_type*> Allocator;
+
+  // Hands out the memory of the value_types of a map without an arena.
+  // Nodes are carved from blocks, which double in size up to kMaxBlockNodes
+  // nodes, and freed nodes are kept for later inserts.  The blocks are only
+  // released when the pool is destroyed, so a map keeps the memory of its
+  // largest size, like the table of a std::vector.
+  class NodePool {
    public:
-    KeyValuePair(const Key& k, value_type* v) : k_(k), v_(v) {}
+    NodePool()
+        : free_(NULL),
+          num_free_(0),
+          blocks_(NULL),
+          next_(NULL),
+          end_(NULL),
+          block_nodes_(0) {}
+    ~NodePool() {
+      while (blocks_ != NULL) {
+        Block* block = blocks_;
+        blocks_ = block->next;
+        ::operator delete(block);
+      }
+    }
+
+    void* Allocate() {
+      if (free_ != NULL) {
+        Node* node = free_;
+        free_ = node->next;
+        --num_free_;
+        return node;
+      }
+      if (next_ == end_) {
+        block_nodes_ = (std::min)(std::max<size_type>(2 * block_nodes_, 1),
+                                  static_cast<size_type>(kMaxBlockNodes));
+        AddBlock(block_nodes_);
+      }
+      return next_++;
+    }
 
-    const Key& key() const { return k_; }
-    Key& key() { return k_; }
-    value_type* value() const { return v_; }
-    value_type*& value() { return v_; }
+    void Free(void* p) {
+      Node* node = static_cast<Node*>(p);
+      node->next = free_;
+      free_ = node;
+      ++num_free_;
+    }
+
+    // Makes sure that the next n calls of Allocate() need at most one new
+    // block.
+    void Reserve(size_type n) {
+      const size_type available =
+          num_free_ + static_cast<size_type>(end_ - next_);
+      if (n > available) AddBlock(n - available);
+    }
 
    private:
-    Key k_;
-    value_type* v_;
-  };
+    enum { kMaxBlockNodes = 256 };
 
-  typedef MapAllocator<KeyValuePair> Allocator;
+    union Node {
+      Node* next;
+      typename std::aligned_storage<sizeof(value_type),
+                                    alignof(value_type)>::type storage;
+    };
+    struct Block {
+      Block* next;
+    };
+    // The size of the Block header, rounded up so that nodes are aligned.
+    static size_type HeaderSize() {
+      return (sizeof(Block) + alignof(Node) - 1) / alignof(Node) *
+             alignof(Node);
+    }
+
+    void AddBlock(size_type n) {
+      // The rest of the current block is not lost.
+      while (next_ != end_) Free(next_++);
+      Block* block =
+          static_cast<Block*>(::operator new(HeaderSize() + n * sizeof(Node)));
+      block->next = blocks_;
+      blocks_ = block;
+      next_ = reinterpret_cast<Node*>(reinterpret_cast<char*>(block) +
+                                      HeaderSize());
+      end_ = next_ + n;
+    }
+
+    Node* free_;
+    size_type num_free_;
+    Block* blocks_;
+    // The nodes of the newest block that were never handed out.
+    Node* next_;
+    Node* end_;
+    // The number of nodes of the last block added by Allocate().
+    size_type block_nodes_;
+    GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(NodePool);
+  };
 
   // InnerMap is a generic hash-based map.  It doesn't contain any
-  // protocol-buffer-specific logic.  It is a chaining hash map with the
-  // additional feature that some buckets can be converted to use an ordered
-  // container.  This ensures O(lg n) bounds on find, insert, and erase, while
-  // avoiding the overheads of ordered containers most of the time.
+  // protocol-buffer-specific logic.  It is an open-addressing hash table in
+  // the style of Abseil's SwissTable: each slot holds a pointer to the
+  // value_type of an element, and a separate array holds one control byte
+  // per slot, which tells whether the slot is empty, deleted, or full, and
+  // for full slots keeps 7 bits of the hash of the key.  Slots are probed a
+  // group of 16 at a time, comparing all their control bytes at once, so
+  // that most lookups only compare the key of the element they find.
   //
   // The implementation doesn't need the full generality of unordered_map,
   // and it doesn't have it.  More bells and whistles can be added as needed.
   // Some implementation details:
-  // 1. The hash function has type hasher and the equality function
-  //    equal_to<Key>.  We inherit from hasher to save space
+  // 1. Keys are hashed with internal::MapKeyHasher<Key>, which mixes in a
+  //    per-map seed, and compared with equal_to<Key>.  hash_function()
+  //    still returns a hasher, which we inherit from to save space
   //    (empty-base-class optimization).
-  // 2. The number of buckets is a power of two.
-  // 3. Buckets are converted to trees in pairs: if we convert bucket b then
-  //    buckets b and b^1 will share a tree.  Invariant: buckets b and b^1 have
-  //    the same non-NULL value iff they are sharing a tree.  (An alternative
-  //    implementation strategy would be to have a tag bit per bucket.)
-  // 4. As is typical for hash_map and such, the Keys and Values are always
-  //    stored in linked list nodes.  Pointers to elements are never invalidated
-  //    until the element is deleted.
-  // 5. The trees' payload type is pointer to linked-list node.  Tree-converting
-  //    a bucket doesn't copy Key-Value pairs.
-  // 6. Once we've tree-converted a bucket, it is never converted back. However,
-  //    the items a tree contains may wind up assigned to trees or lists upon a
-  //    rehash.
-  // 7. The code requires no C++ features from C++11 or later.
-  // 8. Mutations to a map do not invalidate the map's iterators, pointers to
-  //    elements, or references to elements.
-  // 9. Except for erase(iterator), any non-const method can reorder iterators.
+  // 2. The number of slots is a power of two, and at least 16.  A map
+  //    without elements doesn't allocate any.
+  // 3. The slots and the control bytes live in a single allocation, from
+  //    the arena if there is one.
+  // 4. The value_types are allocated by Map and only pointed to by slots,
+  //    so pointers to elements are never invalidated until the element is
+  //    deleted, even if the table is resized.  Without an arena, Map takes
+  //    them from the NodePool of its InnerMap, which moves with the
+  //    InnerMap when maps are swapped.
+  // 5. Erasing marks the slot as deleted, unless no probe sequence can go
+  //    through its group, in which case it is marked empty again.  Deleted
+  //    slots are reused by insertions and dropped when the table is
+  //    rehashed.
+  // 6. Iterators remember the element they point to and the slot it was
+  //    in.  If the table has been rehashed since, the slot is looked up
+  //    again, so mutations to a map do not invalidate the map's iterators,
+  //    pointers to elements, or references to elements.
+  // 7. Except for erase(iterator), any non-const method can reorder
+  //    iterators.
+  // 8. Keys whose hashes are fully equal share a probe sequence, so many
+  //    such keys would make operations linear in their number.  Integer
+  //    keys can't collide fully, and string keys are hashed with a seeded
+  //    SipHash, so their collisions can't be crafted without the seed.
   class InnerMap : private hasher {
    public:
     typedef value_type* Value;
@@ -339,414 +550,300 @@ class Map {
     InnerMap(size_type n, hasher h, Allocator alloc)
         : hasher(h),
           num_elements_(0),
+          num_deleted_(0),
+          num_buckets_(0),
           seed_(Seed()),
-          table_(NULL),
+          index_of_first_non_null_(0),
+          min_num_buckets_(0),
+          hinted_num_buckets_(0),
+          slots_(NULL),
+          ctrl_(NULL),
           alloc_(alloc) {
-      n = TableSize(n);
-      table_ = CreateEmptyTable(n);
-      num_buckets_ = index_of_first_non_null_ = n;
+      if (n > 0) Resize(TableSize(n));
     }
 
     ~InnerMap() {
-      if (table_ != NULL) {
-        clear();
-        Dealloc<void*>(table_, num_buckets_);
+      if (num_buckets_ > 0) {
+        DeallocTable(slots_, num_buckets_);
       }
     }
 
    private:
-    enum { kMinTableSize = 8 };
+    enum { kMinTableSize = 16 };
+    enum { kGroupWidth = 16 };
+    enum { kMaxMapLoadTimes8 = 7 };  // controls RAM vs CPU tradeoff
 
-    // Linked-list nodes, as one would expect for a chaining hash table.
-    struct Node {
-      KeyValuePair kv;
-      Node* next;
-    };
+    // Control bytes.  Full slots have a non-negative control byte, which is
+    // the low 7 bits of the scrambled hash of their key.
+    static const int8 kEmpty = -128;
+    static const int8 kDeleted = -2;
 
-    // This is safe only if the given pointer is known to point to a Key that is
-    // part of a Node.
-    static Node* NodePtrFromKeyPtr(Key* k) {
-      return reinterpret_cast<Node*>(k);
-    }
-
-    static Key* KeyPtrFromNodePtr(Node* node) { return &node->kv.key(); }
+   public:
+    // iterator and const_iterator are the same type; the enclosing class
+    // decides what may be modified through them.
+    class iterator {
+     public:
+      iterator() : node_(NULL), m_(NULL), bucket_index_(0) {}
 
-    // Trees.  The payload type is pointer to Key, so that we can query the tree
-    // with Keys that are not in any particular data structure.  When we insert,
-    // though, the pointer is always pointing to a Key that is inside a Node.
-    struct KeyCompare {
-      bool operator()(const Key* n0, const Key* n1) const { return *n0 < *n1; }
-    };
-    typedef typename Allocator::template rebind<Key*>::other KeyPtrAllocator;
-    typedef std::set<Key*, KeyCompare, KeyPtrAllocator> Tree;
-    typedef typename Tree::iterator TreeIterator;
-
-    // iterator and const_iterator are instantiations of iterator_base.
-    template <typename KeyValueType>
-    struct iterator_base {
-      typedef KeyValueType& reference;
-      typedef KeyValueType* pointer;
-
-      // Invariants:
-      // node_ is always correct. This is handy because the most common
-      // operations are operator* and operator-> and they only use node_.
-      // When node_ is set to a non-NULL value, all the other non-const fields
-      // are updated to be correct also, but those fields can become stale
-      // if the underlying map is modified.  When those fields are needed they
-      // are rechecked, and updated if necessary.
-      iterator_base() : node_(NULL), m_(NULL), bucket_index_(0) {}
-
-      explicit iterator_base(const InnerMap* m) : m_(m) {
+      explicit iterator(const InnerMap* m) : m_(m) {
         SearchFrom(m->index_of_first_non_null_);
       }
 
-      // Any iterator_base can convert to any other.  This is overkill, and we
-      // rely on the enclosing class to use it wisely.  The standard "iterator
-      // can convert to const_iterator" is OK but the reverse direction is not.
-      template <typename U>
-      explicit iterator_base(const iterator_base<U>& it)
-          : node_(it.node_), m_(it.m_), bucket_index_(it.bucket_index_) {}
-
-      iterator_base(Node* n, const InnerMap* m, size_type index)
+      iterator(Value n, const InnerMap* m, size_type index)
           : node_(n), m_(m), bucket_index_(index) {}
 
-      iterator_base(TreeIterator tree_it, const InnerMap* m, size_type index)
-          : node_(NodePtrFromKeyPtr(*tree_it)), m_(m), bucket_index_(index) {
-        // Invariant: iterators that use buckets with trees have an even
-        // bucket_index_.
-        GOOGLE_DCHECK_EQ(bucket_index_ % 2, 0);
-      }
+      // The element, or NULL for end().
+      Value value() const { return node_; }
 
-      // Advance through buckets, looking for the first that isn't empty.
-      // If nothing non-empty is found then leave node_ == NULL.
-      void SearchFrom(size_type start_bucket) {
-        GOOGLE_DCHECK(m_->index_of_first_non_null_ == m_->num_buckets_ ||
-               m_->table_[m_->index_of_first_non_null_] != NULL);
-        node_ = NULL;
-        for (bucket_index_ = start_bucket; bucket_index_ < m_->num_buckets_;
-             bucket_index_++) {
-          if (m_->TableEntryIsNonEmptyList(bucket_index_)) {
-            node_ = static_cast<Node*>(m_->table_[bucket_index_]);
-            break;
-          } else if (m_->TableEntryIsTree(bucket_index_)) {
-            Tree* tree = static_cast<Tree*>(m_->table_[bucket_index_]);
-            GOOGLE_DCHECK(!tree->empty());
-            node_ = NodePtrFromKeyPtr(*tree->begin());
-            break;
-          }
-        }
-      }
-
-      reference operator*() const { return node_->kv; }
-      pointer operator->() const { return &(operator*()); }
-
-      friend bool operator==(const iterator_base& a, const iterator_base& b) {
+      friend bool operator==(const iterator& a, const iterator& b) {
         return a.node_ == b.node_;
       }
-      friend bool operator!=(const iterator_base& a, const iterator_base& b) {
+      friend bool operator!=(const iterator& a, const iterator& b) {
         return a.node_ != b.node_;
       }
 
-      iterator_base& operator++() {
-        if (node_->next == NULL) {
-          TreeIterator tree_it;
-          const bool is_list = revalidate_if_necessary(&tree_it);
-          if (is_list) {
-            SearchFrom(bucket_index_ + 1);
-          } else {
-            GOOGLE_DCHECK_EQ(bucket_index_ & 1, 0);
-            Tree* tree = static_cast<Tree*>(m_->table_[bucket_index_]);
-            if (++tree_it == tree->end()) {
-              SearchFrom(bucket_index_ + 2);
-            } else {
-              node_ = NodePtrFromKeyPtr(*tree_it);
-            }
-          }
-        } else {
-          node_ = node_->next;
-        }
+      iterator& operator++() {
+        revalidate_if_necessary();
+        SearchFrom(bucket_index_ + 1);
         return *this;
       }
 
-      iterator_base operator++(int /* unused */) {
-        iterator_base tmp = *this;
+      iterator operator++(int /* unused */) {
+        iterator tmp = *this;
         ++*this;
         return tmp;
       }
 
-      // Assumes node_ and m_ are correct and non-NULL, but other fields may be
-      // stale.  Fix them as needed.  Then return true iff node_ points to a
-      // Node in a list.  If false is returned then *it is modified to be
-      // a valid iterator for node_.
-      bool revalidate_if_necessary(TreeIterator* it) {
-        GOOGLE_DCHECK(node_ != NULL && m_ != NULL);
-        // Force bucket_index_ to be in range.
-        bucket_index_ &= (m_->num_buckets_ - 1);
-        // Common case: the bucket we think is relevant points to node_.
-        if (m_->table_[bucket_index_] == static_cast<void*>(node_))
-          return true;
-        // Less common: the bucket is a linked list with node_ somewhere in it,
-        // but not at the head.
-        if (m_->TableEntryIsNonEmptyList(bucket_index_)) {
-          Node* l = static_cast<Node*>(m_->table_[bucket_index_]);
-          while ((l = l->next) != NULL) {
-            if (l == node_) {
-              return true;
-            }
+     private:
+      friend class InnerMap;
+
+      // Advance through slots, looking for the first that is full.  If
+      // nothing is found then leave node_ == NULL.
+      void SearchFrom(size_type start_bucket) {
+        node_ = NULL;
+        for (bucket_index_ = start_bucket; bucket_index_ < m_->num_buckets_;
+             bucket_index_++) {
+          if (m_->ctrl_[bucket_index_] >= 0) {
+            node_ = m_->slots_[bucket_index_];
+            break;
           }
         }
-        // Well, bucket_index_ still might be correct, but probably
-        // not.  Revalidate just to be sure.  This case is rare enough that we
-        // don't worry about potential optimizations, such as having a custom
-        // find-like method that compares Node* instead of const Key&.
-        iterator_base i(m_->find(*KeyPtrFromNodePtr(node_), it));
-        bucket_index_ = i.bucket_index_;
-        return m_->TableEntryIsList(bucket_index_);
       }
 
-      Node* node_;
+      // Assumes node_ and m_ are correct and non-NULL, but bucket_index_ may
+      // be stale.  Fix it if needed.
+      void revalidate_if_necessary() {
+        GOOGLE_DCHECK(node_ != NULL && m_ != NULL);
+        // Common case: the slot we think is relevant still holds node_.
+        if (bucket_index_ < m_->num_buckets_ &&
+            m_->ctrl_[bucket_index_] >= 0 &&
+            m_->slots_[bucket_index_] == node_) {
+          return;
+        }
+        bucket_index_ = m_->FindSlot(node_->first, m_->Hash(node_->first));
+        GOOGLE_DCHECK_LT(bucket_index_, m_->num_buckets_);
+      }
+
+      Value node_;
       const InnerMap* m_;
       size_type bucket_index_;
     };
+    typedef iterator const_iterator;
 
-   public:
-    typedef iterator_base<KeyValuePair> iterator;
-    typedef iterator_base<const KeyValuePair> const_iterator;
-
-    iterator begin() { return iterator(this); }
-    iterator end() { return iterator(); }
-    const_iterator begin() const { return const_iterator(this); }
-    const_iterator end() const { return const_iterator(); }
+    iterator begin() const { return iterator(this); }
+    iterator end() const { return iterator(); }
 
+    // Forgets all elements, without touching them.
     void clear() {
-      for (size_type b = 0; b < num_buckets_; b++) {
-        if (TableEntryIsNonEmptyList(b)) {
-          Node* node = static_cast<Node*>(table_[b]);
-          table_[b] = NULL;
-          do {
-            Node* next = node->next;
-            DestroyNode(node);
-            node = next;
-          } while (node != NULL);
-        } else if (TableEntryIsTree(b)) {
-          Tree* tree = static_cast<Tree*>(table_[b]);
-          GOOGLE_DCHECK(table_[b] == table_[b + 1] && (b & 1) == 0);
-          table_[b] = table_[b + 1] = NULL;
-          typename Tree::iterator tree_it = tree->begin();
-          do {
-            Node* node = NodePtrFromKeyPtr(*tree_it);
-            typename Tree::iterator next = tree_it;
-            ++next;
-            tree->erase(tree_it);
-            DestroyNode(node);
-            tree_it = next;
-          } while (tree_it != tree->end());
-          DestroyTree(tree);
-          b++;
-        }
+      if (num_buckets_ > 0) {
+        memset(ctrl_, kEmpty, num_buckets_);
       }
       num_elements_ = 0;
+      num_deleted_ = 0;
       index_of_first_non_null_ = num_buckets_;
+      hinted_num_buckets_ = 0;
     }
 
     const hasher& hash_function() const { return *this; }
 
+    NodePool* node_pool() { return &node_pool_; }
+
+    // Makes room for n elements, so that inserting up to n elements doesn't
+    // resize the table.  The table doesn't shrink below that size later.
+    void reserve(size_type n) {
+      const size_type new_num_buckets = NumBucketsFor(n);
+      min_num_buckets_ = (std::max)(min_num_buckets_, new_num_buckets);
+      if (new_num_buckets > num_buckets_) Resize(new_num_buckets);
+    }
+
+    // Like reserve(), but n is only an estimate, so the table only keeps
+    // that size until the next erase() or clear().
+    void reserve_hint(size_type n) {
+      const size_type new_num_buckets = NumBucketsFor(n);
+      hinted_num_buckets_ = (std::max)(hinted_num_buckets_, new_num_buckets);
+      if (new_num_buckets > num_buckets_) Resize(new_num_buckets);
+    }
+
     static size_type max_size() {
       return static_cast<size_type>(1) << (sizeof(void**) >= 8 ? 60 : 28);
     }
     size_type size() const { return num_elements_; }
     bool empty() const { return size() == 0; }
 
-    iterator find(const Key& k) { return iterator(FindHelper(k).first); }
-    const_iterator find(const Key& k) const { return find(k, NULL); }
-
-    // In traditional C++ style, this performs "insert if not present."
-    std::pair<iterator, bool> insert(const KeyValuePair& kv) {
-      std::pair<const_iterator, size_type> p = FindHelper(kv.key());
-      // Case 1: key was already present.
-      if (p.first.node_ != NULL)
-        return std::make_pair(iterator(p.first), false);
-      // Case 2: insert.
-      if (ResizeIfLoadIsOutOfRange(num_elements_ + 1)) {
-        p = FindHelper(kv.key());
-      }
-      const size_type b = p.second;  // bucket number
-      Node* node = Alloc<Node>(1);
-      alloc_.construct(&node->kv, kv);
-      iterator result = InsertUnique(b, node);
-      ++num_elements_;
-      return std::make_pair(result, true);
+    // K is Key, or a type that hashes and compares like Key, see
+    // Map::IsLookupKey.
+    template <typename K>
+    iterator find(const K& k) const {
+      size_type b = FindSlot(k, Hash(k));
+      return b == num_buckets_ ? end() : iterator_at(b);
     }
 
-    // The same, but if an insertion is necessary then the value portion of the
-    // inserted key-value pair is left uninitialized.
-    std::pair<iterator, bool> insert(const Key& k) {
-      std::pair<const_iterator, size_type> p = FindHelper(k);
+    // In traditional C++ style, this performs "insert if not present."
+    // Returns the slot of k, and whether it was inserted.  The value of an
+    // inserted slot is NULL; the caller must store an element with key k
+    // there with value_at() before calling any other method.
+    template <typename K>
+    std::pair<size_type, bool> insert(const K& k) {
+      const uint64 h = Hash(k);
+      size_type b = FindSlot(k, h);
       // Case 1: key was already present.
-      if (p.first.node_ != NULL)
-        return std::make_pair(iterator(p.first), false);
+      if (b != num_buckets_) return std::make_pair(b, false);
       // Case 2: insert.
-      if (ResizeIfLoadIsOutOfRange(num_elements_ + 1)) {
-        p = FindHelper(k);
-      }
-      const size_type b = p.second;  // bucket number
-      Node* node = Alloc<Node>(1);
-      typedef typename Allocator::template rebind<Key>::other KeyAllocator;
-      KeyAllocator(alloc_).construct(&node->kv.key(), k);
-      iterator result = InsertUnique(b, node);
+      ResizeIfLoadIsOutOfRange(num_elements_ + 1);
+      b = FindInsertSlot(h);
+      if (ctrl_[b] == kDeleted) --num_deleted_;
+      ctrl_[b] = H2(h);
+      slots_[b] = NULL;
       ++num_elements_;
-      return std::make_pair(result, true);
+      // parentheses around (std::min) prevents macro expansion of min(...)
+      index_of_first_non_null_ = (std::min)(index_of_first_non_null_, b);
+      return std::make_pair(b, true);
     }
 
-    Value& operator[](const Key& k) {
-      KeyValuePair kv(k, Value());
-      return insert(kv).first->value();
+    Value& value_at(size_type b) { return slots_[b]; }
+    iterator iterator_at(size_type b) const {
+      return iterator(slots_[b], this, b);
     }
 
     void erase(iterator it) {
       GOOGLE_DCHECK_EQ(it.m_, this);
-      typename Tree::iterator tree_it;
-      const bool is_list = it.revalidate_if_necessary(&tree_it);
-      size_type b = it.bucket_index_;
-      Node* const item = it.node_;
-      if (is_list) {
-        GOOGLE_DCHECK(TableEntryIsNonEmptyList(b));
-        Node* head = static_cast<Node*>(table_[b]);
-        head = EraseFromLinkedList(item, head);
-        table_[b] = static_cast<void*>(head);
+      it.revalidate_if_necessary();
+      const size_type b = it.bucket_index_;
+      // If the group of b has an empty slot, it has never been full since
+      // the last rehash, so no probe sequence goes past it.
+      const int8* group =
+          ctrl_ + (b & ~static_cast<size_type>(kGroupWidth - 1));
+      if (MatchByte(group, kEmpty) != 0) {
+        ctrl_[b] = kEmpty;
       } else {
-        GOOGLE_DCHECK(TableEntryIsTree(b));
-        Tree* tree = static_cast<Tree*>(table_[b]);
-        tree->erase(*tree_it);
-        if (tree->empty()) {
-          // Force b to be the minimum of b and b ^ 1.  This is important
-          // only because we want index_of_first_non_null_ to be correct.
-          b &= ~static_cast<size_type>(1);
-          DestroyTree(tree);
-          table_[b] = table_[b + 1] = NULL;
-        }
+        ctrl_[b] = kDeleted;
+        ++num_deleted_;
       }
-      DestroyNode(item);
       --num_elements_;
+      hinted_num_buckets_ = 0;
       if (PROTOBUF_PREDICT_FALSE(b == index_of_first_non_null_)) {
         while (index_of_first_non_null_ < num_buckets_ &&
-               table_[index_of_first_non_null_] == NULL) {
+               ctrl_[index_of_first_non_null_] < 0) {
           ++index_of_first_non_null_;
         }
       }
     }
 
    private:
-    const_iterator find(const Key& k, TreeIterator* it) const {
-      return FindHelper(k, it).first;
-    }
-    std::pair<const_iterator, size_type> FindHelper(const Key& k) const {
-      return FindHelper(k, NULL);
-    }
-    std::pair<const_iterator, size_type> FindHelper(const Key& k,
-                                                    TreeIterator* it) const {
-      size_type b = BucketNumber(k);
-      if (TableEntryIsNonEmptyList(b)) {
-        Node* node = static_cast<Node*>(table_[b]);
-        do {
-          if (IsMatch(*KeyPtrFromNodePtr(node), k)) {
-            return std::make_pair(const_iterator(node, this, b), b);
-          } else {
-            node = node->next;
-          }
-        } while (node != NULL);
-      } else if (TableEntryIsTree(b)) {
-        GOOGLE_DCHECK_EQ(table_[b], table_[b ^ 1]);
-        b &= ~static_cast<size_t>(1);
-        Tree* tree = static_cast<Tree*>(table_[b]);
-        Key* key = const_cast<Key*>(&k);
-        typename Tree::iterator tree_it = tree->find(key);
-        if (tree_it != tree->end()) {
-          if (it != NULL) *it = tree_it;
-          return std::make_pair(const_iterator(tree_it, this, b), b);
-        }
+    // Returns a mask of the control bytes in group that are equal to c, with
+    // bit i for group[i].
+    static uint32 MatchByte(const int8* group, int8 c) {
+#if defined(__SSE2__)
+      __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+      return static_cast<uint32>(
+          _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(c))));
+#else
+      uint32 mask = 0;
+      for (int i = 0; i < kGroupWidth; i++) {
+        if (group[i] == c) mask |= static_cast<uint32>(1) << i;
       }
-      return std::make_pair(end(), b);
-    }
-
-    // Insert the given Node in bucket b.  If that would make bucket b too big,
-    // and bucket b is not a tree, create a tree for buckets b and b^1 to share.
-    // Requires count(*KeyPtrFromNodePtr(node)) == 0 and that b is the correct
-    // bucket.  num_elements_ is not modified.
-    iterator InsertUnique(size_type b, Node* node) {
-      GOOGLE_DCHECK(index_of_first_non_null_ == num_buckets_ ||
-             table_[index_of_first_non_null_] != NULL);
-      // In practice, the code that led to this point may have already
-      // determined whether we are inserting into an empty list, a short list,
-      // or whatever.  But it's probably cheap enough to recompute that here;
-      // it's likely that we're inserting into an empty or short list.
-      iterator result;
-      GOOGLE_DCHECK(find(*KeyPtrFromNodePtr(node)) == end());
-      if (TableEntryIsEmpty(b)) {
-        result = InsertUniqueInList(b, node);
-      } else if (TableEntryIsNonEmptyList(b)) {
-        if (PROTOBUF_PREDICT_FALSE(TableEntryIsTooLong(b))) {
-          TreeConvert(b);
-          result = InsertUniqueInTree(b, node);
-          GOOGLE_DCHECK_EQ(result.bucket_index_, b & ~static_cast<size_type>(1));
-        } else {
-          // Insert into a pre-existing list.  This case cannot modify
-          // index_of_first_non_null_, so we skip the code to update it.
-          return InsertUniqueInList(b, node);
-        }
-      } else {
-        // Insert into a pre-existing tree.  This case cannot modify
-        // index_of_first_non_null_, so we skip the code to update it.
-        return InsertUniqueInTree(b, node);
+      return mask;
+#endif
+    }
+
+    // Returns a mask of the control bytes in group that are empty or deleted.
+    static uint32 MatchEmptyOrDeleted(const int8* group) {
+#if defined(__SSE2__)
+      // These are exactly the negative ones.
+      return static_cast<uint32>(_mm_movemask_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+#else
+      uint32 mask = 0;
+      for (int i = 0; i < kGroupWidth; i++) {
+        if (group[i] < 0) mask |= static_cast<uint32>(1) << i;
       }
-      // parentheses around (std::min) prevents macro expansion of min(...)
-      index_of_first_non_null_ =
-          (std::min)(index_of_first_non_null_, result.bucket_index_);
-      return result;
+      return mask;
+#endif
     }
 
-    // Helper for InsertUnique.  Handles the case where bucket b is a
-    // not-too-long linked list.
-    iterator InsertUniqueInList(size_type b, Node* node) {
-      node->next = static_cast<Node*>(table_[b]);
-      table_[b] = static_cast<void*>(node);
-      return iterator(node, this, b);
+    static int LowestBit(uint32 mask) {
+      return Bits::Log2FloorNonZero(mask & (~mask + 1));
+    }
+
+    // Returns the slot of k, or num_buckets_ if k is absent.  The groups are
+    // probed in triangular order, which visits all of them.
+    template <typename K>
+    size_type FindSlot(const K& k, uint64 h) const {
+      if (num_buckets_ == 0) return num_buckets_;
+      const size_type group_mask = num_buckets_ / kGroupWidth - 1;
+      size_type group = H1(h) & group_mask;
+      for (size_type step = 1;; step++) {
+        const int8* ctrl = ctrl_ + group * kGroupWidth;
+        for (uint32 match = MatchByte(ctrl, H2(h)); match != 0;
+             match &= match - 1) {
+          const size_type b = group * kGroupWidth + LowestBit(match);
+          if (IsMatch(slots_[b]->first, k)) return b;
+        }
+        if (MatchByte(ctrl, kEmpty) != 0) return num_buckets_;
+        group = (group + step) & group_mask;
+      }
     }
 
-    // Helper for InsertUnique.  Handles the case where bucket b points to a
-    // Tree.
-    iterator InsertUniqueInTree(size_type b, Node* node) {
-      GOOGLE_DCHECK_EQ(table_[b], table_[b ^ 1]);
-      // Maintain the invariant that node->next is NULL for all Nodes in Trees.
-      node->next = NULL;
-      return iterator(static_cast<Tree*>(table_[b])
-                      ->insert(KeyPtrFromNodePtr(node))
-                      .first,
-                      this, b & ~static_cast<size_t>(1));
+    // Returns the first slot on the probe sequence of h that is empty or
+    // deleted.
+    size_type FindInsertSlot(uint64 h) const {
+      const size_type group_mask = num_buckets_ / kGroupWidth - 1;
+      size_type group = H1(h) & group_mask;
+      for (size_type step = 1;; step++) {
+        uint32 mask = MatchEmptyOrDeleted(ctrl_ + group * kGroupWidth);
+        if (mask != 0) return group * kGroupWidth + LowestBit(mask);
+        group = (group + step) & group_mask;
+      }
     }
 
-    // Returns whether it did resize.  Currently this is only used when
+    // Makes room for new_size elements.  Currently this is only used when
     // num_elements_ increases, though it could be used in other situations.
-    // It checks for load too low as well as load too high: because any number
-    // of erases can occur between inserts, the load could be as low as 0 here.
-    // Resizing to a lower size is not always helpful, but failing to do so can
-    // destroy the expected big-O bounds for some operations. By having the
-    // policy that sometimes we resize down as well as up, clients can easily
-    // keep O(size()) = O(number of buckets) if they want that.
-    bool ResizeIfLoadIsOutOfRange(size_type new_size) {
-      const size_type kMaxMapLoadTimes16 = 12;  // controls RAM vs CPU tradeoff
-      const size_type hi_cutoff = num_buckets_ * kMaxMapLoadTimes16 / 16;
+    // It checks for load too low as well as load too high: because any
+    // number of erases can occur between inserts, the load could be as low
+    // as 0 here.  Resizing to a lower size is not always helpful, but failing
+    // to do so can destroy the expected big-O bounds for some operations. By
+    // having the policy that sometimes we resize down as well as up, clients
+    // can easily keep O(size()) = O(number of buckets) if they want that.
+    void ResizeIfLoadIsOutOfRange(size_type new_size) {
+      if (num_buckets_ == 0) {
+        Resize(kMinTableSize);
+        return;
+      }
+      const size_type hi_cutoff = num_buckets_ * kMaxMapLoadTimes8 / 8;
       const size_type lo_cutoff = hi_cutoff / 4;
-      // We don't care how many elements are in trees.  If a lot are,
-      // we may resize even though there are many empty buckets.  In
-      // practice, this seems fine.
-      if (PROTOBUF_PREDICT_FALSE(new_size >= hi_cutoff)) {
-        if (num_buckets_ <= max_size() / 2) {
+      // Deleted slots count against the load, since they lengthen probe
+      // sequences just like full ones.  If they are most of it, rehashing
+      // at the same size is enough to get rid of them.
+      if (PROTOBUF_PREDICT_FALSE(new_size + num_deleted_ > hi_cutoff)) {
+        if (new_size <= hi_cutoff / 2) {
+          Resize(num_buckets_);
+        } else if (num_buckets_ <= max_size() / 2) {
           Resize(num_buckets_ * 2);
-          return true;
         }
       } else if (PROTOBUF_PREDICT_FALSE(new_size <= lo_cutoff &&
-                                        num_buckets_ > kMinTableSize)) {
+                                        num_buckets_ > kMinTableSize &&
+                                        num_buckets_ > min_num_buckets_ &&
+                                        num_buckets_ > hinted_num_buckets_)) {
         size_type lg2_of_size_reduction_factor = 1;
         // It's possible we want to shrink a lot here... size() could even be 0.
         // So, estimate how much to shrink by making sure we don't shrink so
@@ -757,142 +854,66 @@ class Map {
           ++lg2_of_size_reduction_factor;
         }
         size_type new_num_buckets = std::max<size_type>(
-            kMinTableSize, num_buckets_ >> lg2_of_size_reduction_factor);
+            (std::max<size_type>)(kMinTableSize, min_num_buckets_),
+            num_buckets_ >> lg2_of_size_reduction_factor);
         if (new_num_buckets != num_buckets_) {
           Resize(new_num_buckets);
-          return true;
         }
       }
-      return false;
     }
 
     // Resize to the given number of buckets.
-    void Resize(size_t new_num_buckets) {
+    void Resize(size_type new_num_buckets) {
       GOOGLE_DCHECK_GE(new_num_buckets, kMinTableSize);
-      void** const old_table = table_;
+      GOOGLE_DCHECK_EQ(new_num_buckets & (new_num_buckets - 1), 0);
+      Value* const old_slots = slots_;
+      const int8* const old_ctrl = ctrl_;
       const size_type old_table_size = num_buckets_;
-      num_buckets_ = new_num_buckets;
-      table_ = CreateEmptyTable(num_buckets_);
       const size_type start = index_of_first_non_null_;
+      num_buckets_ = new_num_buckets;
+      slots_ = AllocTable(num_buckets_);
+      ctrl_ = reinterpret_cast<int8*>(slots_ + num_buckets_);
+      memset(ctrl_, kEmpty, num_buckets_);
+      num_deleted_ = 0;
       index_of_first_non_null_ = num_buckets_;
       for (size_type i = start; i < old_table_size; i++) {
-        if (TableEntryIsNonEmptyList(old_table, i)) {
-          TransferList(old_table, i);
-        } else if (TableEntryIsTree(old_table, i)) {
-          TransferTree(old_table, i++);
-        }
+        if (old_ctrl[i] < 0) continue;
+        const uint64 h = Hash(old_slots[i]->first);
+        const size_type b = FindInsertSlot(h);
+        ctrl_[b] = H2(h);
+        slots_[b] = old_slots[i];
+        index_of_first_non_null_ = (std::min)(index_of_first_non_null_, b);
       }
-      Dealloc<void*>(old_table, old_table_size);
-    }
-
-    void TransferList(void* const* table, size_type index) {
-      Node* node = static_cast<Node*>(table[index]);
-      do {
-        Node* next = node->next;
-        InsertUnique(BucketNumber(*KeyPtrFromNodePtr(node)), node);
-        node = next;
-      } while (node != NULL);
-    }
-
-    void TransferTree(void* const* table, size_type index) {
-      Tree* tree = static_cast<Tree*>(table[index]);
-      typename Tree::iterator tree_it = tree->begin();
-      do {
-        Node* node = NodePtrFromKeyPtr(*tree_it);
-        InsertUnique(BucketNumber(**tree_it), node);
-      } while (++tree_it != tree->end());
-      DestroyTree(tree);
-    }
-
-    Node* EraseFromLinkedList(Node* item, Node* head) {
-      if (head == item) {
-        return head->next;
-      } else {
-        head->next = EraseFromLinkedList(item, head->next);
-        return head;
+      if (old_table_size > 0) {
+        DeallocTable(old_slots, old_table_size);
       }
     }
 
-    bool TableEntryIsEmpty(size_type b) const {
-      return TableEntryIsEmpty(table_, b);
-    }
-    bool TableEntryIsNonEmptyList(size_type b) const {
-      return TableEntryIsNonEmptyList(table_, b);
-    }
-    bool TableEntryIsTree(size_type b) const {
-      return TableEntryIsTree(table_, b);
-    }
-    bool TableEntryIsList(size_type b) const {
-      return TableEntryIsList(table_, b);
-    }
-    static bool TableEntryIsEmpty(void* const* table, size_type b) {
-      return table[b] == NULL;
-    }
-    static bool TableEntryIsNonEmptyList(void* const* table, size_type b) {
-      return table[b] != NULL && table[b] != table[b ^ 1];
-    }
-    static bool TableEntryIsTree(void* const* table, size_type b) {
-      return !TableEntryIsEmpty(table, b) &&
-          !TableEntryIsNonEmptyList(table, b);
-    }
-    static bool TableEntryIsList(void* const* table, size_type b) {
-      return !TableEntryIsTree(table, b);
+    template <typename K>
+    uint64 Hash(const K& k) const {
+      return internal::MapKeyHasher<K>::Hash(seed_, k);
     }
 
-    void TreeConvert(size_type b) {
-      GOOGLE_DCHECK(!TableEntryIsTree(b) && !TableEntryIsTree(b ^ 1));
-      typename Allocator::template rebind<Tree>::other tree_allocator(alloc_);
-      Tree* tree = tree_allocator.allocate(1);
-      // We want to use the three-arg form of construct, if it exists, but we
-      // create a temporary and use the two-arg construct that's known to exist.
-      // It's clunky, but the compiler should be able to generate more-or-less
-      // the same code.
-      tree_allocator.construct(tree,
-                               Tree(KeyCompare(), KeyPtrAllocator(alloc_)));
-      // Now the tree is ready to use.
-      size_type count = CopyListToTree(b, tree) + CopyListToTree(b ^ 1, tree);
-      GOOGLE_DCHECK_EQ(count, tree->size());
-      table_[b] = table_[b ^ 1] = static_cast<void*>(tree);
-    }
-
-    // Copy a linked list in the given bucket to a tree.
-    // Returns the number of things it copied.
-    size_type CopyListToTree(size_type b, Tree* tree) {
-      size_type count = 0;
-      Node* node = static_cast<Node*>(table_[b]);
-      while (node != NULL) {
-        tree->insert(KeyPtrFromNodePtr(node));
-        ++count;
-        Node* next = node->next;
-        node->next = NULL;
-        node = next;
-      }
-      return count;
-    }
+    // The group where probing starts, before masking, and the control byte.
+    static size_type H1(uint64 h) { return static_cast<size_type>(h >> 7); }
+    static int8 H2(uint64 h) { return static_cast<int8>(h & 0x7f); }
 
-    // Return whether table_[b] is a linked list that seems awfully long.
-    // Requires table_[b] to point to a non-empty linked list.
-    bool TableEntryIsTooLong(size_type b) {
-      const size_type kMaxLength = 8;
-      size_type count = 0;
-      Node* node = static_cast<Node*>(table_[b]);
-      do {
-        ++count;
-        node = node->next;
-      } while (node != NULL);
-      // Invariant: no linked list ever is more than kMaxLength in length.
-      GOOGLE_DCHECK_LE(count, kMaxLength);
-      return count >= kMaxLength;
+    bool IsMatch(const Key& k0, const Key& k1) const {
+      return std::equal_to<Key>()(k0, k1);
     }
-
-    size_type BucketNumber(const Key& k) const {
-      // We inherit from hasher, so one-arg operator() provides a hash function.
-      size_type h = (*const_cast<InnerMap*>(this))(k);
-      return (h + seed_) & (num_buckets_ - 1);
+    template <typename K>
+    bool IsMatch(const Key& k0, const K& k1) const {
+      return k1 == k0;
     }
 
-    bool IsMatch(const Key& k0, const Key& k1) const {
-      return std::equal_to<Key>()(k0, k1);
+    // Returns the number of slots that holds n elements without resizing.
+    static size_type NumBucketsFor(size_type n) {
+      size_type num_buckets = kMinTableSize;
+      while (num_buckets * kMaxMapLoadTimes8 / 8 < n &&
+             num_buckets <= max_size() / 2) {
+        num_buckets *= 2;
+      }
+      return num_buckets;
     }
 
     // Return a power of two no less than max(kMinTableSize, n).
@@ -903,37 +924,17 @@ class Map {
                  : n;
     }
 
-    // Use alloc_ to allocate an array of n objects of type U.
-    template <typename U>
-    U* Alloc(size_type n) {
-      typedef typename Allocator::template rebind<U>::other alloc_type;
-      return alloc_type(alloc_).allocate(n);
-    }
-
-    // Use alloc_ to deallocate an array of n objects of type U.
-    template <typename U>
-    void Dealloc(U* t, size_type n) {
-      typedef typename Allocator::template rebind<U>::other alloc_type;
-      alloc_type(alloc_).deallocate(t, n);
-    }
-
-    void DestroyNode(Node* node) {
-      alloc_.destroy(&node->kv);
-      Dealloc<Node>(node, 1);
+    // The slots are followed by the control bytes, in units of Value.
+    static size_type TableAllocationSize(size_type n) {
+      return n + n / sizeof(Value);
     }
 
-    void DestroyTree(Tree* tree) {
-      typename Allocator::template rebind<Tree>::other tree_allocator(alloc_);
-      tree_allocator.destroy(tree);
-      tree_allocator.deallocate(tree, 1);
+    Value* AllocTable(size_type n) {
+      return alloc_.allocate(TableAllocationSize(n));
     }
 
-    void** CreateEmptyTable(size_type n) {
-      GOOGLE_DCHECK(n >= kMinTableSize);
-      GOOGLE_DCHECK_EQ(n & (n - 1), 0);
-      void** result = Alloc<void*>(n);
-      memset(result, 0, n * sizeof(result[0]));
-      return result;
+    void DeallocTable(Value* table, size_type n) {
+      alloc_.deallocate(table, TableAllocationSize(n));
     }
 
     // Return a randomish value.
@@ -948,11 +949,20 @@ class Map {
     }
 
     size_type num_elements_;
+    size_type num_deleted_;
     size_type num_buckets_;
     size_type seed_;
     size_type index_of_first_non_null_;
-    void** table_;  // an array with num_buckets_ entries
+    // The size reserved with reserve(), below which the table doesn't
+    // shrink.
+    size_type min_num_buckets_;
+    // The size reserved with reserve_hint(), below which the table doesn't
+    // shrink until the next erase() or clear().
+    size_type hinted_num_buckets_;
+    Value* slots_;  // an array with num_buckets_ entries
+    int8* ctrl_;    // num_buckets_ control bytes, right after slots_
     Allocator alloc_;
+    NodePool node_pool_;
     GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(InnerMap);
   };  // end of class InnerMap
 
@@ -972,7 +982,7 @@ class Map {
     explicit const_iterator(const InnerIt& it) : it_(it) {}
 
     const_reference operator*() const {
-      return *it_->value();
+      return *it_.value();
     }
     const_pointer operator->() const { return &(operator*()); }
 
@@ -1006,7 +1016,7 @@ class Map {
     iterator() {}
     explicit iterator(const InnerIt& it) : it_(it) {}
 
-    reference operator*() const { return *it_->value(); }
+    reference operator*() const { return *it_.value(); }
     pointer operator->() const { return &(operator*()); }
 
     iterator& operator++() {
@@ -1048,15 +1058,27 @@ class Map {
   size_type size() const { return elements_->size(); }
   bool empty() const { return size() == 0; }
 
-  // Element access
-  T& operator[](const key_type& key) {
-    value_type** value =  &(*elements_)[key];
-    if (*value == NULL) {
-      *value = CreateValueTypeInternal(key);
-      internal::MapValueInitializer<is_proto_enum<T>::value, T>::Initialize(
-          (*value)->second, default_enum_value_);
+  // Makes room for n elements in total, so that inserting up to n - size()
+  // new keys doesn't rehash the map, and, without an arena, allocates their
+  // memory in one go.  Like for std::unordered_map, this never shrinks the
+  // map.
+  void reserve(size_type n) {
+    elements_->reserve(n);
+    if (arena_ == NULL && n > size()) {
+      elements_->node_pool()->Reserve(n - size());
     }
-    return (*value)->second;
+  }
+
+  // Element access
+  //
+  // The lookup functions of Map<std::string, T> (operator[], at(), count()
+  // and find()) also take a StringPiece, a const char*, or anything else
+  // convertible to StringPiece, and then don't construct a temporary
+  // std::string.  operator[] only builds a string when it inserts the key.
+  T& operator[](const key_type& key) { return InsertOrLookup(key); }
+  template <typename K, typename = EnableIfLookupKey<K> >
+  T& operator[](const K& key) {
+    return InsertOrLookup(StringPiece(key));
   }
   const T& at(const key_type& key) const {
     const_iterator it = find(key);
@@ -1068,6 +1090,18 @@ class Map {
     GOOGLE_CHECK(it != end()) << "key not found: " << key;
     return it->second;
   }
+  template <typename K, typename = EnableIfLookupKey<K> >
+  const T& at(const K& key) const {
+    const_iterator it = find(key);
+    GOOGLE_CHECK(it != end()) << "key not found: " << StringPiece(key);
+    return it->second;
+  }
+  template <typename K, typename = EnableIfLookupKey<K> >
+  T& at(const K& key) {
+    iterator it = find(key);
+    GOOGLE_CHECK(it != end()) << "key not found: " << StringPiece(key);
+    return it->second;
+  }
 
   // Lookup
   size_type count(const key_type& key) const {
@@ -1075,10 +1109,22 @@ class Map {
     GOOGLE_DCHECK(it == end() || key == it->first);
     return it == end() ? 0 : 1;
   }
+  template <typename K, typename = EnableIfLookupKey<K> >
+  size_type count(const K& key) const {
+    return find(key) == end() ? 0 : 1;
+  }
   const_iterator find(const key_type& key) const {
     return const_iterator(iterator(elements_->find(key)));
   }
   iterator find(const key_type& key) { return iterator(elements_->find(key)); }
+  template <typename K, typename = EnableIfLookupKey<K> >
+  const_iterator find(const K& key) const {
+    return const_iterator(iterator(elements_->find(StringPiece(key))));
+  }
+  template <typename K, typename = EnableIfLookupKey<K> >
+  iterator find(const K& key) {
+    return iterator(elements_->find(StringPiece(key)));
+  }
   std::pair<const_iterator, const_iterator> equal_range(
       const key_type& key) const {
     const_iterator it = find(key);
@@ -1101,12 +1147,12 @@ class Map {
 
   // insert
   std::pair<iterator, bool> insert(const value_type& value) {
-    std::pair<typename InnerMap::iterator, bool> p =
-        elements_->insert(value.first);
+    std::pair<size_type, bool> p = elements_->insert(value.first);
     if (p.second) {
-      p.first->value() = CreateValueTypeInternal(value);
+      elements_->value_at(p.first) = CreateValueTypeInternal(value);
     }
-    return std::pair<iterator, bool>(iterator(p.first), p.second);
+    return std::pair<iterator, bool>(iterator(elements_->iterator_at(p.first)),
+                                     p.second);
   }
   template <class InputIt>
   void insert(InputIt first, InputIt last) {
@@ -1132,9 +1178,11 @@ class Map {
     }
   }
   iterator erase(iterator pos) {
-    if (arena_ == NULL) delete pos.operator->();
+    value_type* value = pos.operator->();
     iterator i = pos++;
+    // The element is still needed to find its slot.
     elements_->erase(i.it_);
+    if (arena_ == NULL) DestroyValueTypeInternal(value);
     return pos;
   }
   void erase(iterator first, iterator last) {
@@ -1142,7 +1190,14 @@ class Map {
       first = erase(first);
     }
   }
-  void clear() { erase(begin(), end()); }
+  void clear() {
+    if (arena_ == NULL) {
+      for (iterator it = begin(); it != end(); ++it) {
+        DestroyValueTypeInternal(it.operator->());
+      }
+    }
+    elements_->clear();
+  }
 
   // Assign
   Map& operator=(const Map& other) {
@@ -1177,9 +1232,26 @@ class Map {
     default_enum_value_ = default_enum_value;
   }
 
+  // Returns the value of key, inserting it first if needed.  K is key_type
+  // or StringPiece.
+  template <typename K>
+  T& InsertOrLookup(const K& key) {
+    std::pair<size_type, bool> p = elements_->insert(key);
+    value_type*& value = elements_->value_at(p.first);
+    if (p.second) {
+      value = CreateValueTypeInternal(StoredKey(key));
+      internal::MapValueInitializer<is_proto_enum<T>::value, T>::Initialize(
+          value->second, default_enum_value_);
+    }
+    return value->second;
+  }
+
+  static const Key& StoredKey(const Key& key) { return key; }
+  static std::string StoredKey(StringPiece key) { return key.ToString(); }
+
   value_type* CreateValueTypeInternal(const Key& key) {
     if (arena_ == NULL) {
-      return new value_type(key);
+      return new (elements_->node_pool()->Allocate()) value_type(key);
     } else {
       value_type* value = reinterpret_cast<value_type*>(
           Arena::CreateArray<uint8>(arena_, sizeof(value_type)));
@@ -1192,7 +1264,7 @@ class Map {
 
   value_type* CreateValueTypeInternal(const value_type& value) {
     if (arena_ == NULL) {
-      return new value_type(value);
+      return new (elements_->node_pool()->Allocate()) value_type(value);
     } else {
       value_type* p = reinterpret_cast<value_type*>(
           Arena::CreateArray<uint8>(arena_, sizeof(value_type)));
@@ -1204,6 +1276,18 @@ class Map {
     }
   }
 
+  // Like reserve(), for the parser, which only knows how many entries
+  // follow: some of them may have the same key.  The table only keeps room
+  // for n elements until the next erase() or clear(), and no nodes are
+  // allocated up front.
+  void ReserveHint(size_type n) { elements_->reserve_hint(n); }
+
+  // Only for maps without an arena.
+  void DestroyValueTypeInternal(value_type* value) {
+    value->~value_type();
+    elements_->node_pool()->Free(value);
+  }
+
   Arena* arena_;
   int default_enum_value_;
   InnerMap* elements_;
@@ -1216,6 +1300,11 @@ class Map {
             internal::WireFormatLite::FieldType value_wire_type,
             int default_enum_value>
   friend class internal::MapFieldLite;
+  template <typename Derived, typename Base, typename K, typename V,
+            internal::WireFormatLite::FieldType kKeyFieldType,
+            internal::WireFormatLite::FieldType kValueFieldType,
+            int default_enum_value>
+  friend class internal::MapEntryImpl;
 };
 
 }  // namespace protobuf
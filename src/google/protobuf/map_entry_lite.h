@@ -32,6 +32,7 @@
 #define GOOGLE_PROTOBUF_MAP_ENTRY_LITE_H__
 
 #include <assert.h>
+#include <algorithm>
 #include <string>
 
 #include <google/protobuf/stubs/casts.h>
@@ -421,6 +422,21 @@ class MapEntryImpl : public Base {
     }
 #endif
 
+    // Called right after the tag of an entry is read.  While the map is
+    // still empty, reserves room in it for the run of entries that starts
+    // with this one, so that parsing a large map doesn't rehash it over and
+    // over.  Entries may repeat keys, so the count is only a hint.
+    void ReserveForEntries(io::CodedInputStream* input, uint32 tag) {
+      if (map_->empty()) {
+        int count = WireFormatLite::CountLengthDelimitedRun(input, tag);
+        // Every entry after this one takes at least a tag byte and a length
+        // byte.
+        const int remaining = input->BytesUntilLimit();
+        if (remaining >= 0) count = std::min(count, remaining / 2 + 1);
+        map_->ReserveHint(count);
+      }
+    }
+
     MapEntryImpl* NewEntry() { return entry_ = mf_->NewEntry(); }
 
     const Key& key() const { return key_; }
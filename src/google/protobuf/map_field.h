@@ -408,9 +408,11 @@ class PROTOBUF_EXPORT MapKey {
     SetType(FieldDescriptor::CPPTYPE_BOOL);
     val_.bool_value_ = value;
   }
-  void SetStringValue(const std::string& val) {
+  // Copies val into the string of this key.  A MapKey that is reused for
+  // many lookups keeps its buffer, so only the first copy may allocate.
+  void SetStringValue(StringPiece val) {
     SetType(FieldDescriptor::CPPTYPE_STRING);
-    *val_.string_value_ = val;
+    val_.string_value_->assign(val.data(), val.size());
   }
 
   int64 GetInt64Value() const {
@@ -563,6 +565,36 @@ class PROTOBUF_EXPORT MapKey {
   int type_;
 };
 
+namespace internal {
+
+// Hashes MapKeys as Map hashes keys of their type, so that string keys of
+// dynamic messages are as hard to make collide as those of generated ones.
+template <>
+struct MapKeyHasher<MapKey> {
+  static uint64 Hash(uint64 seed, const MapKey& map_key) {
+    switch (map_key.type()) {
+      case FieldDescriptor::CPPTYPE_STRING:
+        return MapKeyHasher<std::string>::Hash(seed,
+                                               map_key.GetStringValue());
+      case FieldDescriptor::CPPTYPE_INT64:
+        return MapKeyHasher<int64>::Hash(seed, map_key.GetInt64Value());
+      case FieldDescriptor::CPPTYPE_INT32:
+        return MapKeyHasher<int32>::Hash(seed, map_key.GetInt32Value());
+      case FieldDescriptor::CPPTYPE_UINT64:
+        return MapKeyHasher<uint64>::Hash(seed, map_key.GetUInt64Value());
+      case FieldDescriptor::CPPTYPE_UINT32:
+        return MapKeyHasher<uint32>::Hash(seed, map_key.GetUInt32Value());
+      case FieldDescriptor::CPPTYPE_BOOL:
+        return MapKeyHasher<bool>::Hash(seed, map_key.GetBoolValue());
+      default:
+        GOOGLE_LOG(FATAL) << "Unsupported";
+        return 0;
+    }
+  }
+};
+
+}  // namespace internal
+
 // MapValueRef points to a map value.
 class PROTOBUF_EXPORT MapValueRef {
  public:
@@ -45,9 +45,18 @@
 namespace google {
 namespace protobuf {
 namespace internal {
-// UnwrapMapKey template
+// UnwrapMapKey template.  Strings are returned by reference, so that looking
+// up a string key through reflection does not copy it.
+template <typename T>
+struct UnwrappedMapKey {
+  typedef T type;
+};
+template <>
+struct UnwrappedMapKey<std::string> {
+  typedef const std::string& type;
+};
 template<typename T>
-T UnwrapMapKey(const MapKey& map_key);
+typename UnwrappedMapKey<T>::type UnwrapMapKey(const MapKey& map_key);
 template<>
 inline int32 UnwrapMapKey<int32>(const MapKey& map_key) {
   return map_key.GetInt32Value();
@@ -69,7 +78,7 @@ inline bool UnwrapMapKey<bool>(const MapKey& map_key) {
   return map_key.GetBoolValue();
 }
 template<>
-inline std::string UnwrapMapKey<std::string>(const MapKey& map_key) {
+inline const std::string& UnwrapMapKey<std::string>(const MapKey& map_key) {
   return map_key.GetStringValue();
 }
 
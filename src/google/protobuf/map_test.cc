@@ -244,6 +244,42 @@ TEST_F(MapImplTest, MapKeyAssignment) {
   EXPECT_EQ("abc", to.GetStringValue());
 }
 
+TEST_F(MapImplTest, MapKeyStringPiece) {
+  MapKey key;
+  key.SetStringValue(StringPiece("abcdef", 3));
+  EXPECT_EQ("abc", key.GetStringValue());
+  key.SetStringValue(string("x\0y", 3));
+  EXPECT_EQ(string("x\0y", 3), key.GetStringValue());
+}
+
+TEST_F(MapImplTest, StringPieceLookup) {
+  Map<string, int32> map;
+  const string long_key(100, 'a');
+  map["abc"] = 1;
+  map[long_key] = 2;
+  map[string("a\0b", 3)] = 3;
+
+  EXPECT_EQ(1, map.count(StringPiece("abc")));
+  EXPECT_EQ(1, map.count("abc"));
+  EXPECT_EQ(0, map.count(StringPiece("abcd", 2)));
+  EXPECT_EQ(1, map.at(StringPiece("abcd", 3)));
+  EXPECT_EQ(2, map.find(StringPiece(long_key))->second);
+  EXPECT_EQ(3, map.find(StringPiece("a\0b", 3))->second);
+  EXPECT_TRUE(map.find(StringPiece("a\0c", 3)) == map.end());
+  EXPECT_TRUE(map.find(StringPiece("a")) == map.end());
+
+  const Map<string, int32>& const_map = map;
+  EXPECT_EQ(2, const_map.at(StringPiece(long_key)));
+  EXPECT_EQ(1, const_map.find("abc")->second);
+
+  // operator[] only copies the key when it inserts it.
+  map[StringPiece("abc")] = 4;
+  map[StringPiece("xyz")] = 5;
+  EXPECT_EQ(4, map.size());
+  EXPECT_EQ(4, map["abc"]);
+  EXPECT_EQ(5, map["xyz"]);
+}
+
 TEST_F(MapImplTest, CountNonExist) {
   EXPECT_EQ(0, map_.count(0));
 }
@@ -408,6 +444,93 @@ TEST_F(MapImplTest, HashFlood) {
   EXPECT_LE(x1, x0 * 20);
 }
 
+// A string key that counts how often it is compared.  Its hasher is
+// hash<std::string>, but Map hashes it like a std::string key.
+struct CountingStringKey {
+  CountingStringKey() {}
+  explicit CountingStringKey(const std::string& v) : value(v) {}
+  bool operator==(const CountingStringKey& other) const {
+    ++comparisons;
+    return value == other.value;
+  }
+
+  std::string value;
+  static int comparisons;
+};
+int CountingStringKey::comparisons = 0;
+
+template <>
+struct MapKeyHasher<CountingStringKey> {
+  static uint64 Hash(uint64 seed, const CountingStringKey& k) {
+    return MapKeyHasher<std::string>::Hash(seed, k.value);
+  }
+};
+
+}  // namespace internal
+
+template <>
+struct hash<internal::CountingStringKey> {
+  size_t operator()(const internal::CountingStringKey& k) const {
+    return hash<std::string>()(k.value);
+  }
+};
+
+namespace internal {
+
+// Returns 2^n distinct strings with the same hash<std::string>: "af" and
+// "ba" hash the same, and so does any concatenation of n of them.
+std::vector<std::string> CollidingStrings(int n) {
+  std::vector<std::string> keys(1);
+  for (int i = 0; i < n; ++i) {
+    std::vector<std::string> longer;
+    for (int j = 0; j < keys.size(); ++j) {
+      longer.push_back(keys[j] + "af");
+      longer.push_back(keys[j] + "ba");
+    }
+    keys.swap(longer);
+  }
+  return keys;
+}
+
+TEST(MapHashTest, StringHashesDontCollideWithHashOfString) {
+  const std::vector<std::string> keys = CollidingStrings(10);
+  std::set<uint64> hashes;
+  MapKey map_key;
+  for (int i = 0; i < keys.size(); ++i) {
+    ASSERT_EQ(hash<std::string>()(keys[0]), hash<std::string>()(keys[i]));
+    const uint64 h = MapKeyHasher<std::string>::Hash(42, keys[i]);
+    hashes.insert(h);
+    // Lookups by StringPiece and dynamic map keys hash the same.
+    EXPECT_EQ(h, MapKeyHasher<StringPiece>::Hash(42, keys[i]));
+    map_key.SetStringValue(keys[i]);
+    EXPECT_EQ(h, MapKeyHasher<MapKey>::Hash(42, map_key));
+  }
+  EXPECT_EQ(keys.size(), hashes.size());
+  // The seed changes the hash.
+  EXPECT_NE(MapKeyHasher<std::string>::Hash(42, keys[0]),
+            MapKeyHasher<std::string>::Hash(43, keys[0]));
+}
+
+TEST(MapHashTest, CollidingStringKeysAreComparedAboutOnce) {
+  const std::vector<std::string> keys = CollidingStrings(12);
+  Map<CountingStringKey, int> map;
+  CountingStringKey::comparisons = 0;
+  for (int i = 0; i < keys.size(); ++i) {
+    map[CountingStringKey(keys[i])] = i;
+  }
+  for (int i = 0; i < keys.size(); ++i) {
+    Map<CountingStringKey, int>::const_iterator it =
+        map.find(CountingStringKey(keys[i]));
+    ASSERT_TRUE(it != map.end());
+    EXPECT_EQ(i, it->second);
+  }
+  EXPECT_EQ(keys.size(), map.size());
+  // Every lookup compares the key it finds, and rarely another one whose
+  // 7 bits of hash in the control byte are the same.  If the keys shared a
+  // probe sequence, each operation would compare half of them on average.
+  EXPECT_LT(CountingStringKey::comparisons, 2 * static_cast<int>(keys.size()));
+}
+
 TEST_F(MapImplTest, CopyIteratorStressTest) {
   std::vector<Map<int32, int32>::iterator> v;
   const int kIters = 1e5;
@@ -846,6 +969,54 @@ TEST_F(MapImplTest, IterConstructor) {
   EXPECT_EQ(value2, new_map.at(key2));
 }
 
+TEST_F(MapImplTest, Reserve) {
+  map_.reserve(1000);
+  for (int i = 0; i < 1000; i++) {
+    map_[i] = i + 1;
+  }
+  // Reserving less than the size does nothing.
+  map_.reserve(10);
+  EXPECT_EQ(1000, map_.size());
+  for (int i = 0; i < 1000; i += 2) {
+    map_.erase(i);
+  }
+  map_.reserve(2000);
+  for (int i = 0; i < 1000; i++) {
+    if (i % 2 == 0) {
+      EXPECT_TRUE(map_.find(i) == map_.end());
+    } else {
+      EXPECT_EQ(i + 1, map_.at(i));
+    }
+  }
+
+  Arena arena;
+  Map<int32, string> arena_map(&arena);
+  arena_map.reserve(100);
+  for (int i = 0; i < 100; i++) {
+    arena_map[i] = SimpleItoa(i);
+  }
+  EXPECT_EQ(100, arena_map.size());
+  EXPECT_EQ("42", arena_map.at(42));
+}
+
+TEST_F(MapImplTest, ReuseErasedNodes) {
+  // Without an arena, erased elements leave their memory to new ones.
+  Map<int32, string> map;
+  std::set<const void*> addresses;
+  for (int i = 0; i < 100; i++) {
+    map[i] = SimpleItoa(i);
+    addresses.insert(&map[i]);
+  }
+  map.clear();
+  for (int i = 100; i < 200; i++) {
+    map[i] = SimpleItoa(i);
+    EXPECT_TRUE(addresses.count(&map[i]) > 0);
+  }
+  for (int i = 100; i < 200; i++) {
+    EXPECT_EQ(SimpleItoa(i), map.at(i));
+  }
+}
+
 TEST_F(MapImplTest, Assigner) {
   int32 key1 = 0;
   int32 key2 = 1;
@@ -895,6 +1066,48 @@ TEST_F(MapImplTest, Rehash) {
   EXPECT_TRUE(map_.empty());
 }
 
+// Inserting and erasing without growing leaves many deleted slots behind,
+// which must be reused or rehashed away.
+TEST_F(MapImplTest, InsertEraseChurn) {
+  const int kWindow = 10;
+  for (int i = 0; i < 100000; i++) {
+    map_[i] = i;
+    if (i >= kWindow) {
+      EXPECT_EQ(1, map_.erase(i - kWindow));
+    }
+  }
+  EXPECT_EQ(kWindow, map_.size());
+  for (int i = 100000 - kWindow; i < 100000; i++) {
+    EXPECT_EQ(i, map_.at(i));
+  }
+}
+
+TEST_F(MapImplTest, RandomizedAgainstStdMap) {
+  Map<string, int> map;
+  std::map<string, int> reference_map;
+  uint32 frog = 123987;
+  for (int i = 0; i < 20000; i++) {
+    frog *= static_cast<uint32>(k0);
+    frog ^= frog >> 17;
+    const string key = StringPrintf("key%u", frog % 500);
+    switch (frog % 4) {
+      case 0:
+      case 1:
+        map[key] = i;
+        reference_map[key] = i;
+        break;
+      case 2:
+        EXPECT_EQ(reference_map.erase(key), map.erase(key));
+        break;
+      case 3:
+        EXPECT_EQ(reference_map.count(key), map.count(key));
+        break;
+    }
+    ASSERT_EQ(reference_map.size(), map.size());
+  }
+  EXPECT_EQ(reference_map, (std::map<string, int>(map.begin(), map.end())));
+}
+
 TEST_F(MapImplTest, EqualRange) {
   int key = 100, key_missing = 101;
   map_[key] = 100;
@@ -2145,6 +2358,63 @@ TEST(GeneratedMapFieldTest, SerializationToStream) {
   MapTestUtil::ExpectMapFieldsSet(message2);
 }
 
+TEST(GeneratedMapFieldTest, LargeMapWireFormat) {
+  // The parser reserves room for the entries it finds in its buffer, which
+  // must not change the result however the input is split.
+  unittest::TestMap message1;
+  for (int i = 0; i < 1000; i++) {
+    (*message1.mutable_map_int32_int32())[i] = -i;
+    (*message1.mutable_map_string_string())[SimpleItoa(i)] = SimpleItoa(-i);
+  }
+  string data = message1.SerializeAsString();
+
+  for (int block_size : {1, 7, 64, static_cast<int>(data.size())}) {
+    SCOPED_TRACE(block_size);
+    unittest::TestMap message2;
+    (*message2.mutable_map_int32_int32())[5000] = 1;
+    io::ArrayInputStream raw_input(data.data(), data.size(), block_size);
+    io::CodedInputStream input(&raw_input);
+    EXPECT_TRUE(message2.MergePartialFromCodedStream(&input));
+    EXPECT_EQ(1001, message2.map_int32_int32().size());
+    EXPECT_EQ(1000, message2.map_string_string().size());
+    for (int i = 0; i < 1000; i++) {
+      EXPECT_EQ(-i, message2.map_int32_int32().at(i));
+      EXPECT_EQ(SimpleItoa(-i), message2.map_string_string().at(SimpleItoa(i)));
+    }
+  }
+}
+
+TEST(GeneratedMapFieldTest, DuplicateKeysWireFormat) {
+  // The parser's reservation counts entries, not keys, so it only holds
+  // until the map is modified otherwise.
+  string data;
+  for (int i = 0; i < 1000; i++) {
+    unittest::TestMap entry;
+    (*entry.mutable_map_int32_int32())[i % 3] = i;
+    data += entry.SerializeAsString();
+  }
+
+  unittest::TestMap message;
+  ASSERT_TRUE(message.ParseFromString(data));
+  Map<int32, int32>* map = message.mutable_map_int32_int32();
+  EXPECT_EQ(3, map->size());
+  EXPECT_EQ(999, map->at(0));
+  EXPECT_EQ(997, map->at(1));
+  EXPECT_EQ(998, map->at(2));
+
+  map->erase(0);
+  map->clear();
+  for (int i = 0; i < 10; i++) {
+    (*map)[i] = i;
+  }
+  EXPECT_EQ(10, map->size());
+  io::CodedInputStream input(reinterpret_cast<const uint8*>(data.data()),
+                             data.size());
+  ASSERT_TRUE(message.MergeFromCodedStream(&input));
+  EXPECT_EQ(10, map->size());
+  EXPECT_EQ(999, map->at(0));
+  EXPECT_EQ(9, map->at(9));
+}
 
 TEST(GeneratedMapFieldTest, SameTypeMaps) {
   const Descriptor* map1 = unittest::TestSameTypeMap::descriptor()
@@ -162,6 +162,12 @@ class MapReflectionFriend;     // scalar_map_container.h
 namespace expr {
 class CelMapReflectionFriend;  // field_backed_map_impl.cc
 }
+namespace util {
+namespace converter {
+class ReflectionObjectSource;  // reflection_objectsource.h
+class ReflectionObjectWriter;  // reflection_objectwriter.h
+}
+}
 
 namespace internal {
 class MapFieldPrinterHelper;   // text_format.cc
@@ -991,6 +997,9 @@ class PROTOBUF_EXPORT Reflection {
   // Needed for implementing text format for map.
   friend class internal::MapFieldPrinterHelper;
   friend class internal::ReflectionAccessor;
+  // Needed for converting maps to and from JSON.
+  friend class util::converter::ReflectionObjectSource;
+  friend class util::converter::ReflectionObjectWriter;
 
   // Special version for specialized implementations of string.  We can't call
   // MutableRawRepeatedField directly here because we don't have access to
@@ -370,6 +370,7 @@ bool Struct::MergePartialFromCodedStream(
               ::google::protobuf::internal::WireFormatLite::TYPE_MESSAGE,
               0 >,
             ::google::protobuf::Map< ::std::string, ::google::protobuf::Value > > parser(&fields_);
+          parser.ReserveForEntries(input, 10u);
           DO_(::google::protobuf::internal::WireFormatLite::ReadMessageNoVirtual(
               input, &parser));
           DO_(::google::protobuf::internal::WireFormatLite::VerifyUtf8String(
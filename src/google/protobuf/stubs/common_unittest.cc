@@ -30,11 +30,14 @@
 
 // Author: kenton@google.com (Kenton Varda)
 
+#include <atomic>
+#include <thread>
 #include <vector>
 #include <google/protobuf/stubs/callback.h>
 #include <google/protobuf/stubs/casts.h>
 #include <google/protobuf/stubs/common.h>
 #include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/stubs/mutex.h>
 #include <google/protobuf/stubs/strutil.h>
 #include <google/protobuf/stubs/substitute.h>
 
@@ -353,6 +356,61 @@ TEST_F(ClosureTest, TestPermanentClosureDeleteInCallback) {
   permanent_closure_->Run();
 }
 
+#ifndef _WIN32
+TEST(MutexTest, ReadersShareTheLock) {
+  // Every reader waits inside its ReaderMutexLock until all of the others
+  // have entered theirs, which can only finish if the lock is shared.
+  const int kNumReaders = 4;
+  Mutex mu;
+  std::atomic<int> inside(0);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < kNumReaders; i++) {
+    readers.emplace_back([&] {
+      ReaderMutexLock lock(&mu);
+      inside++;
+      while (inside.load() < kNumReaders) std::this_thread::yield();
+    });
+  }
+  for (auto& reader : readers) reader.join();
+  EXPECT_EQ(kNumReaders, inside.load());
+}
+#endif  // !_WIN32
+
+TEST(MutexTest, WriterExcludesReaders) {
+  // The writer keeps the two counters equal only while it holds the lock;
+  // a reader that could overlap it would see them differ.
+  const int kNumReaders = 4;
+  const int kNumWrites = 10000;
+  Mutex mu;
+  int a = 0;
+  int b = 0;
+  std::atomic<bool> done(false);
+  std::atomic<int> mismatches(0);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < kNumReaders; i++) {
+    readers.emplace_back([&] {
+      while (!done.load()) {
+        ReaderMutexLock lock(&mu);
+        if (a != b) mismatches++;
+      }
+    });
+  }
+  std::thread writer([&] {
+    for (int i = 0; i < kNumWrites; i++) {
+      WriterMutexLock lock(&mu);
+      a++;
+      std::this_thread::yield();
+      b++;
+    }
+    done = true;
+  });
+  writer.join();
+  for (auto& reader : readers) reader.join();
+  EXPECT_EQ(0, mismatches.load());
+  EXPECT_EQ(kNumWrites, a);
+  EXPECT_EQ(kNumWrites, b);
+}
+
 }  // anonymous namespace
 }  // namespace protobuf
 }  // namespace google
@@ -0,0 +1,80 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// Conversions between binary floating point and the shortest decimal text,
+// without going through the C library.  The printing side follows Ryu (Ulf
+// Adams, "Ryū: fast float-to-string conversion", PLDI 2018) and the parsing
+// side the Eisel-Lemire algorithm (Daniel Lemire, "Number Parsing at a
+// Gigabyte per Second", 2021).  Both only handle the common cases; callers
+// fall back to snprintf() and strtod() for the rest.
+
+#ifndef GOOGLE_PROTOBUF_STUBS_FLOAT_CONVERSION_H__
+#define GOOGLE_PROTOBUF_STUBS_FLOAT_CONVERSION_H__
+
+#include <google/protobuf/stubs/common.h>
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace internal {
+
+// Finds the shortest decimal that parses back to 'value', and stores it as
+// *digits * 10^*exponent, where *digits has no trailing zeros.  If several
+// decimals of that length round-trip, the one closest to 'value' is chosen.
+// 'value' must be finite and nonzero; its sign is ignored.
+PROTOBUF_EXPORT void ShortestDecimal(double value, uint64* digits,
+                                     int* exponent);
+PROTOBUF_EXPORT void ShortestDecimal(float value, uint32* digits,
+                                     int* exponent);
+
+// Parses the longest prefix of the NUL-terminated 'text' that has the form
+//   [+-]digits[.digits][(e|E)[+-]digits]
+// where the bracketed parts are optional, and the digits before or after the
+// point may be omitted, but not both.
+// Stores the nearest double in *value, as strtod() would in the C locale,
+// and returns the end of the prefix.
+//
+// Returns nullptr if 'text' does not start with such a number (strtod() also
+// accepts leading spaces, hexadecimal numbers, "inf" and "nan"), or if the
+// number has more than 19 significant digits, or if its value is subnormal
+// or out of range, so that strtod() would set errno.  The caller should use
+// strtod() in all these cases.
+PROTOBUF_EXPORT const char* ParseDecimalDouble(const char* text,
+                                               double* value);
+
+}  // namespace internal
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_STUBS_FLOAT_CONVERSION_H__
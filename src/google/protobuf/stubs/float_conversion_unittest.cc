@@ -0,0 +1,206 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <google/protobuf/stubs/float_conversion.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits>
+#include <string>
+
+#include <google/protobuf/stubs/strutil.h>
+#include <gtest/gtest.h>
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace internal {
+namespace {
+
+string Shortest(double value) {
+  uint64 digits;
+  int exponent;
+  ShortestDecimal(value, &digits, &exponent);
+  return SimpleItoa(digits) + "e" + SimpleItoa(exponent);
+}
+
+string Shortest(float value) {
+  uint32 digits;
+  int exponent;
+  ShortestDecimal(value, &digits, &exponent);
+  return SimpleItoa(digits) + "e" + SimpleItoa(exponent);
+}
+
+// Returns the next value of a simple linear congruential generator.
+uint64 NextRandom(uint64* state) {
+  *state = *state * PROTOBUF_ULONGLONG(6364136223846793005) +
+           PROTOBUF_ULONGLONG(1442695040888963407);
+  return *state;
+}
+
+TEST(FloatConversionTest, ShortestDouble) {
+  EXPECT_EQ("1e0", Shortest(1.0));
+  EXPECT_EQ("1e-1", Shortest(0.1));
+  EXPECT_EQ("15e-1", Shortest(-1.5));
+  EXPECT_EQ("1e23", Shortest(1e23));
+  EXPECT_EQ("30000000000000004e-17", Shortest(0.1 + 0.2));
+  EXPECT_EQ("9007199254740992e0", Shortest(9007199254740992.0));
+  EXPECT_EQ("17976931348623157e292",
+            Shortest(std::numeric_limits<double>::max()));
+  EXPECT_EQ("22250738585072014e-324",
+            Shortest(std::numeric_limits<double>::min()));
+  EXPECT_EQ("5e-324", Shortest(std::numeric_limits<double>::denorm_min()));
+  // Powers of two have a narrower interval below them; the closest 16-digit
+  // decimal, 6.156563468186637e+113, does not round-trip.
+  EXPECT_EQ("6156563468186638e98", Shortest(6.156563468186638e+113));
+}
+
+TEST(FloatConversionTest, ShortestFloat) {
+  EXPECT_EQ("1e0", Shortest(1.0f));
+  EXPECT_EQ("1e-1", Shortest(0.1f));
+  EXPECT_EQ("33333334e-8", Shortest(1.0f / 3));
+  EXPECT_EQ("16777216e0", Shortest(16777216.0f));
+  EXPECT_EQ("34028235e31", Shortest(std::numeric_limits<float>::max()));
+  EXPECT_EQ("11754944e-45", Shortest(std::numeric_limits<float>::min()));
+  EXPECT_EQ("1e-45", Shortest(std::numeric_limits<float>::denorm_min()));
+}
+
+TEST(FloatConversionTest, ShortestRoundTrips) {
+  uint64 state = 0;
+  for (int i = 0; i < 100000; i++) {
+    uint64 bits = NextRandom(&state);
+    // Every other value is subnormal.
+    if (i % 2 == 1) bits &= PROTOBUF_ULONGLONG(0x800fffffffffffff);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    if (value != value || value == 0 ||
+        value == std::numeric_limits<double>::infinity() ||
+        value == -std::numeric_limits<double>::infinity()) {
+      continue;
+    }
+    uint64 digits;
+    int exponent;
+    ShortestDecimal(value, &digits, &exponent);
+    EXPECT_NE(0, digits % 10);
+    double parsed = strtod(Shortest(value).c_str(), nullptr);
+    EXPECT_EQ(value < 0 ? -value : value, parsed) << Shortest(value);
+  }
+}
+
+TEST(FloatConversionTest, ParseDecimalDouble) {
+  struct {
+    const char* text;
+    double value;
+    int length;
+  } kCases[] = {
+      {"0", 0.0, 1},
+      {"-0.0", -0.0, 4},
+      {"1.5", 1.5, 3},
+      {"+1.5", 1.5, 4},
+      {"-.25", -0.25, 4},
+      {"5.", 5.0, 2},
+      {"1e10", 1e10, 4},
+      {"1E-10", 1e-10, 5},
+      {"2.5e+3", 2500.0, 6},
+      {"1e", 1.0, 1},
+      {"1e+", 1.0, 1},
+      {"3.0f", 3.0, 3},
+      {"12abc", 12.0, 2},
+      {"0.000001234", 1.234e-6, 11},
+      {"1234567890123456789000000000e-10", 123456789012345678.9, 32},
+      {"0e99999999999", 0.0, 13},
+      {"1.7976931348623157e308", std::numeric_limits<double>::max(), 22},
+      {"2.2250738585072014e-308", std::numeric_limits<double>::min(), 23},
+      // Halfway between 2^53 and 2^53 + 2; rounds to even.
+      {"9007199254740993", 9007199254740992.0, 16},
+      {"9007199254740995", 9007199254740996.0, 16},
+  };
+  for (int i = 0; i < GOOGLE_ARRAYSIZE(kCases); i++) {
+    SCOPED_TRACE(kCases[i].text);
+    double value = 42;
+    const char* end = ParseDecimalDouble(kCases[i].text, &value);
+    ASSERT_TRUE(end != nullptr);
+    EXPECT_EQ(kCases[i].length, end - kCases[i].text);
+    EXPECT_EQ(kCases[i].value, value);
+    EXPECT_EQ(kCases[i].value < 0 || (kCases[i].value == 0 &&
+                                      kCases[i].text[0] == '-'),
+              value < 0 || 1 / value < 0);
+  }
+}
+
+TEST(FloatConversionTest, ParseDecimalDoubleLeavesRestToStrtod) {
+  const char* kTexts[] = {
+      "",     " 1",     ".",      "-",     "e5",    "inf",
+      "nan",  "0x1p3",  "-0X10",  "1e400", "1e-400",
+      "5e-324",  // Subnormal.
+      "12345678901234567890123",  // More than 19 significant digits.
+  };
+  for (int i = 0; i < GOOGLE_ARRAYSIZE(kTexts); i++) {
+    double value;
+    EXPECT_TRUE(ParseDecimalDouble(kTexts[i], &value) == nullptr)
+        << kTexts[i];
+  }
+}
+
+TEST(FloatConversionTest, ParseDecimalDoubleMatchesStrtod) {
+  uint64 state = 0;
+  for (int i = 0; i < 100000; i++) {
+    string text;
+    if (NextRandom(&state) % 2 == 0) {
+      uint64 bits = NextRandom(&state);
+      double value;
+      memcpy(&value, &bits, sizeof(value));
+      if (value != value) continue;
+      text = SimpleDtoa(value);
+    } else {
+      int digits = NextRandom(&state) % 20 + 1;
+      for (int j = 0; j < digits; j++) {
+        text.push_back('0' + NextRandom(&state) % 10);
+      }
+      text.insert(NextRandom(&state) % (text.size() + 1), ".");
+      text += "e" + SimpleItoa(static_cast<int>(NextRandom(&state) % 700) -
+                               350);
+    }
+    double value;
+    const char* end = ParseDecimalDouble(text.c_str(), &value);
+    if (end == nullptr) continue;
+    char* expected_end;
+    double expected = strtod(text.c_str(), &expected_end);
+    EXPECT_EQ(expected_end, end) << text;
+    EXPECT_EQ(expected, value) << text;
+  }
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace protobuf
+}  // namespace google
@@ -31,6 +31,9 @@
 #define GOOGLE_PROTOBUF_STUBS_MUTEX_H_
 
 #include <mutex>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 #include <google/protobuf/stubs/macros.h>
 
@@ -41,9 +44,15 @@
   __attribute__((acquire_capability(__VA_ARGS__)))
 #define GOOGLE_PROTOBUF_RELEASE(...) \
   __attribute__((release_capability(__VA_ARGS__)))
+#define GOOGLE_PROTOBUF_ACQUIRE_SHARED(...) \
+  __attribute__((acquire_shared_capability(__VA_ARGS__)))
+#define GOOGLE_PROTOBUF_RELEASE_SHARED(...) \
+  __attribute__((release_shared_capability(__VA_ARGS__)))
 #else
 #define GOOGLE_PROTOBUF_ACQUIRE(...)
 #define GOOGLE_PROTOBUF_RELEASE(...)
+#define GOOGLE_PROTOBUF_ACQUIRE_SHARED(...)
+#define GOOGLE_PROTOBUF_RELEASE_SHARED(...)
 #endif
 
 #include <google/protobuf/port_def.inc>
@@ -59,17 +68,42 @@ namespace internal {
 // Mutex is a natural type to wrap. As both google and other organization have
 // specialized mutexes. gRPC also provides an injection mechanism for custom
 // mutexes.
+//
+// Where pthreads are available this is a reader/writer lock, so that holders
+// of a ReaderMutexLock do not serialize each other.  Elsewhere reader locks
+// are exclusive.
 class PROTOBUF_EXPORT WrappedMutex {
  public:
   WrappedMutex() = default;
+#ifndef _WIN32
+  // There is no destructor: the rwlock is never destroyed, so that static
+  // mutexes stay usable from the destructors of other statics at exit.
+  void Lock() GOOGLE_PROTOBUF_ACQUIRE() { pthread_rwlock_wrlock(&mu_); }
+  void Unlock() GOOGLE_PROTOBUF_RELEASE() { pthread_rwlock_unlock(&mu_); }
+  void ReaderLock() GOOGLE_PROTOBUF_ACQUIRE_SHARED() {
+    pthread_rwlock_rdlock(&mu_);
+  }
+  void ReaderUnlock() GOOGLE_PROTOBUF_RELEASE_SHARED() {
+    pthread_rwlock_unlock(&mu_);
+  }
+#else
   void Lock() GOOGLE_PROTOBUF_ACQUIRE() { mu_.lock(); }
   void Unlock() GOOGLE_PROTOBUF_RELEASE() { mu_.unlock(); }
+  void ReaderLock() GOOGLE_PROTOBUF_ACQUIRE_SHARED() { mu_.lock(); }
+  void ReaderUnlock() GOOGLE_PROTOBUF_RELEASE_SHARED() { mu_.unlock(); }
+#endif
   // Crash if this Mutex is not held exclusively by this thread.
   // May fail to crash when it should; will never crash when it should not.
   void AssertHeld() const {}
 
  private:
+#ifndef _WIN32
+  pthread_rwlock_t mu_ = PTHREAD_RWLOCK_INITIALIZER;
+#else
   std::mutex mu_;
+#endif
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(WrappedMutex);
 };
 
 using Mutex = WrappedMutex;
@@ -84,8 +118,17 @@ class PROTOBUF_EXPORT MutexLock {
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(MutexLock);
 };
 
-// TODO(kenton):  Implement these?  Hard to implement portably.
-typedef MutexLock ReaderMutexLock;
+// ReaderMutexLock(mu) acquires mu in shared mode when constructed and releases
+// it when destroyed.  Any number of ReaderMutexLocks may hold mu at once.
+class PROTOBUF_EXPORT ReaderMutexLock {
+ public:
+  explicit ReaderMutexLock(Mutex *mu) : mu_(mu) { this->mu_->ReaderLock(); }
+  ~ReaderMutexLock() { this->mu_->ReaderUnlock(); }
+ private:
+  Mutex *const mu_;
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ReaderMutexLock);
+};
+
 typedef MutexLock WriterMutexLock;
 
 // MutexLockMaybe is like MutexLock, but is a no-op when mu is nullptr.
@@ -142,6 +185,8 @@ using internal::MutexLockMaybe;
 
 #undef GOOGLE_PROTOBUF_ACQUIRE
 #undef GOOGLE_PROTOBUF_RELEASE
+#undef GOOGLE_PROTOBUF_ACQUIRE_SHARED
+#undef GOOGLE_PROTOBUF_RELEASE_SHARED
 
 #include <google/protobuf/port_undef.inc>
 
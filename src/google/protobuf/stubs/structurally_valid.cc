@@ -34,6 +34,10 @@
 
 #include <google/protobuf/stubs/stringpiece.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace google {
 namespace protobuf {
 namespace internal {
@@ -509,6 +513,14 @@ int UTF8GenericScanFastAscii(const UTF8ScanObj* st,
   int rest_consumed;
   int exit_reason;
   do {
+#if defined(__SSE2__)
+    // Skip ASCII 16 bytes at a time; movemask gathers the high bits.
+    while (srclimit - src >= 16 &&
+           _mm_movemask_epi8(_mm_loadu_si128(
+               reinterpret_cast<const __m128i*>(src))) == 0) {
+      src += 16;
+    }
+#endif
     // Check initial few bytes one at a time until 8-byte aligned
     while ((((uintptr_t)src & 0x07) != 0) &&
            (src < srclimit) && (src[0] < 0x80)) {
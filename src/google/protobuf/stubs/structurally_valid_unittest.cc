@@ -64,6 +64,21 @@ TEST(StructurallyValidTest, InvalidUTF8String) {
   }
 }
 
+TEST(StructurallyValidTest, LongStrings) {
+  // Covers multibyte characters at every offset in and around a block of 16
+  // bytes.
+  for (int i = 0; i < 40; ++i) {
+    string valid = string(i, 'a') + "\342\200\224" + string(40 - i, 'b');
+    EXPECT_TRUE(IsStructurallyValidUTF8(valid.data(), valid.size())) << i;
+    string invalid = string(i, 'a') + "\342\200" + string(40 - i, 'b');
+    EXPECT_FALSE(IsStructurallyValidUTF8(invalid.data(), invalid.size()))
+        << i;
+    string truncated = string(i, 'a') + "\342\200";
+    EXPECT_FALSE(IsStructurallyValidUTF8(truncated.data(), truncated.size()))
+        << i;
+  }
+}
+
 }  // namespace
 }  // namespace internal
 }  // namespace protobuf
@@ -40,6 +40,7 @@
 #include <iterator>
 #include <limits>
 
+#include <google/protobuf/stubs/float_conversion.h>
 #include <google/protobuf/stubs/logging.h>
 #include <google/protobuf/stubs/stl_util.h>
 
@@ -57,6 +58,8 @@
 #define snprintf _snprintf
 #endif
 
+#include <google/protobuf/port_def.inc>
+
 namespace google {
 namespace protobuf {
 
@@ -1187,30 +1190,15 @@ string SimpleItoa(unsigned long long i) {
 //    It turns out there is no precision value that does the right thing
 //    for all numbers.
 //
-//    Our strategy is to first try printing with a precision that is never
-//    over-precise, then parse the result with strtod() to see if it
-//    matches.  If not, we print again with a precision that will always
-//    give a precise result, but may use more digits than necessary.
-//
-//    An arguably better strategy would be to use the algorithm described
-//    in "How to Print Floating-Point Numbers Accurately" by Steele &
-//    White, e.g. as implemented by David M. Gay's dtoa().  It turns out,
-//    however, that the following implementation is about as fast as
-//    DMG's code.  Furthermore, DMG's code locks mutexes, which means it
-//    will not scale well on multi-core machines.  DMG's code is slightly
-//    more accurate (in that it will never use more digits than
-//    necessary), but this is probably irrelevant for most users.
-//
-//    Rob Pike and Ken Thompson also have an implementation of dtoa() in
-//    third_party/fmt/fltfmt.cc.  Their implementation is similar to this
-//    one in that it makes guesses and then uses strtod() to check them.
-//    Their implementation is faster because they use their own code to
-//    generate the digits in the first place rather than use snprintf(),
-//    thus avoiding format string parsing overhead.  However, this makes
-//    it considerably more complicated than the following implementation,
-//    and it is embedded in a larger library.  If speed turns out to be
-//    an issue, we could re-implement this in terms of their
-//    implementation.
+//    We find the shortest decimal that parses back to the same value with
+//    a Ryu-style digit generator (see stubs/float_conversion.h), which is
+//    exact and never needs to re-parse its output.  The digits are then
+//    laid out as printf("%.*g") does, using the same precisions as the
+//    earlier snprintf()-and-strtod() implementation: DBL_DIG (FLT_DIG) for
+//    values that need no more digits, and DBL_DIG + 2 (FLT_DIG + 3)
+//    otherwise.  Normal values that need at most DBL_DIG (FLT_DIG) digits
+//    are therefore printed exactly as before, while the others may now use
+//    fewer digits.
 // ----------------------------------------------------------------------
 
 string SimpleDtoa(double value) {
@@ -1223,37 +1211,56 @@ string SimpleFtoa(float value) {
   return FloatToBuffer(value, buffer);
 }
 
-static inline bool IsValidFloatChar(char c) {
-  return ('0' <= c && c <= '9') ||
-         c == 'e' || c == 'E' ||
-         c == '+' || c == '-';
-}
-
-void DelocalizeRadix(char* buffer) {
-  // Fast check:  if the buffer has a normal decimal point, assume no
-  // translation is needed.
-  if (strchr(buffer, '.') != nullptr) return;
-
-  // Find the first unknown character.
-  while (IsValidFloatChar(*buffer)) ++buffer;
-
-  if (*buffer == '\0') {
-    // No radix character found.
-    return;
-  }
-
-  // We are now pointing at the locale-specific radix character.  Replace it
-  // with '.'.
-  *buffer = '.';
-  ++buffer;
-
-  if (!IsValidFloatChar(*buffer) && *buffer != '\0') {
-    // It appears the radix was a multi-byte character.  We need to remove the
-    // extra bytes.
-    char* target = buffer;
-    do { ++buffer; } while (!IsValidFloatChar(*buffer) && *buffer != '\0');
-    memmove(target, buffer, strlen(buffer) + 1);
+// Writes digits * 10^exponent to buffer the way snprintf("%.*g") writes a
+// value with the same digits, given that digits has at most 'precision'
+// digits and no trailing zeros.
+static char* FormatGeneral(bool negative, uint64 digits, int exponent,
+                           int precision, char* buffer) {
+  char digit_buffer[kFastToBufferSize];
+  const int length =
+      FastUInt64ToBufferLeft(digits, digit_buffer) - digit_buffer;
+  // The exponent of the first digit, as printed by "%e".
+  int decimal_exponent = exponent + length - 1;
+
+  char* out = buffer;
+  if (negative) *out++ = '-';
+  if (decimal_exponent < -4 || decimal_exponent >= precision) {
+    *out++ = digit_buffer[0];
+    if (length > 1) {
+      *out++ = '.';
+      memcpy(out, digit_buffer + 1, length - 1);
+      out += length - 1;
+    }
+    *out++ = 'e';
+    if (decimal_exponent < 0) {
+      *out++ = '-';
+      decimal_exponent = -decimal_exponent;
+    } else {
+      *out++ = '+';
+    }
+    if (decimal_exponent < 10) *out++ = '0';
+    FastUInt32ToBufferLeft(decimal_exponent, out);
+  } else if (decimal_exponent < 0) {
+    *out++ = '0';
+    *out++ = '.';
+    memset(out, '0', -decimal_exponent - 1);
+    out += -decimal_exponent - 1;
+    memcpy(out, digit_buffer, length);
+    out[length] = '\0';
+  } else if (length <= decimal_exponent + 1) {
+    memcpy(out, digit_buffer, length);
+    out += length;
+    memset(out, '0', decimal_exponent + 1 - length);
+    out[decimal_exponent + 1 - length] = '\0';
+  } else {
+    memcpy(out, digit_buffer, decimal_exponent + 1);
+    out += decimal_exponent + 1;
+    *out++ = '.';
+    memcpy(out, digit_buffer + decimal_exponent + 1,
+           length - decimal_exponent - 1);
+    out[length - decimal_exponent - 1] = '\0';
   }
+  return buffer;
 }
 
 char* DoubleToBuffer(double value, char* buffer) {
@@ -1272,32 +1279,17 @@ char* DoubleToBuffer(double value, char* buffer) {
   } else if (std::isnan(value)) {
     strcpy(buffer, "nan");
     return buffer;
+  } else if (value == 0) {
+    strcpy(buffer, std::signbit(value) ? "-0" : "0");
+    return buffer;
   }
 
-  int snprintf_result =
-    snprintf(buffer, kDoubleToBufferSize, "%.*g", DBL_DIG, value);
-
-  // The snprintf should never overflow because the buffer is significantly
-  // larger than the precision we asked for.
-  GOOGLE_DCHECK(snprintf_result > 0 && snprintf_result < kDoubleToBufferSize);
-
-  // We need to make parsed_value volatile in order to force the compiler to
-  // write it out to the stack.  Otherwise, it may keep the value in a
-  // register, and if it does that, it may keep it as a long double instead
-  // of a double.  This long double may have extra bits that make it compare
-  // unequal to "value" even though it would be exactly equal if it were
-  // truncated to a double.
-  volatile double parsed_value = strtod(buffer, nullptr);
-  if (parsed_value != value) {
-    int snprintf_result =
-      snprintf(buffer, kDoubleToBufferSize, "%.*g", DBL_DIG+2, value);
-
-    // Should never overflow; see above.
-    GOOGLE_DCHECK(snprintf_result > 0 && snprintf_result < kDoubleToBufferSize);
-  }
-
-  DelocalizeRadix(buffer);
-  return buffer;
+  uint64 digits;
+  int exponent;
+  internal::ShortestDecimal(value, &digits, &exponent);
+  const int precision =
+      digits < PROTOBUF_ULONGLONG(1000000000000000) ? DBL_DIG : DBL_DIG + 2;
+  return FormatGeneral(value < 0, digits, exponent, precision, buffer);
 }
 
 static int memcasecmp(const char *s1, const char *s2, size_t len) {
@@ -1347,8 +1339,12 @@ bool safe_strtof(const char* str, float* value) {
 }
 
 bool safe_strtod(const char* str, double* value) {
-  char* endptr;
-  *value = strtod(str, &endptr);
+  const char* endptr = internal::ParseDecimalDouble(str, value);
+  if (endptr == nullptr) {
+    char* strtod_endptr;
+    *value = strtod(str, &strtod_endptr);
+    endptr = strtod_endptr;
+  }
   if (endptr != str) {
     while (ascii_isspace(*endptr)) ++endptr;
   }
@@ -1390,26 +1386,16 @@ char* FloatToBuffer(float value, char* buffer) {
   } else if (std::isnan(value)) {
     strcpy(buffer, "nan");
     return buffer;
+  } else if (value == 0) {
+    strcpy(buffer, std::signbit(value) ? "-0" : "0");
+    return buffer;
   }
 
-  int snprintf_result =
-    snprintf(buffer, kFloatToBufferSize, "%.*g", FLT_DIG, value);
-
-  // The snprintf should never overflow because the buffer is significantly
-  // larger than the precision we asked for.
-  GOOGLE_DCHECK(snprintf_result > 0 && snprintf_result < kFloatToBufferSize);
-
-  float parsed_value;
-  if (!safe_strtof(buffer, &parsed_value) || parsed_value != value) {
-    int snprintf_result =
-      snprintf(buffer, kFloatToBufferSize, "%.*g", FLT_DIG+3, value);
-
-    // Should never overflow; see above.
-    GOOGLE_DCHECK(snprintf_result > 0 && snprintf_result < kFloatToBufferSize);
-  }
-
-  DelocalizeRadix(buffer);
-  return buffer;
+  uint32 digits;
+  int exponent;
+  internal::ShortestDecimal(value, &digits, &exponent);
+  const int precision = digits < 1000000 ? FLT_DIG : FLT_DIG + 3;
+  return FormatGeneral(value < 0, digits, exponent, precision, buffer);
 }
 
 namespace strings {
@@ -33,11 +33,17 @@
 #include <google/protobuf/stubs/strutil.h>
 
 #include <locale.h>
+#include <string.h>
+#include <cmath>
+#include <limits>
 
+#include <google/protobuf/stubs/mathlimits.h>
 #include <google/protobuf/stubs/stl_util.h>
 #include <google/protobuf/testing/googletest.h>
 #include <gtest/gtest.h>
 
+#include <google/protobuf/port_def.inc>
+
 #ifdef _WIN32
 #define snprintf _snprintf
 #endif
@@ -74,6 +80,97 @@ TEST(StringUtilityTest, ImmuneToLocales) {
   setlocale(LC_NUMERIC, old_locale.c_str());
 }
 
+TEST(StringUtilityTest, SimpleDtoaMatchesPrintf) {
+  // Values that round-trip with DBL_DIG digits print as "%.15g" does.
+  const double kValues[] = {
+      1.5,     0.1,      -0.3,     100,       1e15,    1e-5,
+      0.0001,  1e100,    -1.5e-7,  123456789012345.0,   0.000123,
+      3.14159, 1e21,     2e-308,   12345.678};
+  for (int i = 0; i < GOOGLE_ARRAYSIZE(kValues); i++) {
+    char expected[kDoubleToBufferSize];
+    snprintf(expected, sizeof(expected), "%.15g", kValues[i]);
+    EXPECT_EQ(expected, SimpleDtoa(kValues[i]));
+  }
+
+  // Values that need more digits print as "%.17g" does, if they need all 17.
+  const double kLongValues[] = {0.1 + 0.2, 1.2345678901234568e+17,
+                                -2.2250738585072014e-308,
+                                std::numeric_limits<double>::max()};
+  for (int i = 0; i < GOOGLE_ARRAYSIZE(kLongValues); i++) {
+    char expected[kDoubleToBufferSize];
+    snprintf(expected, sizeof(expected), "%.17g", kLongValues[i]);
+    EXPECT_EQ(expected, SimpleDtoa(kLongValues[i]));
+  }
+}
+
+TEST(StringUtilityTest, SimpleDtoaIsShortest) {
+  // "%.17g" would print 6.1565634681866377e+113 and 0.33333333333333331.
+  EXPECT_EQ("6.156563468186638e+113", SimpleDtoa(6.156563468186638e+113));
+  EXPECT_EQ("0.3333333333333333", SimpleDtoa(1.0 / 3));
+  // Subnormals have fewer significant bits, so even "%.15g" may print more
+  // digits than needed: 4.94065645841247e-324.
+  EXPECT_EQ("5e-324", SimpleDtoa(std::numeric_limits<double>::denorm_min()));
+}
+
+TEST(StringUtilityTest, SimpleDtoaSpecialValues) {
+  EXPECT_EQ("0", SimpleDtoa(0.0));
+  EXPECT_EQ("-0", SimpleDtoa(-0.0));
+  EXPECT_EQ("inf", SimpleDtoa(std::numeric_limits<double>::infinity()));
+  EXPECT_EQ("-inf", SimpleDtoa(-std::numeric_limits<double>::infinity()));
+  EXPECT_EQ("nan", SimpleDtoa(std::numeric_limits<double>::quiet_NaN()));
+}
+
+TEST(StringUtilityTest, SimpleFtoa) {
+  EXPECT_EQ("0.1", SimpleFtoa(0.1f));
+  EXPECT_EQ("-1.5e-07", SimpleFtoa(-1.5e-7f));
+  EXPECT_EQ("16777216", SimpleFtoa(16777216.0f));
+  EXPECT_EQ("1e+10", SimpleFtoa(1e10f));
+  EXPECT_EQ("3.4028235e+38", SimpleFtoa(std::numeric_limits<float>::max()));
+  EXPECT_EQ("1e-45", SimpleFtoa(std::numeric_limits<float>::denorm_min()));
+  EXPECT_EQ("-0", SimpleFtoa(-0.0f));
+  EXPECT_EQ("inf", SimpleFtoa(std::numeric_limits<float>::infinity()));
+}
+
+TEST(StringUtilityTest, SimpleDtoaRoundTrips) {
+  uint64 bits = PROTOBUF_ULONGLONG(0x123456789abcdef);
+  for (int i = 0; i < 10000; i++) {
+    bits = bits * PROTOBUF_ULONGLONG(6364136223846793005) +
+           PROTOBUF_ULONGLONG(1442695040888963407);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    if (!MathLimits<double>::IsFinite(value)) continue;
+    double parsed;
+    ASSERT_TRUE(safe_strtod(SimpleDtoa(value), &parsed));
+    EXPECT_EQ(value, parsed) << SimpleDtoa(value);
+
+    float float_value;
+    uint32 float_bits = static_cast<uint32>(bits >> 32);
+    memcpy(&float_value, &float_bits, sizeof(float_value));
+    if (!MathLimits<float>::IsFinite(float_value)) continue;
+    float parsed_float;
+    // Ignore the result, which is false for subnormals.
+    safe_strtof(SimpleFtoa(float_value).c_str(), &parsed_float);
+    EXPECT_EQ(float_value, parsed_float) << SimpleFtoa(float_value);
+  }
+}
+
+TEST(StringUtilityTest, SafeStrtod) {
+  double value;
+  EXPECT_TRUE(safe_strtod("1.5", &value));
+  EXPECT_EQ(1.5, value);
+  EXPECT_TRUE(safe_strtod("-2.5e-3  ", &value));
+  EXPECT_EQ(-2.5e-3, value);
+  EXPECT_TRUE(safe_strtod(" 7", &value));
+  EXPECT_EQ(7, value);
+  EXPECT_TRUE(safe_strtod("1e400", &value));
+  EXPECT_EQ(std::numeric_limits<double>::infinity(), value);
+  EXPECT_TRUE(safe_strtod("0x10", &value));
+  EXPECT_EQ(16, value);
+  EXPECT_FALSE(safe_strtod("1.5x", &value));
+  EXPECT_FALSE(safe_strtod("", &value));
+  EXPECT_FALSE(safe_strtod("e5", &value));
+}
+
 #define EXPECT_EQ_ARRAY(len, x, y, msg)                     \
   for (int j = 0; j < len; ++j) {                           \
     EXPECT_EQ(x[j], y[j]) << "" # x << " != " # y           \
@@ -255,6 +255,9 @@ class PROTOBUF_EXPORT DefaultFieldComparator : public FieldComparator {
   // those particular fields.
   ToleranceMap map_tolerance_;
 
+  // Copies the settings when comparing in parallel.
+  friend class MessageDifferencer;
+
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(DefaultFieldComparator);
 };
 
@@ -30,15 +30,23 @@
 
 #include <google/protobuf/util/field_mask_util.h>
 
+#include <algorithm>
+
 #include <google/protobuf/stubs/strutil.h>
 
 #include <google/protobuf/stubs/map_util.h>
+#include <google/protobuf/stubs/once.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/wire_format.h>
+#include <google/protobuf/wire_format_lite_inl.h>
 
 namespace google {
 namespace protobuf {
 namespace util {
 
 using google::protobuf::FieldMask;
+using internal::WireFormat;
+using internal::WireFormatLite;
 
 string FieldMaskUtil::ToString(const FieldMask& mask) {
   return Join(mask.paths(), ",");
@@ -168,6 +176,45 @@ void FieldMaskUtil::GetFieldMaskForAllFields(
 }
 
 namespace {
+// One step of a compiled FieldMask, see CompiledFieldMask.  The steps for a
+// sub-message directly follow the DESCEND step of its field.
+struct MaskStep {
+  enum Kind {
+    COPY,     // Merge: copy the field from the source.
+    CLEAR,    // Trim: clear the field.
+    DESCEND,  // Apply the next num_nested steps to the sub-message.
+  };
+
+  MaskStep(Kind kind, const FieldDescriptor* field)
+      : kind(kind), field(field), num_nested(0) {}
+
+  Kind kind;
+  const FieldDescriptor* field;
+  int num_nested;
+};
+
+typedef std::vector<MaskStep> MaskSteps;
+
+// A field to keep when parsing with a FieldMask.
+struct ParseField {
+  ParseField(const FieldDescriptor* field, int nested)
+      : number(field->number()), field(field), nested(nested) {}
+
+  bool operator<(const ParseField& other) const {
+    return number < other.number;
+  }
+  bool operator<(int other_number) const { return number < other_number; }
+
+  int number;
+  const FieldDescriptor* field;
+  // The index of the ParseLevel of the sub-message, or -1 to parse the whole
+  // field.
+  int nested;
+};
+
+// The fields to keep of a message type, sorted by number.
+typedef std::vector<ParseField> ParseLevel;
+
 // A FieldMaskTree represents a FieldMask in a tree structure. For example,
 // given a FieldMask "foo.bar,foo.baz,bar.baz", the FieldMaskTree will be:
 //
@@ -206,15 +253,25 @@ class FieldMaskTree {
   // the intersection field path into out.
   void IntersectPath(const string& path, FieldMaskTree* out);
 
-  // Merge all fields specified by this tree from one message to another.
-  void MergeMessage(const Message& source,
-                    const FieldMaskUtil::MergeOptions& options,
-                    Message* destination) {
+  // Appends the steps that merge all fields specified by this tree from one
+  // message of the given type to another.
+  void AppendMergeSteps(const Descriptor* descriptor, MaskSteps* steps) {
     // Do nothing if the tree is empty.
     if (root_.children.empty()) {
       return;
     }
-    MergeMessage(&root_, source, options, destination);
+    AppendMergeSteps(&root_, descriptor, steps);
+  }
+
+  // Appends the levels that parse only the fields specified by this tree
+  // from a message of the given type.  levels[0] is the one of the message.
+  void AppendParseLevels(const Descriptor* descriptor,
+                         std::vector<ParseLevel>* levels) {
+    // Do nothing if the tree is empty.
+    if (root_.children.empty()) {
+      return;
+    }
+    AppendParseLevels(&root_, descriptor, levels);
   }
 
   // Add required field path of the message to this tree based on current tree
@@ -229,14 +286,14 @@ class FieldMaskTree {
     AddRequiredFieldPath(&root_, descriptor);
   }
 
-  // Trims all fields not specified by this tree from the given message.
-  // Returns true if the message is modified.
-  bool TrimMessage(Message* message) {
+  // Appends the steps that trim all fields not specified by this tree from
+  // a message of the given type.
+  void AppendTrimSteps(const Descriptor* descriptor, MaskSteps* steps) {
     // Do nothing if the tree is empty.
     if (root_.children.empty()) {
-      return false;
+      return;
     }
-    return TrimMessage(&root_, message);
+    AppendTrimSteps(&root_, descriptor, steps);
   }
 
  private:
@@ -267,10 +324,9 @@ class FieldMaskTree {
   void MergeLeafNodesToTree(const string& prefix, const Node* node,
                             FieldMaskTree* out);
 
-  // Merge all fields specified by a sub-tree from one message to another.
-  void MergeMessage(const Node* node, const Message& source,
-                    const FieldMaskUtil::MergeOptions& options,
-                    Message* destination);
+  // Appends the steps that merge all fields specified by a sub-tree.
+  void AppendMergeSteps(const Node* node, const Descriptor* descriptor,
+                        MaskSteps* steps);
 
   // Add required field path of the message to this tree based on current tree
   // structure. If a message is present in the tree, add the path of its
@@ -278,9 +334,14 @@ class FieldMaskTree {
   // message with required fields are set, check IsInitialized() will not fail.
   void AddRequiredFieldPath(Node* node, const Descriptor* descriptor);
 
-  // Trims all fields not specified by this sub-tree from the given message.
-  // Returns true if the message is actually modified
-  bool TrimMessage(const Node* node, Message* message);
+  // Appends the steps that trim all fields not specified by a sub-tree.
+  void AppendTrimSteps(const Node* node, const Descriptor* descriptor,
+                       MaskSteps* steps);
+
+  // Appends the levels that parse the fields specified by a sub-tree, and
+  // returns the index of the first one.
+  int AppendParseLevels(const Node* node, const Descriptor* descriptor,
+                        std::vector<ParseLevel>* levels);
 
   Node root_;
 
@@ -442,13 +503,10 @@ void FieldMaskTree::MergeLeafNodesToTree(const string& prefix, const Node* node,
   }
 }
 
-void FieldMaskTree::MergeMessage(const Node* node, const Message& source,
-                                 const FieldMaskUtil::MergeOptions& options,
-                                 Message* destination) {
+void FieldMaskTree::AppendMergeSteps(const Node* node,
+                                     const Descriptor* descriptor,
+                                     MaskSteps* steps) {
   GOOGLE_DCHECK(!node->children.empty());
-  const Reflection* source_reflection = source.GetReflection();
-  const Reflection* destination_reflection = destination->GetReflection();
-  const Descriptor* descriptor = source.GetDescriptor();
   for (std::map<string, Node*>::const_iterator it = node->children.begin();
        it != node->children.end(); ++it) {
     const string& field_name = it->first;
@@ -469,79 +527,13 @@ void FieldMaskTree::MergeMessage(const Node* node, const Message& source,
                    << "have sub-fields.";
         continue;
       }
-      MergeMessage(child, source_reflection->GetMessage(source, field), options,
-                   destination_reflection->MutableMessage(destination, field));
+      const int descend = steps->size();
+      steps->push_back(MaskStep(MaskStep::DESCEND, field));
+      AppendMergeSteps(child, field->message_type(), steps);
+      (*steps)[descend].num_nested = steps->size() - descend - 1;
       continue;
     }
-    if (!field->is_repeated()) {
-      switch (field->cpp_type()) {
-#define COPY_VALUE(TYPE, Name)                                              \
-  case FieldDescriptor::CPPTYPE_##TYPE: {                                   \
-    if (source_reflection->HasField(source, field)) {                       \
-      destination_reflection->Set##Name(                                    \
-          destination, field, source_reflection->Get##Name(source, field)); \
-    } else {                                                                \
-      destination_reflection->ClearField(destination, field);               \
-    }                                                                       \
-    break;                                                                  \
-  }
-        COPY_VALUE(BOOL, Bool)
-        COPY_VALUE(INT32, Int32)
-        COPY_VALUE(INT64, Int64)
-        COPY_VALUE(UINT32, UInt32)
-        COPY_VALUE(UINT64, UInt64)
-        COPY_VALUE(FLOAT, Float)
-        COPY_VALUE(DOUBLE, Double)
-        COPY_VALUE(ENUM, Enum)
-        COPY_VALUE(STRING, String)
-#undef COPY_VALUE
-        case FieldDescriptor::CPPTYPE_MESSAGE: {
-          if (options.replace_message_fields()) {
-            destination_reflection->ClearField(destination, field);
-          }
-          if (source_reflection->HasField(source, field)) {
-            destination_reflection->MutableMessage(destination, field)
-                ->MergeFrom(source_reflection->GetMessage(source, field));
-          }
-          break;
-        }
-      }
-    } else {
-      if (options.replace_repeated_fields()) {
-        destination_reflection->ClearField(destination, field);
-      }
-      switch (field->cpp_type()) {
-#define COPY_REPEATED_VALUE(TYPE, Name)                            \
-  case FieldDescriptor::CPPTYPE_##TYPE: {                          \
-    int size = source_reflection->FieldSize(source, field);        \
-    for (int i = 0; i < size; ++i) {                               \
-      destination_reflection->Add##Name(                           \
-          destination, field,                                      \
-          source_reflection->GetRepeated##Name(source, field, i)); \
-    }                                                              \
-    break;                                                         \
-  }
-        COPY_REPEATED_VALUE(BOOL, Bool)
-        COPY_REPEATED_VALUE(INT32, Int32)
-        COPY_REPEATED_VALUE(INT64, Int64)
-        COPY_REPEATED_VALUE(UINT32, UInt32)
-        COPY_REPEATED_VALUE(UINT64, UInt64)
-        COPY_REPEATED_VALUE(FLOAT, Float)
-        COPY_REPEATED_VALUE(DOUBLE, Double)
-        COPY_REPEATED_VALUE(ENUM, Enum)
-        COPY_REPEATED_VALUE(STRING, String)
-#undef COPY_REPEATED_VALUE
-        case FieldDescriptor::CPPTYPE_MESSAGE: {
-          int size = source_reflection->FieldSize(source, field);
-          for (int i = 0; i < size; ++i) {
-            destination_reflection->AddMessage(destination, field)
-                ->MergeFrom(
-                    source_reflection->GetRepeatedMessage(source, field, i));
-          }
-          break;
-        }
-      }
-    }
+    steps->push_back(MaskStep(MaskStep::COPY, field));
   }
 }
 
@@ -580,17 +572,265 @@ void FieldMaskTree::AddRequiredFieldPath(
   }
 }
 
-bool FieldMaskTree::TrimMessage(const Node* node, Message* message) {
+void FieldMaskTree::AppendTrimSteps(const Node* node,
+                                    const Descriptor* descriptor,
+                                    MaskSteps* steps) {
   GOOGLE_DCHECK(!node->children.empty());
-  const Reflection* reflection = message->GetReflection();
-  const Descriptor* descriptor = message->GetDescriptor();
   const int32 field_count = descriptor->field_count();
-  bool modified = false;
   for (int index = 0; index < field_count; ++index) {
     const FieldDescriptor* field = descriptor->field(index);
     std::map<string, Node*>::const_iterator it =
         node->children.find(field->name());
     if (it == node->children.end()) {
+      steps->push_back(MaskStep(MaskStep::CLEAR, field));
+    } else if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE &&
+               !field->is_repeated()) {
+      const Node* child = it->second;
+      if (!child->children.empty()) {
+        const int descend = steps->size();
+        steps->push_back(MaskStep(MaskStep::DESCEND, field));
+        AppendTrimSteps(child, field->message_type(), steps);
+        (*steps)[descend].num_nested = steps->size() - descend - 1;
+        // Nothing to trim in the sub-message.
+        if ((*steps)[descend].num_nested == 0) steps->pop_back();
+      }
+    }
+  }
+}
+
+int FieldMaskTree::AppendParseLevels(const Node* node,
+                                     const Descriptor* descriptor,
+                                     std::vector<ParseLevel>* levels) {
+  GOOGLE_DCHECK(!node->children.empty());
+  const int level = levels->size();
+  levels->push_back(ParseLevel());
+  ParseLevel fields;
+  for (std::map<string, Node*>::const_iterator it = node->children.begin();
+       it != node->children.end(); ++it) {
+    const FieldDescriptor* field = descriptor->FindFieldByName(it->first);
+    if (field == NULL) continue;
+    const Node* child = it->second;
+    // Like TrimMessage(), only go into singular message fields.
+    if (!child->children.empty() &&
+        field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE &&
+        !field->is_repeated()) {
+      fields.push_back(ParseField(
+          field, AppendParseLevels(child, field->message_type(), levels)));
+    } else {
+      fields.push_back(ParseField(field, -1));
+    }
+  }
+  std::sort(fields.begin(), fields.end());
+  (*levels)[level].swap(fields);
+  return level;
+}
+
+// Merges a field that is fully covered by the mask from one message to
+// another.
+void MergeField(const FieldDescriptor* field, const Message& source,
+                const FieldMaskUtil::MergeOptions& options,
+                Message* destination) {
+  const Reflection* source_reflection = source.GetReflection();
+  const Reflection* destination_reflection = destination->GetReflection();
+  if (!field->is_repeated()) {
+    switch (field->cpp_type()) {
+#define COPY_VALUE(TYPE, Name)                                              \
+  case FieldDescriptor::CPPTYPE_##TYPE: {                                   \
+    if (source_reflection->HasField(source, field)) {                       \
+      destination_reflection->Set##Name(                                    \
+          destination, field, source_reflection->Get##Name(source, field)); \
+    } else {                                                                \
+      destination_reflection->ClearField(destination, field);               \
+    }                                                                       \
+    break;                                                                  \
+  }
+      COPY_VALUE(BOOL, Bool)
+      COPY_VALUE(INT32, Int32)
+      COPY_VALUE(INT64, Int64)
+      COPY_VALUE(UINT32, UInt32)
+      COPY_VALUE(UINT64, UInt64)
+      COPY_VALUE(FLOAT, Float)
+      COPY_VALUE(DOUBLE, Double)
+      COPY_VALUE(ENUM, Enum)
+      COPY_VALUE(STRING, String)
+#undef COPY_VALUE
+      case FieldDescriptor::CPPTYPE_MESSAGE: {
+        if (options.replace_message_fields()) {
+          destination_reflection->ClearField(destination, field);
+        }
+        if (source_reflection->HasField(source, field)) {
+          destination_reflection->MutableMessage(destination, field)
+              ->MergeFrom(source_reflection->GetMessage(source, field));
+        }
+        break;
+      }
+    }
+  } else {
+    if (options.replace_repeated_fields()) {
+      destination_reflection->ClearField(destination, field);
+    }
+    switch (field->cpp_type()) {
+#define COPY_REPEATED_VALUE(TYPE, Name)                            \
+  case FieldDescriptor::CPPTYPE_##TYPE: {                          \
+    int size = source_reflection->FieldSize(source, field);        \
+    for (int i = 0; i < size; ++i) {                               \
+      destination_reflection->Add##Name(                           \
+          destination, field,                                      \
+          source_reflection->GetRepeated##Name(source, field, i)); \
+    }                                                              \
+    break;                                                         \
+  }
+      COPY_REPEATED_VALUE(BOOL, Bool)
+      COPY_REPEATED_VALUE(INT32, Int32)
+      COPY_REPEATED_VALUE(INT64, Int64)
+      COPY_REPEATED_VALUE(UINT32, UInt32)
+      COPY_REPEATED_VALUE(UINT64, UInt64)
+      COPY_REPEATED_VALUE(FLOAT, Float)
+      COPY_REPEATED_VALUE(DOUBLE, Double)
+      COPY_REPEATED_VALUE(ENUM, Enum)
+      COPY_REPEATED_VALUE(STRING, String)
+#undef COPY_REPEATED_VALUE
+      case FieldDescriptor::CPPTYPE_MESSAGE: {
+        int size = source_reflection->FieldSize(source, field);
+        for (int i = 0; i < size; ++i) {
+          destination_reflection->AddMessage(destination, field)
+              ->MergeFrom(
+                  source_reflection->GetRepeatedMessage(source, field, i));
+        }
+        break;
+      }
+    }
+  }
+}
+
+void MergeSteps(const MaskStep* begin, const MaskStep* end,
+                const Message& source,
+                const FieldMaskUtil::MergeOptions& options,
+                Message* destination) {
+  for (const MaskStep* step = begin; step != end; ++step) {
+    if (step->kind == MaskStep::DESCEND) {
+      const Reflection* source_reflection = source.GetReflection();
+      const Reflection* destination_reflection = destination->GetReflection();
+      MergeSteps(step + 1, step + 1 + step->num_nested,
+                 source_reflection->GetMessage(source, step->field), options,
+                 destination_reflection->MutableMessage(destination,
+                                                        step->field));
+      step += step->num_nested;
+    } else {
+      MergeField(step->field, source, options, destination);
+    }
+  }
+}
+
+// Handles a field whose number isn't in the mask.  Like TrimMessage(), which
+// only clears the message's own fields, keeps extensions and unknown fields
+// by parsing them as WireFormat::ParseAndMergePartial() does, and skips the
+// rest.
+bool ParseFieldNotInMask(uint32 tag, io::CodedInputStream* input,
+                         Message* message) {
+  const Descriptor* descriptor = message->GetDescriptor();
+  const int number = WireFormatLite::GetTagFieldNumber(tag);
+  if (descriptor->FindFieldByNumber(number) != NULL) {
+    return WireFormatLite::SkipField(input, tag);
+  }
+  const FieldDescriptor* field = NULL;
+  if (descriptor->IsExtensionNumber(number)) {
+    if (input->GetExtensionPool() == NULL) {
+      field = message->GetReflection()->FindKnownExtensionByNumber(number);
+    } else {
+      field = input->GetExtensionPool()->FindExtensionByNumber(descriptor,
+                                                               number);
+    }
+  }
+  if (field == NULL && descriptor->options().message_set_wire_format() &&
+      tag == WireFormatLite::kMessageSetItemStartTag) {
+    return WireFormat::ParseAndMergeMessageSetItem(input, message);
+  }
+  // With a NULL field, this adds the field to the unknown fields.
+  return WireFormat::ParseAndMergeField(tag, field, message, input);
+}
+
+bool ParseWithLevels(const std::vector<ParseLevel>& levels, int level,
+                     io::CodedInputStream* input, Message* message) {
+  const ParseLevel& fields = levels[level];
+  while (true) {
+    const uint32 tag = input->ReadTag();
+    if (tag == 0) {
+      // End of input.  This is a valid place to end, so return true.
+      return true;
+    }
+    const WireFormatLite::WireType wire_type =
+        WireFormatLite::GetTagWireType(tag);
+    if (wire_type == WireFormatLite::WIRETYPE_END_GROUP) {
+      // Must be the end of the message.
+      return true;
+    }
+    const int number = WireFormatLite::GetTagFieldNumber(tag);
+    ParseLevel::const_iterator it =
+        std::lower_bound(fields.begin(), fields.end(), number);
+    if (it == fields.end() || it->number != number) {
+      if (!ParseFieldNotInMask(tag, input, message)) return false;
+      continue;
+    }
+    const FieldDescriptor* field = it->field;
+    if (it->nested < 0) {
+      if (!WireFormat::ParseAndMergeField(tag, field, message, input)) {
+        return false;
+      }
+      continue;
+    }
+    // Only parse the fields of the sub-message that are in the mask.
+    Message* sub_message =
+        message->GetReflection()->MutableMessage(message, field);
+    if (field->type() == FieldDescriptor::TYPE_MESSAGE &&
+        wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      int length;
+      if (!input->ReadVarintSizeAsInt(&length)) return false;
+      std::pair<io::CodedInputStream::Limit, int> p =
+          input->IncrementRecursionDepthAndPushLimit(length);
+      if (p.second < 0 ||
+          !ParseWithLevels(levels, it->nested, input, sub_message)) {
+        return false;
+      }
+      // Make sure that parsing stopped when the limit was hit, not at an
+      // endgroup tag.
+      if (!input->DecrementRecursionDepthAndPopLimit(p.first)) return false;
+    } else if (field->type() == FieldDescriptor::TYPE_GROUP &&
+               wire_type == WireFormatLite::WIRETYPE_START_GROUP) {
+      if (!input->IncrementRecursionDepth()) return false;
+      if (!ParseWithLevels(levels, it->nested, input, sub_message)) {
+        return false;
+      }
+      input->DecrementRecursionDepth();
+      // Make sure the last thing read was an end tag for this group.
+      if (!input->LastTagWas(WireFormatLite::MakeTag(
+              number, WireFormatLite::WIRETYPE_END_GROUP))) {
+        return false;
+      }
+    } else {
+      // The wire type doesn't match; let the regular parser handle it.
+      if (!WireFormat::ParseAndMergeField(tag, field, message, input)) {
+        return false;
+      }
+    }
+  }
+}
+
+// Returns true if the message is modified.
+bool TrimSteps(const MaskStep* begin, const MaskStep* end, Message* message) {
+  const Reflection* reflection = message->GetReflection();
+  bool modified = false;
+  for (const MaskStep* step = begin; step != end; ++step) {
+    const FieldDescriptor* field = step->field;
+    if (step->kind == MaskStep::DESCEND) {
+      if (reflection->HasField(*message, field)) {
+        bool nestedMessageChanged =
+            TrimSteps(step + 1, step + 1 + step->num_nested,
+                      reflection->MutableMessage(message, field));
+        modified = nestedMessageChanged || modified;
+      }
+      step += step->num_nested;
+    } else {
       if (field->is_repeated()) {
         if (reflection->FieldSize(*message, field) != 0) {
           modified = true;
@@ -601,15 +841,6 @@ bool FieldMaskTree::TrimMessage(const Node* node, Message* message) {
         }
       }
       reflection->ClearField(message, field);
-    } else {
-      if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
-        Node* child = it->second;
-        if (!child->children.empty() && reflection->HasField(*message, field)) {
-          bool nestedMessageChanged =
-              TrimMessage(child, reflection->MutableMessage(message, field));
-          modified = nestedMessageChanged || modified;
-        }
-      }
     }
   }
   return modified;
@@ -685,15 +916,15 @@ void FieldMaskUtil::MergeMessageTo(const Message& source, const FieldMask& mask,
   // fields.
   FieldMaskTree tree;
   tree.MergeFromFieldMask(mask);
-  tree.MergeMessage(source, options, destination);
+  MaskSteps steps;
+  tree.AppendMergeSteps(source.GetDescriptor(), &steps);
+  if (steps.empty()) return;
+  MergeSteps(&steps[0], &steps[0] + steps.size(), source, options,
+             destination);
 }
 
 bool FieldMaskUtil::TrimMessage(const FieldMask& mask, Message* message) {
-  // Build a FieldMaskTree and walk through the tree to merge all specified
-  // fields.
-  FieldMaskTree tree;
-  tree.MergeFromFieldMask(mask);
-  return tree.TrimMessage(GOOGLE_CHECK_NOTNULL(message));
+  return TrimMessage(mask, message, TrimOptions());
 }
 
 bool FieldMaskUtil::TrimMessage(const FieldMask& mask, Message* message,
@@ -702,12 +933,127 @@ bool FieldMaskUtil::TrimMessage(const FieldMask& mask, Message* message,
   // fields.
   FieldMaskTree tree;
   tree.MergeFromFieldMask(mask);
-  // If keep_required_fields is true, implicitely add required fields of
+  const Descriptor* descriptor =
+      GOOGLE_CHECK_NOTNULL(message)->GetDescriptor();
+  // If keep_required_fields is true, implicitly add required fields of
   // a message present in the tree to prevent from trimming.
   if (options.keep_required_fields()) {
-    tree.AddRequiredFieldPath(GOOGLE_CHECK_NOTNULL(message->GetDescriptor()));
+    tree.AddRequiredFieldPath(descriptor);
+  }
+  MaskSteps steps;
+  tree.AppendTrimSteps(descriptor, &steps);
+  if (steps.empty()) return false;
+  return TrimSteps(&steps[0], &steps[0] + steps.size(), message);
+}
+
+bool FieldMaskUtil::ParseWithMask(const FieldMask& mask,
+                                  io::CodedInputStream* input,
+                                  Message* message) {
+  FieldMaskTree tree;
+  tree.MergeFromFieldMask(mask);
+  std::vector<ParseLevel> levels;
+  tree.AppendParseLevels(GOOGLE_CHECK_NOTNULL(message)->GetDescriptor(),
+                         &levels);
+  message->Clear();
+  if (levels.empty()) return message->MergePartialFromCodedStream(input);
+  return ParseWithLevels(levels, 0, input, message);
+}
+
+// Each plan is built the first time it is needed, so that a mask that is
+// only used one way doesn't pay for the others.
+struct CompiledFieldMask::Plans {
+  FieldMask mask;
+
+  internal::once_flag merge_once;
+  MaskSteps merge;
+
+  internal::once_flag trim_once;
+  MaskSteps trim;
+
+  // For TrimOptions::keep_required_fields().
+  internal::once_flag trim_keeping_required_once;
+  MaskSteps trim_keeping_required;
+
+  // Empty if the whole message is parsed.
+  internal::once_flag parse_once;
+  std::vector<ParseLevel> parse;
+};
+
+CompiledFieldMask::CompiledFieldMask(const Descriptor* descriptor,
+                                     const FieldMask& mask)
+    : descriptor_(GOOGLE_CHECK_NOTNULL(descriptor)), plans_(new Plans) {
+  plans_->mask = mask;
+}
+
+CompiledFieldMask::~CompiledFieldMask() {}
+
+void CompiledFieldMask::MergeMessageTo(
+    const Message& source, const FieldMaskUtil::MergeOptions& options,
+    Message* destination) const {
+  GOOGLE_CHECK(source.GetDescriptor() == descriptor_);
+  GOOGLE_CHECK(destination->GetDescriptor() == descriptor_);
+  Plans* plans = plans_.get();
+  internal::call_once(plans->merge_once, [plans, this] {
+    FieldMaskTree tree;
+    tree.MergeFromFieldMask(plans->mask);
+    tree.AppendMergeSteps(descriptor_, &plans->merge);
+  });
+  const MaskSteps& steps = plans->merge;
+  if (steps.empty()) return;
+  MergeSteps(&steps[0], &steps[0] + steps.size(), source, options,
+             destination);
+}
+
+bool CompiledFieldMask::ParsePartialFromCodedStream(
+    io::CodedInputStream* input, Message* message) const {
+  message->Clear();
+  return MergePartialFromCodedStream(input, message);
+}
+
+bool CompiledFieldMask::MergePartialFromCodedStream(
+    io::CodedInputStream* input, Message* message) const {
+  GOOGLE_CHECK(GOOGLE_CHECK_NOTNULL(message)->GetDescriptor() == descriptor_);
+  Plans* plans = plans_.get();
+  internal::call_once(plans->parse_once, [plans, this] {
+    FieldMaskTree tree;
+    tree.MergeFromFieldMask(plans->mask);
+    tree.AppendParseLevels(descriptor_, &plans->parse);
+  });
+  if (plans->parse.empty()) {
+    return message->MergePartialFromCodedStream(input);
+  }
+  return ParseWithLevels(plans->parse, 0, input, message);
+}
+
+bool CompiledFieldMask::TrimMessage(Message* message) const {
+  return TrimMessage(message, FieldMaskUtil::TrimOptions());
+}
+
+bool CompiledFieldMask::TrimMessage(
+    Message* message, const FieldMaskUtil::TrimOptions& options) const {
+  GOOGLE_CHECK(GOOGLE_CHECK_NOTNULL(message)->GetDescriptor() == descriptor_);
+  Plans* plans = plans_.get();
+  const MaskSteps* steps;
+  if (options.keep_required_fields()) {
+    internal::call_once(plans->trim_keeping_required_once, [plans, this] {
+      // Implicitly add required fields of a message present in the tree to
+      // prevent them from being trimmed.
+      FieldMaskTree tree;
+      tree.MergeFromFieldMask(plans->mask);
+      tree.AddRequiredFieldPath(descriptor_);
+      tree.AppendTrimSteps(descriptor_, &plans->trim_keeping_required);
+    });
+    steps = &plans->trim_keeping_required;
+  } else {
+    internal::call_once(plans->trim_once, [plans, this] {
+      FieldMaskTree tree;
+      tree.MergeFromFieldMask(plans->mask);
+      tree.AppendTrimSteps(descriptor_, &plans->trim);
+    });
+    steps = &plans->trim;
   }
-  return tree.TrimMessage(GOOGLE_CHECK_NOTNULL(message));
+  if (steps->empty()) return false;
+  return TrimSteps(&(*steps)[0], &(*steps)[0] + steps->size(), message);
 }
 
 }  // namespace util
@@ -33,6 +33,7 @@
 #ifndef GOOGLE_PROTOBUF_UTIL_FIELD_MASK_UTIL_H__
 #define GOOGLE_PROTOBUF_UTIL_FIELD_MASK_UTIL_H__
 
+#include <memory>
 #include <string>
 
 #include <google/protobuf/descriptor.h>
@@ -145,7 +146,8 @@ class PROTOBUF_EXPORT FieldMaskUtil {
   static bool IsPathInFieldMask(StringPiece path, const FieldMask& mask);
 
   class MergeOptions;
-  // Merges fields specified in a FieldMask into another message.
+  // Merges fields specified in a FieldMask into another message.  To apply
+  // the same mask to many messages, use CompiledFieldMask instead.
   static void MergeMessageTo(const Message& source, const FieldMask& mask,
                              const MergeOptions& options, Message* destination);
 
@@ -162,6 +164,16 @@ class PROTOBUF_EXPORT FieldMaskUtil {
   static bool TrimMessage(const FieldMask& mask, Message* message,
                           const TrimOptions& options);
 
+  // Parses a message from input, keeping only the fields represented in the
+  // given FieldMask, like parsing it and then calling TrimMessage() does.
+  // Fields outside the mask are skipped on the wire without being parsed;
+  // as with TrimMessage(), extensions and unknown fields are kept.  Required
+  // fields are not checked.  If the FieldMask is empty, the whole message is
+  // parsed.  To parse many messages with the same mask, use
+  // CompiledFieldMask instead.
+  static bool ParseWithMask(const FieldMask& mask, io::CodedInputStream* input,
+                            Message* message);
+
  private:
   friend class SnakeCaseCamelCaseTest;
   // Converts a field name from snake_case to camelCase:
@@ -238,6 +250,60 @@ class PROTOBUF_EXPORT FieldMaskUtil::TrimOptions {
   bool keep_required_fields_;
 };
 
+// A FieldMask resolved against a message type once, so that it can be
+// applied to many messages of that type.  The paths are looked up the first
+// time the mask is used for merging, trimming or parsing; later calls then
+// only walk lists of FieldDescriptors through Reflection.  The results are
+// the same as those of FieldMaskUtil::MergeMessageTo() and
+// FieldMaskUtil::TrimMessage() with the same mask, and invalid paths are
+// logged once, by the first merge.
+//
+// A CompiledFieldMask is immutable, so it can be shared between threads.
+// The descriptor must outlive it.
+//
+// Sample usage:
+//   static const CompiledFieldMask* mask =
+//       new CompiledFieldMask(Foo::descriptor(), field_mask);
+//   for (...) {
+//     mask->MergeMessageTo(source, options, &destination);
+//   }
+class PROTOBUF_EXPORT CompiledFieldMask {
+ public:
+  CompiledFieldMask(const Descriptor* descriptor, const FieldMask& mask);
+  ~CompiledFieldMask();
+
+  const Descriptor* descriptor() const { return descriptor_; }
+
+  // Same as FieldMaskUtil::MergeMessageTo().  Both messages must be of the
+  // type the mask was compiled for.
+  void MergeMessageTo(const Message& source,
+                      const FieldMaskUtil::MergeOptions& options,
+                      Message* destination) const;
+
+  // Same as FieldMaskUtil::TrimMessage().  The message must be of the type
+  // the mask was compiled for.
+  bool TrimMessage(Message* message) const;
+  bool TrimMessage(Message* message,
+                   const FieldMaskUtil::TrimOptions& options) const;
+
+  // Same as FieldMaskUtil::ParseWithMask().  The message must be of the type
+  // the mask was compiled for.
+  bool ParsePartialFromCodedStream(io::CodedInputStream* input,
+                                   Message* message) const;
+  // Like ParsePartialFromCodedStream(), but merges into the message instead
+  // of clearing it first.
+  bool MergePartialFromCodedStream(io::CodedInputStream* input,
+                                   Message* message) const;
+
+ private:
+  struct Plans;
+
+  const Descriptor* const descriptor_;
+  std::unique_ptr<Plans> plans_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(CompiledFieldMask);
+};
+
 }  // namespace util
 }  // namespace protobuf
 }  // namespace google
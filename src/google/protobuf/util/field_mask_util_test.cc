@@ -35,8 +35,11 @@
 #include <google/protobuf/stubs/logging.h>
 #include <google/protobuf/stubs/common.h>
 #include <google/protobuf/field_mask.pb.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <google/protobuf/unittest.pb.h>
 #include <google/protobuf/test_util.h>
+#include <google/protobuf/testing/googletest.h>
 #include <gtest/gtest.h>
 
 namespace google {
@@ -816,6 +819,211 @@ TEST(FieldMaskUtilTest, TrimMessageReturnValue) {
   // supported.
 }
 
+TEST(FieldMaskUtilTest, ParseWithMask) {
+  NestedTestAllTypes source;
+  TestUtil::SetAllFields(source.mutable_payload());
+  TestUtil::SetAllFields(source.mutable_child()->mutable_payload());
+  TestUtil::SetAllFields(
+      source.mutable_child()->mutable_child()->mutable_payload());
+  const string data = source.SerializeAsString();
+
+  const char* const kMasks[] = {
+      "",
+      "payload",
+      "payload.optional_int32",
+      "payload.optional_int32,payload.repeated_string,no_such_field",
+      "payload.optionalgroup.a,payload.optional_nested_message.bb",
+      "payload.repeated_nested_message.bb,payload.packed_int32",
+      "child.payload.optional_string,child.child",
+      "child.child.payload.optional_foreign_message.c,payload.oneof_bytes",
+  };
+  for (const char* paths : kMasks) {
+    SCOPED_TRACE(paths);
+    FieldMask mask;
+    FieldMaskUtil::FromString(paths, &mask);
+    NestedTestAllTypes expected;
+    ASSERT_TRUE(expected.ParseFromString(data));
+    FieldMaskUtil::TrimMessage(mask, &expected);
+
+    NestedTestAllTypes actual;
+    actual.mutable_payload()->set_optional_int64(1);  // Cleared.
+    io::CodedInputStream input(reinterpret_cast<const uint8*>(data.data()),
+                               data.size());
+    EXPECT_TRUE(FieldMaskUtil::ParseWithMask(mask, &input, &actual));
+    EXPECT_TRUE(input.ConsumedEntireMessage());
+    EXPECT_EQ(expected.DebugString(), actual.DebugString());
+
+    // The same with input that arrives a few bytes at a time, merged into
+    // a message.
+    const CompiledFieldMask compiled(NestedTestAllTypes::descriptor(), mask);
+    for (int i = 0; i < 2; ++i) {
+      io::ArrayInputStream raw_input(data.data(), data.size(), 5);
+      io::CodedInputStream chunked_input(&raw_input);
+      actual.Clear();
+      EXPECT_TRUE(compiled.MergePartialFromCodedStream(&chunked_input,
+                                                      &actual));
+      EXPECT_EQ(expected.DebugString(), actual.DebugString());
+    }
+  }
+}
+
+TEST(FieldMaskUtilTest, ParseWithMaskKeepsUnknownFieldsAndExtensions) {
+  protobuf_unittest::TestFieldOrderings source;
+  source.set_my_int(1);
+  source.set_my_string("abc");
+  source.set_my_float(2.0);
+  source.SetExtension(protobuf_unittest::my_extension_int, 3);
+  source.SetExtension(protobuf_unittest::my_extension_string, "def");
+  source.mutable_optional_nested_message()->set_oo(4);
+  source.mutable_optional_nested_message()->set_bb(5);
+  source.mutable_unknown_fields()->AddVarint(1000, 6);
+  source.mutable_optional_nested_message()
+      ->mutable_unknown_fields()
+      ->AddVarint(1000, 7);
+  const string data = source.SerializeAsString();
+
+  FieldMask mask;
+  FieldMaskUtil::FromString("my_string,optional_nested_message.bb", &mask);
+  protobuf_unittest::TestFieldOrderings expected;
+  ASSERT_TRUE(expected.ParseFromString(data));
+  FieldMaskUtil::TrimMessage(mask, &expected);
+  EXPECT_EQ(3, expected.GetExtension(protobuf_unittest::my_extension_int));
+  EXPECT_EQ(1, expected.unknown_fields().field_count());
+  EXPECT_EQ(1,
+            expected.optional_nested_message().unknown_fields().field_count());
+
+  protobuf_unittest::TestFieldOrderings actual;
+  io::CodedInputStream input(reinterpret_cast<const uint8*>(data.data()),
+                             data.size());
+  EXPECT_TRUE(FieldMaskUtil::ParseWithMask(mask, &input, &actual));
+  EXPECT_EQ(expected.DebugString(), actual.DebugString());
+  EXPECT_EQ(expected.SerializeAsString(), actual.SerializeAsString());
+
+  // Truncated input fails.
+  io::CodedInputStream truncated(
+      reinterpret_cast<const uint8*>(data.data()), data.size() - 1);
+  EXPECT_FALSE(FieldMaskUtil::ParseWithMask(mask, &truncated, &actual));
+}
+
+TEST(CompiledFieldMaskTest, MergeMessageTo) {
+  FieldMask masks[2];
+  FieldMaskUtil::FromString(
+      "optional_int32,repeated_string,payload.optional_string,"
+      "child.payload.repeated_int32,no_such_field",
+      &masks[0]);
+  FieldMaskUtil::FromString(
+      "payload.optional_int32,payload.repeated_nested_message,"
+      "child.child.payload",
+      &masks[1]);
+  const CompiledFieldMask compiled[2] = {
+      {NestedTestAllTypes::descriptor(), masks[0]},
+      {NestedTestAllTypes::descriptor(), masks[1]}};
+  EXPECT_EQ(NestedTestAllTypes::descriptor(), compiled[0].descriptor());
+
+  // The compiled masks give the same results as FieldMaskUtil, over and over.
+  for (int i = 0; i < 3; ++i) {
+    NestedTestAllTypes source;
+    TestUtil::SetAllFields(source.mutable_payload());
+    TestUtil::SetAllFields(source.mutable_child()->mutable_payload());
+    if (i > 0) {
+      TestUtil::SetAllFields(
+          source.mutable_child()->mutable_child()->mutable_payload());
+    }
+    source.mutable_payload()->set_optional_int32(i);
+    FieldMaskUtil::MergeOptions options;
+    options.set_replace_repeated_fields(i == 2);
+
+    for (int m = 0; m < 2; ++m) {
+      NestedTestAllTypes expected;
+      expected.mutable_payload()->add_repeated_int32(1);
+      NestedTestAllTypes actual = expected;
+      FieldMaskUtil::MergeMessageTo(source, masks[m], options, &expected);
+      compiled[m].MergeMessageTo(source, options, &actual);
+      EXPECT_EQ(expected.DebugString(), actual.DebugString());
+    }
+  }
+}
+
+TEST(CompiledFieldMaskTest, TrimMessage) {
+  FieldMask mask;
+  FieldMaskUtil::FromString(
+      "optional_int32,optional_nested_message.bb,repeated_string", &mask);
+  const CompiledFieldMask compiled(TestAllTypes::descriptor(), mask);
+
+  for (int i = 0; i < 3; ++i) {
+    TestAllTypes expected;
+    TestUtil::SetAllFields(&expected);
+    expected.set_optional_int32(i);
+    TestAllTypes actual = expected;
+    EXPECT_TRUE(FieldMaskUtil::TrimMessage(mask, &expected));
+    EXPECT_TRUE(compiled.TrimMessage(&actual));
+    EXPECT_EQ(expected.DebugString(), actual.DebugString());
+    EXPECT_EQ(i, actual.optional_int32());
+    // Trimming again changes nothing.
+    EXPECT_FALSE(compiled.TrimMessage(&actual));
+  }
+
+  // An empty mask doesn't trim anything.
+  const CompiledFieldMask empty(TestAllTypes::descriptor(), FieldMask());
+  TestAllTypes message;
+  TestUtil::SetAllFields(&message);
+  EXPECT_FALSE(empty.TrimMessage(&message));
+  TestUtil::ExpectAllFieldsSet(message);
+}
+
+TEST(CompiledFieldMaskTest, TrimMessageKeepingRequiredFields) {
+  FieldMask mask;
+  FieldMaskUtil::FromString("optional_message.a,dummy", &mask);
+  const CompiledFieldMask compiled(TestRequiredMessage::descriptor(), mask);
+  FieldMaskUtil::TrimOptions options;
+  options.set_keep_required_fields(true);
+
+  TestRequiredMessage message;
+  TestRequired* required = message.mutable_optional_message();
+  required->set_a(1);
+  required->set_b(2);
+  required->set_c(3);
+  required->set_dummy2(4);
+  TestRequiredMessage expected = message;
+  TestRequiredMessage without_options = message;
+
+  EXPECT_TRUE(FieldMaskUtil::TrimMessage(mask, &expected, options));
+  EXPECT_TRUE(compiled.TrimMessage(&message, options));
+  EXPECT_EQ(expected.DebugString(), message.DebugString());
+  EXPECT_TRUE(message.optional_message().has_b());
+  EXPECT_FALSE(message.optional_message().has_dummy2());
+
+  // The same compiled mask trims required fields without the option.
+  EXPECT_TRUE(compiled.TrimMessage(&without_options));
+  EXPECT_FALSE(without_options.optional_message().has_b());
+}
+
+TEST(CompiledFieldMaskTest, OnlyMergingLogsInvalidPaths) {
+  FieldMask mask;
+  FieldMaskUtil::FromString("optional_int32,no_such_field", &mask);
+  TestAllTypes message;
+  message.set_optional_int32(1);
+  message.set_optional_int64(2);
+  {
+    ScopedMemoryLog log;
+    const CompiledFieldMask compiled(TestAllTypes::descriptor(), mask);
+    TestAllTypes trimmed[2] = {message, message};
+    EXPECT_TRUE(compiled.TrimMessage(&trimmed[0]));
+    EXPECT_TRUE(FieldMaskUtil::TrimMessage(mask, &trimmed[1]));
+    EXPECT_TRUE(log.GetMessages(ERROR).empty());
+  }
+  {
+    ScopedMemoryLog log;
+    const CompiledFieldMask compiled(TestAllTypes::descriptor(), mask);
+    TestAllTypes merged;
+    compiled.MergeMessageTo(message, FieldMaskUtil::MergeOptions(), &merged);
+    compiled.MergeMessageTo(message, FieldMaskUtil::MergeOptions(), &merged);
+    EXPECT_EQ(1, merged.optional_int32());
+    EXPECT_FALSE(merged.has_optional_int64());
+    EXPECT_EQ(1, log.GetMessages(ERROR).size());
+  }
+}
+
 
 }  // namespace
 }  // namespace util
@@ -70,6 +70,20 @@ DefaultValueObjectWriter::DefaultValueObjectWriter(
       field_scrub_callback_(nullptr),
       ow_(ow) {}
 
+DefaultValueObjectWriter::DefaultValueObjectWriter(
+    const TypeInfo* typeinfo, const google::protobuf::Type& type,
+    ObjectWriter* ow)
+    : typeinfo_(typeinfo),
+      own_typeinfo_(false),
+      type_(type),
+      current_(nullptr),
+      root_(nullptr),
+      suppress_empty_list_(false),
+      preserve_proto_field_names_(false),
+      use_ints_for_enums_(false),
+      field_scrub_callback_(nullptr),
+      ow_(ow) {}
+
 DefaultValueObjectWriter::~DefaultValueObjectWriter() {
   for (int i = 0; i < string_values_.size(); ++i) {
     delete string_values_[i];
@@ -82,6 +82,13 @@ class PROTOBUF_EXPORT DefaultValueObjectWriter : public ObjectWriter {
                            const google::protobuf::Type& type,
                            ObjectWriter* ow);
 
+  // Looks up types through 'typeinfo', which must outlive this object.  A
+  // TypeInfo from TypeInfo::NewConcurrentTypeInfo() can be shared by the
+  // writers of all threads.
+  DefaultValueObjectWriter(const TypeInfo* typeinfo,
+                           const google::protobuf::Type& type,
+                           ObjectWriter* ow);
+
   virtual ~DefaultValueObjectWriter();
 
   // ObjectWriter methods.
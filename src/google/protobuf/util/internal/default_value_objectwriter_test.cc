@@ -75,7 +75,8 @@ class DefaultValueObjectWriterTest : public BaseDefaultValueObjectWriterTest {
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         DefaultValueObjectWriterTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 TEST_P(DefaultValueObjectWriterTest, Empty) {
   // Set expectation
@@ -162,7 +163,8 @@ class DefaultValueObjectWriterSuppressListTest
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         DefaultValueObjectWriterSuppressListTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 TEST_P(DefaultValueObjectWriterSuppressListTest, Empty) {
   // Set expectation. Emtpy lists should be suppressed.
@@ -0,0 +1,212 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/internal/delimited_objectwriter.h>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/stubs/strutil.h>
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+// Passes errors on, remembering whether the current element had any.
+class DelimitedObjectWriter::ElementErrorListener : public ErrorListener {
+ public:
+  explicit ElementErrorListener(ErrorListener* listener)
+      : listener_(listener), failed_(false) {}
+
+  void InvalidName(const LocationTrackerInterface& loc,
+                   StringPiece invalid_name, StringPiece message) override {
+    failed_ = true;
+    listener_->InvalidName(loc, invalid_name, message);
+  }
+
+  void InvalidValue(const LocationTrackerInterface& loc,
+                    StringPiece type_name, StringPiece value) override {
+    failed_ = true;
+    listener_->InvalidValue(loc, type_name, value);
+  }
+
+  void MissingField(const LocationTrackerInterface& loc,
+                    StringPiece missing_name) override {
+    failed_ = true;
+    listener_->MissingField(loc, missing_name);
+  }
+
+  bool failed() const { return failed_; }
+
+ private:
+  ErrorListener* listener_;
+  bool failed_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ElementErrorListener);
+};
+
+DelimitedObjectWriter::DelimitedObjectWriter(
+    const TypeInfo* typeinfo, const google::protobuf::Type& type,
+    ErrorListener* listener, const ProtoStreamObjectWriter::Options& options,
+    io::ZeroCopyOutputStream* output)
+    : typeinfo_(typeinfo),
+      type_(type),
+      options_(options),
+      output_(output),
+      listener_(new ElementErrorListener(listener)),
+      sink_(&buffer_),
+      element_depth_(0),
+      in_root_list_(false),
+      done_(false),
+      records_written_(0) {}
+
+DelimitedObjectWriter::~DelimitedObjectWriter() {}
+
+DelimitedObjectWriter* DelimitedObjectWriter::StartObject(StringPiece name) {
+  ObjectWriter* ow = ElementWriter();
+  if (ow == nullptr) return this;
+  ++element_depth_;
+  ow->StartObject(name);
+  return this;
+}
+
+DelimitedObjectWriter* DelimitedObjectWriter::EndObject() {
+  if (element_writer_ == nullptr) {
+    // Only the root list can end outside of an element.
+    if (status_.ok()) {
+      status_ = util::Status(util::error::INVALID_ARGUMENT,
+                               "Unexpected end of object.");
+    }
+    return this;
+  }
+  --element_depth_;
+  element_writer_->EndObject();
+  MaybeFinishElement();
+  return this;
+}
+
+DelimitedObjectWriter* DelimitedObjectWriter::StartList(StringPiece name) {
+  if (!in_root_list_ && !done_ && status_.ok()) {
+    in_root_list_ = true;
+    return this;
+  }
+  ObjectWriter* ow = ElementWriter();
+  if (ow == nullptr) return this;
+  ++element_depth_;
+  ow->StartList(name);
+  return this;
+}
+
+DelimitedObjectWriter* DelimitedObjectWriter::EndList() {
+  if (element_writer_ == nullptr) {
+    in_root_list_ = false;
+    done_ = true;
+    return this;
+  }
+  --element_depth_;
+  element_writer_->EndList();
+  MaybeFinishElement();
+  return this;
+}
+
+#define DELIMITED_OBJECTWRITER_RENDER(Method, ValueType)                    \
+  DelimitedObjectWriter* DelimitedObjectWriter::Method(StringPiece name,    \
+                                                       ValueType value) {   \
+    ObjectWriter* ow = ElementWriter();                                     \
+    if (ow == nullptr) return this;                                         \
+    ow->Method(name, value);                                                \
+    MaybeFinishElement();                                                   \
+    return this;                                                            \
+  }
+
+DELIMITED_OBJECTWRITER_RENDER(RenderBool, bool)
+DELIMITED_OBJECTWRITER_RENDER(RenderInt32, int32)
+DELIMITED_OBJECTWRITER_RENDER(RenderUint32, uint32)
+DELIMITED_OBJECTWRITER_RENDER(RenderInt64, int64)
+DELIMITED_OBJECTWRITER_RENDER(RenderUint64, uint64)
+DELIMITED_OBJECTWRITER_RENDER(RenderDouble, double)
+DELIMITED_OBJECTWRITER_RENDER(RenderFloat, float)
+DELIMITED_OBJECTWRITER_RENDER(RenderString, StringPiece)
+DELIMITED_OBJECTWRITER_RENDER(RenderBytes, StringPiece)
+
+#undef DELIMITED_OBJECTWRITER_RENDER
+
+DelimitedObjectWriter* DelimitedObjectWriter::RenderNull(StringPiece name) {
+  ObjectWriter* ow = ElementWriter();
+  if (ow == nullptr) return this;
+  ow->RenderNull(name);
+  MaybeFinishElement();
+  return this;
+}
+
+
+ObjectWriter* DelimitedObjectWriter::ElementWriter() {
+  if (!status_.ok()) return nullptr;
+  if (element_writer_ != nullptr) return element_writer_.get();
+  if (!in_root_list_) {
+    status_ = util::Status(
+        util::error::INVALID_ARGUMENT,
+        StrCat("Expected a list of ", type_.name(), " messages."));
+    return nullptr;
+  }
+  buffer_.clear();
+  element_writer_.reset(new ProtoStreamObjectWriter(
+      typeinfo_, type_, &sink_, listener_.get(), options_));
+  element_writer_->set_use_strict_base64_decoding(
+      use_strict_base64_decoding());
+  return element_writer_.get();
+}
+
+void DelimitedObjectWriter::MaybeFinishElement() {
+  if (element_depth_ > 0) return;
+  // The element is complete, and its bytes are in buffer_.
+  element_writer_.reset();
+  if (listener_->failed()) {
+    status_ = util::Status(
+        util::error::INVALID_ARGUMENT,
+        StrCat("Invalid ", type_.name(), " at index ", records_written_, "."));
+    return;
+  }
+  io::CodedOutputStream coded_output(output_);
+  coded_output.WriteVarint32(buffer_.size());
+  coded_output.WriteString(buffer_);
+  if (coded_output.HadError()) {
+    status_ = util::Status(util::error::INTERNAL,
+                             "Failed to write to the output stream.");
+    return;
+  }
+  ++records_written_;
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
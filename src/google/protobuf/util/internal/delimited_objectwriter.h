@@ -0,0 +1,155 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GOOGLE_PROTOBUF_UTIL_CONVERTER_DELIMITED_OBJECTWRITER_H__
+#define GOOGLE_PROTOBUF_UTIL_CONVERTER_DELIMITED_OBJECTWRITER_H__
+
+#include <memory>
+#include <string>
+
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include <google/protobuf/type.pb.h>
+#include <google/protobuf/util/internal/error_listener.h>
+#include <google/protobuf/util/internal/object_writer.h>
+#include <google/protobuf/util/internal/protostream_objectwriter.h>
+#include <google/protobuf/util/internal/type_info.h>
+#include <google/protobuf/stubs/bytestream.h>
+#include <google/protobuf/stubs/stringpiece.h>
+#include <google/protobuf/stubs/status.h>
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+// An ObjectWriter that takes a list of objects of one message type and writes
+// each of them to a ZeroCopyOutputStream as a size-delimited record, the
+// format read by util::ParseDelimitedFromZeroCopyStream().
+//
+// Each element of the list goes through its own ProtoStreamObjectWriter and
+// is written out as soon as it ends, so only one element is held in memory
+// at a time.  All elements share one TypeInfo.
+//
+// The root value must be a list.  Anything else makes status() fail, as does
+// an error reported for an element; the writer then ignores the remaining
+// input.  Records written before the error are left in the output.
+//
+// Sample usage:
+//   DelimitedObjectWriter writer(typeinfo, type, &listener, options, output);
+//   JsonStreamParser parser(&writer);
+//   parser.Parse(chunk1);
+//   parser.Parse(chunk2);
+//   parser.FinishParse();
+//   if (!writer.status().ok()) { ... }
+class PROTOBUF_EXPORT DelimitedObjectWriter : public ObjectWriter {
+ public:
+  // Errors in elements are passed on to 'listener'.  Does not take ownership
+  // of any parameter.
+  DelimitedObjectWriter(const TypeInfo* typeinfo,
+                        const google::protobuf::Type& type,
+                        ErrorListener* listener,
+                        const ProtoStreamObjectWriter::Options& options,
+                        io::ZeroCopyOutputStream* output);
+  ~DelimitedObjectWriter() override;
+
+  // ObjectWriter methods.
+  DelimitedObjectWriter* StartObject(StringPiece name) override;
+  DelimitedObjectWriter* EndObject() override;
+  DelimitedObjectWriter* StartList(StringPiece name) override;
+  DelimitedObjectWriter* EndList() override;
+  DelimitedObjectWriter* RenderBool(StringPiece name, bool value) override;
+  DelimitedObjectWriter* RenderInt32(StringPiece name, int32 value) override;
+  DelimitedObjectWriter* RenderUint32(StringPiece name,
+                                      uint32 value) override;
+  DelimitedObjectWriter* RenderInt64(StringPiece name, int64 value) override;
+  DelimitedObjectWriter* RenderUint64(StringPiece name,
+                                      uint64 value) override;
+  DelimitedObjectWriter* RenderDouble(StringPiece name,
+                                      double value) override;
+  DelimitedObjectWriter* RenderFloat(StringPiece name, float value) override;
+  DelimitedObjectWriter* RenderString(StringPiece name,
+                                      StringPiece value) override;
+  DelimitedObjectWriter* RenderBytes(StringPiece name,
+                                     StringPiece value) override;
+  DelimitedObjectWriter* RenderNull(StringPiece name) override;
+
+  bool done() override { return done_; }
+
+  // OK unless an error has been found so far.  done() tells whether the whole
+  // list has been written.
+  const util::Status& status() const { return status_; }
+
+  // The number of records written so far.
+  int64 records_written() const { return records_written_; }
+
+ private:
+  class ElementErrorListener;
+
+  // Returns the writer for the current element, starting one if needed.
+  // Returns NULL if the input is to be ignored.
+  ObjectWriter* ElementWriter();
+
+  // Called after each event for the current element.  Writes the record once
+  // the element is complete.
+  void MaybeFinishElement();
+
+  const TypeInfo* typeinfo_;
+  const google::protobuf::Type& type_;
+  const ProtoStreamObjectWriter::Options options_;
+  io::ZeroCopyOutputStream* output_;
+  std::unique_ptr<ElementErrorListener> listener_;
+
+  // The encoded current element.  Reused, so it keeps the capacity of the
+  // largest element seen.
+  std::string buffer_;
+  strings::StringByteSink sink_;
+  std::unique_ptr<ProtoStreamObjectWriter> element_writer_;
+
+  // Objects and lists open in the current element.
+  int element_depth_;
+  bool in_root_list_;
+  bool done_;
+  int64 records_written_;
+  util::Status status_;
+
+  GOOGLE_DISALLOW_IMPLICIT_CONSTRUCTORS(DelimitedObjectWriter);
+};
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_UTIL_CONVERTER_DELIMITED_OBJECTWRITER_H__
@@ -33,6 +33,10 @@
 #include <google/protobuf/stubs/logging.h>
 #include <google/protobuf/stubs/common.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace google {
 namespace protobuf {
 namespace util {
@@ -278,6 +282,38 @@ StringPiece EscapeCodePoint(uint32 cp, char* buffer) {
   return StringPiece();
 }
 
+// Returns the length of the prefix of 'str' that is copied without escaping.
+int UnescapedPrefixLength(const char* str, int size) {
+  const char* p = str;
+  const char* end = str + size;
+#if defined(__SSE2__)
+  const __m128i space = _mm_set1_epi8(0x20);
+  const __m128i del = _mm_set1_epi8(0x7f);
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i less = _mm_set1_epi8('<');
+  const __m128i greater = _mm_set1_epi8('>');
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    // As signed bytes, non-ASCII bytes are negative and so below ' ' too.
+    __m128i special = _mm_or_si128(_mm_cmplt_epi8(chunk, space),
+                                   _mm_cmpeq_epi8(chunk, del));
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, quote));
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, backslash));
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, less));
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, greater));
+    if (_mm_movemask_epi8(special) != 0) break;
+    p += 16;
+  }
+#endif
+  while (p < end) {
+    uint8 c = static_cast<uint8>(*p);
+    if (c >= 0x80 || kCommonEscapes[c][0] != '\0') break;
+    ++p;
+  }
+  return p - str;
+}
+
 // Tries to escape the given code point first. If the given code point
 // does not need to be escaped, but force_output is true, then render
 // the given multi-byte code point in UTF8 in the buffer and returns it.
@@ -316,22 +352,26 @@ void JsonEscaping::Escape(strings::ByteSource* input,
     StringPiece str = input->Peek();
     StringPiece escaped;
     int i = 0;
-    int num_read;
-    bool ok;
+    int num_read = 0;
+    bool ok = true;
     bool cp_was_split = num_left > 0;
+    if (!cp_was_split) {
+      i = UnescapedPrefixLength(str.data(), str.size());
+    }
     // Loop until we encounter either
     //   i) a code point that needs to be escaped; or
     //  ii) a split code point is completely read; or
     // iii) a character that is not a valid utf8; or
     //  iv) end of the StringPiece str is reached.
-    do {
+    while (i < str.length()) {         // case iv
       ok = ReadCodePoint(str, i, &cp, &num_left, &num_read);
       if (num_left > 0 || !ok) break;  // case iii or iv
       escaped = EscapeCodePoint(cp, buffer, cp_was_split);
       if (!escaped.empty()) break;     // case i or ii
       i += num_read;
       num_read = 0;
-    } while (i < str.length());        // case iv
+      i += UnescapedPrefixLength(str.data() + i, str.size() - i);
+    }
     // First copy the un-escaped prefix, if any, to the output ByteSink.
     if (i > 0) input->CopyTo(output, i);
     if (num_read > 0) input->Skip(num_read);
@@ -269,6 +269,24 @@ TEST_F(JsonObjectWriterTest, StringsEscapedAndEnclosedInDoubleQuotes) {
             output_.substr(0, out_stream_->ByteCount()));
 }
 
+TEST_F(JsonObjectWriterTest, LongStringsEscapedAtAnyPosition) {
+  // Covers escapes at every offset in and around a block of 16 bytes.
+  ow_ = new JsonObjectWriter("", out_stream_);
+  ow_->StartList("");
+  string expected = "[";
+  for (int i = 0; i < 40; ++i) {
+    string prefix(i, 'a');
+    string suffix(40 - i, 'b');
+    ow_->RenderString("", prefix + "<\xc3\xa9\x7f\"" + suffix);
+    if (i > 0) expected += ",";
+    expected +=
+        "\"" + prefix + "\\u003c\xc3\xa9\\u007f\\\"" + suffix + "\"";
+  }
+  ow_->EndList();
+  expected += "]";
+  EXPECT_EQ(expected, output_.substr(0, out_stream_->ByteCount()));
+}
+
 TEST_F(JsonObjectWriterTest, Stringification) {
   ow_ = new JsonObjectWriter("", out_stream_);
   ow_->StartObject("")
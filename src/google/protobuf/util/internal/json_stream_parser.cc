@@ -45,6 +45,9 @@
 #include <google/protobuf/util/internal/json_escaping.h>
 #include <google/protobuf/stubs/mathlimits.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace google {
 namespace protobuf {
@@ -97,6 +100,27 @@ static bool MatchKey(StringPiece input) {
   return !input.empty() && IsLetter(input[0]);
 }
 
+// Returns the number of leading bytes of 'input' that are neither 'quote' nor
+// a backslash.  The input is valid UTF-8, where ASCII bytes only stand for
+// themselves, so the bytes can be skipped without decoding them.
+static int StringPrefixLength(StringPiece input, char quote) {
+  const char* p = input.data();
+  const char* end = p + input.size();
+#if defined(__SSE2__)
+  const __m128i quotes = _mm_set1_epi8(quote);
+  const __m128i backslashes = _mm_set1_epi8('\\');
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quotes),
+                                   _mm_cmpeq_epi8(chunk, backslashes));
+    if (_mm_movemask_epi8(special) != 0) break;
+    p += 16;
+  }
+#endif
+  while (p < end && *p != quote && *p != '\\') ++p;
+  return p - input.data();
+}
+
 JsonStreamParser::JsonStreamParser(ObjectWriter* ow)
     : ow_(ow),
       stack_(),
@@ -390,8 +414,8 @@ util::Status JsonStreamParser::ParseStringHelper() {
       Advance();
       return util::Status();
     }
-    // Normal character, just advance past it.
-    Advance();
+    // Normal characters, advance up to the next quote or backslash.
+    p_.remove_prefix(StringPrefixLength(p_, string_open_));
   }
   // If we ran out of characters, copy over what we have so far.
   if (last < p_.data()) {
@@ -301,6 +301,18 @@ TEST_F(JsonStreamParserTest, SimpleDoubleQuotedString) {
   }
 }
 
+TEST_F(JsonStreamParserTest, LongStringsWithEscapes) {
+  // Covers quotes and escapes at offsets in and around a block of 16 bytes.
+  for (int offset = 0; offset < 20; offset += 3) {
+    string prefix(offset, 'x');
+    string str = "\"" + prefix + "\\n'\xc3\xa9" + prefix + "\\\"z\"";
+    for (int i = 0; i <= str.length(); ++i) {
+      ow_.RenderString("", prefix + "\n'\xc3\xa9" + prefix + "\"z");
+      DoTest(str, i);
+    }
+  }
+}
+
 TEST_F(JsonStreamParserTest, SimpleSingleQuotedString) {
   StringPiece str = "'Another String'";
   for (int i = 0; i <= str.length(); ++i) {
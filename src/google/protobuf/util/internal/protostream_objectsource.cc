@@ -75,10 +75,6 @@ namespace {
 
 static int kDefaultMaxRecursionDepth = 64;
 
-// Finds a field with the given number. nullptr if none found.
-const google::protobuf::Field* FindFieldByNumber(
-    const google::protobuf::Type& type, int number);
-
 // Returns true if the field is packable.
 bool IsPackable(const google::protobuf::Field& field);
 
@@ -164,7 +160,8 @@ Status ProtoStreamObjectSource::NamedWriteTo(StringPiece name,
 const google::protobuf::Field* ProtoStreamObjectSource::FindAndVerifyField(
     const google::protobuf::Type& type, uint32 tag) const {
   // Lookup the new field in the type by tag number.
-  const google::protobuf::Field* field = FindFieldByNumber(type, tag >> 3);
+  const google::protobuf::Field* field =
+      typeinfo_->FindFieldByNumber(&type, tag >> 3);
   // Verify if the field corresponds to the wire type in tag.
   // If there is any discrepancy, mark the field as not found.
   if (field != nullptr) {
@@ -295,7 +292,7 @@ StatusOr<uint32> ProtoStreamObjectSource::RenderMap(
         if (map_key.empty()) {
           // An absent map key is treated as the default.
           const google::protobuf::Field* key_field =
-              FindFieldByNumber(*field_type, 1);
+              typeinfo_->FindFieldByNumber(field_type, 1);
           if (key_field == nullptr) {
             // The Type info for this map entry is incorrect. It should always
             // have a field named "key" and with field number 1.
@@ -1094,17 +1091,6 @@ Status ProtoStreamObjectSource::IncrementRecursionDepth(
 }
 
 namespace {
-// TODO(skarvaje): Speed this up by not doing a linear scan.
-const google::protobuf::Field* FindFieldByNumber(
-    const google::protobuf::Type& type, int number) {
-  for (int i = 0; i < type.fields_size(); ++i) {
-    if (type.fields(i).number() == number) {
-      return &type.fields(i);
-    }
-  }
-  return nullptr;
-}
-
 // TODO(skarvaje): Replace FieldDescriptor by implementing IsTypePackable()
 // using tech Field.
 bool IsPackable(const google::protobuf::Field& field) {
@@ -81,6 +81,13 @@ class PROTOBUF_EXPORT ProtoStreamObjectSource : public ObjectSource {
                           TypeResolver* type_resolver,
                           const google::protobuf::Type& type);
 
+  // Looks up types through 'typeinfo', which must outlive this object.  A
+  // TypeInfo from TypeInfo::NewConcurrentTypeInfo() can be shared by the
+  // sources of all threads.
+  ProtoStreamObjectSource(io::CodedInputStream* stream,
+                          const TypeInfo* typeinfo,
+                          const google::protobuf::Type& type);
+
   ~ProtoStreamObjectSource() override;
 
   util::Status NamedWriteTo(StringPiece name,
@@ -167,9 +174,6 @@ class PROTOBUF_EXPORT ProtoStreamObjectSource : public ObjectSource {
 
 
  private:
-  ProtoStreamObjectSource(io::CodedInputStream* stream,
-                          const TypeInfo* typeinfo,
-                          const google::protobuf::Type& type);
   // Function that renders a well known type with a modified behavior.
   typedef util::Status (*TypeRenderer)(const ProtoStreamObjectSource*,
                                          const google::protobuf::Type&,
@@ -293,7 +293,8 @@ class ProtostreamObjectSourceTest
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtostreamObjectSourceTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 TEST_P(ProtostreamObjectSourceTest, EmptyMessage) {
   Book empty;
@@ -609,7 +610,8 @@ class ProtostreamObjectSourceMapsTest : public ProtostreamObjectSourceTest {
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtostreamObjectSourceMapsTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 // Tests JSON map.
 //
@@ -751,7 +753,8 @@ class ProtostreamObjectSourceAnysTest : public ProtostreamObjectSourceTest {
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtostreamObjectSourceAnysTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 // Tests JSON any support.
 //
@@ -987,7 +990,8 @@ class ProtostreamObjectSourceStructTest : public ProtostreamObjectSourceTest {
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtostreamObjectSourceStructTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 // Tests struct
 //
@@ -1033,7 +1037,8 @@ class ProtostreamObjectSourceFieldMaskTest
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtostreamObjectSourceFieldMaskTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 TEST_P(ProtostreamObjectSourceFieldMaskTest, FieldMaskRenderSuccess) {
   FieldMaskTest out;
@@ -1096,7 +1101,8 @@ class ProtostreamObjectSourceTimestampTest
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtostreamObjectSourceTimestampTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 TEST_P(ProtostreamObjectSourceTimestampTest, InvalidTimestampBelowMinTest) {
   TimestampDuration out;
@@ -128,6 +128,13 @@ class PROTOBUF_EXPORT ProtoStreamObjectWriter : public ProtoWriter {
                           strings::ByteSink* output, ErrorListener* listener,
                           const ProtoStreamObjectWriter::Options& options =
                               ProtoStreamObjectWriter::Options::Defaults());
+  // Looks up types through 'typeinfo', which must outlive this object.  A
+  // TypeInfo from TypeInfo::NewConcurrentTypeInfo() can be shared by the
+  // writers of all threads.
+  ProtoStreamObjectWriter(const TypeInfo* typeinfo,
+                          const google::protobuf::Type& type,
+                          strings::ByteSink* output, ErrorListener* listener,
+                          const ProtoStreamObjectWriter::Options& options);
   ~ProtoStreamObjectWriter() override;
 
   // ObjectWriter methods.
@@ -330,11 +337,6 @@ class PROTOBUF_EXPORT ProtoStreamObjectWriter : public ProtoWriter {
                           const google::protobuf::Type& type,
                           strings::ByteSink* output, ErrorListener* listener);
 
- ProtoStreamObjectWriter(const TypeInfo* typeinfo,
-                          const google::protobuf::Type& type,
-                          strings::ByteSink* output, ErrorListener* listener,
-                          const ProtoStreamObjectWriter::Options& options);
-
   // Returns true if the field is a map.
   inline bool IsMap(const google::protobuf::Field& field);
 
@@ -194,7 +194,8 @@ class ProtoStreamObjectWriterTest : public BaseProtoStreamObjectWriterTest {
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtoStreamObjectWriterTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 TEST_P(ProtoStreamObjectWriterTest, EmptyObject) {
   Book empty;
@@ -1121,7 +1122,8 @@ class ProtoStreamObjectWriterTimestampDurationTest
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtoStreamObjectWriterTimestampDurationTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 TEST_P(ProtoStreamObjectWriterTimestampDurationTest, ParseTimestamp) {
   TimestampDuration timestamp;
@@ -1517,7 +1519,8 @@ class ProtoStreamObjectWriterStructTest
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtoStreamObjectWriterStructTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 // TODO(skarvaje): Write tests for failure cases.
 TEST_P(ProtoStreamObjectWriterStructTest, StructRenderSuccess) {
@@ -1669,7 +1672,8 @@ class ProtoStreamObjectWriterMapTest : public BaseProtoStreamObjectWriterTest {
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtoStreamObjectWriterMapTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 TEST_P(ProtoStreamObjectWriterMapTest, MapShouldNotAcceptList) {
   MapIn mm;
@@ -1766,7 +1770,8 @@ class ProtoStreamObjectWriterAnyTest : public BaseProtoStreamObjectWriterTest {
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtoStreamObjectWriterAnyTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 TEST_P(ProtoStreamObjectWriterAnyTest, AnyRenderSuccess) {
   AnyOut any;
@@ -2407,7 +2412,8 @@ class ProtoStreamObjectWriterFieldMaskTest
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtoStreamObjectWriterFieldMaskTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 TEST_P(ProtoStreamObjectWriterFieldMaskTest, SimpleFieldMaskTest) {
   FieldMaskTest expected;
@@ -2660,7 +2666,8 @@ class ProtoStreamObjectWriterWrappersTest
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtoStreamObjectWriterWrappersTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 TEST_P(ProtoStreamObjectWriterWrappersTest, WrapperAcceptsNull) {
   Int32Wrapper wrapper;
@@ -2683,7 +2690,8 @@ class ProtoStreamObjectWriterOneOfsTest
 INSTANTIATE_TEST_CASE_P(DifferentTypeInfoSourceTest,
                         ProtoStreamObjectWriterOneOfsTest,
                         ::testing::Values(
-                            testing::USE_TYPE_RESOLVER));
+                            testing::USE_TYPE_RESOLVER,
+                            testing::USE_CONCURRENT_TYPE_INFO));
 
 TEST_P(ProtoStreamObjectWriterOneOfsTest,
        MultipleOneofsFailForPrimitiveTypesTest) {
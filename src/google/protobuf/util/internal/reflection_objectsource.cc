@@ -0,0 +1,538 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/internal/reflection_objectsource.h>
+
+#include <vector>
+
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/stubs/stringprintf.h>
+#include <google/protobuf/stubs/time.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/map_field.h>
+#include <google/protobuf/unknown_field_set.h>
+#include <google/protobuf/util/internal/constants.h>
+#include <google/protobuf/util/internal/field_mask_utility.h>
+#include <google/protobuf/util/internal/protostream_objectsource.h>
+#include <google/protobuf/util/internal/type_info.h>
+#include <google/protobuf/util/internal/utility.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/stubs/status_macros.h>
+
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+using util::Status;
+
+namespace {
+
+static const int kDefaultMaxRecursionDepth = 64;
+
+// The well known types that ProtoStreamObjectSource renders specially.
+enum WellKnownType {
+  WKT_NONE,
+  WKT_TIMESTAMP,
+  WKT_DURATION,
+  WKT_WRAPPER,
+  WKT_STRUCT,
+  WKT_VALUE,
+  WKT_LIST_VALUE,
+  WKT_FIELD_MASK,
+  WKT_ANY,
+};
+
+WellKnownType GetWellKnownType(const Descriptor* descriptor) {
+  if (descriptor->file()->package() != "google.protobuf") {
+    return WKT_NONE;
+  }
+  const string& name = descriptor->name();
+  if (name == "Timestamp") return WKT_TIMESTAMP;
+  if (name == "Duration") return WKT_DURATION;
+  if (name == "DoubleValue" || name == "FloatValue" || name == "Int64Value" ||
+      name == "UInt64Value" || name == "Int32Value" || name == "UInt32Value" ||
+      name == "BoolValue" || name == "StringValue" || name == "BytesValue") {
+    return WKT_WRAPPER;
+  }
+  if (name == "Struct") return WKT_STRUCT;
+  if (name == "Value") return WKT_VALUE;
+  if (name == "ListValue") return WKT_LIST_VALUE;
+  if (name == "FieldMask") return WKT_FIELD_MASK;
+  if (name == "Any") return WKT_ANY;
+  return WKT_NONE;
+}
+
+Status Unsupported(StringPiece what, StringPiece field_name) {
+  return Status(util::error::UNIMPLEMENTED,
+                StrCat("Cannot render ", what, " from reflection for field: ",
+                       field_name));
+}
+
+// Returns true if the unknown fields of 'message' would change what
+// ProtoStreamObjectSource renders for its serialized form.  That happens when
+// an unknown field reuses the number of a known one, or when the message is a
+// well known type whose renderer reads the wire format directly.
+bool HasConflictingUnknownFields(const Message& message,
+                                 WellKnownType well_known_type) {
+  const UnknownFieldSet& unknown_fields =
+      message.GetReflection()->GetUnknownFields(message);
+  if (unknown_fields.empty()) return false;
+  if (well_known_type != WKT_NONE) return true;
+  const Descriptor* descriptor = message.GetDescriptor();
+  for (int i = 0; i < unknown_fields.field_count(); ++i) {
+    if (descriptor->FindFieldByNumber(unknown_fields.field(i).number()) !=
+        nullptr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Same as ProtoStreamObjectSource's FormatNanos without trailing zeros, but
+// formats the digits as integers.
+string FormatNanos(int32 nanos) {
+  if (nanos == 0) return "";
+  if (nanos % 1000 != 0) return StringPrintf(".%09d", nanos);
+  if (nanos % 1000000 != 0) return StringPrintf(".%06d", nanos / 1000);
+  return StringPrintf(".%03d", nanos / 1000000);
+}
+
+string MapKeyAsString(const MapKey& key) {
+  switch (key.type()) {
+    case FieldDescriptor::CPPTYPE_BOOL:
+      return key.GetBoolValue() ? "true" : "false";
+    case FieldDescriptor::CPPTYPE_INT32:
+      return SimpleItoa(key.GetInt32Value());
+    case FieldDescriptor::CPPTYPE_INT64:
+      return SimpleItoa(key.GetInt64Value());
+    case FieldDescriptor::CPPTYPE_UINT32:
+      return SimpleItoa(key.GetUInt32Value());
+    case FieldDescriptor::CPPTYPE_UINT64:
+      return SimpleItoa(key.GetUInt64Value());
+    case FieldDescriptor::CPPTYPE_STRING:
+      return key.GetStringValue();
+    default:
+      return string();
+  }
+}
+
+}  // namespace
+
+ReflectionObjectSource::ReflectionObjectSource(const Message& message,
+                                               const TypeInfo* typeinfo)
+    : message_(message),
+      typeinfo_(typeinfo),
+      use_ints_for_enums_(false),
+      preserve_proto_field_names_(false),
+      recursion_depth_(0) {}
+
+ReflectionObjectSource::~ReflectionObjectSource() {}
+
+Status ReflectionObjectSource::NamedWriteTo(StringPiece name,
+                                            ObjectWriter* ow) const {
+  recursion_depth_ = 0;
+  return WriteMessage(message_, name, true, ow);
+}
+
+Status ReflectionObjectSource::WriteMessage(const Message& message,
+                                            StringPiece name,
+                                            bool include_start_and_end,
+                                            ObjectWriter* ow) const {
+  const WellKnownType well_known_type =
+      GetWellKnownType(message.GetDescriptor());
+  if (HasConflictingUnknownFields(message, well_known_type)) {
+    return Unsupported("unknown fields", name);
+  }
+  switch (well_known_type) {
+    case WKT_TIMESTAMP:
+      return RenderTimestamp(message, name, ow);
+    case WKT_DURATION:
+      return RenderDuration(message, name, ow);
+    case WKT_WRAPPER:
+      return RenderWrapper(message, name, ow);
+    case WKT_STRUCT:
+      return RenderStruct(message, name, ow);
+    case WKT_VALUE:
+      return RenderStructValue(message, name, ow);
+    case WKT_LIST_VALUE:
+      return RenderStructListValue(message, name, ow);
+    case WKT_FIELD_MASK:
+      return RenderFieldMask(message, name, ow);
+    case WKT_ANY:
+      return RenderAny(message, name, ow);
+    case WKT_NONE:
+      break;
+  }
+
+  const Reflection* reflection = message.GetReflection();
+  std::vector<const FieldDescriptor*> fields;
+  reflection->ListFields(message, &fields);
+
+  if (include_start_and_end) {
+    ow->StartObject(name);
+  }
+  for (int i = 0; i < fields.size(); ++i) {
+    const FieldDescriptor* field = fields[i];
+    // Extensions are not part of the google.protobuf.Type, so the binary
+    // path skips them.
+    if (field->is_extension()) continue;
+    const string& field_name =
+        preserve_proto_field_names_ ? field->name() : field->json_name();
+    if (field->type() == FieldDescriptor::TYPE_GROUP) {
+      return Unsupported("groups", field_name);
+    }
+
+    if (field->is_map()) {
+      RETURN_IF_ERROR(RenderMap(message, field, field_name, ow));
+    } else if (field->is_repeated()) {
+      ow->StartList(field_name);
+      const int size = reflection->FieldSize(message, field);
+      for (int j = 0; j < size; ++j) {
+        if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+          RETURN_IF_ERROR(RenderMessage(
+              reflection->GetRepeatedMessage(message, field, j), "", ow));
+        } else {
+          RETURN_IF_ERROR(RenderField(message, field, j, "", ow));
+        }
+      }
+      ow->EndList();
+    } else if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+      RETURN_IF_ERROR(RenderMessage(reflection->GetMessage(message, field),
+                                    field_name, ow));
+    } else {
+      RETURN_IF_ERROR(RenderField(message, field, -1, field_name, ow));
+    }
+  }
+  if (include_start_and_end) {
+    ow->EndObject();
+  }
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderMessage(const Message& message,
+                                             StringPiece name,
+                                             ObjectWriter* ow) const {
+  // Well known types do not count towards the recursion depth, as in
+  // ProtoStreamObjectSource::RenderField().
+  if (GetWellKnownType(message.GetDescriptor()) != WKT_NONE) {
+    return WriteMessage(message, name, true, ow);
+  }
+  if (++recursion_depth_ > kDefaultMaxRecursionDepth) {
+    return Unsupported("messages nested this deep", name);
+  }
+  RETURN_IF_ERROR(WriteMessage(message, name, true, ow));
+  --recursion_depth_;
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderField(const Message& message,
+                                           const FieldDescriptor* field,
+                                           int index, StringPiece name,
+                                           ObjectWriter* ow) const {
+  const Reflection* reflection = message.GetReflection();
+  const bool repeated = field->is_repeated();
+  switch (field->cpp_type()) {
+    case FieldDescriptor::CPPTYPE_INT32:
+      ow->RenderInt32(name,
+                      repeated ? reflection->GetRepeatedInt32(message, field,
+                                                              index)
+                               : reflection->GetInt32(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_INT64:
+      ow->RenderInt64(name,
+                      repeated ? reflection->GetRepeatedInt64(message, field,
+                                                              index)
+                               : reflection->GetInt64(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_UINT32:
+      ow->RenderUint32(name,
+                       repeated ? reflection->GetRepeatedUInt32(message, field,
+                                                                index)
+                                : reflection->GetUInt32(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_UINT64:
+      ow->RenderUint64(name,
+                       repeated ? reflection->GetRepeatedUInt64(message, field,
+                                                                index)
+                                : reflection->GetUInt64(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_DOUBLE:
+      ow->RenderDouble(name,
+                       repeated ? reflection->GetRepeatedDouble(message, field,
+                                                                index)
+                                : reflection->GetDouble(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_FLOAT:
+      ow->RenderFloat(name,
+                      repeated ? reflection->GetRepeatedFloat(message, field,
+                                                              index)
+                               : reflection->GetFloat(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_BOOL:
+      ow->RenderBool(name,
+                     repeated ? reflection->GetRepeatedBool(message, field,
+                                                            index)
+                              : reflection->GetBool(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_ENUM:
+      RenderEnum(field,
+                 repeated
+                     ? reflection->GetRepeatedEnumValue(message, field, index)
+                     : reflection->GetEnumValue(message, field),
+                 name, ow);
+      break;
+    case FieldDescriptor::CPPTYPE_STRING: {
+      string scratch;
+      const string& value =
+          repeated ? reflection->GetRepeatedStringReference(message, field,
+                                                            index, &scratch)
+                   : reflection->GetStringReference(message, field, &scratch);
+      if (field->type() == FieldDescriptor::TYPE_BYTES) {
+        ow->RenderBytes(name, value);
+      } else {
+        ow->RenderString(name, value);
+      }
+      break;
+    }
+    case FieldDescriptor::CPPTYPE_MESSAGE:
+      return RenderMessage(
+          repeated ? reflection->GetRepeatedMessage(message, field, index)
+                   : reflection->GetMessage(message, field),
+          name, ow);
+  }
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderMap(const Message& message,
+                                         const FieldDescriptor* field,
+                                         StringPiece name,
+                                         ObjectWriter* ow) const {
+  const Reflection* reflection = message.GetReflection();
+  const FieldDescriptor* value_field = field->message_type()->field(1);
+  Message* mutable_message = const_cast<Message*>(&message);
+  ow->StartObject(name);
+  for (MapIterator it = reflection->MapBegin(mutable_message, field);
+       it != reflection->MapEnd(mutable_message, field); ++it) {
+    const string key = MapKeyAsString(it.GetKey());
+    const MapValueRef& value = it.GetValueRef();
+    switch (value_field->cpp_type()) {
+      case FieldDescriptor::CPPTYPE_INT32:
+        ow->RenderInt32(key, value.GetInt32Value());
+        break;
+      case FieldDescriptor::CPPTYPE_INT64:
+        ow->RenderInt64(key, value.GetInt64Value());
+        break;
+      case FieldDescriptor::CPPTYPE_UINT32:
+        ow->RenderUint32(key, value.GetUInt32Value());
+        break;
+      case FieldDescriptor::CPPTYPE_UINT64:
+        ow->RenderUint64(key, value.GetUInt64Value());
+        break;
+      case FieldDescriptor::CPPTYPE_DOUBLE:
+        ow->RenderDouble(key, value.GetDoubleValue());
+        break;
+      case FieldDescriptor::CPPTYPE_FLOAT:
+        ow->RenderFloat(key, value.GetFloatValue());
+        break;
+      case FieldDescriptor::CPPTYPE_BOOL:
+        ow->RenderBool(key, value.GetBoolValue());
+        break;
+      case FieldDescriptor::CPPTYPE_ENUM:
+        RenderEnum(value_field, value.GetEnumValue(), key, ow);
+        break;
+      case FieldDescriptor::CPPTYPE_STRING:
+        if (value_field->type() == FieldDescriptor::TYPE_BYTES) {
+          ow->RenderBytes(key, value.GetStringValue());
+        } else {
+          ow->RenderString(key, value.GetStringValue());
+        }
+        break;
+      case FieldDescriptor::CPPTYPE_MESSAGE:
+        RETURN_IF_ERROR(RenderMessage(value.GetMessageValue(), key, ow));
+        break;
+    }
+  }
+  ow->EndObject();
+  return util::Status();
+}
+
+void ReflectionObjectSource::RenderEnum(const FieldDescriptor* field,
+                                        int value, StringPiece name,
+                                        ObjectWriter* ow) const {
+  const EnumDescriptor* enum_type = field->enum_type();
+  // If the field represents an explicit NULL value, render null.
+  if (enum_type->full_name() == "google.protobuf.NullValue") {
+    ow->RenderNull(name);
+    return;
+  }
+  // Unknown enum values are printed as integers.
+  const EnumValueDescriptor* enum_value = enum_type->FindValueByNumber(value);
+  if (enum_value != nullptr && !use_ints_for_enums_) {
+    ow->RenderString(name, enum_value->name());
+  } else {
+    ow->RenderInt32(name, value);
+  }
+}
+
+Status ReflectionObjectSource::RenderTimestamp(const Message& message,
+                                               StringPiece name,
+                                               ObjectWriter* ow) const {
+  const Reflection* reflection = message.GetReflection();
+  const Descriptor* descriptor = message.GetDescriptor();
+  int64 seconds = reflection->GetInt64(message, descriptor->field(0));
+  int32 nanos = reflection->GetInt32(message, descriptor->field(1));
+  if (seconds > kTimestampMaxSeconds || seconds < kTimestampMinSeconds ||
+      nanos < 0 || nanos >= kNanosPerSecond) {
+    return Unsupported("an out of range Timestamp", name);
+  }
+  ow->RenderString(name,
+                   ::google::protobuf::internal::FormatTime(seconds, nanos));
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderDuration(const Message& message,
+                                              StringPiece name,
+                                              ObjectWriter* ow) const {
+  const Reflection* reflection = message.GetReflection();
+  const Descriptor* descriptor = message.GetDescriptor();
+  int64 seconds = reflection->GetInt64(message, descriptor->field(0));
+  int32 nanos = reflection->GetInt32(message, descriptor->field(1));
+  // Mixed signs are rejected or rendered oddly by the binary path.
+  if (seconds > kDurationMaxSeconds || seconds < kDurationMinSeconds ||
+      nanos <= -kNanosPerSecond || nanos >= kNanosPerSecond ||
+      (seconds < 0 && nanos > 0) || (seconds > 0 && nanos < 0)) {
+    return Unsupported("an invalid Duration", name);
+  }
+  const char* sign = "";
+  if (seconds < 0 || nanos < 0) {
+    sign = "-";
+    seconds = -seconds;
+    nanos = -nanos;
+  }
+  ow->RenderString(
+      name, StringPrintf("%s%lld%ss", sign,
+                         static_cast<long long>(seconds),  // NOLINT
+                         FormatNanos(nanos).c_str()));
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderWrapper(const Message& message,
+                                             StringPiece name,
+                                             ObjectWriter* ow) const {
+  // All wrappers have a single singular field called "value", which is read
+  // as its default when unset.
+  return RenderField(message, message.GetDescriptor()->field(0), -1, name, ow);
+}
+
+Status ReflectionObjectSource::RenderStruct(const Message& message,
+                                            StringPiece name,
+                                            ObjectWriter* ow) const {
+  // google.protobuf.Struct has only one field, a map<string, Value>.
+  return RenderMap(message, message.GetDescriptor()->field(0), name, ow);
+}
+
+Status ReflectionObjectSource::RenderStructValue(const Message& message,
+                                                 StringPiece name,
+                                                 ObjectWriter* ow) const {
+  // The fields of google.protobuf.Value form a oneof, so this renders at most
+  // one value, and nothing at all when the kind is not set.
+  const Reflection* reflection = message.GetReflection();
+  std::vector<const FieldDescriptor*> fields;
+  reflection->ListFields(message, &fields);
+  for (int i = 0; i < fields.size(); ++i) {
+    RETURN_IF_ERROR(RenderField(message, fields[i], -1, name, ow));
+  }
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderStructListValue(const Message& message,
+                                                     StringPiece name,
+                                                     ObjectWriter* ow) const {
+  const Reflection* reflection = message.GetReflection();
+  const FieldDescriptor* values = message.GetDescriptor()->field(0);
+  ow->StartList(name);
+  const int size = reflection->FieldSize(message, values);
+  for (int i = 0; i < size; ++i) {
+    RETURN_IF_ERROR(RenderField(message, values, i, "", ow));
+  }
+  ow->EndList();
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderFieldMask(const Message& message,
+                                               StringPiece name,
+                                               ObjectWriter* ow) const {
+  const Reflection* reflection = message.GetReflection();
+  const FieldDescriptor* paths = message.GetDescriptor()->field(0);
+  string combined;
+  string scratch;
+  const int size = reflection->FieldSize(message, paths);
+  for (int i = 0; i < size; ++i) {
+    const string& path =
+        reflection->GetRepeatedStringReference(message, paths, i, &scratch);
+    if (!combined.empty()) {
+      combined.append(",");
+    }
+    combined.append(ConvertFieldMaskPath(path, &ToCamelCase));
+  }
+  ow->RenderString(name, combined);
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderAny(const Message& message,
+                                         StringPiece name,
+                                         ObjectWriter* ow) const {
+  const google::protobuf::Type* any_type = typeinfo_->GetTypeByTypeUrl(
+      StrCat(kTypeServiceBaseUrl, "/", message.GetDescriptor()->full_name()));
+  if (any_type == nullptr) {
+    return Unsupported("Any without type information", name);
+  }
+
+  // The payload is only available in binary form, so let the binary path
+  // render the whole Any.
+  string serialized;
+  message.SerializePartialToString(&serialized);
+  io::ArrayInputStream zero_copy_stream(serialized.data(), serialized.size());
+  io::CodedInputStream in_stream(&zero_copy_stream);
+  ProtoStreamObjectSource any_os(&in_stream, typeinfo_, *any_type);
+  any_os.set_use_ints_for_enums(use_ints_for_enums_);
+  any_os.set_preserve_proto_field_names(preserve_proto_field_names_);
+  return any_os.NamedWriteTo(name, ow);
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
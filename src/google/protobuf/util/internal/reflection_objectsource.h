@@ -0,0 +1,160 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GOOGLE_PROTOBUF_UTIL_CONVERTER_REFLECTION_OBJECTSOURCE_H__
+#define GOOGLE_PROTOBUF_UTIL_CONVERTER_REFLECTION_OBJECTSOURCE_H__
+
+#include <string>
+
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/util/internal/object_source.h>
+#include <google/protobuf/util/internal/object_writer.h>
+#include <google/protobuf/stubs/stringpiece.h>
+#include <google/protobuf/stubs/status.h>
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+class TypeInfo;
+
+// An ObjectSource that walks a Message through its Reflection interface.
+// It emits the same ObjectWriter calls as a ProtoStreamObjectSource reading
+// message.SerializeAsString() would, but without serializing the message and
+// parsing it back, and without google.protobuf.Type lookups for each nested
+// message.
+//
+// A few inputs cannot be rendered identically from reflection alone, for
+// example unknown fields that reuse a known field number, groups, or values
+// the binary path rejects with an error.  For those NamedWriteTo() stops and
+// returns an UNIMPLEMENTED status.  Whatever was written to the ObjectWriter
+// by then must be discarded, and the caller should fall back to the binary
+// path, which produces the reference output or error.
+//
+// google.protobuf.Any payloads are rendered by a ProtoStreamObjectSource, as
+// they are bytes anyway.  typeinfo is only used for that, must resolve
+// "type.googleapis.com" type urls and must outlive this object.
+//
+// Sample usage:
+//   ReflectionObjectSource os(message, typeinfo);
+//   Status status = os.WriteTo(<some ObjectWriter>);
+class PROTOBUF_EXPORT ReflectionObjectSource : public ObjectSource {
+ public:
+  ReflectionObjectSource(const Message& message, const TypeInfo* typeinfo);
+  ~ReflectionObjectSource() override;
+
+  util::Status NamedWriteTo(StringPiece name,
+                              ObjectWriter* ow) const override;
+
+  // Sets whether to always output enums as ints, by default this is off, and
+  // enums are rendered as strings.
+  void set_use_ints_for_enums(bool value) { use_ints_for_enums_ = value; }
+
+  // Sets whether to use original proto field names
+  void set_preserve_proto_field_names(bool value) {
+    preserve_proto_field_names_ = value;
+  }
+
+ private:
+  // Writes the fields of 'message'.  include_start_and_end has the same
+  // meaning as in ProtoStreamObjectSource::WriteMessage().
+  util::Status WriteMessage(const Message& message, StringPiece name,
+                              bool include_start_and_end,
+                              ObjectWriter* ow) const;
+
+  // Renders a nested message, using the well known type rendering if there
+  // is one.
+  util::Status RenderMessage(const Message& message, StringPiece name,
+                               ObjectWriter* ow) const;
+
+  // Renders one value of a non-message field.  index is ignored for singular
+  // fields.
+  util::Status RenderField(const Message& message,
+                             const FieldDescriptor* field, int index,
+                             StringPiece name, ObjectWriter* ow) const;
+
+  // Renders a map field as an object keyed by the map keys.
+  util::Status RenderMap(const Message& message, const FieldDescriptor* field,
+                           StringPiece name, ObjectWriter* ow) const;
+
+  void RenderEnum(const FieldDescriptor* field, int value, StringPiece name,
+                  ObjectWriter* ow) const;
+
+  // Renderers for the well known types, named after the type.  They return
+  // UNIMPLEMENTED where ProtoStreamObjectSource would report an error.
+  util::Status RenderTimestamp(const Message& message, StringPiece name,
+                                 ObjectWriter* ow) const;
+  util::Status RenderDuration(const Message& message, StringPiece name,
+                                ObjectWriter* ow) const;
+  util::Status RenderWrapper(const Message& message, StringPiece name,
+                               ObjectWriter* ow) const;
+  util::Status RenderStruct(const Message& message, StringPiece name,
+                              ObjectWriter* ow) const;
+  util::Status RenderStructValue(const Message& message, StringPiece name,
+                                   ObjectWriter* ow) const;
+  util::Status RenderStructListValue(const Message& message,
+                                       StringPiece name,
+                                       ObjectWriter* ow) const;
+  util::Status RenderFieldMask(const Message& message, StringPiece name,
+                                 ObjectWriter* ow) const;
+  util::Status RenderAny(const Message& message, StringPiece name,
+                           ObjectWriter* ow) const;
+
+  // The message to render.  Ownership rests with the caller.
+  const Message& message_;
+
+  // Used to resolve the payload types of google.protobuf.Any.
+  const TypeInfo* typeinfo_;
+
+  // Whether to render enums as ints always. Defaults to false.
+  bool use_ints_for_enums_;
+
+  // Whether to preserve proto field names
+  bool preserve_proto_field_names_;
+
+  // Tracks current recursion depth, counted like ProtoStreamObjectSource
+  // does so that the same inputs hit the limit.
+  mutable int recursion_depth_;
+
+  GOOGLE_DISALLOW_IMPLICIT_CONSTRUCTORS(ReflectionObjectSource);
+};
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_UTIL_CONVERTER_REFLECTION_OBJECTSOURCE_H__
@@ -0,0 +1,689 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/internal/reflection_objectwriter.h>
+
+#include <google/protobuf/stubs/callback.h>
+#include <google/protobuf/stubs/mutex.h>
+#include <google/protobuf/stubs/time.h>
+#include <google/protobuf/util/internal/field_mask_utility.h>
+#include <google/protobuf/util/internal/utility.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/stubs/statusor.h>
+
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+using util::Status;
+using util::StatusOr;
+
+namespace {
+
+// The well known types that ProtoStreamObjectWriter handles specially.
+enum WellKnownType {
+  WKT_NONE,
+  WKT_TIMESTAMP,
+  WKT_DURATION,
+  WKT_WRAPPER,
+  WKT_STRUCT,
+  WKT_VALUE,
+  WKT_LIST_VALUE,
+  WKT_FIELD_MASK,
+  WKT_ANY,
+};
+
+WellKnownType GetWellKnownType(const Descriptor* descriptor) {
+  if (descriptor->file()->package() != "google.protobuf") {
+    return WKT_NONE;
+  }
+  const string& name = descriptor->name();
+  if (name == "Timestamp") return WKT_TIMESTAMP;
+  if (name == "Duration") return WKT_DURATION;
+  if (name == "DoubleValue" || name == "FloatValue" || name == "Int64Value" ||
+      name == "UInt64Value" || name == "Int32Value" || name == "UInt32Value" ||
+      name == "BoolValue" || name == "StringValue" || name == "BytesValue") {
+    return WKT_WRAPPER;
+  }
+  if (name == "Struct") return WKT_STRUCT;
+  if (name == "Value") return WKT_VALUE;
+  if (name == "ListValue") return WKT_LIST_VALUE;
+  if (name == "FieldMask") return WKT_FIELD_MASK;
+  if (name == "Any") return WKT_ANY;
+  return WKT_NONE;
+}
+
+// Returns true for the well known types that have a JSON value rendering in
+// ProtoStreamObjectWriter, i.e. the ones in its TypeRenderer map.
+bool HasTypeRenderer(WellKnownType well_known_type) {
+  switch (well_known_type) {
+    case WKT_TIMESTAMP:
+    case WKT_DURATION:
+    case WKT_WRAPPER:
+    case WKT_VALUE:
+    case WKT_FIELD_MASK:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool IsNullValueEnum(const FieldDescriptor* field) {
+  return field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM &&
+         field->enum_type()->full_name() == "google.protobuf.NullValue";
+}
+
+bool IsProto3String(const FieldDescriptor* field) {
+  return field->type() == FieldDescriptor::TYPE_STRING &&
+         field->file()->syntax() == FileDescriptor::SYNTAX_PROTO3;
+}
+
+Status Unimplemented(StringPiece message) {
+  return Status(util::error::UNIMPLEMENTED, message);
+}
+
+// Same as DataPiece::ToEnum(), with an EnumDescriptor instead of a
+// google::protobuf::Enum and use_lower_camel_for_enums off.
+StatusOr<int> ToEnum(const DataPiece& data, const EnumDescriptor* enum_type,
+                     bool ignore_unknown_enum_values,
+                     bool* is_unknown_enum_value) {
+  if (data.type() == DataPiece::TYPE_NULL) return 0;
+  if (data.type() != DataPiece::TYPE_STRING) return data.ToInt32();
+
+  string enum_name = string(data.str());
+  const EnumValueDescriptor* value = enum_type->FindValueByName(enum_name);
+  if (value != nullptr) return value->number();
+
+  StatusOr<int32> int_value = data.ToInt32();
+  if (int_value.ok() &&
+      enum_type->FindValueByNumber(int_value.ValueOrDie()) != nullptr) {
+    return int_value.ValueOrDie();
+  }
+
+  for (string::iterator it = enum_name.begin(); it != enum_name.end(); ++it) {
+    *it = *it == '-' ? '_' : ascii_toupper(*it);
+  }
+  value = enum_type->FindValueByName(enum_name);
+  if (value != nullptr) return value->number();
+
+  if (ignore_unknown_enum_values) {
+    *is_unknown_enum_value = true;
+    return enum_type->value(0)->number();
+  }
+  return Unimplemented("Unknown enum value.");
+}
+
+// Converts a JSON object name to the key of a map entry, like ProtoWriter
+// does for the "key" field.
+Status ToMapKey(const DataPiece& data, const FieldDescriptor* key_field,
+                MapKey* key) {
+  switch (key_field->cpp_type()) {
+#define HANDLE_TYPE(CPPTYPE, TYPE, METHOD, CONVERT) \
+  case FieldDescriptor::CPPTYPE_##CPPTYPE: {        \
+    StatusOr<TYPE> value = data.CONVERT();          \
+    if (!value.ok()) return value.status();         \
+    key->Set##METHOD##Value(value.ValueOrDie());    \
+    return Status();                                \
+  }
+    HANDLE_TYPE(INT32, int32, Int32, ToInt32)
+    HANDLE_TYPE(INT64, int64, Int64, ToInt64)
+    HANDLE_TYPE(UINT32, uint32, UInt32, ToUint32)
+    HANDLE_TYPE(UINT64, uint64, UInt64, ToUint64)
+    HANDLE_TYPE(BOOL, bool, Bool, ToBool)
+#undef HANDLE_TYPE
+    case FieldDescriptor::CPPTYPE_STRING: {
+      StatusOr<string> value = data.ToString();
+      if (!value.ok()) return value.status();
+      if (IsProto3String(key_field) &&
+          !::google::protobuf::internal::IsStructurallyValidUTF8(
+              value.ValueOrDie())) {
+        return Unimplemented("Map key is not valid UTF-8.");
+      }
+      key->SetStringValue(value.ValueOrDie());
+      return Status();
+    }
+    default:
+      return Unimplemented("Unsupported map key type.");
+  }
+}
+
+Status AddFieldMaskPath(Message* field_mask, StringPiece path) {
+  field_mask->GetReflection()->AddString(
+      field_mask, field_mask->GetDescriptor()->FindFieldByName("paths"),
+      ConvertFieldMaskPath(path, &ToSnakeCase));
+  return Status();
+}
+
+}  // namespace
+
+ReflectionObjectWriter::ReflectionObjectWriter(Message* message)
+    : message_(message),
+      skip_depth_(0),
+      ignore_unknown_fields_(false),
+      done_(false) {}
+
+ReflectionObjectWriter::~ReflectionObjectWriter() {}
+
+Status ReflectionObjectWriter::status() const {
+  if (!status_.ok()) return status_;
+  if (!done_) return Unimplemented("JSON object is incomplete.");
+  if (!message_->IsInitialized()) {
+    return Unimplemented("Message is missing required fields.");
+  }
+  return Status();
+}
+
+ReflectionObjectWriter* ReflectionObjectWriter::StartObject(StringPiece name) {
+  if (!status_.ok()) return this;
+  if (skip_depth_ > 0) {
+    ++skip_depth_;
+    return this;
+  }
+
+  if (stack_.empty()) {
+    // The binary path renders a few well known types from a JSON value at the
+    // root; keep the object form for it as well.
+    if (done_ || !name.empty() ||
+        GetWellKnownType(message_->GetDescriptor()) != WKT_NONE) {
+      Unsupported("root object");
+      return this;
+    }
+    stack_.push_back(Element(Element::MESSAGE, message_, nullptr));
+    stack_.back().oneofs_taken.resize(
+        message_->GetDescriptor()->oneof_decl_count());
+    return this;
+  }
+
+  Slot slot;
+  if (!ResolveSlot(name, &slot)) {
+    if (status_.ok()) skip_depth_ = 1;
+    return this;
+  }
+
+  const FieldDescriptor* field = slot.field;
+  if (stack_.back().kind == Element::MESSAGE && field->is_repeated()) {
+    if (!field->is_map()) {
+      Unsupported(StrCat("object for repeated field ", field->name()));
+      return this;
+    }
+    stack_.push_back(Element(Element::MAP, slot.message, field));
+    return this;
+  }
+  if (field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) {
+    Unsupported(StrCat("object for field ", field->name()));
+    return this;
+  }
+  if (!TakeOneof(field)) return this;
+  StartMessageObject(&slot);
+  return this;
+}
+
+ReflectionObjectWriter* ReflectionObjectWriter::EndObject() {
+  if (!status_.ok()) return this;
+  if (skip_depth_ > 0) {
+    --skip_depth_;
+    return this;
+  }
+
+  if (stack_.empty() || stack_.back().kind == Element::LIST) {
+    Unsupported("end of object");
+    return this;
+  }
+  stack_.pop_back();
+  if (stack_.empty()) done_ = true;
+  return this;
+}
+
+ReflectionObjectWriter* ReflectionObjectWriter::StartList(StringPiece name) {
+  if (!status_.ok()) return this;
+  if (skip_depth_ > 0) {
+    ++skip_depth_;
+    return this;
+  }
+
+  if (stack_.empty()) {
+    Unsupported("root list");
+    return this;
+  }
+
+  Slot slot;
+  if (!ResolveSlot(name, &slot)) {
+    if (status_.ok()) skip_depth_ = 1;
+    return this;
+  }
+
+  const FieldDescriptor* field = slot.field;
+  if (stack_.back().kind == Element::MESSAGE && field->is_repeated()) {
+    if (field->is_map()) {
+      Unsupported(StrCat("list for map field ", field->name()));
+      return this;
+    }
+    stack_.push_back(Element(Element::LIST, slot.message, field));
+    return this;
+  }
+
+  // Otherwise the list is a single value of a google.protobuf.Value or
+  // google.protobuf.ListValue field, a list element or a map value.
+  const WellKnownType well_known_type =
+      field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE
+          ? GetWellKnownType(field->message_type())
+          : WKT_NONE;
+  if (well_known_type != WKT_VALUE && well_known_type != WKT_LIST_VALUE) {
+    Unsupported(StrCat("list for field ", field->name()));
+    return this;
+  }
+  if (!TakeOneof(field)) return this;
+
+  Message* list_value = MutableMessage(&slot);
+  if (well_known_type == WKT_VALUE) {
+    Message* value = list_value;
+    list_value = value->GetReflection()->MutableMessage(
+        value, value->GetDescriptor()->FindFieldByName("list_value"));
+  }
+  stack_.push_back(Element(Element::LIST, list_value,
+                           list_value->GetDescriptor()->field(0)));
+  return this;
+}
+
+ReflectionObjectWriter* ReflectionObjectWriter::EndList() {
+  if (!status_.ok()) return this;
+  if (skip_depth_ > 0) {
+    --skip_depth_;
+    return this;
+  }
+
+  if (stack_.empty() || stack_.back().kind != Element::LIST) {
+    Unsupported("end of list");
+    return this;
+  }
+  stack_.pop_back();
+  return this;
+}
+
+ReflectionObjectWriter* ReflectionObjectWriter::RenderDataPiece(
+    StringPiece name, const DataPiece& data) {
+  if (!status_.ok() || skip_depth_ > 0) return this;
+
+  if (stack_.empty()) {
+    Unsupported("root value");
+    return this;
+  }
+
+  Slot slot;
+  if (!ResolveSlot(name, &slot)) return this;
+
+  const FieldDescriptor* field = slot.field;
+  const bool is_null = data.type() == DataPiece::TYPE_NULL;
+  const WellKnownType well_known_type =
+      field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE
+          ? GetWellKnownType(field->message_type())
+          : WKT_NONE;
+
+  if (stack_.back().kind == Element::MESSAGE && field->is_repeated()) {
+    // The binary path accepts a single value for a repeated field, but that
+    // is not worth repeating here.  Nulls are ignored, except for Value.
+    if (!is_null || well_known_type == WKT_VALUE) {
+      Unsupported(StrCat("single value for repeated field ", field->name()));
+    }
+    return this;
+  }
+
+  if (HasTypeRenderer(well_known_type)) {
+    // Pass through null value only for google.protobuf.Value.  Map values
+    // are created anyway.
+    if (is_null && well_known_type != WKT_VALUE && !slot.in_map) return this;
+    if (!TakeOneof(field)) return this;
+    Status status = RenderWellKnownType(MutableMessage(&slot), data);
+    if (!status.ok()) Unsupported(status.error_message());
+    return this;
+  }
+
+  if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+    if (!is_null) Unsupported(StrCat("value for field ", field->name()));
+    return this;
+  }
+
+  // Null is absence, unless the field is a google.protobuf.NullValue.
+  if (is_null && !IsNullValueEnum(field)) return this;
+  if (!TakeOneof(field)) return this;
+  Status status = RenderScalar(&slot, data);
+  if (!status.ok()) Unsupported(status.error_message());
+  return this;
+}
+
+bool ReflectionObjectWriter::ResolveSlot(StringPiece name, Slot* slot) {
+  Element& element = stack_.back();
+  switch (element.kind) {
+    case Element::MESSAGE: {
+      const FieldDescriptor* field =
+          FindField(element.message->GetDescriptor(), name);
+      if (field == nullptr) {
+        if (!ignore_unknown_fields_) {
+          Unsupported(StrCat("unknown field ", name));
+        }
+        return false;
+      }
+      slot->message = element.message;
+      slot->field = field;
+      return true;
+    }
+    case Element::LIST: {
+      slot->message = element.message;
+      slot->field = element.field;
+      return true;
+    }
+    case Element::MAP: {
+      const Descriptor* entry = element.field->message_type();
+      MapKey key;
+      Status status = ToMapKey(DataPiece(name, use_strict_base64_decoding()),
+                               entry->field(0), &key);
+      if (!status.ok()) {
+        Unsupported(status.error_message());
+        return false;
+      }
+      if (!element.message->GetReflection()->InsertOrLookupMapValue(
+              element.message, element.field, key, &slot->map_value)) {
+        Unsupported(StrCat("repeated map key ", name));
+        return false;
+      }
+      slot->message = element.message;
+      slot->field = entry->field(1);
+      slot->in_map = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ReflectionObjectWriter::TakeOneof(const FieldDescriptor* field) {
+  Element& element = stack_.back();
+  if (element.kind != Element::MESSAGE) return true;
+  const OneofDescriptor* oneof = field->containing_oneof();
+  if (oneof == nullptr) return true;
+  if (element.oneofs_taken[oneof->index()]) {
+    Unsupported(StrCat("second field of oneof ", oneof->name()));
+    return false;
+  }
+  element.oneofs_taken[oneof->index()] = true;
+  return true;
+}
+
+Message* ReflectionObjectWriter::MutableMessage(Slot* slot) {
+  if (slot->in_map) return slot->map_value.MutableMessageValue();
+  const Reflection* reflection = slot->message->GetReflection();
+  if (slot->field->is_repeated()) {
+    return reflection->AddMessage(slot->message, slot->field);
+  }
+  return reflection->MutableMessage(slot->message, slot->field);
+}
+
+void ReflectionObjectWriter::StartMessageObject(Slot* slot) {
+  switch (GetWellKnownType(slot->field->message_type())) {
+    case WKT_ANY:
+      Unsupported(StrCat("google.protobuf.Any field ", slot->field->name()));
+      return;
+    case WKT_STRUCT: {
+      Message* struct_message = MutableMessage(slot);
+      stack_.push_back(Element(Element::MAP, struct_message,
+                               struct_message->GetDescriptor()->field(0)));
+      return;
+    }
+    case WKT_VALUE: {
+      // The only object a google.protobuf.Value holds is a Struct.
+      Message* value = MutableMessage(slot);
+      Message* struct_message = value->GetReflection()->MutableMessage(
+          value, value->GetDescriptor()->FindFieldByName("struct_value"));
+      stack_.push_back(Element(Element::MAP, struct_message,
+                               struct_message->GetDescriptor()->field(0)));
+      return;
+    }
+    default: {
+      Message* message = MutableMessage(slot);
+      stack_.push_back(Element(Element::MESSAGE, message, nullptr));
+      stack_.back().oneofs_taken.resize(
+          message->GetDescriptor()->oneof_decl_count());
+      return;
+    }
+  }
+}
+
+Status ReflectionObjectWriter::RenderScalar(Slot* slot,
+                                            const DataPiece& data) {
+  const FieldDescriptor* field = slot->field;
+  const Reflection* reflection = slot->message->GetReflection();
+  switch (field->cpp_type()) {
+#define HANDLE_TYPE(CPPTYPE, TYPE, METHOD, CONVERT)                       \
+  case FieldDescriptor::CPPTYPE_##CPPTYPE: {                              \
+    StatusOr<TYPE> value = data.CONVERT();                                \
+    if (!value.ok()) return value.status();                               \
+    if (slot->in_map) {                                                    \
+      slot->map_value.Set##METHOD##Value(value.ValueOrDie());              \
+    } else if (field->is_repeated()) {                                    \
+      reflection->Add##METHOD(slot->message, field, value.ValueOrDie());   \
+    } else {                                                              \
+      reflection->Set##METHOD(slot->message, field, value.ValueOrDie());   \
+    }                                                                     \
+    return Status();                                                      \
+  }
+    HANDLE_TYPE(INT32, int32, Int32, ToInt32)
+    HANDLE_TYPE(INT64, int64, Int64, ToInt64)
+    HANDLE_TYPE(UINT32, uint32, UInt32, ToUint32)
+    HANDLE_TYPE(UINT64, uint64, UInt64, ToUint64)
+    HANDLE_TYPE(DOUBLE, double, Double, ToDouble)
+    HANDLE_TYPE(FLOAT, float, Float, ToFloat)
+    HANDLE_TYPE(BOOL, bool, Bool, ToBool)
+#undef HANDLE_TYPE
+
+    case FieldDescriptor::CPPTYPE_STRING: {
+      StatusOr<string> value = field->type() == FieldDescriptor::TYPE_BYTES
+                                   ? data.ToBytes()
+                                   : data.ToString();
+      if (!value.ok()) return value.status();
+      // Parsing would reject the binary form.
+      if (IsProto3String(field) &&
+          !::google::protobuf::internal::IsStructurallyValidUTF8(
+              value.ValueOrDie())) {
+        return Unimplemented("String is not valid UTF-8.");
+      }
+      if (slot->in_map) {
+        slot->map_value.SetStringValue(value.ValueOrDie());
+      } else if (field->is_repeated()) {
+        reflection->AddString(slot->message, field, value.ValueOrDie());
+      } else {
+        reflection->SetString(slot->message, field, value.ValueOrDie());
+      }
+      return Status();
+    }
+
+    case FieldDescriptor::CPPTYPE_ENUM: {
+      bool is_unknown_enum_value = false;
+      StatusOr<int> value = ToEnum(data, field->enum_type(),
+                                   ignore_unknown_fields_,
+                                   &is_unknown_enum_value);
+      if (!value.ok()) return value.status();
+      if (is_unknown_enum_value) return Status();
+      // Parsing would move unknown values of closed enums to the unknown
+      // fields.
+      if (field->file()->syntax() != FileDescriptor::SYNTAX_PROTO3 &&
+          field->enum_type()->FindValueByNumber(value.ValueOrDie()) ==
+              nullptr) {
+        return Unimplemented("Unknown value for closed enum.");
+      }
+      if (slot->in_map) {
+        slot->map_value.SetEnumValue(value.ValueOrDie());
+      } else if (field->is_repeated()) {
+        reflection->AddEnumValue(slot->message, field, value.ValueOrDie());
+      } else {
+        reflection->SetEnumValue(slot->message, field, value.ValueOrDie());
+      }
+      return Status();
+    }
+
+    default:
+      return Unimplemented("Unsupported field type.");
+  }
+}
+
+Status ReflectionObjectWriter::RenderWellKnownType(Message* message,
+                                                   const DataPiece& data) {
+  const Descriptor* descriptor = message->GetDescriptor();
+  const Reflection* reflection = message->GetReflection();
+  switch (GetWellKnownType(descriptor)) {
+    case WKT_TIMESTAMP: {
+      if (data.type() == DataPiece::TYPE_NULL) return Status();
+      if (data.type() != DataPiece::TYPE_STRING) {
+        return Unimplemented("Invalid data type for timestamp.");
+      }
+      int64 seconds;
+      int32 nanos;
+      if (!::google::protobuf::internal::ParseTime(string(data.str()),
+                                                   &seconds, &nanos)) {
+        return Unimplemented("Invalid time format.");
+      }
+      reflection->SetInt64(message, descriptor->FindFieldByName("seconds"),
+                           seconds);
+      reflection->SetInt32(message, descriptor->FindFieldByName("nanos"),
+                           nanos);
+      return Status();
+    }
+    case WKT_FIELD_MASK: {
+      if (data.type() == DataPiece::TYPE_NULL) return Status();
+      if (data.type() != DataPiece::TYPE_STRING) {
+        return Unimplemented("Invalid data type for field mask.");
+      }
+      std::unique_ptr<ResultCallback1<util::Status, StringPiece>> callback(
+          ::google::protobuf::NewPermanentCallback(&AddFieldMaskPath,
+                                                   message));
+      return DecodeCompactFieldMaskPaths(data.str(), callback.get());
+    }
+    case WKT_WRAPPER: {
+      if (data.type() == DataPiece::TYPE_NULL) return Status();
+      Slot slot;
+      slot.message = message;
+      slot.field = descriptor->field(0);
+      return RenderScalar(&slot, data);
+    }
+    case WKT_VALUE: {
+      Slot slot;
+      slot.message = message;
+      switch (data.type()) {
+        case DataPiece::TYPE_INT64:
+        case DataPiece::TYPE_UINT64:
+        case DataPiece::TYPE_DOUBLE:
+          slot.field = descriptor->FindFieldByName("number_value");
+          break;
+        case DataPiece::TYPE_STRING:
+          slot.field = descriptor->FindFieldByName("string_value");
+          break;
+        case DataPiece::TYPE_BOOL:
+          slot.field = descriptor->FindFieldByName("bool_value");
+          break;
+        case DataPiece::TYPE_NULL:
+          slot.field = descriptor->FindFieldByName("null_value");
+          break;
+        default:
+          return Unimplemented("Invalid struct data type.");
+      }
+      return RenderScalar(&slot, data);
+    }
+    default:
+      // Durations are left to the binary path, which has the parser.
+      return Unimplemented(
+          StrCat("Cannot parse ", descriptor->full_name(), " value."));
+  }
+}
+
+const FieldDescriptor* ReflectionObjectWriter::FindField(
+    const Descriptor* descriptor, StringPiece name) {
+  const JsonNameIndex* index = GetJsonNameIndex(descriptor);
+  JsonNameIndex::const_iterator it = index->find(name);
+  if (it != index->end()) return it->second;
+  return descriptor->FindFieldByName(string(name));
+}
+
+ReflectionObjectWriter::JsonNameIndex*
+ReflectionObjectWriter::NewJsonNameIndex(const Descriptor* descriptor) {
+  // Like TypeInfo::FindField(), the first field with a JSON name wins.
+  JsonNameIndex* index = new JsonNameIndex;
+  for (int i = 0; i < descriptor->field_count(); ++i) {
+    const FieldDescriptor* field = descriptor->field(i);
+    index->insert(std::make_pair(StringPiece(field->json_name()), field));
+  }
+  return index;
+}
+
+const ReflectionObjectWriter::JsonNameIndex*
+ReflectionObjectWriter::GetJsonNameIndex(const Descriptor* descriptor) {
+  const JsonNameIndex*& index = json_name_indices_[descriptor];
+  if (index != nullptr) return index;
+  // Other pools may be deleted, and a new descriptor may reuse the address of
+  // a deleted one, so only the indices of generated types are shared.
+  if (descriptor->file()->pool() != DescriptorPool::generated_pool()) {
+    owned_json_name_indices_.emplace_back(NewJsonNameIndex(descriptor));
+    index = owned_json_name_indices_.back().get();
+    return index;
+  }
+  typedef std::unordered_map<const Descriptor*, std::unique_ptr<JsonNameIndex>>
+      Cache;
+  static ::google::protobuf::internal::WrappedMutex mutex;
+  static Cache* cache =
+      ::google::protobuf::internal::OnShutdownDelete(new Cache());
+  {
+    ReaderMutexLock lock(&mutex);
+    Cache::const_iterator it = cache->find(descriptor);
+    if (it != cache->end()) {
+      index = it->second.get();
+      return index;
+    }
+  }
+  // Build the index outside of the lock; if two threads race, the first
+  // result wins and the other is dropped.
+  std::unique_ptr<JsonNameIndex> built(NewJsonNameIndex(descriptor));
+  WriterMutexLock lock(&mutex);
+  std::unique_ptr<JsonNameIndex>& cached = (*cache)[descriptor];
+  if (cached == nullptr) cached = std::move(built);
+  index = cached.get();
+  return index;
+}
+
+void ReflectionObjectWriter::Unsupported(StringPiece what) {
+  if (status_.ok()) {
+    status_ = Unimplemented(
+        StrCat("Cannot parse ", what, " through reflection."));
+  }
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
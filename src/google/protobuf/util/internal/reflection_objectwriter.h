@@ -0,0 +1,245 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GOOGLE_PROTOBUF_UTIL_CONVERTER_REFLECTION_OBJECTWRITER_H__
+#define GOOGLE_PROTOBUF_UTIL_CONVERTER_REFLECTION_OBJECTWRITER_H__
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/map_field.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/util/internal/datapiece.h>
+#include <google/protobuf/util/internal/object_writer.h>
+#include <google/protobuf/stubs/hash.h>
+#include <google/protobuf/stubs/stringpiece.h>
+#include <google/protobuf/stubs/status.h>
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+// An ObjectWriter that sets the fields of a Message through its Reflection
+// interface.  Fed by a JsonStreamParser, it leaves the message in the same
+// state as running the JSON through a ProtoStreamObjectWriter and parsing the
+// resulting bytes, without producing those bytes.  Sub-messages are created
+// through Reflection, so they live on the arena of the target message.
+//
+// Not every input is handled.  Anything the binary path would reject, and a
+// few things it accepts but that are not worth repeating here (for example
+// google.protobuf.Any, Duration strings, or repeated oneof and map keys),
+// make the writer stop and report an UNIMPLEMENTED status().  The target
+// message is then left partially populated; the caller should discard it and
+// take the binary path, which produces the reference result or error.
+//
+// Sample usage:
+//   ReflectionObjectWriter writer(<some empty message>);
+//   JsonStreamParser parser(&writer);
+//   parser.Parse(json);
+//   parser.FinishParse();
+//   if (!writer.status().ok()) { <discard message and fall back> }
+class PROTOBUF_EXPORT ReflectionObjectWriter : public ObjectWriter {
+ public:
+  // message must be empty.  Ownership rests with the caller.
+  explicit ReflectionObjectWriter(Message* message);
+  ~ReflectionObjectWriter() override;
+
+  // ObjectWriter methods.
+  ReflectionObjectWriter* StartObject(StringPiece name) override;
+  ReflectionObjectWriter* EndObject() override;
+  ReflectionObjectWriter* StartList(StringPiece name) override;
+  ReflectionObjectWriter* EndList() override;
+  ReflectionObjectWriter* RenderBool(StringPiece name, bool value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderInt32(StringPiece name,
+                                      int32 value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderUint32(StringPiece name,
+                                       uint32 value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderInt64(StringPiece name,
+                                      int64 value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderUint64(StringPiece name,
+                                       uint64 value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderDouble(StringPiece name,
+                                       double value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderFloat(StringPiece name,
+                                      float value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderString(StringPiece name,
+                                       StringPiece value) override {
+    return RenderDataPiece(name,
+                           DataPiece(value, use_strict_base64_decoding()));
+  }
+  ReflectionObjectWriter* RenderBytes(StringPiece name,
+                                      StringPiece value) override {
+    return RenderDataPiece(
+        name, DataPiece(value, false, use_strict_base64_decoding()));
+  }
+  ReflectionObjectWriter* RenderNull(StringPiece name) override {
+    return RenderDataPiece(name, DataPiece::NullData());
+  }
+
+  bool done() override { return done_; }
+
+  // When true, fields not found in the message are skipped, and so are
+  // unknown enum names, as ProtoStreamObjectWriter does with both its
+  // ignore_unknown_fields and ignore_unknown_enum_values options set.
+  void set_ignore_unknown_fields(bool ignore_unknown_fields) {
+    ignore_unknown_fields_ = ignore_unknown_fields;
+  }
+
+  // OK once a complete, initialized message has been written.  UNIMPLEMENTED
+  // if the input needs the binary path, or if the root object is not
+  // finished yet.
+  util::Status status() const;
+
+ private:
+  // An open JSON object or list.
+  struct Element {
+    enum Kind {
+      MESSAGE,  // An object whose names are fields of 'message'.
+      LIST,     // A list of values for the repeated 'field' of 'message'.
+      MAP,      // An object whose names are keys of the map 'field'.
+    };
+
+    Element(Kind kind, Message* message, const FieldDescriptor* field)
+        : kind(kind), message(message), field(field) {}
+
+    Kind kind;
+    Message* message;
+    const FieldDescriptor* field;
+    // MESSAGE only.  The oneofs set by this object so far, by oneof index.
+    std::vector<bool> oneofs_taken;
+  };
+
+  // Where the value named in the current event goes: a field of a message,
+  // or the value of a map entry.
+  struct Slot {
+    Slot() : message(nullptr), field(nullptr), in_map(false) {}
+
+    Message* message;
+    // The field that determines the type of the value.  For maps this is the
+    // value field of the entry.
+    const FieldDescriptor* field;
+    bool in_map;
+    MapValueRef map_value;
+  };
+
+  // Field lookup by JSON name, built once per message type.  The indices of
+  // generated types are shared by all writers.
+  typedef std::unordered_map<StringPiece, const FieldDescriptor*,
+                             hash<StringPiece> >
+      JsonNameIndex;
+
+  ReflectionObjectWriter* RenderDataPiece(StringPiece name,
+                                          const DataPiece& data);
+
+  // Fills in the slot for 'name' in the innermost element.  Returns false if
+  // there is none: either the name is an unknown field to ignore, or
+  // Unsupported() has been called.  Map entries are created here, since the
+  // binary path writes them even for null values.
+  bool ResolveSlot(StringPiece name, Slot* slot);
+
+  // Implements the oneof checks of ProtoWriter::ValidOneof() for a field of
+  // the innermost element.  Returns false after calling Unsupported() if
+  // another field of the oneof was set before.
+  bool TakeOneof(const FieldDescriptor* field);
+
+  // Returns the message in 'slot', adding or creating it as needed.
+  Message* MutableMessage(Slot* slot);
+
+  // Pushes the element for the JSON object written to a message 'slot'.
+  void StartMessageObject(Slot* slot);
+
+  // Converts 'data' like ProtoWriter does and stores it in 'slot'.
+  util::Status RenderScalar(Slot* slot, const DataPiece& data);
+
+  // Applies the ProtoStreamObjectWriter rendering for well known types that
+  // can be written as a JSON value.
+  util::Status RenderWellKnownType(Message* message, const DataPiece& data);
+
+  const FieldDescriptor* FindField(const Descriptor* descriptor,
+                                   StringPiece name);
+
+  // Returns the JSON name index of 'descriptor'.
+  const JsonNameIndex* GetJsonNameIndex(const Descriptor* descriptor);
+  static JsonNameIndex* NewJsonNameIndex(const Descriptor* descriptor);
+
+  void Unsupported(StringPiece what);
+
+  // The message being populated.  Ownership rests with the caller.
+  Message* const message_;
+
+  std::vector<Element> stack_;
+
+  // The indices looked up so far.  Those of types outside the generated pool
+  // are owned by 'owned_json_name_indices_'.
+  std::unordered_map<const Descriptor*, const JsonNameIndex*>
+      json_name_indices_;
+  std::vector<std::unique_ptr<JsonNameIndex>> owned_json_name_indices_;
+
+  // The first reason to fall back to the binary path, if any.
+  util::Status status_;
+
+  // Nesting depth of the unknown field being skipped.
+  int skip_depth_;
+
+  bool ignore_unknown_fields_;
+
+  bool done_;
+
+  GOOGLE_DISALLOW_IMPLICIT_CONSTRUCTORS(ReflectionObjectWriter);
+};
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_UTIL_CONVERTER_REFLECTION_OBJECTWRITER_H__
@@ -30,17 +30,25 @@
 
 #include <google/protobuf/util/internal/type_info.h>
 
+#include <atomic>
 #include <map>
+#include <memory>
 #include <set>
+#include <unordered_map>
+#include <vector>
 
 #include <google/protobuf/stubs/common.h>
+#include <google/protobuf/stubs/mutex.h>
 #include <google/protobuf/type.pb.h>
 #include <google/protobuf/util/internal/utility.h>
 #include <google/protobuf/stubs/stringpiece.h>
+#include <google/protobuf/stubs/hash.h>
 #include <google/protobuf/stubs/map_util.h>
 #include <google/protobuf/stubs/status.h>
 #include <google/protobuf/stubs/statusor.h>
 
+#include <google/protobuf/port_def.inc>
+
 namespace google {
 namespace protobuf {
 namespace util {
@@ -169,12 +177,259 @@ class TypeInfoForTypeResolver : public TypeInfo {
   mutable std::map<const google::protobuf::Type*, CamelCaseNameTable>
       indexed_types_;
 };
+
+// The number of independently locked parts of a ConcurrentTable.
+const int kNumShards = 16;
+
+// Spreads the bits of 'hash' so that both the shard and the slot can be taken
+// from it, even for pointers, whose low bits are mostly zero.
+inline size_t MixHash(size_t hash) {
+  uint64 mixed =
+      static_cast<uint64>(hash) * PROTOBUF_ULONGLONG(0x9E3779B97F4A7C15);
+  return static_cast<size_t>(mixed ^ (mixed >> 32));
+}
+
+// An insert-only hash table from Key to an owned Value, split into shards.
+//
+// Find() takes no locks.  Entries are published into open-addressing slot
+// arrays with release stores and never change or move afterwards.  Insert()
+// locks one shard.  When a shard outgrows its slots, they are copied into an
+// array twice as large; the old array stays alive until the table is
+// destroyed, since readers may still be probing it.
+template <typename Key, typename Value>
+class ConcurrentTable {
+ public:
+  ConcurrentTable() {}
+
+  // Returns the value for 'key', or NULL.  'hash' must be MixHash()ed.
+  template <typename LookupKey>
+  const Value* Find(const LookupKey& key, size_t hash) const {
+    const Slots* slots =
+        shards_[hash % kNumShards].slots.load(std::memory_order_acquire);
+    if (slots == NULL) return NULL;
+    for (size_t i = hash / kNumShards;; ++i) {
+      const Entry* entry =
+          slots->entries[i & slots->mask].load(std::memory_order_acquire);
+      if (entry == NULL) return NULL;
+      if (entry->hash == hash && entry->key == key) return entry->value.get();
+    }
+  }
+
+  // Adds 'value' for 'key' unless the key is present already, and returns the
+  // value now in the table.  Takes ownership of 'value'; it is deleted if
+  // another thread got there first.
+  const Value* Insert(const Key& key, size_t hash, Value* value) {
+    std::unique_ptr<Entry> entry(new Entry(key, hash, value));
+    Shard* shard = &shards_[hash % kNumShards];
+    MutexLock lock(&shard->mutex);
+    const Value* existing = Find(key, hash);
+    if (existing != NULL) return existing;
+
+    Slots* slots = shard->slots.load(std::memory_order_relaxed);
+    if (slots == NULL || 2 * (shard->entries.size() + 1) > slots->mask + 1) {
+      Slots* grown = new Slots(slots == NULL ? 8 : 2 * (slots->mask + 1));
+      for (size_t i = 0; i < shard->entries.size(); ++i) {
+        Place(grown, shard->entries[i].get());
+      }
+      shard->slot_arrays.emplace_back(grown);
+      shard->slots.store(grown, std::memory_order_release);
+      slots = grown;
+    }
+    Place(slots, entry.get());
+    shard->entries.push_back(std::move(entry));
+    return value;
+  }
+
+ private:
+  struct Entry {
+    Entry(const Key& key, size_t hash, Value* value)
+        : key(key), hash(hash), value(value) {}
+
+    const Key key;
+    const size_t hash;
+    const std::unique_ptr<Value> value;
+  };
+
+  struct Slots {
+    explicit Slots(size_t size)
+        : mask(size - 1), entries(new std::atomic<const Entry*>[size]) {
+      for (size_t i = 0; i < size; ++i) {
+        entries[i].store(NULL, std::memory_order_relaxed);
+      }
+    }
+
+    const size_t mask;
+    std::unique_ptr<std::atomic<const Entry*>[]> entries;
+  };
+
+  struct Shard {
+    Shard() : slots(NULL) {}
+
+    // Guards everything but 'slots', which is read without it.
+    ::google::protobuf::internal::WrappedMutex mutex;
+    std::atomic<Slots*> slots;
+    std::vector<std::unique_ptr<Entry> > entries;
+    // All slot arrays ever published, including the current one.
+    std::vector<std::unique_ptr<Slots> > slot_arrays;
+  };
+
+  static void Place(Slots* slots, const Entry* entry) {
+    size_t i = entry->hash / kNumShards;
+    while (slots->entries[i & slots->mask].load(std::memory_order_relaxed) !=
+           NULL) {
+      ++i;
+    }
+    slots->entries[i & slots->mask].store(entry, std::memory_order_release);
+  }
+
+  Shard shards_[kNumShards];
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ConcurrentTable);
+};
+
+// Hash tables over the fields of a Type.  Where several fields share a key,
+// the first one wins, as with the linear scans in utility.h.
+class FieldIndex {
+ public:
+  explicit FieldIndex(const google::protobuf::Type& type) {
+    for (int i = 0; i < type.fields_size(); ++i) {
+      const google::protobuf::Field& field = type.fields(i);
+      by_name_.insert(std::make_pair(StringPiece(field.name()), &field));
+      by_number_.insert(std::make_pair(field.number(), &field));
+      std::pair<JsonNameMap::iterator, bool> inserted = by_json_name_.insert(
+          std::make_pair(StringPiece(field.json_name()), &field));
+      if (!inserted.second && inserted.first->second->name() != field.name()) {
+        GOOGLE_LOG(WARNING) << "Field '" << field.name() << "' and '"
+                     << inserted.first->second->name()
+                     << "' map to the same camel case name '"
+                     << field.json_name() << "'.";
+      }
+    }
+  }
+
+  // Same result as TypeInfoForTypeResolver::FindField().
+  const google::protobuf::Field* FindField(StringPiece camel_case_name) const {
+    JsonNameMap::const_iterator it = by_json_name_.find(camel_case_name);
+    StringPiece name =
+        it == by_json_name_.end() ? camel_case_name
+                                  : StringPiece(it->second->name());
+    return FindWithDefault(by_name_, name, NULL);
+  }
+
+  const google::protobuf::Field* FindFieldByNumber(int32 number) const {
+    return FindWithDefault(by_number_, number, NULL);
+  }
+
+ private:
+  typedef std::unordered_map<StringPiece, const google::protobuf::Field*,
+                             hash<StringPiece> >
+      JsonNameMap;
+
+  JsonNameMap by_json_name_;
+  std::unordered_map<StringPiece, const google::protobuf::Field*,
+                     hash<StringPiece> >
+      by_name_;
+  std::unordered_map<int32, const google::protobuf::Field*> by_number_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(FieldIndex);
+};
+
+// A thread-safe TypeInfo that looks up information provided by a
+// TypeResolver.
+class ConcurrentTypeInfoForTypeResolver : public TypeInfo {
+ public:
+  explicit ConcurrentTypeInfoForTypeResolver(TypeResolver* type_resolver)
+      : type_resolver_(type_resolver) {}
+
+  util::StatusOr<const google::protobuf::Type*> ResolveTypeUrl(
+      StringPiece type_url) const override {
+    size_t hash = MixHash(hash_url_(type_url));
+    const google::protobuf::Type* found = types_.Find(type_url, hash);
+    if (found != NULL) return found;
+
+    string string_type_url(type_url);
+    std::unique_ptr<google::protobuf::Type> type(new google::protobuf::Type());
+    util::Status status =
+        type_resolver_->ResolveMessageType(string_type_url, type.get());
+    if (!status.ok()) return status;
+    const google::protobuf::Type* inserted = type.get();
+    const google::protobuf::Type* result =
+        types_.Insert(string_type_url, hash, type.release());
+    if (result == inserted) {
+      // Until this is done, other threads scan the fields of 'result'.
+      indices_.Insert(result, HashType(result), new FieldIndex(*result));
+    }
+    return result;
+  }
+
+  const google::protobuf::Type* GetTypeByTypeUrl(
+      StringPiece type_url) const override {
+    util::StatusOr<const google::protobuf::Type*> result =
+        ResolveTypeUrl(type_url);
+    return result.ok() ? result.ValueOrDie() : NULL;
+  }
+
+  const google::protobuf::Enum* GetEnumByTypeUrl(
+      StringPiece type_url) const override {
+    size_t hash = MixHash(hash_url_(type_url));
+    const google::protobuf::Enum* found = enums_.Find(type_url, hash);
+    if (found != NULL) return found;
+
+    string string_type_url(type_url);
+    std::unique_ptr<google::protobuf::Enum> enum_type(
+        new google::protobuf::Enum());
+    util::Status status =
+        type_resolver_->ResolveEnumType(string_type_url, enum_type.get());
+    if (!status.ok()) return NULL;
+    return enums_.Insert(string_type_url, hash, enum_type.release());
+  }
+
+  const google::protobuf::Field* FindField(
+      const google::protobuf::Type* type,
+      StringPiece camel_case_name) const override {
+    const FieldIndex* index = indices_.Find(type, HashType(type));
+    if (index != NULL) return index->FindField(camel_case_name);
+    const google::protobuf::Field* field =
+        FindJsonFieldInTypeOrNull(type, camel_case_name);
+    return FindFieldInTypeOrNull(
+        type, field == NULL ? camel_case_name : StringPiece(field->name()));
+  }
+
+  const google::protobuf::Field* FindFieldByNumber(
+      const google::protobuf::Type* type, int32 number) const override {
+    const FieldIndex* index = indices_.Find(type, HashType(type));
+    if (index != NULL) return index->FindFieldByNumber(number);
+    return FindFieldInTypeByNumberOrNull(type, number);
+  }
+
+ private:
+  static size_t HashType(const google::protobuf::Type* type) {
+    return MixHash(reinterpret_cast<uintptr_t>(type));
+  }
+
+  TypeResolver* type_resolver_;
+  hash<StringPiece> hash_url_;
+
+  mutable ConcurrentTable<string, google::protobuf::Type> types_;
+  mutable ConcurrentTable<string, google::protobuf::Enum> enums_;
+  // Only covers the types in types_.
+  mutable ConcurrentTable<const google::protobuf::Type*, FieldIndex> indices_;
+};
 }  // namespace
 
+const google::protobuf::Field* TypeInfo::FindFieldByNumber(
+    const google::protobuf::Type* type, int32 number) const {
+  return FindFieldInTypeByNumberOrNull(type, number);
+}
+
 TypeInfo* TypeInfo::NewTypeInfo(TypeResolver* type_resolver) {
   return new TypeInfoForTypeResolver(type_resolver);
 }
 
+TypeInfo* TypeInfo::NewConcurrentTypeInfo(TypeResolver* type_resolver) {
+  return new ConcurrentTypeInfoForTypeResolver(type_resolver);
+}
+
 }  // namespace converter
 }  // namespace util
 }  // namespace protobuf
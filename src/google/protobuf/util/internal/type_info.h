@@ -44,8 +44,9 @@ namespace google {
 namespace protobuf {
 namespace util {
 namespace converter {
-// Internal helper class for type resolving. Note that this class is not
-// thread-safe and should only be accessed in one thread.
+// Internal helper class for type resolving.  Instances created by
+// NewTypeInfo() are not thread-safe and should only be accessed in one thread;
+// those created by NewConcurrentTypeInfo() may be shared by all threads.
 class PROTOBUF_EXPORT TypeInfo {
  public:
   TypeInfo() {}
@@ -78,10 +79,25 @@ class PROTOBUF_EXPORT TypeInfo {
       const google::protobuf::Type* type,
       StringPiece camel_case_name) const = 0;
 
+  // Looks up a field in the specified type given its number.  Returns NULL if
+  // there is none.
+  virtual const google::protobuf::Field* FindFieldByNumber(
+      const google::protobuf::Type* type, int32 number) const;
+
   // Creates a TypeInfo object that looks up type information from a
   // TypeResolver. Caller takes ownership of the returned pointer.
   static TypeInfo* NewTypeInfo(TypeResolver* type_resolver);
 
+  // Like NewTypeInfo(), but the returned TypeInfo is thread-safe, so that one
+  // instance can serve the converters of all threads.  Lookups of types seen
+  // before take no locks.  For each resolved type, hash tables by name and by
+  // number back FindField() and FindFieldByNumber(); types not obtained from
+  // this TypeInfo are scanned instead.  Failed lookups are not remembered.
+  //
+  // type_resolver must be thread-safe and outlive the returned TypeInfo.
+  // Caller takes ownership of the returned pointer.
+  static TypeInfo* NewConcurrentTypeInfo(TypeResolver* type_resolver);
+
  private:
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(TypeInfo);
 };
@@ -0,0 +1,178 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/internal/type_info.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <google/protobuf/util/internal/testdata/books.pb.h>
+#include <google/protobuf/util/internal/constants.h>
+#include <google/protobuf/util/type_resolver.h>
+#include <google/protobuf/util/type_resolver_util.h>
+#include <gtest/gtest.h>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+namespace {
+
+using google::protobuf::testing::Author;
+using google::protobuf::testing::Book;
+
+template <typename DescriptorType>
+string TypeUrl(const DescriptorType* descriptor) {
+  return string(kTypeServiceBaseUrl) + "/" + descriptor->full_name();
+}
+
+class ConcurrentTypeInfoTest : public ::testing::Test {
+ protected:
+  ConcurrentTypeInfoTest()
+      : type_resolver_(NewTypeResolverForDescriptorPool(
+            kTypeServiceBaseUrl, DescriptorPool::generated_pool())),
+        typeinfo_(TypeInfo::NewConcurrentTypeInfo(type_resolver_.get())),
+        reference_(TypeInfo::NewTypeInfo(type_resolver_.get())) {}
+
+  std::unique_ptr<TypeResolver> type_resolver_;
+  std::unique_ptr<TypeInfo> typeinfo_;
+  // The single-threaded TypeInfo, whose answers must match.
+  std::unique_ptr<TypeInfo> reference_;
+};
+
+TEST_F(ConcurrentTypeInfoTest, ResolvesTypesOnce) {
+  const google::protobuf::Type* type =
+      typeinfo_->GetTypeByTypeUrl(TypeUrl(Book::descriptor()));
+  ASSERT_TRUE(type != NULL);
+  EXPECT_EQ("google.protobuf.testing.Book", type->name());
+  EXPECT_EQ(type, typeinfo_->GetTypeByTypeUrl(TypeUrl(Book::descriptor())));
+  util::StatusOr<const google::protobuf::Type*> resolved =
+      typeinfo_->ResolveTypeUrl(TypeUrl(Book::descriptor()));
+  ASSERT_TRUE(resolved.ok());
+  EXPECT_EQ(type, resolved.ValueOrDie());
+
+  const google::protobuf::Enum* enum_type = typeinfo_->GetEnumByTypeUrl(
+      TypeUrl(Book::descriptor()->FindEnumTypeByName("Type")));
+  ASSERT_TRUE(enum_type != NULL);
+  EXPECT_EQ(enum_type,
+            typeinfo_->GetEnumByTypeUrl(
+                TypeUrl(Book::descriptor()->FindEnumTypeByName("Type"))));
+}
+
+TEST_F(ConcurrentTypeInfoTest, ReportsUnknownTypes) {
+  string type_url = string(kTypeServiceBaseUrl) + "/no.such.Type";
+  EXPECT_EQ(util::error::NOT_FOUND,
+            typeinfo_->ResolveTypeUrl(type_url).status().error_code());
+  EXPECT_TRUE(typeinfo_->GetTypeByTypeUrl(type_url) == NULL);
+  EXPECT_TRUE(typeinfo_->GetEnumByTypeUrl(type_url) == NULL);
+  EXPECT_FALSE(typeinfo_->ResolveTypeUrl("no_slash").ok());
+}
+
+TEST_F(ConcurrentTypeInfoTest, FindsFieldsLikeTypeInfo) {
+  const google::protobuf::Type* type =
+      typeinfo_->GetTypeByTypeUrl(TypeUrl(Author::descriptor()));
+  const google::protobuf::Type* reference_type =
+      reference_->GetTypeByTypeUrl(TypeUrl(Author::descriptor()));
+  ASSERT_TRUE(type != NULL);
+  ASSERT_TRUE(reference_type != NULL);
+
+  const char* kNames[] = {"@id", "id", "name", "pseudonym", "alive", "friend",
+                          "unknown"};
+  for (int i = 0; i < GOOGLE_ARRAYSIZE(kNames); ++i) {
+    SCOPED_TRACE(kNames[i]);
+    const google::protobuf::Field* field =
+        typeinfo_->FindField(type, kNames[i]);
+    const google::protobuf::Field* expected =
+        reference_->FindField(reference_type, kNames[i]);
+    if (expected == NULL) {
+      EXPECT_TRUE(field == NULL);
+    } else {
+      ASSERT_TRUE(field != NULL);
+      EXPECT_EQ(expected->number(), field->number());
+    }
+    // Types from elsewhere are looked up too.
+    EXPECT_EQ(expected, typeinfo_->FindField(reference_type, kNames[i]));
+  }
+
+  for (int number = 0; number <= 6; ++number) {
+    const google::protobuf::Field* field =
+        typeinfo_->FindFieldByNumber(type, number);
+    const google::protobuf::Field* expected =
+        reference_->FindFieldByNumber(reference_type, number);
+    if (expected == NULL) {
+      EXPECT_TRUE(field == NULL);
+    } else {
+      ASSERT_TRUE(field != NULL);
+      EXPECT_EQ(expected->name(), field->name());
+    }
+  }
+}
+
+TEST_F(ConcurrentTypeInfoTest, SharedByThreads) {
+  const Descriptor* descriptors[] = {
+      Book::descriptor(), Author::descriptor(),
+      google::protobuf::testing::Publisher::descriptor(),
+      google::protobuf::testing::Primitive::descriptor()};
+  const int kNumThreads = 8;
+  std::vector<const google::protobuf::Type*> seen(
+      kNumThreads * GOOGLE_ARRAYSIZE(descriptors));
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < GOOGLE_ARRAYSIZE(descriptors); ++i) {
+        const google::protobuf::Type* type =
+            typeinfo_->GetTypeByTypeUrl(TypeUrl(descriptors[i]));
+        if (type != NULL && typeinfo_->FindFieldByNumber(type, 1) != NULL) {
+          seen[t * GOOGLE_ARRAYSIZE(descriptors) + i] = type;
+        }
+      }
+    });
+  }
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads[t].join();
+  }
+  // Every thread got the same, complete types.
+  for (int i = 0; i < GOOGLE_ARRAYSIZE(descriptors); ++i) {
+    const google::protobuf::Type* type =
+        typeinfo_->GetTypeByTypeUrl(TypeUrl(descriptors[i]));
+    ASSERT_TRUE(type != NULL);
+    EXPECT_EQ(descriptors[i]->full_name(), type->name());
+    for (int t = 0; t < kNumThreads; ++t) {
+      EXPECT_EQ(type, seen[t * GOOGLE_ARRAYSIZE(descriptors) + i]);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -55,7 +55,8 @@ namespace testing {
 void TypeInfoTestHelper::ResetTypeInfo(
     const std::vector<const Descriptor*>& descriptors) {
   switch (type_) {
-    case USE_TYPE_RESOLVER: {
+    case USE_TYPE_RESOLVER:
+    case USE_CONCURRENT_TYPE_INFO: {
       const DescriptorPool* pool = descriptors[0]->file()->pool();
       for (int i = 1; i < descriptors.size(); ++i) {
         GOOGLE_CHECK(pool == descriptors[i]->file()->pool())
@@ -63,7 +64,10 @@ void TypeInfoTestHelper::ResetTypeInfo(
       }
       type_resolver_.reset(
           NewTypeResolverForDescriptorPool(kTypeServiceBaseUrl, pool));
-      typeinfo_.reset(TypeInfo::NewTypeInfo(type_resolver_.get()));
+      typeinfo_.reset(type_ == USE_TYPE_RESOLVER
+                          ? TypeInfo::NewTypeInfo(type_resolver_.get())
+                          : TypeInfo::NewConcurrentTypeInfo(
+                                type_resolver_.get()));
       return;
     }
   }
@@ -94,6 +98,9 @@ ProtoStreamObjectSource* TypeInfoTestHelper::NewProtoSource(
       return new ProtoStreamObjectSource(coded_input, type_resolver_.get(),
                                          *type);
     }
+    case USE_CONCURRENT_TYPE_INFO: {
+      return new ProtoStreamObjectSource(coded_input, typeinfo_.get(), *type);
+    }
   }
   GOOGLE_LOG(FATAL) << "Can not reach here.";
   return NULL;
@@ -108,6 +115,10 @@ ProtoStreamObjectWriter* TypeInfoTestHelper::NewProtoWriter(
       return new ProtoStreamObjectWriter(type_resolver_.get(), *type, output,
                                          listener, options);
     }
+    case USE_CONCURRENT_TYPE_INFO: {
+      return new ProtoStreamObjectWriter(typeinfo_.get(), *type, output,
+                                         listener, options);
+    }
   }
   GOOGLE_LOG(FATAL) << "Can not reach here.";
   return NULL;
@@ -120,6 +131,9 @@ DefaultValueObjectWriter* TypeInfoTestHelper::NewDefaultValueWriter(
     case USE_TYPE_RESOLVER: {
       return new DefaultValueObjectWriter(type_resolver_.get(), *type, writer);
     }
+    case USE_CONCURRENT_TYPE_INFO: {
+      return new DefaultValueObjectWriter(typeinfo_.get(), *type, writer);
+    }
   }
   GOOGLE_LOG(FATAL) << "Can not reach here.";
   return NULL;
@@ -50,6 +50,9 @@ namespace testing {
 
 enum TypeInfoSource {
   USE_TYPE_RESOLVER,
+  // A TypeInfo from TypeInfo::NewConcurrentTypeInfo(), handed to the
+  // converters instead of the TypeResolver.
+  USE_CONCURRENT_TYPE_INFO,
 };
 
 // In the unit-tests we want to test two scenarios: one with type info from
@@ -0,0 +1,134 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/internal/type_resolver_cache.h>
+
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <google/protobuf/stubs/mutex.h>
+#include <google/protobuf/util/type_resolver_util.h>
+
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+PoolTypeInfo::PoolTypeInfo(TypeResolver* type_resolver)
+    : resolver_(type_resolver),
+      typeinfo_(TypeInfo::NewConcurrentTypeInfo(type_resolver)) {}
+
+PoolTypeInfo::~PoolTypeInfo() {}
+
+struct TypeResolverCache::State {
+  State(const string& url_prefix, int max_pools)
+      : url_prefix(url_prefix), max_pools(max_pools) {}
+
+  // Drops the entry of a destroyed pool.
+  void OnPoolDestroyed(const DescriptorPool* pool) {
+    MutexLock lock(&mutex);
+    watched_pools.erase(pool);
+    std::unordered_map<const DescriptorPool*, Entry>::iterator it =
+        entries.find(pool);
+    if (it == entries.end()) return;
+    lru.erase(it->second.lru_position);
+    entries.erase(it);
+  }
+
+  struct Entry {
+    std::shared_ptr<const PoolTypeInfo> types;
+    // Position of the pool in 'lru'.
+    std::list<const DescriptorPool*>::iterator lru_position;
+  };
+
+  const string url_prefix;
+  const int max_pools;
+
+  ::google::protobuf::internal::WrappedMutex mutex;
+  std::unordered_map<const DescriptorPool*, Entry> entries;
+  // The pools in 'entries', most recently used first.
+  std::list<const DescriptorPool*> lru;
+  // The pools that will tell us when they are destroyed.  Kept apart from
+  // 'entries' so that a pool that is dropped and used again only registers
+  // one callback.
+  std::unordered_set<const DescriptorPool*> watched_pools;
+};
+
+TypeResolverCache::TypeResolverCache(const string& url_prefix, int max_pools)
+    : state_(new State(url_prefix, max_pools)) {}
+
+TypeResolverCache::~TypeResolverCache() {}
+
+std::shared_ptr<const PoolTypeInfo> TypeResolverCache::Get(
+    const DescriptorPool* pool) {
+  MutexLock lock(&state_->mutex);
+  std::unordered_map<const DescriptorPool*, State::Entry>::iterator it =
+      state_->entries.find(pool);
+  if (it != state_->entries.end()) {
+    state_->lru.splice(state_->lru.begin(), state_->lru,
+                       it->second.lru_position);
+    return it->second.types;
+  }
+
+  if (state_->watched_pools.insert(pool).second) {
+    std::weak_ptr<State> weak_state = state_;
+    pool->InternalAddDestructionCallback([weak_state, pool]() {
+      std::shared_ptr<State> state = weak_state.lock();
+      if (state != nullptr) state->OnPoolDestroyed(pool);
+    });
+  }
+
+  State::Entry& entry = state_->entries[pool];
+  entry.types.reset(new PoolTypeInfo(
+      NewTypeResolverForDescriptorPool(state_->url_prefix, pool)));
+  state_->lru.push_front(pool);
+  entry.lru_position = state_->lru.begin();
+  std::shared_ptr<const PoolTypeInfo> types = entry.types;
+
+  while (static_cast<int>(state_->lru.size()) > state_->max_pools) {
+    state_->entries.erase(state_->lru.back());
+    state_->lru.pop_back();
+  }
+  return types;
+}
+
+int TypeResolverCache::size() const {
+  MutexLock lock(&state_->mutex);
+  return state_->entries.size();
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,110 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GOOGLE_PROTOBUF_UTIL_CONVERTER_TYPE_RESOLVER_CACHE_H__
+#define GOOGLE_PROTOBUF_UTIL_CONVERTER_TYPE_RESOLVER_CACHE_H__
+
+#include <memory>
+#include <string>
+
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/util/internal/type_info.h>
+#include <google/protobuf/util/type_resolver.h>
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+// The type information of one DescriptorPool: a resolver for its types and a
+// concurrent TypeInfo on top of it, which builds each type only once and
+// lets all threads share it.
+class PROTOBUF_EXPORT PoolTypeInfo {
+ public:
+  // Takes ownership of type_resolver, which must be thread-safe.
+  explicit PoolTypeInfo(TypeResolver* type_resolver);
+  ~PoolTypeInfo();
+
+  TypeResolver* resolver() const { return resolver_.get(); }
+  const TypeInfo* typeinfo() const { return typeinfo_.get(); }
+
+ private:
+  std::unique_ptr<TypeResolver> resolver_;
+  // Looks types up through resolver_, so it is declared after it to be
+  // destroyed first.
+  std::unique_ptr<TypeInfo> typeinfo_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(PoolTypeInfo);
+};
+
+// Hands out a PoolTypeInfo per DescriptorPool, so that converting messages
+// of the same pool over and over only builds each type once.
+//
+// At most max_pools entries are kept; the least recently used one is dropped
+// when another pool needs one.  The entry of a pool is also dropped when the
+// pool is destroyed, so a new pool that happens to get the same address never
+// sees stale types.  Entries are handed out as shared_ptrs, so dropping one
+// never affects a conversion that still uses it.
+//
+// Thread-safe.  The cache may be destroyed before or after the pools it has
+// seen.
+class PROTOBUF_EXPORT TypeResolverCache {
+ public:
+  // url_prefix is passed to NewTypeResolverForDescriptorPool().
+  TypeResolverCache(const std::string& url_prefix, int max_pools);
+  ~TypeResolverCache();
+
+  // Returns the type information of 'pool', creating it if needed.
+  std::shared_ptr<const PoolTypeInfo> Get(const DescriptorPool* pool);
+
+  // Returns the number of pools that currently have an entry.
+  int size() const;
+
+ private:
+  struct State;
+
+  // Shared with the destruction callbacks of the pools, which must not
+  // touch the cache once it is gone.
+  std::shared_ptr<State> state_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(TypeResolverCache);
+};
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_UTIL_CONVERTER_TYPE_RESOLVER_CACHE_H__
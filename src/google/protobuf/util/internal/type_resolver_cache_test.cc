@@ -0,0 +1,241 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/internal/type_resolver_cache.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/text_format.h>
+#include <google/protobuf/util/type_resolver_util.h>
+#include <google/protobuf/util/message_differencer.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <gtest/gtest.h>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+namespace {
+
+const char kUrlPrefix[] = "type.googleapis.com";
+
+// Returns a new pool holding a single file with message 'Foo' and enum 'Bar'
+// in package 'package'.
+DescriptorPool* NewPool(const string& package) {
+  FileDescriptorProto file;
+  GOOGLE_CHECK(TextFormat::ParseFromString(
+      "name: 'foo.proto' "
+      "syntax: 'proto3' "
+      "message_type { "
+      "  name: 'Foo' "
+      "  field {"
+      "    name: 'value' number: 1 type: TYPE_INT32 label: LABEL_OPTIONAL"
+      "  }"
+      "} "
+      "enum_type { name: 'Bar' value { name: 'BAR_ZERO' number: 0 } }",
+      &file));
+  file.set_package(package);
+  DescriptorPool* pool = new DescriptorPool;
+  GOOGLE_CHECK(pool->BuildFile(file) != NULL);
+  return pool;
+}
+
+string TypeUrl(const string& name) {
+  return string(kUrlPrefix) + "/" + name;
+}
+
+// Counts the lookups that reach the wrapped resolver.
+class CountingTypeResolver : public TypeResolver {
+ public:
+  CountingTypeResolver(const DescriptorPool* pool, int* lookups)
+      : resolver_(NewTypeResolverForDescriptorPool(kUrlPrefix, pool)),
+        lookups_(lookups) {}
+
+  util::Status ResolveMessageType(const string& type_url,
+                                  google::protobuf::Type* type) override {
+    ++*lookups_;
+    return resolver_->ResolveMessageType(type_url, type);
+  }
+
+  util::Status ResolveEnumType(const string& type_url,
+                               google::protobuf::Enum* enum_type) override {
+    ++*lookups_;
+    return resolver_->ResolveEnumType(type_url, enum_type);
+  }
+
+ private:
+  std::unique_ptr<TypeResolver> resolver_;
+  int* lookups_;
+};
+
+TEST(PoolTypeInfoTest, ResolvesEachTypeOnce) {
+  std::unique_ptr<DescriptorPool> pool(NewPool("a"));
+  std::unique_ptr<TypeResolver> reference(
+      NewTypeResolverForDescriptorPool(kUrlPrefix, pool.get()));
+  int lookups = 0;
+  PoolTypeInfo types(new CountingTypeResolver(pool.get(), &lookups));
+
+  google::protobuf::Type expected_type;
+  ASSERT_TRUE(
+      reference->ResolveMessageType(TypeUrl("a.Foo"), &expected_type).ok());
+  google::protobuf::Enum expected_enum;
+  ASSERT_TRUE(
+      reference->ResolveEnumType(TypeUrl("a.Bar"), &expected_enum).ok());
+
+  const google::protobuf::Type* type =
+      types.typeinfo()->GetTypeByTypeUrl(TypeUrl("a.Foo"));
+  ASSERT_TRUE(type != NULL);
+  EXPECT_TRUE(MessageDifferencer::Equals(expected_type, *type));
+  const google::protobuf::Enum* enum_type =
+      types.typeinfo()->GetEnumByTypeUrl(TypeUrl("a.Bar"));
+  ASSERT_TRUE(enum_type != NULL);
+  EXPECT_TRUE(MessageDifferencer::Equals(expected_enum, *enum_type));
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(type, types.typeinfo()->GetTypeByTypeUrl(TypeUrl("a.Foo")));
+    EXPECT_EQ(enum_type, types.typeinfo()->GetEnumByTypeUrl(TypeUrl("a.Bar")));
+  }
+  EXPECT_EQ(2, lookups);
+}
+
+TEST(PoolTypeInfoTest, DoesNotCacheErrors) {
+  std::unique_ptr<DescriptorPool> pool(NewPool("a"));
+  int lookups = 0;
+  PoolTypeInfo types(new CountingTypeResolver(pool.get(), &lookups));
+
+  EXPECT_FALSE(types.typeinfo()->ResolveTypeUrl(TypeUrl("a.Baz")).ok());
+  EXPECT_FALSE(types.typeinfo()->ResolveTypeUrl(TypeUrl("a.Baz")).ok());
+  EXPECT_EQ(2, lookups);
+}
+
+TEST(TypeResolverCacheTest, ReturnsSameTypesForPool) {
+  std::unique_ptr<DescriptorPool> pool_a(NewPool("a"));
+  std::unique_ptr<DescriptorPool> pool_b(NewPool("b"));
+  TypeResolverCache cache(kUrlPrefix, 4);
+
+  std::shared_ptr<const PoolTypeInfo> types_a = cache.Get(pool_a.get());
+  std::shared_ptr<const PoolTypeInfo> types_b = cache.Get(pool_b.get());
+  EXPECT_NE(types_a, types_b);
+  EXPECT_EQ(types_a, cache.Get(pool_a.get()));
+  EXPECT_EQ(types_b, cache.Get(pool_b.get()));
+  EXPECT_EQ(2, cache.size());
+
+  const google::protobuf::Type* type =
+      types_a->typeinfo()->GetTypeByTypeUrl(TypeUrl("a.Foo"));
+  ASSERT_TRUE(type != NULL);
+  EXPECT_EQ("a.Foo", type->name());
+  EXPECT_TRUE(types_a->typeinfo()->GetTypeByTypeUrl(TypeUrl("b.Foo")) == NULL);
+}
+
+TEST(TypeResolverCacheTest, DropsLeastRecentlyUsedPool) {
+  std::unique_ptr<DescriptorPool> pool_a(NewPool("a"));
+  std::unique_ptr<DescriptorPool> pool_b(NewPool("b"));
+  std::unique_ptr<DescriptorPool> pool_c(NewPool("c"));
+  TypeResolverCache cache(kUrlPrefix, 2);
+
+  std::shared_ptr<const PoolTypeInfo> types_a = cache.Get(pool_a.get());
+  std::shared_ptr<const PoolTypeInfo> types_b = cache.Get(pool_b.get());
+  EXPECT_EQ(types_a, cache.Get(pool_a.get()));
+  cache.Get(pool_c.get());
+  EXPECT_EQ(2, cache.size());
+
+  // 'b' was used least recently, so it had to go.
+  EXPECT_EQ(types_a, cache.Get(pool_a.get()));
+  EXPECT_NE(types_b, cache.Get(pool_b.get()));
+
+  // The dropped entry still works for whoever holds it.
+  EXPECT_TRUE(types_b->typeinfo()->GetTypeByTypeUrl(TypeUrl("b.Foo")) !=
+              NULL);
+}
+
+TEST(TypeResolverCacheTest, DropsTypesOfDestroyedPool) {
+  TypeResolverCache cache(kUrlPrefix, 4);
+  std::unique_ptr<DescriptorPool> pool_a(NewPool("a"));
+  std::unique_ptr<DescriptorPool> pool_b(NewPool("b"));
+  cache.Get(pool_a.get());
+  std::shared_ptr<const PoolTypeInfo> types_b = cache.Get(pool_b.get());
+  EXPECT_EQ(2, cache.size());
+
+  pool_a.reset();
+  EXPECT_EQ(1, cache.size());
+  EXPECT_EQ(types_b, cache.Get(pool_b.get()));
+}
+
+TEST(TypeResolverCacheTest, CacheMayGoAwayBeforePool) {
+  std::unique_ptr<DescriptorPool> pool(NewPool("a"));
+  {
+    TypeResolverCache cache(kUrlPrefix, 4);
+    cache.Get(pool.get());
+  }
+  // Destroying the pool runs the callback of the deleted cache.
+  pool.reset();
+}
+
+TEST(TypeResolverCacheTest, ConcurrentLookups) {
+  const int kNumPools = 4;
+  const int kNumThreads = 8;
+  std::vector<std::unique_ptr<DescriptorPool> > pools;
+  for (int i = 0; i < kNumPools; ++i) {
+    pools.emplace_back(NewPool("p" + SimpleItoa(i)));
+  }
+  // Smaller than the number of pools, so entries are dropped concurrently
+  // with lookups.
+  TypeResolverCache cache(kUrlPrefix, kNumPools / 2);
+
+  std::vector<std::thread> threads;
+  std::vector<int> failures(kNumThreads);
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < 200; ++i) {
+        int p = (i + t) % kNumPools;
+        string name = "p" + SimpleItoa(p) + ".Foo";
+        std::shared_ptr<const PoolTypeInfo> types = cache.Get(pools[p].get());
+        const google::protobuf::Type* type =
+            types->typeinfo()->GetTypeByTypeUrl(TypeUrl(name));
+        if (type == NULL || type->name() != name) {
+          ++failures[t];
+        }
+      }
+    });
+  }
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads[t].join();
+    EXPECT_EQ(0, failures[t]);
+  }
+  EXPECT_EQ(kNumPools / 2, cache.size());
+}
+
+}  // namespace
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
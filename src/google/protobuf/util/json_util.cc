@@ -30,16 +30,23 @@
 
 #include <google/protobuf/util/json_util.h>
 
+#include <memory>
+
 #include <google/protobuf/stubs/common.h>
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream.h>
 #include <google/protobuf/stubs/once.h>
 #include <google/protobuf/util/internal/default_value_objectwriter.h>
+#include <google/protobuf/util/internal/delimited_objectwriter.h>
 #include <google/protobuf/util/internal/error_listener.h>
 #include <google/protobuf/util/internal/json_objectwriter.h>
 #include <google/protobuf/util/internal/json_stream_parser.h>
 #include <google/protobuf/util/internal/protostream_objectsource.h>
 #include <google/protobuf/util/internal/protostream_objectwriter.h>
+#include <google/protobuf/util/internal/reflection_objectsource.h>
+#include <google/protobuf/util/internal/reflection_objectwriter.h>
+#include <google/protobuf/util/internal/type_info.h>
+#include <google/protobuf/util/internal/type_resolver_cache.h>
 #include <google/protobuf/util/type_resolver.h>
 #include <google/protobuf/util/type_resolver_util.h>
 #include <google/protobuf/stubs/bytestream.h>
@@ -82,15 +89,18 @@ void ZeroCopyStreamByteSink::Append(const char* bytes, size_t len) {
 }
 }  // namespace internal
 
-util::Status BinaryToJsonStream(TypeResolver* resolver,
-                                  const string& type_url,
-                                  io::ZeroCopyInputStream* binary_input,
-                                  io::ZeroCopyOutputStream* json_output,
-                                  const JsonPrintOptions& options) {
+namespace {
+// Like BinaryToJsonStream(), but looks the types up in 'typeinfo'.
+util::Status BinaryToJsonStreamWithTypeInfo(
+    const converter::TypeInfo* typeinfo, const string& type_url,
+    io::ZeroCopyInputStream* binary_input,
+    io::ZeroCopyOutputStream* json_output, const JsonPrintOptions& options) {
   io::CodedInputStream in_stream(binary_input);
-  google::protobuf::Type type;
-  RETURN_IF_ERROR(resolver->ResolveMessageType(type_url, &type));
-  converter::ProtoStreamObjectSource proto_source(&in_stream, resolver, type);
+  util::StatusOr<const google::protobuf::Type*> type =
+      typeinfo->ResolveTypeUrl(type_url);
+  RETURN_IF_ERROR(type.status());
+  converter::ProtoStreamObjectSource proto_source(&in_stream, typeinfo,
+                                                  *type.ValueOrDie());
   proto_source.set_use_ints_for_enums(options.always_print_enums_as_ints);
   proto_source.set_preserve_proto_field_names(
       options.preserve_proto_field_names);
@@ -99,7 +109,7 @@ util::Status BinaryToJsonStream(TypeResolver* resolver,
                                           &out_stream);
   if (options.always_print_primitive_fields) {
     converter::DefaultValueObjectWriter default_value_writer(
-        resolver, type, &json_writer);
+        typeinfo, *type.ValueOrDie(), &json_writer);
     default_value_writer.set_preserve_proto_field_names(
         options.preserve_proto_field_names);
     default_value_writer.set_print_enums_as_ints(
@@ -110,6 +120,28 @@ util::Status BinaryToJsonStream(TypeResolver* resolver,
   }
 }
 
+util::Status BinaryToJsonStringWithTypeInfo(
+    const converter::TypeInfo* typeinfo, const string& type_url,
+    const string& binary_input, string* json_output,
+    const JsonPrintOptions& options) {
+  io::ArrayInputStream input_stream(binary_input.data(), binary_input.size());
+  io::StringOutputStream output_stream(json_output);
+  return BinaryToJsonStreamWithTypeInfo(typeinfo, type_url, &input_stream,
+                                        &output_stream, options);
+}
+}  // namespace
+
+util::Status BinaryToJsonStream(TypeResolver* resolver,
+                                  const string& type_url,
+                                  io::ZeroCopyInputStream* binary_input,
+                                  io::ZeroCopyOutputStream* json_output,
+                                  const JsonPrintOptions& options) {
+  std::unique_ptr<converter::TypeInfo> typeinfo(
+      converter::TypeInfo::NewTypeInfo(resolver));
+  return BinaryToJsonStreamWithTypeInfo(typeinfo.get(), type_url,
+                                        binary_input, json_output, options);
+}
+
 util::Status BinaryToJsonString(TypeResolver* resolver,
                                   const string& type_url,
                                   const string& binary_input,
@@ -171,24 +203,24 @@ class StatusErrorListener : public converter::ErrorListener {
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(StatusErrorListener);
 };
-}  // namespace
 
-util::Status JsonToBinaryStream(TypeResolver* resolver,
-                                  const string& type_url,
-                                  io::ZeroCopyInputStream* json_input,
-                                  io::ZeroCopyOutputStream* binary_output,
-                                  const JsonParseOptions& options) {
-  google::protobuf::Type type;
-  RETURN_IF_ERROR(resolver->ResolveMessageType(type_url, &type));
+// Like JsonToBinaryStream(), but looks the types up in 'typeinfo'.
+util::Status JsonToBinaryStreamWithTypeInfo(
+    const converter::TypeInfo* typeinfo, const string& type_url,
+    io::ZeroCopyInputStream* json_input,
+    io::ZeroCopyOutputStream* binary_output,
+    const JsonParseOptions& options) {
+  util::StatusOr<const google::protobuf::Type*> type =
+      typeinfo->ResolveTypeUrl(type_url);
+  RETURN_IF_ERROR(type.status());
   internal::ZeroCopyStreamByteSink sink(binary_output);
   StatusErrorListener listener;
   converter::ProtoStreamObjectWriter::Options proto_writer_options;
   proto_writer_options.ignore_unknown_fields = options.ignore_unknown_fields;
   proto_writer_options.ignore_unknown_enum_values =
       options.ignore_unknown_fields;
-  converter::ProtoStreamObjectWriter proto_writer(resolver, type, &sink,
-                                                  &listener,
-                                                  proto_writer_options);
+  converter::ProtoStreamObjectWriter proto_writer(
+      typeinfo, *type.ValueOrDie(), &sink, &listener, proto_writer_options);
 
   converter::JsonStreamParser parser(&proto_writer);
   const void* buffer;
@@ -203,6 +235,28 @@ util::Status JsonToBinaryStream(TypeResolver* resolver,
   return listener.GetStatus();
 }
 
+util::Status JsonToBinaryStringWithTypeInfo(
+    const converter::TypeInfo* typeinfo, const string& type_url,
+    StringPiece json_input, string* binary_output,
+    const JsonParseOptions& options) {
+  io::ArrayInputStream input_stream(json_input.data(), json_input.size());
+  io::StringOutputStream output_stream(binary_output);
+  return JsonToBinaryStreamWithTypeInfo(typeinfo, type_url, &input_stream,
+                                        &output_stream, options);
+}
+}  // namespace
+
+util::Status JsonToBinaryStream(TypeResolver* resolver,
+                                  const string& type_url,
+                                  io::ZeroCopyInputStream* json_input,
+                                  io::ZeroCopyOutputStream* binary_output,
+                                  const JsonParseOptions& options) {
+  std::unique_ptr<converter::TypeInfo> typeinfo(
+      converter::TypeInfo::NewTypeInfo(resolver));
+  return JsonToBinaryStreamWithTypeInfo(typeinfo.get(), type_url, json_input,
+                                        binary_output, options);
+}
+
 util::Status JsonToBinaryString(TypeResolver* resolver,
                                   const string& type_url,
                                   StringPiece json_input,
@@ -214,64 +268,170 @@ util::Status JsonToBinaryString(TypeResolver* resolver,
       resolver, type_url, &input_stream, &output_stream, options);
 }
 
+util::Status JsonArrayToDelimitedBinaryStream(
+    TypeResolver* resolver, const string& type_url,
+    io::ZeroCopyInputStream* json_input,
+    io::ZeroCopyOutputStream* binary_output,
+    const JsonParseOptions& options) {
+  std::unique_ptr<converter::TypeInfo> typeinfo(
+      converter::TypeInfo::NewTypeInfo(resolver));
+  util::StatusOr<const google::protobuf::Type*> type =
+      typeinfo->ResolveTypeUrl(type_url);
+  RETURN_IF_ERROR(type.status());
+  StatusErrorListener listener;
+  converter::ProtoStreamObjectWriter::Options proto_writer_options;
+  proto_writer_options.ignore_unknown_fields = options.ignore_unknown_fields;
+  proto_writer_options.ignore_unknown_enum_values =
+      options.ignore_unknown_fields;
+  converter::DelimitedObjectWriter delimited_writer(
+      typeinfo.get(), *type.ValueOrDie(), &listener, proto_writer_options,
+      binary_output);
+
+  converter::JsonStreamParser parser(&delimited_writer);
+  const void* buffer;
+  int length;
+  while (json_input->Next(&buffer, &length)) {
+    if (length == 0) continue;
+    RETURN_IF_ERROR(parser.Parse(
+        StringPiece(static_cast<const char*>(buffer), length)));
+    // Stop at the first bad element rather than parsing the rest.
+    RETURN_IF_ERROR(listener.GetStatus());
+    RETURN_IF_ERROR(delimited_writer.status());
+  }
+  RETURN_IF_ERROR(parser.FinishParse());
+  RETURN_IF_ERROR(listener.GetStatus());
+  return delimited_writer.status();
+}
+
 namespace {
 const char* kTypeUrlPrefix = "type.googleapis.com";
-TypeResolver* generated_type_resolver_ = NULL;
-PROTOBUF_NAMESPACE_ID::internal::once_flag generated_type_resolver_init_;
+// Maximum number of non-generated pools whose types are kept around.
+const int kMaxCachedPools = 64;
+converter::PoolTypeInfo* generated_types_ = NULL;
+converter::TypeResolverCache* type_resolver_cache_ = NULL;
+PROTOBUF_NAMESPACE_ID::internal::once_flag generated_types_init_;
 
 string GetTypeUrl(const Message& message) {
   return string(kTypeUrlPrefix) + "/" + message.GetDescriptor()->full_name();
 }
 
-void DeleteGeneratedTypeResolver() { delete generated_type_resolver_; }
+void DeleteGeneratedTypes() {
+  delete generated_types_;
+  delete type_resolver_cache_;
+}
 
-void InitGeneratedTypeResolver() {
-  generated_type_resolver_ = NewTypeResolverForDescriptorPool(
-      kTypeUrlPrefix, DescriptorPool::generated_pool());
-  ::google::protobuf::internal::OnShutdown(&DeleteGeneratedTypeResolver);
+void InitGeneratedTypes() {
+  generated_types_ = new converter::PoolTypeInfo(
+      NewTypeResolverForDescriptorPool(kTypeUrlPrefix,
+                                       DescriptorPool::generated_pool()));
+  type_resolver_cache_ =
+      new converter::TypeResolverCache(kTypeUrlPrefix, kMaxCachedPools);
+  ::google::protobuf::internal::OnShutdown(&DeleteGeneratedTypes);
 }
 
-TypeResolver* GetGeneratedTypeResolver() {
-  PROTOBUF_NAMESPACE_ID::internal::call_once(generated_type_resolver_init_,
-                                             InitGeneratedTypeResolver);
-  return generated_type_resolver_;
+// Returns the type information of 'pool'.  Resolved types are cached, so
+// converting messages of the same pool again does not rebuild them.
+std::shared_ptr<const converter::PoolTypeInfo> GetPoolTypeInfo(
+    const DescriptorPool* pool) {
+  PROTOBUF_NAMESPACE_ID::internal::call_once(generated_types_init_,
+                                             InitGeneratedTypes);
+  if (pool == DescriptorPool::generated_pool()) {
+    // Lives until shutdown, so it is not owned by the returned pointer.
+    return std::shared_ptr<const converter::PoolTypeInfo>(
+        std::shared_ptr<const converter::PoolTypeInfo>(), generated_types_);
+  }
+  return type_resolver_cache_->Get(pool);
+}
+
+// Appends the JSON for 'message' to 'output' by walking it with reflection.
+// Fails for inputs ReflectionObjectSource cannot render exactly like
+// BinaryToJsonString() would, leaving partial output behind.
+util::Status ReflectionToJsonString(const converter::TypeInfo* typeinfo,
+                                    const Message& message, string* output,
+                                    const JsonPrintOptions& options) {
+  converter::ReflectionObjectSource reflection_source(message, typeinfo);
+  reflection_source.set_use_ints_for_enums(options.always_print_enums_as_ints);
+  reflection_source.set_preserve_proto_field_names(
+      options.preserve_proto_field_names);
+  io::StringOutputStream output_stream(output);
+  io::CodedOutputStream out_stream(&output_stream);
+  converter::JsonObjectWriter json_writer(options.add_whitespace ? " " : "",
+                                          &out_stream);
+  if (options.always_print_primitive_fields) {
+    util::StatusOr<const google::protobuf::Type*> type =
+        typeinfo->ResolveTypeUrl(GetTypeUrl(message));
+    RETURN_IF_ERROR(type.status());
+    converter::DefaultValueObjectWriter default_value_writer(
+        typeinfo, *type.ValueOrDie(), &json_writer);
+    default_value_writer.set_preserve_proto_field_names(
+        options.preserve_proto_field_names);
+    default_value_writer.set_print_enums_as_ints(
+        options.always_print_enums_as_ints);
+    return reflection_source.WriteTo(&default_value_writer);
+  } else {
+    return reflection_source.WriteTo(&json_writer);
+  }
+}
+
+// Parses 'input' into the empty 'message' by setting its fields with
+// reflection.  Fails for inputs ReflectionObjectWriter cannot handle exactly
+// like JsonToBinaryString() followed by parsing would, leaving the message
+// partially populated.
+util::Status JsonStringToMessageViaReflection(StringPiece input,
+                                              Message* message,
+                                              const JsonParseOptions& options) {
+  converter::ReflectionObjectWriter reflection_writer(message);
+  reflection_writer.set_ignore_unknown_fields(options.ignore_unknown_fields);
+  converter::JsonStreamParser parser(&reflection_writer);
+  RETURN_IF_ERROR(parser.Parse(input));
+  RETURN_IF_ERROR(parser.FinishParse());
+  return reflection_writer.status();
 }
 }  // namespace
 
 util::Status MessageToJsonString(const Message& message, string* output,
                                    const JsonOptions& options) {
-  const DescriptorPool* pool = message.GetDescriptor()->file()->pool();
-  TypeResolver* resolver =
-      pool == DescriptorPool::generated_pool()
-          ? GetGeneratedTypeResolver()
-          : NewTypeResolverForDescriptorPool(kTypeUrlPrefix, pool);
+  std::shared_ptr<const converter::PoolTypeInfo> types =
+      GetPoolTypeInfo(message.GetDescriptor()->file()->pool());
+  // Render straight from the message when possible, and otherwise go through
+  // the binary form, which also produces the errors for invalid input.
+  const size_t original_size = output->size();
   util::Status result =
-      BinaryToJsonString(resolver, GetTypeUrl(message),
-                         message.SerializeAsString(), output, options);
-  if (pool != DescriptorPool::generated_pool()) {
-    delete resolver;
+      ReflectionToJsonString(types->typeinfo(), message, output, options);
+  if (!result.ok()) {
+    output->resize(original_size);
+    result = BinaryToJsonStringWithTypeInfo(types->typeinfo(),
+                                            GetTypeUrl(message),
+                                            message.SerializeAsString(),
+                                            output, options);
   }
   return result;
 }
 
 util::Status JsonStringToMessage(StringPiece input, Message* message,
                                    const JsonParseOptions& options) {
-  const DescriptorPool* pool = message->GetDescriptor()->file()->pool();
-  TypeResolver* resolver =
-      pool == DescriptorPool::generated_pool()
-          ? GetGeneratedTypeResolver()
-          : NewTypeResolverForDescriptorPool(kTypeUrlPrefix, pool);
+  // Set the fields directly when possible, and otherwise go through the
+  // binary form, which also produces the errors for invalid input.  The
+  // fields are set on a new message on the same arena, so that 'message' is
+  // left untouched on failure as before.
+  Arena* arena = message->GetArena();
+  Message* parsed = message->New(arena);
+  std::unique_ptr<Message> parsed_deleter(arena == nullptr ? parsed : nullptr);
+  if (JsonStringToMessageViaReflection(input, parsed, options).ok()) {
+    message->GetReflection()->Swap(message, parsed);
+    return util::Status();
+  }
+
+  std::shared_ptr<const converter::PoolTypeInfo> types =
+      GetPoolTypeInfo(message->GetDescriptor()->file()->pool());
   string binary;
-  util::Status result = JsonToBinaryString(
-      resolver, GetTypeUrl(*message), input, &binary, options);
+  util::Status result = JsonToBinaryStringWithTypeInfo(
+      types->typeinfo(), GetTypeUrl(*message), input, &binary, options);
   if (result.ok() && !message->ParseFromString(binary)) {
     result =
         util::Status(util::error::INVALID_ARGUMENT,
                        "JSON transcoder produced invalid protobuf output.");
   }
-  if (pool != DescriptorPool::generated_pool()) {
-    delete resolver;
-  }
   return result;
 }
 
@@ -166,6 +166,28 @@ inline util::Status JsonToBinaryString(TypeResolver* resolver,
                             JsonParseOptions());
 }
 
+// Converts a JSON array of messages to a stream of size-delimited binary
+// messages, one per element, as read by ParseDelimitedFromZeroCopyStream().
+// Each element is written out as soon as it has been parsed, so the memory
+// used is bounded by the largest element rather than the whole input.
+// The conversion will fail if:
+//   1. TypeResolver fails to resolve a type.
+//   2. input is not a JSON array, or an element is not valid JSON format or
+//      conflicts with the type information returned by TypeResolver.
+// On failure, the elements before the bad one have been written already.
+PROTOBUF_EXPORT util::Status JsonArrayToDelimitedBinaryStream(
+    TypeResolver* resolver, const std::string& type_url,
+    io::ZeroCopyInputStream* json_input,
+    io::ZeroCopyOutputStream* binary_output, const JsonParseOptions& options);
+
+inline util::Status JsonArrayToDelimitedBinaryStream(
+    TypeResolver* resolver, const std::string& type_url,
+    io::ZeroCopyInputStream* json_input,
+    io::ZeroCopyOutputStream* binary_output) {
+  return JsonArrayToDelimitedBinaryStream(resolver, type_url, json_input,
+                                          binary_output, JsonParseOptions());
+}
+
 namespace internal {
 // Internal helper class. Put in the header so we can write unit-tests for it.
 class PROTOBUF_EXPORT ZeroCopyStreamByteSink : public strings::ByteSink {
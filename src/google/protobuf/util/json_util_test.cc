@@ -37,11 +37,18 @@
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/descriptor_database.h>
 #include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/duration.pb.h>
+#include <google/protobuf/util/internal/json_stream_parser.h>
+#include <google/protobuf/util/internal/reflection_objectwriter.h>
 #include <google/protobuf/util/internal/testdata/maps.pb.h>
+#include <google/protobuf/unittest.pb.h>
 #include <google/protobuf/util/json_format.pb.h>
 #include <google/protobuf/util/json_format_proto3.pb.h>
+#include <google/protobuf/util/delimited_message_util.h>
+#include <google/protobuf/util/message_differencer.h>
 #include <google/protobuf/util/type_resolver.h>
 #include <google/protobuf/util/type_resolver_util.h>
+#include <google/protobuf/stubs/strutil.h>
 #include <gtest/gtest.h>
 
 namespace google {
@@ -605,6 +612,441 @@ TEST_F(JsonUtilTest, HtmlEscape) {
   EXPECT_EQ("{\"stringValue\":\"\\u003c/script\\u003e\"}", ToJson(m, options));
 }
 
+// MessageToJsonString() renders messages through reflection and only goes
+// through the binary form when that cannot be done exactly.  Both must agree.
+class JsonReflectionPrintTest : public JsonUtilTest {
+ protected:
+  JsonReflectionPrintTest() {
+    resolver_.reset(NewTypeResolverForDescriptorPool(
+        kTypeUrlPrefix, DescriptorPool::generated_pool()));
+  }
+
+  util::Status ToJsonViaBinary(const Message& message,
+                               const JsonPrintOptions& options,
+                               string* output) {
+    return BinaryToJsonString(
+        resolver_.get(),
+        StrCat(kTypeUrlPrefix, "/", message.GetDescriptor()->full_name()),
+        message.SerializeAsString(), output, options);
+  }
+
+  void ExpectSameJson(const Message& message) {
+    for (int i = 0; i < 8; ++i) {
+      JsonPrintOptions options;
+      options.add_whitespace = i & 1;
+      options.always_print_primitive_fields = i & 2;
+      options.always_print_enums_as_ints = i & 4;
+      options.preserve_proto_field_names = i & 4;
+      string expected;
+      ASSERT_TRUE(ToJsonViaBinary(message, options, &expected).ok());
+      EXPECT_EQ(expected, ToJson(message, options)) << "options: " << i;
+    }
+  }
+};
+
+TEST_F(JsonReflectionPrintTest, Scalars) {
+  TestMessage m;
+  m.set_bool_value(true);
+  m.set_int32_value(-1);
+  m.set_int64_value(static_cast<int64>(-1234567890123));
+  m.set_uint32_value(42);
+  m.set_uint64_value(static_cast<uint64>(1234567890123));
+  m.set_float_value(1.5);
+  m.set_double_value(-2.25);
+  m.set_string_value("</script>\xc3\xa9");
+  m.set_bytes_value("\x01\x02\xff");
+  m.set_enum_value(proto3::BAR);
+  m.mutable_message_value()->set_value(7);
+  m.add_repeated_int32_value(1);
+  m.add_repeated_int32_value(-2);
+  m.add_repeated_string_value("a");
+  m.add_repeated_bytes_value("b");
+  m.add_repeated_enum_value(proto3::FOO);
+  m.add_repeated_enum_value(static_cast<proto3::EnumType>(42));
+  m.add_repeated_message_value()->set_value(1);
+  m.add_repeated_message_value();
+  ExpectSameJson(m);
+  ExpectSameJson(TestMessage());
+}
+
+TEST_F(JsonReflectionPrintTest, Proto2) {
+  protobuf_unittest::TestAllTypes m;
+  m.set_optional_int32(0);
+  m.set_optional_sint64(-5);
+  m.set_optional_fixed32(6);
+  m.set_optional_sfixed64(-7);
+  m.set_optional_nested_enum(protobuf_unittest::TestAllTypes::BAZ);
+  m.mutable_optional_nested_message()->set_bb(3);
+  m.add_repeated_foreign_message()->set_c(4);
+  m.set_oneof_string("oneof");
+  ExpectSameJson(m);
+}
+
+TEST_F(JsonReflectionPrintTest, Maps) {
+  proto3::TestNestedMap m;
+  (*m.mutable_bool_map())[true] = 1;
+  (*m.mutable_bool_map())[false] = 2;
+  (*m.mutable_int64_map())[-3] = 3;
+  (*m.mutable_uint64_map())[4] = 4;
+  (*m.mutable_string_map())[""] = 5;
+  (*(*m.mutable_map_map())["nested"].mutable_int32_map())[6] = 6;
+  ExpectSameJson(m);
+}
+
+TEST_F(JsonReflectionPrintTest, WellKnownTypes) {
+  proto3::TestWrapper wrappers;
+  wrappers.mutable_bool_value()->set_value(true);
+  wrappers.mutable_int64_value();
+  wrappers.mutable_bytes_value()->set_value("abc");
+  wrappers.add_repeated_double_value()->set_value(0.5);
+  ExpectSameJson(wrappers);
+
+  proto3::TestTimestamp timestamp;
+  timestamp.mutable_value()->set_seconds(1234567890);
+  timestamp.mutable_value()->set_nanos(1000);
+  timestamp.add_repeated_value();
+  ExpectSameJson(timestamp);
+
+  proto3::TestDuration duration;
+  duration.mutable_value()->set_seconds(-3);
+  duration.mutable_value()->set_nanos(-500000000);
+  duration.add_repeated_value()->set_nanos(-1);
+  duration.add_repeated_value()->set_nanos(20000);
+  ExpectSameJson(duration);
+
+  proto3::TestFieldMask field_mask;
+  field_mask.mutable_value()->add_paths("foo_bar.baz");
+  field_mask.mutable_value()->add_paths("qux");
+  ExpectSameJson(field_mask);
+
+  proto3::TestStruct s;
+  Struct* value = s.mutable_value();
+  (*value->mutable_fields())["null"].set_null_value(NULL_VALUE);
+  (*value->mutable_fields())["number"].set_number_value(1.25);
+  (*value->mutable_fields())["unset"];
+  ListValue* list = (*value->mutable_fields())["list"].mutable_list_value();
+  list->add_values()->set_string_value("x");
+  list->add_values()->mutable_struct_value();
+  list->add_values()->mutable_list_value();
+  s.add_repeated_value();
+  ExpectSameJson(s);
+
+  proto3::TestAny any;
+  TestMessage payload;
+  payload.set_int32_value(5);
+  payload.set_enum_value(proto3::BAR);
+  any.mutable_value()->PackFrom(payload);
+  any.add_repeated_value();
+  ExpectSameJson(any);
+}
+
+TEST_F(JsonReflectionPrintTest, FallsBackForUnknownFields) {
+  TestMessage m;
+  m.set_int32_value(1);
+  // An unknown field that reuses a known field number is rendered by the
+  // binary path, so the reflection path must defer to it.
+  UnknownFieldSet* unknown_fields =
+      m.GetReflection()->MutableUnknownFields(&m);
+  unknown_fields->AddVarint(2, 5);
+  unknown_fields->AddVarint(1000, 6);
+  ExpectSameJson(m);
+}
+
+TEST_F(JsonReflectionPrintTest, FallsBackForInvalidInput) {
+  proto3::TestTimestamp m;
+  m.mutable_value()->set_seconds(static_cast<int64>(1) << 40);
+  JsonPrintOptions options;
+  string expected;
+  util::Status expected_status = ToJsonViaBinary(m, options, &expected);
+  ASSERT_FALSE(expected_status.ok());
+  string output;
+  EXPECT_EQ(expected_status, MessageToJsonString(m, &output, options));
+  EXPECT_EQ(expected, output);
+}
+
+class JsonReflectionParseTest : public JsonUtilTest {
+ protected:
+  JsonReflectionParseTest() {
+    resolver_.reset(NewTypeResolverForDescriptorPool(
+        kTypeUrlPrefix, DescriptorPool::generated_pool()));
+  }
+
+  util::Status FromJsonViaReflection(const string& json, Message* message,
+                                     const JsonParseOptions& options) {
+    converter::ReflectionObjectWriter writer(message);
+    writer.set_ignore_unknown_fields(options.ignore_unknown_fields);
+    converter::JsonStreamParser parser(&writer);
+    util::Status status = parser.Parse(json);
+    if (status.ok()) status = parser.FinishParse();
+    if (status.ok()) status = writer.status();
+    return status;
+  }
+
+  util::Status FromJsonViaBinary(const string& json, Message* message,
+                                 const JsonParseOptions& options) {
+    string binary;
+    util::Status status = JsonToBinaryString(
+        resolver_.get(),
+        StrCat(kTypeUrlPrefix, "/", message->GetDescriptor()->full_name()),
+        json, &binary, options);
+    if (status.ok() && !message->ParseFromString(binary)) {
+      status = util::Status(util::error::INVALID_ARGUMENT, "parse failed");
+    }
+    return status;
+  }
+
+  // Expects 'json' to be handled by the reflection path alone, with the same
+  // result as the binary path.
+  void ExpectDirectParse(const string& json, const Message& prototype,
+                         const JsonParseOptions& options = JsonParseOptions()) {
+    std::unique_ptr<Message> expected(prototype.New());
+    ASSERT_TRUE(FromJsonViaBinary(json, expected.get(), options).ok()) << json;
+    std::unique_ptr<Message> direct(prototype.New());
+    EXPECT_TRUE(FromJsonViaReflection(json, direct.get(), options).ok())
+        << json;
+    EXPECT_TRUE(MessageDifferencer::Equals(*expected, *direct)) << json;
+    std::unique_ptr<Message> actual(prototype.New());
+    ASSERT_TRUE(JsonStringToMessage(json, actual.get(), options).ok()) << json;
+    EXPECT_TRUE(MessageDifferencer::Equals(*expected, *actual)) << json;
+  }
+
+  // Expects 'json' to need the binary path, and JsonStringToMessage() to
+  // return what that path does.
+  void ExpectFallback(const string& json, const Message& prototype,
+                      const JsonParseOptions& options = JsonParseOptions()) {
+    std::unique_ptr<Message> direct(prototype.New());
+    EXPECT_FALSE(FromJsonViaReflection(json, direct.get(), options).ok())
+        << json;
+    std::unique_ptr<Message> expected(prototype.New());
+    util::Status expected_status =
+        FromJsonViaBinary(json, expected.get(), options);
+    std::unique_ptr<Message> actual(prototype.New());
+    util::Status status = JsonStringToMessage(json, actual.get(), options);
+    EXPECT_EQ(expected_status.ok(), status.ok()) << json;
+    if (expected_status.ok()) {
+      EXPECT_TRUE(MessageDifferencer::Equals(*expected, *actual)) << json;
+    }
+  }
+};
+
+TEST_F(JsonReflectionParseTest, Scalars) {
+  ExpectDirectParse(
+      "{\"boolValue\":true,\"int32Value\":-1,\"int64Value\":\"-1234567890123\","
+      "\"uint32Value\":42,\"uint64Value\":\"1234567890123\","
+      "\"floatValue\":1.5,\"doubleValue\":-2.25,\"stringValue\":\"\\u00e9\","
+      "\"bytesValue\":\"AQL/\",\"enumValue\":\"BAR\","
+      "\"messageValue\":{\"value\":7},\"repeatedInt32Value\":[1,-2,\"3\"],"
+      "\"repeatedEnumValue\":[\"FOO\",42,\"bar\",\"1\"],"
+      "\"repeatedMessageValue\":[{\"value\":1},{}],"
+      "\"repeatedStringValue\":[],\"int32_value\":5,\"uint64Value\":null}",
+      TestMessage());
+  ExpectDirectParse("{}", TestMessage());
+  ExpectDirectParse(
+      "{\"optionalInt32\":0,\"optionalSint64\":\"-5\",\"optionalFixed32\":6,"
+      "\"optional_sfixed64\":\"-7\",\"optionalNestedEnum\":\"BAZ\","
+      "\"optionalNestedMessage\":{\"bb\":3},\"optionalBytes\":\"\","
+      "\"repeatedForeignMessage\":[{\"c\":4}],\"oneofString\":\"oneof\","
+      "\"defaultInt32\":null,\"optionalNestedMessage\":{}}",
+      protobuf_unittest::TestAllTypes());
+}
+
+TEST_F(JsonReflectionParseTest, Maps) {
+  ExpectDirectParse(
+      "{\"boolMap\":{\"true\":1,\"false\":2},\"int64Map\":{\"-3\":3},"
+      "\"uint64Map\":{\"4\":4},\"stringMap\":{\"\":5,\"null\":null},"
+      "\"mapMap\":{\"nested\":{\"int32Map\":{\"6\":6}},\"empty\":{}}}",
+      proto3::TestNestedMap());
+}
+
+TEST_F(JsonReflectionParseTest, WellKnownTypes) {
+  ExpectDirectParse(
+      "{\"boolValue\":true,\"int64Value\":\"0\",\"bytesValue\":\"YWJj\","
+      "\"stringValue\":null,\"uint32Value\":{\"value\":3},"
+      "\"repeatedDoubleValue\":[0.5,null]}",
+      proto3::TestWrapper());
+  ExpectDirectParse(
+      "{\"value\":\"2009-02-13T23:31:30.000001Z\","
+      "\"repeatedValue\":[\"1970-01-01T00:00:00Z\"]}",
+      proto3::TestTimestamp());
+  ExpectDirectParse("{\"value\":\"fooBar.baz,qux\"}", proto3::TestFieldMask());
+  ExpectDirectParse(
+      "{\"value\":{\"null\":null,\"number\":1.25,\"string\":\"s\","
+      "\"bool\":false,\"list\":[\"x\",{},[],{\"a\":[1]}],"
+      "\"object\":{\"nested\":{}}},\"repeatedValue\":[{}]}",
+      proto3::TestStruct());
+  ExpectDirectParse(
+      "{\"value\":[1,\"a\"],\"repeatedValue\":[null,{\"a\":1},[true]]}",
+      proto3::TestValue());
+  ExpectDirectParse("{\"value\":null}", proto3::TestValue());
+  ExpectDirectParse("{\"value\":{\"a\":\"b\"}}", proto3::TestValue());
+  ExpectDirectParse("{\"value\":[1,[2]],\"repeatedValue\":[[],[\"x\"]]}",
+                    proto3::TestListValue());
+}
+
+TEST_F(JsonReflectionParseTest, Oneof) {
+  ExpectDirectParse("{\"oneofInt32Value\":null,\"oneofStringValue\":\"x\"}",
+                    TestOneof());
+  ExpectDirectParse("{\"oneofMessageValue\":{\"value\":1}}", TestOneof());
+  ExpectFallback("{\"oneofInt32Value\":1,\"oneofStringValue\":\"x\"}",
+                 TestOneof());
+}
+
+TEST_F(JsonReflectionParseTest, IgnoreUnknownFields) {
+  JsonParseOptions options;
+  options.ignore_unknown_fields = true;
+  const string json =
+      "{\"unknown\":{\"a\":[1,{\"b\":2}]},\"int32Value\":3,"
+      "\"unknownList\":[[]],\"unknownScalar\":1,"
+      "\"enumValue\":\"NOT_AN_ENUM\",\"repeatedEnumValue\":[\"BAZ\", \"X\"]}";
+  ExpectDirectParse(json, TestMessage(), options);
+  ExpectFallback(json, TestMessage());
+}
+
+TEST_F(JsonReflectionParseTest, UsesMessageArena) {
+  Arena arena;
+  protobuf_unittest::TestAllTypes* m =
+      Arena::CreateMessage<protobuf_unittest::TestAllTypes>(&arena);
+  ASSERT_TRUE(JsonStringToMessage("{\"optionalNestedMessage\":{\"bb\":1},"
+                                  "\"repeatedForeignMessage\":[{}]}",
+                                  m)
+                  .ok());
+  EXPECT_EQ(&arena, m->optional_nested_message().GetArena());
+  EXPECT_EQ(&arena, m->repeated_foreign_message(0).GetArena());
+}
+
+TEST_F(JsonReflectionParseTest, FallsBack) {
+  ExpectFallback(
+      "{\"value\":{\"@type\":\"type.googleapis.com/proto3.TestMessage\","
+      "\"int32Value\":5}}",
+      TestAny());
+  ExpectFallback("{\"value\":\"1.5s\"}", proto3::TestDuration());
+  ExpectFallback("{\"int32Map\":{\"1\":1,\"01\":2}}", TestMap());
+  ExpectFallback("{\"int32Value\":\"abc\"}", TestMessage());
+  ExpectFallback("{\"int32Value\":", TestMessage());
+  ExpectFallback("{\"a\":1}", protobuf_unittest::TestRequired());
+  ExpectFallback("{\"optionalNestedEnum\":42}",
+                 protobuf_unittest::TestAllTypes());
+}
+
+TEST_F(JsonReflectionParseTest, ClearsMessage) {
+  TestMessage m;
+  m.set_int32_value(1);
+  m.add_repeated_int32_value(2);
+  ASSERT_TRUE(FromJson("{\"int64Value\":\"3\"}", &m));
+  EXPECT_EQ(0, m.int32_value());
+  EXPECT_EQ(0, m.repeated_int32_value_size());
+  EXPECT_EQ(3, m.int64_value());
+}
+
+class JsonArrayToDelimitedTest : public ::testing::Test {
+ protected:
+  JsonArrayToDelimitedTest()
+      : resolver_(NewTypeResolverForDescriptorPool(
+            kTypeUrlPrefix, DescriptorPool::generated_pool())) {}
+
+  // Feeds 'json' to the conversion in chunks of 'block_size' bytes.
+  util::Status Convert(const Descriptor* descriptor, const string& json,
+                       int block_size, string* output) {
+    io::ArrayInputStream input(json.data(), json.size(), block_size);
+    io::StringOutputStream output_stream(output);
+    return JsonArrayToDelimitedBinaryStream(
+        resolver_.get(),
+        string(kTypeUrlPrefix) + "/" + descriptor->full_name(), &input,
+        &output_stream);
+  }
+
+  // Parses the records in 'binary' into new messages like 'prototype'.
+  std::vector<std::unique_ptr<Message> > ParseRecords(
+      const Message& prototype, const string& binary) {
+    std::vector<std::unique_ptr<Message> > records;
+    io::ArrayInputStream input(binary.data(), binary.size());
+    bool clean_eof = false;
+    while (true) {
+      std::unique_ptr<Message> record(prototype.New());
+      if (!ParseDelimitedFromZeroCopyStream(record.get(), &input,
+                                            &clean_eof)) {
+        break;
+      }
+      records.push_back(std::move(record));
+    }
+    EXPECT_TRUE(clean_eof);
+    return records;
+  }
+
+  std::unique_ptr<TypeResolver> resolver_;
+};
+
+TEST_F(JsonArrayToDelimitedTest, WritesOneRecordPerElement) {
+  const char* kElements[] = {
+      "{\"int32Value\":1,\"stringValue\":\"a\","
+      "\"messageValue\":{\"value\":5}}",
+      "{}",
+      "{\"repeatedInt32Value\":[1,2],\"repeatedMessageValue\":"
+      "[{\"value\":6},{\"value\":7}]}",
+  };
+  string json = "[";
+  for (int i = 0; i < GOOGLE_ARRAYSIZE(kElements); ++i) {
+    if (i > 0) json += " , ";
+    json += kElements[i];
+  }
+  json += "]";
+
+  for (int block_size = 1; block_size <= json.size(); block_size *= 3) {
+    SCOPED_TRACE(block_size);
+    string binary;
+    ASSERT_TRUE(
+        Convert(TestMessage::descriptor(), json, block_size, &binary).ok());
+    std::vector<std::unique_ptr<Message> > records =
+        ParseRecords(TestMessage::default_instance(), binary);
+    ASSERT_EQ(GOOGLE_ARRAYSIZE(kElements), records.size());
+    for (int i = 0; i < GOOGLE_ARRAYSIZE(kElements); ++i) {
+      TestMessage expected;
+      ASSERT_TRUE(JsonStringToMessage(kElements[i], &expected).ok());
+      EXPECT_TRUE(MessageDifferencer::Equals(expected, *records[i]));
+    }
+  }
+}
+
+TEST_F(JsonArrayToDelimitedTest, WellKnownTypeElements) {
+  string binary;
+  ASSERT_TRUE(Convert(google::protobuf::Duration::descriptor(),
+                      "[\"1s\", \"2.5s\"]", 4, &binary)
+                  .ok());
+  std::vector<std::unique_ptr<Message> > records =
+      ParseRecords(google::protobuf::Duration::default_instance(), binary);
+  ASSERT_EQ(2, records.size());
+  EXPECT_EQ("seconds: 1\n", records[0]->DebugString());
+  EXPECT_EQ("seconds: 2\nnanos: 500000000\n", records[1]->DebugString());
+}
+
+TEST_F(JsonArrayToDelimitedTest, EmptyArray) {
+  string binary;
+  EXPECT_TRUE(Convert(TestMessage::descriptor(), "[]", 1, &binary).ok());
+  EXPECT_EQ("", binary);
+}
+
+TEST_F(JsonArrayToDelimitedTest, RejectsNonArrays) {
+  string binary;
+  util::Status status =
+      Convert(TestMessage::descriptor(), "{\"int32Value\":1}", 100, &binary);
+  EXPECT_EQ(util::error::INVALID_ARGUMENT, status.error_code());
+  EXPECT_EQ("", binary);
+  EXPECT_FALSE(Convert(TestMessage::descriptor(), "[{}", 100, &binary).ok());
+}
+
+TEST_F(JsonArrayToDelimitedTest, StopsAtBadElement) {
+  string binary;
+  util::Status status = Convert(
+      TestMessage::descriptor(),
+      "[{\"int32Value\":1},{\"int32Value\":\"x\"},{\"int32Value\":3}]", 100,
+      &binary);
+  EXPECT_EQ(util::error::INVALID_ARGUMENT, status.error_code());
+  std::vector<std::unique_ptr<Message> > records =
+      ParseRecords(TestMessage::default_instance(), binary);
+  ASSERT_EQ(1, records.size());
+  EXPECT_EQ(1, static_cast<TestMessage*>(records[0].get())->int32_value());
+}
+
 }  // namespace
 }  // namespace util
 }  // namespace protobuf
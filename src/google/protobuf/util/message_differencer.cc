@@ -35,14 +35,23 @@
 #include <google/protobuf/util/message_differencer.h>
 
 #include <algorithm>
+#include <condition_variable>
+#include <cstring>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
 #include <utility>
 
 #include <google/protobuf/stubs/callback.h>
+#include <google/protobuf/stubs/casts.h>
 #include <google/protobuf/stubs/common.h>
 #include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/stubs/mathlimits.h>
+#include <google/protobuf/stubs/mutex.h>
 #include <google/protobuf/stubs/stringprintf.h>
 #include <google/protobuf/any.h>
+#include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/printer.h>
 #include <google/protobuf/io/zero_copy_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
@@ -58,6 +67,316 @@ namespace protobuf {
 
 namespace util {
 
+namespace {
+
+// Mixes the bits of x (the finalizer of MurmurHash3).
+inline uint64 MixBits(uint64 x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+inline uint64 HashCombine(uint64 seed, uint64 value) {
+  return MixBits(seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6)));
+}
+
+// Hashes a scalar given as bits, so that the default value of its field
+// hashes to 0 no matter whether the field is set or not.
+inline uint64 HashScalar(uint64 bits, uint64 default_bits) {
+  return bits == default_bits ? 0 : MixBits(bits);
+}
+
+// Returns the bits of a floating point value, with all zeros and all NaNs
+// mapped to one value each, since those compare equal under EXACT
+// comparison (NaNs only if treat_nan_as_equal is set).
+template <typename T>
+uint64 FloatBits(T value) {
+  if (value == 0) return 0;
+  if (MathLimits<T>::IsNaN(value)) return 1;
+  return bit_cast<uint64>(static_cast<double>(value));
+}
+
+// Elements of repeated fields are only compared in parallel if each shard
+// gets at least this many of them.
+const int kMinElementsPerShard = 64;
+
+// Records the reports of a shard, to pass them on in order once all shards
+// are done.
+class BufferedReporter : public MessageDifferencer::Reporter {
+ public:
+  typedef MessageDifferencer::SpecificField SpecificField;
+
+  BufferedReporter() {}
+
+  void ReportAdded(const Message& message1, const Message& message2,
+                   const std::vector<SpecificField>& field_path) override {
+    Add(ADDED, message1, message2, field_path);
+  }
+  void ReportDeleted(const Message& message1, const Message& message2,
+                     const std::vector<SpecificField>& field_path) override {
+    Add(DELETED, message1, message2, field_path);
+  }
+  void ReportModified(const Message& message1, const Message& message2,
+                      const std::vector<SpecificField>& field_path) override {
+    Add(MODIFIED, message1, message2, field_path);
+  }
+  void ReportMoved(const Message& message1, const Message& message2,
+                   const std::vector<SpecificField>& field_path) override {
+    Add(MOVED, message1, message2, field_path);
+  }
+  void ReportMatched(const Message& message1, const Message& message2,
+                     const std::vector<SpecificField>& field_path) override {
+    Add(MATCHED, message1, message2, field_path);
+  }
+  void ReportIgnored(const Message& message1, const Message& message2,
+                     const std::vector<SpecificField>& field_path) override {
+    Add(IGNORED, message1, message2, field_path);
+  }
+  void ReportUnknownFieldIgnored(
+      const Message& message1, const Message& message2,
+      const std::vector<SpecificField>& field_path) override {
+    Add(UNKNOWN_FIELD_IGNORED, message1, message2, field_path);
+  }
+
+  // Passes the recorded reports on to 'reporter'.
+  void Replay(MessageDifferencer::Reporter* reporter) const {
+    for (int i = 0; i < reports_.size(); ++i) {
+      const Report& report = reports_[i];
+      const Message& message1 = *report.message1;
+      const Message& message2 = *report.message2;
+      switch (report.type) {
+        case ADDED:
+          reporter->ReportAdded(message1, message2, report.field_path);
+          break;
+        case DELETED:
+          reporter->ReportDeleted(message1, message2, report.field_path);
+          break;
+        case MODIFIED:
+          reporter->ReportModified(message1, message2, report.field_path);
+          break;
+        case MOVED:
+          reporter->ReportMoved(message1, message2, report.field_path);
+          break;
+        case MATCHED:
+          reporter->ReportMatched(message1, message2, report.field_path);
+          break;
+        case IGNORED:
+          reporter->ReportIgnored(message1, message2, report.field_path);
+          break;
+        case UNKNOWN_FIELD_IGNORED:
+          reporter->ReportUnknownFieldIgnored(message1, message2,
+                                              report.field_path);
+          break;
+      }
+    }
+  }
+
+ private:
+  enum ReportType {
+    ADDED,
+    DELETED,
+    MODIFIED,
+    MOVED,
+    MATCHED,
+    IGNORED,
+    UNKNOWN_FIELD_IGNORED,
+  };
+
+  struct Report {
+    ReportType type;
+    const Message* message1;
+    const Message* message2;
+    std::vector<SpecificField> field_path;
+  };
+
+  void Add(ReportType type, const Message& message1, const Message& message2,
+           const std::vector<SpecificField>& field_path) {
+    reports_.push_back(Report());
+    Report& report = reports_.back();
+    report.type = type;
+    report.message1 = &message1;
+    report.message2 = &message2;
+    report.field_path = field_path;
+  }
+
+  std::vector<Report> reports_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(BufferedReporter);
+};
+
+// Blocks in Wait() until DecrementCount() was called 'count' times.
+class BlockingCounter {
+ public:
+  explicit BlockingCounter(int count) : count_(count) {}
+
+  void DecrementCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--count_ == 0) done_.notify_all();
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (count_ > 0) done_.wait(lock);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable done_;
+  int count_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(BlockingCounter);
+};
+
+// Implements SerializationDeterminesEquality() for all types reachable from
+// 'descriptor'.  Types in 'visited' are either done or being checked further
+// up.
+bool SerializationDeterminesEqualityUncached(
+    const Descriptor* descriptor, std::set<const Descriptor*>* visited) {
+  if (!visited->insert(descriptor).second) return true;
+  if (descriptor->extension_range_count() > 0 ||
+      descriptor->full_name() == internal::kAnyFullTypeName) {
+    return false;
+  }
+  for (int i = 0; i < descriptor->field_count(); ++i) {
+    const FieldDescriptor* field = descriptor->field(i);
+    switch (field->cpp_type()) {
+      case FieldDescriptor::CPPTYPE_FLOAT:
+      case FieldDescriptor::CPPTYPE_DOUBLE:
+        return false;
+      case FieldDescriptor::CPPTYPE_MESSAGE:
+        if (!SerializationDeterminesEqualityUncached(field->message_type(),
+                                                     visited)) {
+          return false;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  return true;
+}
+
+// Returns true if two messages of this type are equal to Equals() whenever
+// their deterministic serializations are equal.  That is not the case for
+// floating point fields, since NaNs never equal each other, and
+// google.protobuf.Any, whose payload may have such fields.  Extensions are
+// not known up front, so types with extension ranges are excluded too.
+bool SerializationDeterminesEquality(const Descriptor* descriptor) {
+  // Other pools may be deleted, and a new descriptor may reuse the address of
+  // a deleted one, so only generated types are cached.
+  if (descriptor->file()->pool() != DescriptorPool::generated_pool()) {
+    std::set<const Descriptor*> visited;
+    return SerializationDeterminesEqualityUncached(descriptor, &visited);
+  }
+  static internal::WrappedMutex mutex;
+  static std::unordered_map<const Descriptor*, bool>* cache =
+      internal::OnShutdownDelete(
+          new std::unordered_map<const Descriptor*, bool>());
+  {
+    // Every Equals() call looks the type up, so lookups share the lock.
+    ReaderMutexLock lock(&mutex);
+    std::unordered_map<const Descriptor*, bool>::const_iterator it =
+        cache->find(descriptor);
+    if (it != cache->end()) return it->second;
+  }
+  std::set<const Descriptor*> visited;
+  const bool result =
+      SerializationDeterminesEqualityUncached(descriptor, &visited);
+  WriterMutexLock lock(&mutex);
+  (*cache)[descriptor] = result;
+  return result;
+}
+
+// Compares the bytes written to it with the expected ones, a chunk at a time.
+// Writing fails after the first difference.
+class ComparingOutputStream : public io::ZeroCopyOutputStream {
+ public:
+  ComparingOutputStream(const uint8* expected, int size)
+      : expected_(expected),
+        size_(size),
+        position_(0),
+        pending_(0),
+        equal_(true) {}
+
+  bool Next(void** data, int* size) override {
+    if (!CheckPending()) return false;
+    pending_ = sizeof(buffer_);
+    *data = buffer_;
+    *size = pending_;
+    return true;
+  }
+  void BackUp(int count) override { pending_ -= count; }
+  int64 ByteCount() const override { return position_ + pending_; }
+
+  // Returns true if exactly the expected bytes have been written.  Call after
+  // the CodedOutputStream writing to this stream is trimmed.
+  bool Matched() { return CheckPending() && position_ == size_; }
+
+ private:
+  // Compares the bytes written since the last call to Next().
+  bool CheckPending() {
+    if (!equal_) return false;
+    if (pending_ > size_ - position_ ||
+        memcmp(buffer_, expected_ + position_, pending_) != 0) {
+      equal_ = false;
+      return false;
+    }
+    position_ += pending_;
+    pending_ = 0;
+    return true;
+  }
+
+  static const int kChunkSize = 1024;
+
+  const uint8* expected_;
+  const int size_;
+  int position_;
+  int pending_;
+  bool equal_;
+  uint8 buffer_[kChunkSize];
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ComparingOutputStream);
+};
+
+// Returns true if the deterministic serializations of the messages are the
+// same.  Only the serialization of message1 is kept in memory, on the stack
+// unless it is large.  The one of message2 is compared to it as it is
+// written, which stops at the first difference.
+bool SerializationsEqual(const Message& message1, const Message& message2) {
+  const size_t size = message1.ByteSizeLong();
+  if (size != message2.ByteSizeLong() || size > kint32max) return false;
+
+  const int kStackBufferSize = 1024;
+  uint8 stack_buffer[kStackBufferSize];
+  std::unique_ptr<uint8[]> heap_buffer;
+  uint8* expected = stack_buffer;
+  if (size > kStackBufferSize) {
+    heap_buffer.reset(new uint8[size]);
+    expected = heap_buffer.get();
+  }
+  {
+    io::ArrayOutputStream array_stream(expected, size);
+    io::CodedOutputStream output(&array_stream);
+    output.SetSerializationDeterministic(true);
+    message1.SerializeWithCachedSizes(&output);
+    if (output.HadError()) return false;
+  }
+
+  ComparingOutputStream comparing_stream(expected, size);
+  {
+    io::CodedOutputStream output(&comparing_stream);
+    output.SetSerializationDeterministic(true);
+    message2.SerializeWithCachedSizes(&output);
+    if (output.HadError()) return false;
+  }
+  return comparing_stream.Matched();
+}
+
+}  // namespace
+
 // When comparing a repeated field as map, MultipleFieldMapKeyComparator can
 // be used to specify multiple fields as key for key comparison.
 // Two elements of a repeated field will be regarded as having the same key
@@ -95,7 +414,40 @@ class MessageDifferencer::MultipleFieldsMapKeyComparator
     return true;
   }
 
+  bool HashKey(const Message& message, uint64* hash) const override {
+    if (!message_differencer_->CanHashFieldValues()) return false;
+    uint64 result = 0;
+    for (int i = 0; i < key_field_paths_.size(); ++i) {
+      result = HashCombine(result,
+                           HashKeyInternal(message, key_field_paths_[i], 0));
+    }
+    *hash = result;
+    return true;
+  }
+
+  const std::vector<std::vector<const FieldDescriptor*> >& key_field_paths()
+      const {
+    return key_field_paths_;
+  }
+
  private:
+  // Hashes what IsMatchInternal() compares.
+  uint64 HashKeyInternal(
+      const Message& message,
+      const std::vector<const FieldDescriptor*>& key_field_path,
+      int path_index) const {
+    const FieldDescriptor* field = key_field_path[path_index];
+    if (path_index == key_field_path.size() - 1) {
+      return field->is_repeated()
+                 ? message_differencer_->HashField(message, field)
+                 : message_differencer_->HashFieldValue(message, field, -1);
+    }
+    const Reflection* reflection = message.GetReflection();
+    if (!reflection->HasField(message, field)) return 0;
+    return HashKeyInternal(reflection->GetMessage(message, field),
+                           key_field_path, path_index + 1);
+  }
+
   bool IsMatchInternal(
       const Message& message1,
       const Message& message2,
@@ -170,8 +522,33 @@ bool MessageDifferencer::MapEntryKeyComparator::IsMatch(
       message1, message2, key, -1, -1, &current_parent_fields);
 }
 
+bool MessageDifferencer::MapEntryKeyComparator::HashKey(const Message& message,
+                                                        uint64* hash) const {
+  // In PARTIAL scope, entries without a key are matched as a whole.
+  if (!message_differencer_->CanHashFieldValues() ||
+      message_differencer_->scope() == PARTIAL) {
+    return false;
+  }
+  const FieldDescriptor* key = message.GetDescriptor()->FindFieldByNumber(1);
+  if (message_differencer_->IsIgnored(message, message, key,
+                                      std::vector<SpecificField>())) {
+    *hash = message_differencer_->HashMessage(message);
+  } else {
+    *hash = message_differencer_->HashFieldValue(message, key, -1);
+  }
+  return true;
+}
+
 bool MessageDifferencer::Equals(const Message& message1,
                                 const Message& message2) {
+  if (message1.GetDescriptor() == message2.GetDescriptor() &&
+      SerializationDeterminesEquality(message1.GetDescriptor()) &&
+      SerializationsEqual(message1, message2)) {
+    return true;
+  }
+
+  // Different serializations may still be equal, for example if unknown
+  // fields are in a different order.
   MessageDifferencer differencer;
 
   return differencer.Compare(message1, message2);
@@ -212,17 +589,23 @@ MessageDifferencer::MessageDifferencer()
       scope_(FULL),
       repeated_field_comparison_(AS_LIST),
       map_entry_key_comparator_(this),
+      owns_ignore_criteria_(true),
       report_matches_(false),
       report_moves_(true),
       report_ignores_(true),
-      output_string_(NULL) {}
+      output_string_(NULL),
+      executor_(NULL),
+      num_shards_(1),
+      keep_unpacked_any_(false) {}
 
 MessageDifferencer::~MessageDifferencer() {
   for (int i = 0; i < owned_key_comparators_.size(); ++i) {
     delete owned_key_comparators_[i];
   }
-  for (int i = 0; i < ignore_criteria_.size(); ++i) {
-    delete ignore_criteria_[i];
+  if (owns_ignore_criteria_) {
+    for (int i = 0; i < ignore_criteria_.size(); ++i) {
+      delete ignore_criteria_[i];
+    }
   }
 }
 
@@ -255,6 +638,13 @@ void MessageDifferencer::set_repeated_field_comparison(
   repeated_field_comparison_ = comparison;
 }
 
+void MessageDifferencer::set_executor(Executor* executor, int num_shards) {
+  GOOGLE_CHECK(executor == NULL || num_shards > 0)
+      << "Number of shards must be positive.";
+  executor_ = executor;
+  num_shards_ = num_shards;
+}
+
 void MessageDifferencer::TreatAsSet(const FieldDescriptor* field) {
   GOOGLE_CHECK(field->is_repeated()) << "Field must be repeated: "
                                << field->full_name();
@@ -425,6 +815,7 @@ bool MessageDifferencer::Compare(const Message& message1,
   } else {
     result = Compare(message1, message2, &parent_fields);
   }
+  message_hashes_.clear();
 
   return result;
 }
@@ -465,6 +856,7 @@ bool MessageDifferencer::CompareWithFields(
     result = CompareRequestedFieldsUsingSettings(
         message1, message2, message1_fields, message2_fields, &parent_fields);
   }
+  message_hashes_.clear();
 
   return result;
 }
@@ -491,7 +883,14 @@ bool MessageDifferencer::Compare(
       if (data1->GetDescriptor() != data2->GetDescriptor()) {
         return false;
       }
-      return Compare(*data1, *data2, parent_fields);
+      const bool result = Compare(*data1, *data2, parent_fields);
+      if (keep_unpacked_any_) {
+        unpacked_any_.push_back(std::move(data1));
+        unpacked_any_.push_back(std::move(data2));
+      } else {
+        message_hashes_.clear();
+      }
+      return result;
     }
   }
   const Reflection* reflection1 = message1.GetReflection();
@@ -871,12 +1270,62 @@ bool MessageDifferencer::CompareRepeatedField(
   }
 
   bool fieldDifferent = false;
-  SpecificField specific_field;
-  specific_field.field = repeated_field;
 
   // At this point, we have already matched pairs of fields (with the reporting
   // to be done later). Now to check if the paired elements are different.
-  for (int i = 0; i < count1; i++) {
+  const bool in_parallel =
+      executor_ != NULL && num_shards_ > 1 &&
+      repeated_field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE &&
+      count1 >= 2 * kMinElementsPerShard;
+  if (!(in_parallel
+            ? CompareMatchedElementsInParallel(message1, message2,
+                                               repeated_field, match_list1,
+                                               parent_fields)
+            : CompareMatchedElements(message1, message2, repeated_field,
+                                     match_list1, 0, count1, parent_fields))) {
+    if (reporter_ == NULL) return false;
+    fieldDifferent = true;
+  }
+
+  SpecificField specific_field;
+  specific_field.field = repeated_field;
+
+  // Report any remaining additions or deletions.
+  for (int i = 0; i < count2; ++i) {
+    if (match_list2[i] != -1) continue;
+    if (!treated_as_subset) {
+      fieldDifferent = true;
+    }
+
+    if (reporter_ == NULL) continue;
+    specific_field.index = i;
+    specific_field.new_index = i;
+    parent_fields->push_back(specific_field);
+    reporter_->ReportAdded(message1, message2, *parent_fields);
+    parent_fields->pop_back();
+  }
+
+  for (int i = 0; i < count1; ++i) {
+    if (match_list1[i] != -1) continue;
+    assert(reporter_ != NULL);
+    specific_field.index = i;
+    parent_fields->push_back(specific_field);
+    reporter_->ReportDeleted(message1, message2, *parent_fields);
+    parent_fields->pop_back();
+    fieldDifferent = true;
+  }
+  return !fieldDifferent;
+}
+
+bool MessageDifferencer::CompareMatchedElements(
+    const Message& message1, const Message& message2,
+    const FieldDescriptor* repeated_field, const std::vector<int>& match_list1,
+    int begin, int end, std::vector<SpecificField>* parent_fields) {
+  bool fieldDifferent = false;
+  SpecificField specific_field;
+  specific_field.field = repeated_field;
+
+  for (int i = begin; i < end; i++) {
     if (match_list1[i] == -1) continue;
     specific_field.index = i;
     specific_field.new_index = match_list1[i];
@@ -906,32 +1355,118 @@ bool MessageDifferencer::CompareRepeatedField(
       parent_fields->pop_back();
     }
   }
+  return !fieldDifferent;
+}
 
-  // Report any remaining additions or deletions.
-  for (int i = 0; i < count2; ++i) {
-    if (match_list2[i] != -1) continue;
-    if (!treated_as_subset) {
-      fieldDifferent = true;
+struct MessageDifferencer::Shard {
+  MessageDifferencer differencer;
+  BufferedReporter reporter;
+  const Message* message1;
+  const Message* message2;
+  const FieldDescriptor* repeated_field;
+  const std::vector<int>* match_list1;
+  int begin;
+  int end;
+  std::vector<SpecificField> parent_fields;
+  bool result;
+  // Counted down when done, unless the shard runs on the calling thread.
+  BlockingCounter* pending;
+};
+
+void MessageDifferencer::CompareShard(Shard* shard) {
+  shard->result = shard->differencer.CompareMatchedElements(
+      *shard->message1, *shard->message2, shard->repeated_field,
+      *shard->match_list1, shard->begin, shard->end, &shard->parent_fields);
+  if (shard->pending != NULL) shard->pending->DecrementCount();
+}
+
+bool MessageDifferencer::CompareMatchedElementsInParallel(
+    const Message& message1, const Message& message2,
+    const FieldDescriptor* repeated_field, const std::vector<int>& match_list1,
+    std::vector<SpecificField>* parent_fields) {
+  const int count1 = match_list1.size();
+  const int num_shards =
+      std::min(num_shards_, std::max(1, count1 / kMinElementsPerShard));
+  BlockingCounter pending(num_shards - 1);
+  std::vector<std::unique_ptr<Shard> > shards(num_shards);
+  for (int i = 0; i < num_shards; ++i) {
+    shards[i].reset(new Shard);
+    Shard* shard = shards[i].get();
+    shard->differencer.CopySettingsFrom(*this);
+    if (reporter_ != NULL) {
+      shard->differencer.reporter_ = &shard->reporter;
+      shard->differencer.keep_unpacked_any_ = true;
     }
+    shard->message1 = &message1;
+    shard->message2 = &message2;
+    shard->repeated_field = repeated_field;
+    shard->match_list1 = &match_list1;
+    shard->begin = static_cast<int64>(count1) * i / num_shards;
+    shard->end = static_cast<int64>(count1) * (i + 1) / num_shards;
+    shard->parent_fields = *parent_fields;
+    shard->result = false;
+    shard->pending = i == 0 ? NULL : &pending;
+  }
+  for (int i = 1; i < num_shards; ++i) {
+    executor_->Schedule(NewCallback(&CompareShard, shards[i].get()));
+  }
+  CompareShard(shards[0].get());
+  pending.Wait();
 
-    if (reporter_ == NULL) continue;
-    specific_field.index = i;
-    specific_field.new_index = i;
-    parent_fields->push_back(specific_field);
-    reporter_->ReportAdded(message1, message2, *parent_fields);
-    parent_fields->pop_back();
+  bool result = true;
+  for (int i = 0; i < num_shards; ++i) {
+    if (reporter_ != NULL) shards[i]->reporter.Replay(reporter_);
+    result = result && shards[i]->result;
   }
+  return result;
+}
 
-  for (int i = 0; i < count1; ++i) {
-    if (match_list1[i] != -1) continue;
-    assert(reporter_ != NULL);
-    specific_field.index = i;
-    parent_fields->push_back(specific_field);
-    reporter_->ReportDeleted(message1, message2, *parent_fields);
-    parent_fields->pop_back();
-    fieldDifferent = true;
+void MessageDifferencer::CopySettingsFrom(const MessageDifferencer& other) {
+  default_field_comparator_.float_comparison_ =
+      other.default_field_comparator_.float_comparison_;
+  default_field_comparator_.treat_nan_as_equal_ =
+      other.default_field_comparator_.treat_nan_as_equal_;
+  default_field_comparator_.has_default_tolerance_ =
+      other.default_field_comparator_.has_default_tolerance_;
+  default_field_comparator_.default_tolerance_ =
+      other.default_field_comparator_.default_tolerance_;
+  default_field_comparator_.map_tolerance_ =
+      other.default_field_comparator_.map_tolerance_;
+  field_comparator_ = other.field_comparator_;
+  message_field_comparison_ = other.message_field_comparison_;
+  scope_ = other.scope_;
+  repeated_field_comparison_ = other.repeated_field_comparison_;
+  set_fields_ = other.set_fields_;
+  list_fields_ = other.list_fields_;
+
+  // The owned key comparators refer to the differencer that created them, so
+  // they are recreated for this one.  All of them are
+  // MultipleFieldsMapKeyComparators.
+  std::map<const MapKeyComparator*, const MapKeyComparator*> copies;
+  for (int i = 0; i < other.owned_key_comparators_.size(); ++i) {
+    const MultipleFieldsMapKeyComparator* key_comparator =
+        static_cast<const MultipleFieldsMapKeyComparator*>(
+            other.owned_key_comparators_[i]);
+    MapKeyComparator* copy = new MultipleFieldsMapKeyComparator(
+        this, key_comparator->key_field_paths());
+    owned_key_comparators_.push_back(copy);
+    copies[key_comparator] = copy;
   }
-  return !fieldDifferent;
+  for (FieldKeyComparatorMap::const_iterator it =
+           other.map_field_key_comparator_.begin();
+       it != other.map_field_key_comparator_.end(); ++it) {
+    std::map<const MapKeyComparator*, const MapKeyComparator*>::iterator
+        copy = copies.find(it->second);
+    map_field_key_comparator_[it->first] =
+        copy != copies.end() ? copy->second : it->second;
+  }
+
+  ignore_criteria_ = other.ignore_criteria_;
+  owns_ignore_criteria_ = false;
+  ignored_fields_ = other.ignored_fields_;
+  report_matches_ = other.report_matches_;
+  report_moves_ = other.report_moves_;
+  report_ignores_ = other.report_ignores_;
 }
 
 bool MessageDifferencer::CompareFieldValue(const Message& message1,
@@ -1052,6 +1587,138 @@ MessageDifferencer ::GetMapKeyComparator(const FieldDescriptor* field) const {
   return NULL;
 }
 
+bool MessageDifferencer::CanHashFieldValues() const {
+  return field_comparator_ == NULL && ignore_criteria_.empty();
+}
+
+uint64 MessageDifferencer::HashMessage(const Message& message) {
+  // Partial comparisons are not symmetric, and Any payloads may compare equal
+  // with different bytes, so neither can be hashed.
+  if (scope_ == PARTIAL ||
+      message.GetDescriptor()->full_name() == internal::kAnyFullTypeName) {
+    return 0;
+  }
+  std::unordered_map<const Message*, uint64>::const_iterator it =
+      message_hashes_.find(&message);
+  if (it != message_hashes_.end()) return it->second;
+  std::vector<const FieldDescriptor*> fields;
+  message.GetReflection()->ListFields(message, &fields);
+  uint64 hash = 0;
+  for (int i = 0; i < fields.size(); ++i) {
+    const FieldDescriptor* field = fields[i];
+    if (ignored_fields_.find(field) != ignored_fields_.end()) continue;
+    // Fields hashing to 0 are skipped, so that a field set to its default
+    // value hashes like an unset one, as EQUIVALENT comparison requires.
+    uint64 field_hash = HashField(message, field);
+    if (field_hash != 0) {
+      hash = HashCombine(hash, HashCombine(field->number(), field_hash));
+    }
+  }
+  message_hashes_[&message] = hash;
+  return hash;
+}
+
+uint64 MessageDifferencer::HashField(const Message& message,
+                                     const FieldDescriptor* field) {
+  if (!field->is_repeated()) return HashFieldValue(message, field, -1);
+  if (scope_ == PARTIAL) return 0;
+  const int count = message.GetReflection()->FieldSize(message, field);
+  // Elements of sets and maps may be in any order, so their hashes are
+  // summed up.
+  const bool unordered =
+      IsTreatedAsSet(field) || GetMapKeyComparator(field) != NULL;
+  uint64 hash = 0;
+  for (int i = 0; i < count; ++i) {
+    uint64 element_hash = HashFieldValue(message, field, i);
+    hash = unordered ? hash + element_hash : HashCombine(hash, element_hash);
+  }
+  return HashCombine(count, hash);
+}
+
+uint64 MessageDifferencer::HashFieldValue(const Message& message,
+                                          const FieldDescriptor* field,
+                                          int index) {
+  const Reflection* reflection = message.GetReflection();
+  switch (field->cpp_type()) {
+#define HASH_SCALAR(CPPTYPE, METHOD, DEFAULT)                        \
+    case FieldDescriptor::CPPTYPE_##CPPTYPE:                         \
+      return HashScalar(                                             \
+          static_cast<uint64>(                                       \
+              index < 0 ? reflection->Get##METHOD(message, field)    \
+                        : reflection->GetRepeated##METHOD(message,   \
+                                                          field,     \
+                                                          index)),   \
+          static_cast<uint64>(field->DEFAULT));
+    HASH_SCALAR(INT32, Int32, default_value_int32());
+    HASH_SCALAR(INT64, Int64, default_value_int64());
+    HASH_SCALAR(UINT32, UInt32, default_value_uint32());
+    HASH_SCALAR(UINT64, UInt64, default_value_uint64());
+    HASH_SCALAR(BOOL, Bool, default_value_bool());
+    HASH_SCALAR(ENUM, EnumValue, default_value_enum()->number());
+#undef HASH_SCALAR
+    case FieldDescriptor::CPPTYPE_DOUBLE:
+      if (default_field_comparator_.float_comparison() !=
+          DefaultFieldComparator::EXACT) {
+        return 0;
+      }
+      return HashScalar(
+          FloatBits(index < 0
+                        ? reflection->GetDouble(message, field)
+                        : reflection->GetRepeatedDouble(message, field, index)),
+          FloatBits(field->default_value_double()));
+    case FieldDescriptor::CPPTYPE_FLOAT:
+      if (default_field_comparator_.float_comparison() !=
+          DefaultFieldComparator::EXACT) {
+        return 0;
+      }
+      return HashScalar(
+          FloatBits(index < 0
+                        ? reflection->GetFloat(message, field)
+                        : reflection->GetRepeatedFloat(message, field, index)),
+          FloatBits(field->default_value_float()));
+    case FieldDescriptor::CPPTYPE_STRING: {
+      string scratch;
+      const string& value =
+          index < 0
+              ? reflection->GetStringReference(message, field, &scratch)
+              : reflection->GetRepeatedStringReference(message, field, index,
+                                                       &scratch);
+      if (value == field->default_value_string()) return 0;
+      return MixBits(std::hash<string>()(value));
+    }
+    case FieldDescriptor::CPPTYPE_MESSAGE:
+      return HashMessage(
+          index < 0 ? reflection->GetMessage(message, field)
+                    : reflection->GetRepeatedMessage(message, field, index));
+  }
+  return 0;
+}
+
+bool MessageDifferencer::HashRepeatedFieldElements(
+    const Message& message, const FieldDescriptor* repeated_field,
+    const MapKeyComparator* key_comparator, int start,
+    std::vector<uint64>* hashes) {
+  const Reflection* reflection = message.GetReflection();
+  const int count = reflection->FieldSize(message, repeated_field);
+  hashes->resize(count - start);
+  if (key_comparator != NULL &&
+      repeated_field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+    for (int i = start; i < count; ++i) {
+      if (!key_comparator->HashKey(
+              reflection->GetRepeatedMessage(message, repeated_field, i),
+              &(*hashes)[i - start])) {
+        return false;
+      }
+    }
+    return true;
+  }
+  if (!CanHashFieldValues()) return false;
+  for (int i = start; i < count; ++i) {
+    (*hashes)[i - start] = HashFieldValue(message, repeated_field, i);
+  }
+  return true;
+}
+
 namespace {
 
 typedef std::pair<int, const UnknownField*> IndexUnknownFieldPair;
@@ -1326,6 +1993,12 @@ class MaximumMatcher {
   // match_list1[i] == -1 means the node is not matched. Same with match_list2.
   MaximumMatcher(int count1, int count2, NodeMatchCallback* callback,
                  std::vector<int>* match_list1, std::vector<int>* match_list2);
+  // Restricts the nodes on the right side that the i-th node on the left side
+  // may match to (*candidates)[i], which lists them in increasing order.  The
+  // callback is then only run for those pairs.  Does not take ownership.
+  void SetCandidates(const std::vector<const std::vector<int>*>* candidates) {
+    candidates_ = candidates;
+  }
   // Find a maximum match and return the number of matched node pairs.
   // If early_return is true, this method will return 0 immediately when it
   // finds that not all nodes on the left side can be matched.
@@ -1343,6 +2016,7 @@ class MaximumMatcher {
   int count2_;
   std::unique_ptr<NodeMatchCallback> match_callback_;
   std::map<std::pair<int, int>, bool> cached_match_results_;
+  const std::vector<const std::vector<int>*>* candidates_;
   std::vector<int>* match_list1_;
   std::vector<int>* match_list2_;
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(MaximumMatcher);
@@ -1353,7 +2027,8 @@ MaximumMatcher::MaximumMatcher(int count1, int count2,
                                std::vector<int>* match_list1,
                                std::vector<int>* match_list2)
     : count1_(count1), count2_(count2), match_callback_(callback),
-      match_list1_(match_list1), match_list2_(match_list2) {
+      candidates_(NULL), match_list1_(match_list1),
+      match_list2_(match_list2) {
   match_list1_->assign(count1, -1);
   match_list2_->assign(count2, -1);
 }
@@ -1389,14 +2064,30 @@ bool MaximumMatcher::Match(int left, int right) {
   return cached_match_results_[p];
 }
 
+// The elements of the second repeated field that have the same hash, in
+// increasing order of their indices.
+struct MatchBucket {
+  MatchBucket() : first_unmatched(0) {}
+  std::vector<int> indices;
+  // All indices before this one are known to be matched already.
+  int first_unmatched;
+};
+
+typedef std::unordered_map<uint64, MatchBucket> MatchBucketMap;
+
 bool MaximumMatcher::FindArgumentPathDFS(int v, std::vector<bool>* visited) {
   (*visited)[v] = true;
+  const std::vector<int>* candidates =
+      candidates_ != NULL ? (*candidates_)[v] : NULL;
+  const int candidate_count =
+      candidates != NULL ? candidates->size() : count2_;
   // We try to match those un-matched nodes on the right side first. This is
   // the step that the navie greedy matching algorithm uses. In the best cases
   // where the greedy algorithm can find a maximum matching, we will always
   // find a match in this step and the performance will be identical to the
   // greedy algorithm.
-  for (int i = 0; i < count2_; ++i) {
+  for (int k = 0; k < candidate_count; ++k) {
+    int i = candidates != NULL ? (*candidates)[k] : k;
     int matched = (*match_list2_)[i];
     if (matched == -1 && Match(v, i)) {
       (*match_list2_)[i] = v;
@@ -1407,7 +2098,8 @@ bool MaximumMatcher::FindArgumentPathDFS(int v, std::vector<bool>* visited) {
   // alternaive match for the node matched to them.
   // The greedy algorithm will stop before this and fail to produce the
   // correct result.
-  for (int i = 0; i < count2_; ++i) {
+  for (int k = 0; k < candidate_count; ++k) {
+    int i = candidates != NULL ? (*candidates)[k] : k;
     int matched = (*match_list2_)[i];
     if (matched != -1 && Match(v, i)) {
       if (!(*visited)[matched] && FindArgumentPathDFS(matched, visited)) {
@@ -1447,7 +2139,18 @@ bool MessageDifferencer::MatchRepeatedFieldIndices(
   bool success = true;
   // Find potential match if this is a special repeated field.
   if (key_comparator != NULL || IsTreatedAsSet(repeated_field)) {
+    // Elements that match have the same hash, so when the elements can be
+    // hashed only those in the same bucket need to be compared.  This keeps
+    // the matching linear unless many elements share a hash.
+    std::vector<uint64> hashes1;
+    std::vector<uint64> hashes2;
+    MatchBucketMap buckets;
     if (scope_ == PARTIAL) {
+      const bool hashed =
+          HashRepeatedFieldElements(message1, repeated_field, key_comparator,
+                                    0, &hashes1) &&
+          HashRepeatedFieldElements(message2, repeated_field, key_comparator,
+                                    0, &hashes2);
       // When partial matching is enabled, Compare(a, b) && Compare(a, c)
       // doesn't necessarily imply Compare(b, c). Therefore a naive greedy
       // algorithm will fail to find a maximum matching.
@@ -1459,6 +2162,19 @@ bool MessageDifferencer::MatchRepeatedFieldIndices(
               &message1, &message2, parent_fields);
       MaximumMatcher matcher(count1, count2, callback, match_list1,
                              match_list2);
+      const std::vector<int> no_candidates;
+      std::vector<const std::vector<int>*> candidates;
+      if (hashed) {
+        for (int j = 0; j < count2; ++j) {
+          buckets[hashes2[j]].indices.push_back(j);
+        }
+        candidates.resize(count1, &no_candidates);
+        for (int i = 0; i < count1; ++i) {
+          MatchBucketMap::const_iterator it = buckets.find(hashes1[i]);
+          if (it != buckets.end()) candidates[i] = &it->second.indices;
+        }
+        matcher.SetCandidates(&candidates);
+      }
       // If diff info is not needed, we should end the matching process as
       // soon as possible if not all items can be matched.
       bool early_return = (reporter == NULL);
@@ -1482,20 +2198,59 @@ bool MessageDifferencer::MatchRepeatedFieldIndices(
           }
         }
       }
+      // Only the elements after the common prefix are hashed.
+      const bool hashed =
+          HashRepeatedFieldElements(message1, repeated_field, key_comparator,
+                                    start_offset, &hashes1) &&
+          HashRepeatedFieldElements(message2, repeated_field, key_comparator,
+                                    start_offset, &hashes2);
+      if (hashed) {
+        for (int j = start_offset; j < count2; ++j) {
+          buckets[hashes2[j - start_offset]].indices.push_back(j);
+        }
+      }
       for (int i = start_offset; i < count1; ++i) {
         // Indicates any matched elements for this repeated field.
         bool match = false;
 
-        for (int j = start_offset; j < count2; j++) {
-          if (match_list2->at(j) != -1) continue;
-
-          match = IsMatch(repeated_field, key_comparator,
-                          &message1, &message2, parent_fields, i, j);
-
-          if (match) {
-            match_list1->at(i) = j;
-            match_list2->at(j) = i;
-            break;
+        if (hashed) {
+          // Same as below, but only for the candidates in the bucket.
+          MatchBucketMap::iterator it =
+              buckets.find(hashes1[i - start_offset]);
+          if (it != buckets.end()) {
+            MatchBucket* bucket = &it->second;
+            const int size = bucket->indices.size();
+            while (bucket->first_unmatched < size &&
+                   match_list2->at(bucket->indices[bucket->first_unmatched]) !=
+                       -1) {
+              ++bucket->first_unmatched;
+            }
+            for (int k = bucket->first_unmatched; k < size; ++k) {
+              const int j = bucket->indices[k];
+              if (match_list2->at(j) != -1) continue;
+
+              match = IsMatch(repeated_field, key_comparator,
+                              &message1, &message2, parent_fields, i, j);
+
+              if (match) {
+                match_list1->at(i) = j;
+                match_list2->at(j) = i;
+                break;
+              }
+            }
+          }
+        } else {
+          for (int j = start_offset; j < count2; j++) {
+            if (match_list2->at(j) != -1) continue;
+
+            match = IsMatch(repeated_field, key_comparator,
+                            &message1, &message2, parent_fields, i, j);
+
+            if (match) {
+              match_list1->at(i) = j;
+              match_list2->at(j) = i;
+              break;
+            }
           }
         }
         if (!match && reporter == NULL) return false;
@@ -1542,6 +2297,11 @@ MessageDifferencer::IgnoreCriteria::~IgnoreCriteria() {}
 
 // ===========================================================================
 
+MessageDifferencer::Executor::Executor() {}
+MessageDifferencer::Executor::~Executor() {}
+
+// ===========================================================================
+
 // Note that the printer's delimiter is not used, because if we are given a
 // printer, we don't know its delimiter.
 MessageDifferencer::StreamReporter::StreamReporter(
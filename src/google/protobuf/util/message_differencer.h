@@ -45,7 +45,9 @@
 #include <map>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
+#include <google/protobuf/stubs/callback.h>
 #include <google/protobuf/descriptor.h>  // FieldDescriptor
 #include <google/protobuf/message.h>  // Message
 #include <google/protobuf/unknown_field_set.h>
@@ -116,6 +118,11 @@ class PROTOBUF_EXPORT MessageDifferencer {
   // are compared as if via a recursive call. Use IgnoreField() and Compare()
   // if some fields should be ignored in the comparison.
   //
+  // For types without floating point fields, google.protobuf.Any fields or
+  // extensions, at any depth, the deterministic serializations of the two
+  // messages are compared first, which is much faster than reflection when
+  // the messages are equal.
+  //
   // This method REQUIRES that the two messages have the same
   // Descriptor (message1.GetDescriptor() == message2.GetDescriptor()).
   static bool Equals(const Message& message1, const Message& message2);
@@ -305,6 +312,16 @@ class PROTOBUF_EXPORT MessageDifferencer {
       return false;
     }
 
+    // Optionally hashes the key of 'message', so that the elements of a
+    // repeated field can be put into buckets before any pair of them is passed
+    // to IsMatch().  Two messages for which IsMatch() returns true must get
+    // the same hash.  Returns false (the default) if keys can't be hashed, in
+    // which case every pair of elements may be compared with IsMatch().
+    virtual bool HashKey(const Message& /* message */,
+                         uint64* /* hash */) const {
+      return false;
+    }
+
    private:
     GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(MapKeyComparator);
   };
@@ -338,6 +355,20 @@ class PROTOBUF_EXPORT MessageDifferencer {
     }
   };
 
+  // Runs closures, for example on a thread pool.  See set_executor().
+  class PROTOBUF_EXPORT Executor {
+   public:
+    Executor();
+    virtual ~Executor();
+
+    // Runs 'closure' once on any thread, before or after returning.  The
+    // closure deletes itself when run.
+    virtual void Schedule(Closure* closure) = 0;
+
+   private:
+    GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(Executor);
+  };
+
   // To add a Reporter, construct default here, then use ReportDifferencesTo or
   // ReportDifferencesToString.
   explicit MessageDifferencer();
@@ -562,6 +593,20 @@ class PROTOBUF_EXPORT MessageDifferencer {
   // differencer when compare repeated fields in messages.
   void set_repeated_field_comparison(RepeatedFieldComparison comparison);
 
+  // Lets this differencer split the elements of large repeated message fields,
+  // including map fields, into up to num_shards parts that are compared in
+  // parallel by closures run on 'executor'.  Only the outermost large field
+  // on each path is split.  Differences are reported in the same order as
+  // without an executor, after all parts are done.
+  //
+  // Each part is compared by a copy of this differencer, so any
+  // FieldComparator, MapKeyComparator and IgnoreCriteria set must be safe to
+  // call from several threads at once.  Pass NULL to compare everything on
+  // the calling thread, which is the default.  Compare() waits for the
+  // closures, so the executor must not need the calling thread to run them.
+  // Does not take ownership of executor.
+  void set_executor(Executor* executor, int num_shards);
+
   // Compares the two specified messages, returning true if they are the same,
   // false otherwise. If this method returns false, any changes between the
   // two messages will be reported if a Reporter was specified via
@@ -687,11 +732,15 @@ class PROTOBUF_EXPORT MessageDifferencer {
     bool IsMatch(
         const Message& message1, const Message& message2,
         const std::vector<SpecificField>& parent_fields) const override;
+    bool HashKey(const Message& message, uint64* hash) const override;
 
    private:
     MessageDifferencer* message_differencer_;
   };
 
+  // A part of a repeated field compared by set_executor().
+  struct Shard;
+
   // Returns true if field1's number() is less than field2's.
   static bool FieldBefore(const FieldDescriptor* field1,
                           const FieldDescriptor* field2);
@@ -808,6 +857,58 @@ class PROTOBUF_EXPORT MessageDifferencer {
   const MapKeyComparator* GetMapKeyComparator(
       const FieldDescriptor* field) const;
 
+  // Compares the elements of repeated_field in message1 with index in
+  // [begin, end) to the elements of message2 they are matched to in
+  // match_list1, and reports the modified, moved and matched ones.  Returns
+  // true if all of them are the same.
+  bool CompareMatchedElements(const Message& message1, const Message& message2,
+                              const FieldDescriptor* repeated_field,
+                              const std::vector<int>& match_list1, int begin,
+                              int end,
+                              std::vector<SpecificField>* parent_fields);
+
+  // Same as CompareMatchedElements() for all elements, but splits them up
+  // among copies of this differencer run by executor_.
+  bool CompareMatchedElementsInParallel(
+      const Message& message1, const Message& message2,
+      const FieldDescriptor* repeated_field,
+      const std::vector<int>& match_list1,
+      std::vector<SpecificField>* parent_fields);
+
+  // Runs CompareMatchedElements() for a shard.
+  static void CompareShard(Shard* shard);
+
+  // Copies the settings of 'other' except for the reporter and the executor.
+  // The IgnoreCriteria of 'other' are shared, not copied.
+  void CopySettingsFrom(const MessageDifferencer& other);
+
+  // Returns true if the hashes below are consistent with the comparisons of
+  // this differencer, ie. if no custom FieldComparator or IgnoreCriteria is
+  // set.
+  bool CanHashFieldValues() const;
+
+  // Hash functions used to put the elements of a repeated field into buckets
+  // before matching them.  Whenever this differencer considers two messages,
+  // fields or values equal, they get the same hash.  Only valid if
+  // CanHashFieldValues() returns true.  Values that don't compare exactly,
+  // such as approximately compared floats or anything compared in PARTIAL
+  // scope, are hashed to 0.  The hashes of messages are remembered in
+  // message_hashes_, so that nested repeated fields are not hashed again when
+  // their own elements are matched.
+  uint64 HashMessage(const Message& message);
+  uint64 HashField(const Message& message, const FieldDescriptor* field);
+  // index is -1 for singular fields.
+  uint64 HashFieldValue(const Message& message, const FieldDescriptor* field,
+                        int index);
+
+  // Fills 'hashes' with a hash of each element of repeated_field from index
+  // 'start' on, such that elements matched by MatchRepeatedFieldIndices()
+  // have the same hash.  Returns false if the elements can't be hashed.
+  bool HashRepeatedFieldElements(const Message& message,
+                                 const FieldDescriptor* repeated_field,
+                                 const MapKeyComparator* key_comparator,
+                                 int start, std::vector<uint64>* hashes);
+
   // Attempts to match indices of a repeated field, so that the contained values
   // match. Clears output vectors and sets their values to indices of paired
   // messages, ie. if message1[0] matches message2[1], then match_list1[0] == 1
@@ -858,6 +959,8 @@ class PROTOBUF_EXPORT MessageDifferencer {
   FieldKeyComparatorMap map_field_key_comparator_;
   MapEntryKeyComparator map_entry_key_comparator_;
   std::vector<IgnoreCriteria*> ignore_criteria_;
+  // False for copies made by CopySettingsFrom().
+  bool owns_ignore_criteria_;
 
   FieldSet ignored_fields_;
 
@@ -867,7 +970,18 @@ class PROTOBUF_EXPORT MessageDifferencer {
 
   std::string* output_string_;
 
+  Executor* executor_;
+  int num_shards_;
+
   std::unique_ptr<DynamicMessageFactory> dynamic_message_factory_;
+  // If set, the payloads unpacked from google.protobuf.Any are kept in
+  // unpacked_any_, since buffered reports may still refer to them.
+  bool keep_unpacked_any_;
+  std::vector<std::unique_ptr<Message> > unpacked_any_;
+  // The hashes computed by HashMessage() during the current comparison, by
+  // message address.  Cleared when the comparison ends, and after comparing
+  // payloads unpacked from google.protobuf.Any, whose addresses may be reused.
+  std::unordered_map<const Message*, uint64> message_hashes_;
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(MessageDifferencer);
 };
 
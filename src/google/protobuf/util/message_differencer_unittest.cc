@@ -35,8 +35,11 @@
 // TODO(ksroka): Move some of these tests to field_comparator_test.cc.
 
 #include <algorithm>
+#include <functional>
+#include <limits>
 #include <random>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <google/protobuf/stubs/strutil.h>
@@ -163,6 +166,64 @@ TEST(MessageDifferencerTest, MapFieldEqualityTest) {
   EXPECT_TRUE(util::MessageDifferencer::Equals(msg1, msg2));
 }
 
+TEST(MessageDifferencerTest, EqualsBySerialization) {
+  // TestField has no floating point fields, Any fields or extensions, so
+  // Equals() compares serializations first.
+  protobuf_unittest::TestField msg1;
+  protobuf_unittest::TestField msg2;
+  msg1.set_a(1);
+  msg1.add_rc(2);
+  msg1.mutable_m()->set_b(3);
+  msg2 = msg1;
+  EXPECT_TRUE(util::MessageDifferencer::Equals(msg1, msg2));
+  msg2.mutable_m()->set_b(4);
+  EXPECT_FALSE(util::MessageDifferencer::Equals(msg1, msg2));
+
+  // Larger than the buffers used for the comparison.
+  for (int i = 0; i < 1000; ++i) {
+    msg1.add_rc(i);
+  }
+  msg2 = msg1;
+  EXPECT_TRUE(util::MessageDifferencer::Equals(msg1, msg2));
+  msg2.set_rc(999, 0);
+  EXPECT_FALSE(util::MessageDifferencer::Equals(msg1, msg2));
+  msg2.set_rc(999, 998);
+  msg2.add_rc(0);
+  EXPECT_FALSE(util::MessageDifferencer::Equals(msg1, msg2));
+}
+
+TEST(MessageDifferencerTest, EqualsBySerializationMapOrder) {
+  unittest::TestSameTypeMap msg1;
+  unittest::TestSameTypeMap msg2;
+  for (int i = 0; i < 100; ++i) {
+    (*msg1.mutable_map1())[i] = i;
+    (*msg2.mutable_map1())[99 - i] = 99 - i;
+  }
+  EXPECT_TRUE(util::MessageDifferencer::Equals(msg1, msg2));
+  (*msg2.mutable_map1())[50] = 0;
+  EXPECT_FALSE(util::MessageDifferencer::Equals(msg1, msg2));
+}
+
+TEST(MessageDifferencerTest, EqualsBySerializationUnknownFieldOrder) {
+  // The serializations differ, but the messages are still equal.
+  protobuf_unittest::TestField msg1;
+  protobuf_unittest::TestField msg2;
+  msg1.mutable_unknown_fields()->AddVarint(100, 1);
+  msg1.mutable_unknown_fields()->AddVarint(101, 2);
+  msg2.mutable_unknown_fields()->AddVarint(101, 2);
+  msg2.mutable_unknown_fields()->AddVarint(100, 1);
+  EXPECT_TRUE(util::MessageDifferencer::Equals(msg1, msg2));
+}
+
+TEST(MessageDifferencerTest, EqualsNaNWithSameSerialization) {
+  // NaNs are never equal, even with the same bits.
+  unittest::TestAllTypes msg1;
+  unittest::TestAllTypes msg2;
+  msg1.set_optional_double(std::numeric_limits<double>::quiet_NaN());
+  msg2 = msg1;
+  EXPECT_FALSE(util::MessageDifferencer::Equals(msg1, msg2));
+}
+
 TEST(MessageDifferencerTest, BasicPartialEqualityTest) {
   // Create the testing protos
   unittest::TestAllTypes msg1;
@@ -1618,6 +1679,231 @@ TEST(MessageDifferencerTest, RepeatedFieldMapTest_CustomIndexMapKeyComparator) {
       output);
 }
 
+// Fills msg1 and msg2 with items that mostly equal each other in a shuffled
+// order, with some modified, added, deleted and duplicated ones.
+void FillShuffledItems(protobuf_unittest::TestDiffMessage* msg1,
+                       protobuf_unittest::TestDiffMessage* msg2) {
+  std::default_random_engine rng;
+  std::vector<protobuf_unittest::TestDiffMessage::Item> items;
+  for (int i = 0; i < 300; ++i) {
+    protobuf_unittest::TestDiffMessage::Item item;
+    item.set_a(i % 100);
+    if (i % 3 != 0) item.set_b(StrCat("b", i % 7));
+    if (i % 5 == 0) item.set_a(0);
+    item.add_ra(i % 4);
+    item.add_ra(i % 3);
+    if (i % 11 == 0) item.mutable_m()->set_c(i % 2);
+    items.push_back(item);
+  }
+  for (int i = 0; i < items.size(); ++i) {
+    if (i % 17 != 0) *msg1->add_item() = items[i];
+  }
+  std::shuffle(items.begin(), items.end(), rng);
+  for (int i = 0; i < items.size(); ++i) {
+    if (i % 13 == 0) continue;
+    protobuf_unittest::TestDiffMessage::Item* item = msg2->add_item();
+    *item = items[i];
+    if (i % 19 == 0) item->set_b("modified");
+    if (i % 23 == 0) item->mutable_m()->set_a(i);
+  }
+}
+
+// Hashing the elements of a set or map must not change how they are matched.
+// A custom field comparator disables hashing, which gives the reference.
+void ExpectSameDiffWithoutHashing(
+    const std::function<void(util::MessageDifferencer*)>& configure,
+    const Message& msg1, const Message& msg2) {
+  for (int scope = 0; scope < 2; ++scope) {
+    util::MessageDifferencer hashed;
+    util::MessageDifferencer pairwise;
+    util::DefaultFieldComparator comparator;
+    pairwise.set_field_comparator(&comparator);
+    configure(&hashed);
+    configure(&pairwise);
+    if (scope == 1) {
+      hashed.set_scope(util::MessageDifferencer::PARTIAL);
+      pairwise.set_scope(util::MessageDifferencer::PARTIAL);
+    }
+    string hashed_output;
+    string pairwise_output;
+    hashed.ReportDifferencesToString(&hashed_output);
+    pairwise.ReportDifferencesToString(&pairwise_output);
+    EXPECT_EQ(pairwise.Compare(msg1, msg2), hashed.Compare(msg1, msg2));
+    EXPECT_EQ(pairwise_output, hashed_output);
+    EXPECT_FALSE(hashed_output.empty());
+  }
+}
+
+TEST(MessageDifferencerTest, RepeatedFieldSetTest_HashedMatching) {
+  protobuf_unittest::TestDiffMessage msg1;
+  protobuf_unittest::TestDiffMessage msg2;
+  FillShuffledItems(&msg1, &msg2);
+  const FieldDescriptor* item = GetFieldDescriptor(msg1, "item");
+  const FieldDescriptor* ra = GetFieldDescriptor(msg1, "item.ra");
+  ExpectSameDiffWithoutHashing(
+      [item](util::MessageDifferencer* differencer) {
+        differencer->TreatAsSet(item);
+      },
+      msg1, msg2);
+  ExpectSameDiffWithoutHashing(
+      [item, ra](util::MessageDifferencer* differencer) {
+        differencer->TreatAsSet(item);
+        differencer->TreatAsSet(ra);
+      },
+      msg1, msg2);
+  ExpectSameDiffWithoutHashing(
+      [item](util::MessageDifferencer* differencer) {
+        differencer->TreatAsSet(item);
+        differencer->set_message_field_comparison(
+            util::MessageDifferencer::EQUIVALENT);
+      },
+      msg1, msg2);
+}
+
+TEST(MessageDifferencerTest, RepeatedFieldSetTest_HashedMatchingAfterPrefix) {
+  // Only the elements after the common prefix are hashed and bucketed.
+  protobuf_unittest::TestDiffMessage msg1;
+  protobuf_unittest::TestDiffMessage msg2;
+  FillShuffledItems(&msg1, &msg2);
+  protobuf_unittest::TestDiffMessage prefixed;
+  for (int i = 0; i < msg1.item_size() / 2; ++i) {
+    *prefixed.add_item() = msg1.item(i);
+  }
+  for (int i = 0; i < msg2.item_size(); ++i) {
+    *prefixed.add_item() = msg2.item(i);
+  }
+  const FieldDescriptor* item = GetFieldDescriptor(msg1, "item");
+  const FieldDescriptor* ra = GetFieldDescriptor(msg1, "item.ra");
+  ExpectSameDiffWithoutHashing(
+      [item, ra](util::MessageDifferencer* differencer) {
+        differencer->TreatAsSet(item);
+        differencer->TreatAsSet(ra);
+      },
+      msg1, prefixed);
+}
+
+TEST(MessageDifferencerTest, RepeatedFieldSetTest_HashesAreNotReused) {
+  // The hashes of a comparison must not leak into the next one, even when
+  // the messages are at the same addresses.
+  protobuf_unittest::TestDiffMessage msg1;
+  protobuf_unittest::TestDiffMessage msg2;
+  for (int i = 0; i < 10; ++i) {
+    msg1.add_item()->add_ra(i);
+    msg2.add_item()->add_ra(9 - i);
+  }
+  util::MessageDifferencer differencer;
+  differencer.TreatAsSet(GetFieldDescriptor(msg1, "item"));
+  EXPECT_TRUE(differencer.Compare(msg1, msg2));
+  msg2.mutable_item(0)->set_ra(0, 100);
+  EXPECT_FALSE(differencer.Compare(msg1, msg2));
+  msg1.mutable_item(9)->set_ra(0, 100);
+  EXPECT_TRUE(differencer.Compare(msg1, msg2));
+}
+
+TEST(MessageDifferencerTest, RepeatedFieldMapTest_HashedMatching) {
+  protobuf_unittest::TestDiffMessage msg1;
+  protobuf_unittest::TestDiffMessage msg2;
+  FillShuffledItems(&msg1, &msg2);
+  const FieldDescriptor* item = GetFieldDescriptor(msg1, "item");
+  const FieldDescriptor* a = GetFieldDescriptor(msg1, "item.a");
+  const FieldDescriptor* b = GetFieldDescriptor(msg1, "item.b");
+  const FieldDescriptor* ra = GetFieldDescriptor(msg1, "item.ra");
+  const FieldDescriptor* m = GetFieldDescriptor(msg1, "item.m");
+  const FieldDescriptor* mc = GetFieldDescriptor(msg1, "item.m.c");
+  ExpectSameDiffWithoutHashing(
+      [item, a](util::MessageDifferencer* differencer) {
+        differencer->TreatAsMap(item, a);
+      },
+      msg1, msg2);
+  ExpectSameDiffWithoutHashing(
+      [item, b, ra](util::MessageDifferencer* differencer) {
+        differencer->TreatAsMapWithMultipleFieldsAsKey(item, {b, ra});
+        differencer->TreatAsSet(ra);
+      },
+      msg1, msg2);
+  ExpectSameDiffWithoutHashing(
+      [item, a, m, mc](util::MessageDifferencer* differencer) {
+        differencer->TreatAsMapWithMultipleFieldPathsAsKey(item,
+                                                           {{a}, {m, mc}});
+      },
+      msg1, msg2);
+}
+
+TEST(MessageDifferencerTest, RepeatedFieldSetTest_HashedEquivalentValues) {
+  // Values that compare equal in spite of different representations must
+  // still be matched.
+  protobuf_unittest::TestDiffMessage msg1;
+  protobuf_unittest::TestDiffMessage msg2;
+  msg1.add_item()->set_b("x");
+  msg1.add_item()->set_a(1);
+  msg2.add_item()->set_a(1);
+  protobuf_unittest::TestDiffMessage::Item* item = msg2.add_item();
+  item->set_a(0);
+  item->set_b("x");
+  item->mutable_m();
+  util::MessageDifferencer differencer;
+  differencer.TreatAsSet(GetFieldDescriptor(msg1, "item"));
+  differencer.set_message_field_comparison(
+      util::MessageDifferencer::EQUIVALENT);
+  EXPECT_TRUE(differencer.Compare(msg1, msg2));
+
+  unittest::TestAllTypes doubles1;
+  unittest::TestAllTypes doubles2;
+  doubles1.add_repeated_double(0.0);
+  doubles1.add_repeated_double(1.5);
+  doubles2.add_repeated_double(1.5);
+  doubles2.add_repeated_double(-0.0);
+  util::MessageDifferencer double_differencer;
+  double_differencer.TreatAsSet(
+      GetFieldDescriptor(doubles1, "repeated_double"));
+  EXPECT_TRUE(double_differencer.Compare(doubles1, doubles2));
+}
+
+// Matches items by item.a and hashes them accordingly.  Counts the calls to
+// IsMatch().
+class HashedMapKeyComparator
+    : public util::MessageDifferencer::MapKeyComparator {
+ public:
+  typedef util::MessageDifferencer::SpecificField SpecificField;
+  HashedMapKeyComparator() : match_calls_(0) {}
+  bool IsMatch(const Message& message1, const Message& message2,
+               const std::vector<SpecificField>& parent_fields) const override {
+    ++match_calls_;
+    return GetA(message1) == GetA(message2);
+  }
+  bool HashKey(const Message& message, uint64* hash) const override {
+    *hash = GetA(message);
+    return true;
+  }
+  int match_calls() const { return match_calls_; }
+
+ private:
+  static int32 GetA(const Message& message) {
+    return message.GetReflection()->GetInt32(
+        message, message.GetDescriptor()->FindFieldByName("a"));
+  }
+
+  mutable int match_calls_;
+};
+
+TEST(MessageDifferencerTest, RepeatedFieldMapTest_KeyComparatorHashKey) {
+  protobuf_unittest::TestDiffMessage msg1;
+  protobuf_unittest::TestDiffMessage msg2;
+  const int kCount = 1000;
+  for (int i = 0; i < kCount; ++i) {
+    msg1.add_item()->set_a(i);
+    msg2.add_item()->set_a(kCount - 1 - i);
+  }
+  msg2.mutable_item(0)->set_b("changed");
+  util::MessageDifferencer differencer;
+  HashedMapKeyComparator key_comparator;
+  differencer.TreatAsMapUsingKeyComparator(GetFieldDescriptor(msg1, "item"),
+                                           &key_comparator);
+  EXPECT_FALSE(differencer.Compare(msg1, msg2));
+  // Each item is only compared with the one that has the same key.
+  EXPECT_EQ(kCount, key_comparator.match_calls());
+}
+
 TEST(MessageDifferencerTest, RepeatedFieldSetTest_Subset) {
   protobuf_unittest::TestDiffMessage msg1;
   protobuf_unittest::TestDiffMessage msg2;
@@ -3392,6 +3678,113 @@ TEST(Anytest, TreatAsSet_DifferentType) {
   EXPECT_TRUE(message_differencer.Compare(m1, m2));
 }
 
+// Runs each closure on a new thread.
+class ThreadPerClosureExecutor : public util::MessageDifferencer::Executor {
+ public:
+  ThreadPerClosureExecutor() : scheduled_(0) {}
+  ~ThreadPerClosureExecutor() override {
+    for (int i = 0; i < threads_.size(); ++i) threads_[i].join();
+  }
+
+  void Schedule(Closure* closure) override {
+    ++scheduled_;
+    threads_.emplace_back([closure] { closure->Run(); });
+  }
+
+  int scheduled() const { return scheduled_; }
+
+ private:
+  int scheduled_;
+  std::vector<std::thread> threads_;
+};
+
+// Comparing in parallel must give the same result and reports as comparing
+// on one thread.
+void ExpectSameDiffInParallel(
+    const std::function<void(util::MessageDifferencer*)>& configure,
+    const Message& msg1, const Message& msg2) {
+  util::MessageDifferencer serial;
+  util::MessageDifferencer parallel;
+  ThreadPerClosureExecutor executor;
+  parallel.set_executor(&executor, 4);
+  configure(&serial);
+  configure(&parallel);
+  const bool expected = serial.Compare(msg1, msg2);
+  EXPECT_EQ(expected, parallel.Compare(msg1, msg2));
+
+  string serial_output;
+  string parallel_output;
+  serial.ReportDifferencesToString(&serial_output);
+  parallel.ReportDifferencesToString(&parallel_output);
+  EXPECT_EQ(expected, serial.Compare(msg1, msg2));
+  EXPECT_EQ(expected, parallel.Compare(msg1, msg2));
+  EXPECT_EQ(serial_output, parallel_output);
+  EXPECT_FALSE(parallel_output.empty());
+  EXPECT_GT(executor.scheduled(), 0);
+}
+
+TEST(MessageDifferencerParallelTest, RepeatedField) {
+  protobuf_unittest::TestDiffMessage msg1;
+  protobuf_unittest::TestDiffMessage msg2;
+  for (int i = 0; i < 1000; ++i) {
+    protobuf_unittest::TestDiffMessage::Item* item = msg1.add_item();
+    item->set_a(i);
+    item->set_b(StrCat("b", i));
+    item->add_ra(i % 10);
+  }
+  for (int i = 999; i >= 10; --i) {
+    protobuf_unittest::TestDiffMessage::Item* item = msg2.add_item();
+    *item = msg1.item(i);
+    if (i % 37 == 0) item->set_b("modified");
+    if (i % 101 == 0) item->add_ra(i);
+  }
+  const FieldDescriptor* item = GetFieldDescriptor(msg1, "item");
+  const FieldDescriptor* a = GetFieldDescriptor(msg1, "item.a");
+  const FieldDescriptor* ra = GetFieldDescriptor(msg1, "item.ra");
+  ExpectSameDiffInParallel([](util::MessageDifferencer* differencer) {},
+                           msg1, msg2);
+  ExpectSameDiffInParallel(
+      [item](util::MessageDifferencer* differencer) {
+        differencer->TreatAsSet(item);
+        differencer->set_report_matches(true);
+      },
+      msg1, msg2);
+  ExpectSameDiffInParallel(
+      [item, a, ra](util::MessageDifferencer* differencer) {
+        differencer->TreatAsMap(item, a);
+        differencer->IgnoreField(ra);
+      },
+      msg1, msg2);
+}
+
+TEST(MessageDifferencerParallelTest, MapField) {
+  protobuf_unittest::TestMap msg1;
+  protobuf_unittest::TestMap msg2;
+  for (int i = 0; i < 1000; ++i) {
+    (*msg1.mutable_map_int32_foreign_message())[i].set_c(i);
+    if (i % 7 != 0) {
+      (*msg2.mutable_map_int32_foreign_message())[i].set_c(i % 43 ? i : -i);
+    }
+  }
+  ExpectSameDiffInParallel([](util::MessageDifferencer* differencer) {},
+                           msg1, msg2);
+}
+
+TEST(MessageDifferencerParallelTest, AnyPayloads) {
+  // Reports of fields in Any payloads refer to the unpacked payloads.
+  protobuf_unittest::TestAny msg1;
+  protobuf_unittest::TestAny msg2;
+  for (int i = 0; i < 500; ++i) {
+    protobuf_unittest::TestField value;
+    value.set_a(i);
+    msg1.add_repeated_any_value()->PackFrom(value);
+    if (i % 50 == 0) value.set_b(i);
+    msg2.add_repeated_any_value()->PackFrom(value);
+  }
+  ExpectSameDiffInParallel([](util::MessageDifferencer* differencer) {},
+                           msg1, msg2);
+}
+
 
 }  // namespace
 }  // namespace protobuf
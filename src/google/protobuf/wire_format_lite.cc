@@ -34,6 +34,7 @@
 
 #include <google/protobuf/wire_format_lite_inl.h>
 
+#include <string.h>
 #include <stack>
 #include <string>
 #include <vector>
@@ -45,6 +46,10 @@
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <google/protobuf/port_def.inc>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 
 namespace google {
 namespace protobuf {
@@ -225,6 +230,40 @@ bool WireFormatLite::SkipField(
   }
 }
 
+int WireFormatLite::CountLengthDelimitedRun(io::CodedInputStream* input,
+                                            uint32 tag) {
+  GOOGLE_DCHECK_EQ(GetTagWireType(tag), WIRETYPE_LENGTH_DELIMITED);
+  uint8 tag_bytes[5];  // The longest varint32.
+  const int tag_size =
+      io::CodedOutputStream::WriteVarint32ToArray(tag, tag_bytes) - tag_bytes;
+
+  const void* data;
+  int size;
+  input->GetDirectBufferPointerInline(&data, &size);
+  const uint8* ptr = static_cast<const uint8*>(data);
+  const uint8* const end = ptr + size;
+  int count = 0;
+  while (true) {
+    // Read the length of the value.
+    uint32 length = 0;
+    int shift = 0;
+    while (true) {
+      if (ptr == end || shift >= 32) return count;
+      const uint8 byte = *ptr++;
+      length |= static_cast<uint32>(byte & 0x7F) << shift;
+      if (byte < 0x80) break;
+      shift += 7;
+    }
+    if (static_cast<uint32>(end - ptr) < length) return count;
+    ptr += length;
+    ++count;
+    if (end - ptr < tag_size || memcmp(ptr, tag_bytes, tag_size) != 0) {
+      return count;
+    }
+    ptr += tag_size;
+  }
+}
+
 bool WireFormatLite::SkipMessage(io::CodedInputStream* input) {
   while (true) {
     uint32 tag = input->ReadTag();
@@ -294,6 +333,39 @@ void CodedOutputStreamFieldSkipper::SkipUnknownEnum(
   unknown_fields_->WriteVarint64(value);
 }
 
+int WireFormatLite::CountVarintTerminators(const uint8* buffer, int size) {
+  // Every byte with the high bit clear ends a varint, so the number of values
+  // in a packed run is size minus the number of continuation bytes.
+  const uint8* ptr = buffer;
+  const uint8* end = buffer + size;
+  int continuations = 0;
+#if defined(__SSE2__)
+  while (end - ptr >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+    // Shift the high bits down to one per byte and sum each 8-byte half.
+    __m128i bits = _mm_and_si128(_mm_srli_epi64(chunk, 7), _mm_set1_epi8(1));
+    __m128i sums = _mm_sad_epu8(bits, _mm_setzero_si128());
+    continuations += _mm_cvtsi128_si32(sums) +
+                     _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums));
+    ptr += 16;
+  }
+#endif
+  while (end - ptr >= 8) {
+    uint64 chunk;
+    memcpy(&chunk, ptr, sizeof(chunk));
+    // Gather the high bit of each byte into the low bit of the byte, then sum
+    // the bytes into the top byte.
+    chunk = (chunk >> 7) & PROTOBUF_ULONGLONG(0x0101010101010101);
+    continuations += static_cast<int>(
+        (chunk * PROTOBUF_ULONGLONG(0x0101010101010101)) >> 56);
+    ptr += 8;
+  }
+  while (ptr < end) {
+    continuations += *ptr++ >> 7;
+  }
+  return size - continuations;
+}
+
 bool WireFormatLite::ReadPackedEnumNoInline(io::CodedInputStream* input,
                                             bool (*is_valid)(int),
                                             RepeatedField<int>* values) {
@@ -428,6 +500,77 @@ void WireFormatLite::WriteBoolArray(const bool* a, int n,
   WriteArray<bool>(a, n, output);
 }
 
+static const int kMaxVarintBytes = 10;
+static const int kMaxVarint32Bytes = 5;
+
+// Encodes values directly into the stream's buffer for as long as it has room
+// for kMaxBytes per remaining value, so that the hot loop needs no per-element
+// space check.  Values near a buffer boundary go through a small local buffer.
+template <typename CType, uint8* (*Encode)(CType, uint8*), int kMaxBytes>
+static void WriteVarintArray(const CType* a, int n,
+                             io::CodedOutputStream* output) {
+  int i = 0;
+  while (i < n) {
+    void* data;
+    int size;
+    if (!output->GetDirectBufferPointer(&data, &size)) return;
+    int to_do = std::min(n - i, size / kMaxBytes);
+    if (to_do == 0) {
+      uint8 buf[kMaxBytes];
+      output->WriteRaw(buf, Encode(a[i++], buf) - buf);
+      continue;
+    }
+    uint8* start = static_cast<uint8*>(data);
+    uint8* ptr = start;
+    for (const int end = i + to_do; i < end; i++) {
+      ptr = Encode(a[i], ptr);
+    }
+    output->Skip(ptr - start);
+  }
+}
+
+void WireFormatLite::WriteInt32Array(const int32* a, int n,
+                                     io::CodedOutputStream* output) {
+  WriteVarintArray<int32, WriteInt32NoTagToArray,
+                   kMaxVarintBytes>(a, n, output);
+}
+
+void WireFormatLite::WriteInt64Array(const int64* a, int n,
+                                     io::CodedOutputStream* output) {
+  WriteVarintArray<int64, WriteInt64NoTagToArray,
+                   kMaxVarintBytes>(a, n, output);
+}
+
+void WireFormatLite::WriteUInt32Array(const uint32* a, int n,
+                                      io::CodedOutputStream* output) {
+  WriteVarintArray<uint32, WriteUInt32NoTagToArray,
+                   kMaxVarint32Bytes>(a, n, output);
+}
+
+void WireFormatLite::WriteUInt64Array(const uint64* a, int n,
+                                      io::CodedOutputStream* output) {
+  WriteVarintArray<uint64, WriteUInt64NoTagToArray,
+                   kMaxVarintBytes>(a, n, output);
+}
+
+void WireFormatLite::WriteSInt32Array(const int32* a, int n,
+                                      io::CodedOutputStream* output) {
+  WriteVarintArray<int32, WriteSInt32NoTagToArray,
+                   kMaxVarint32Bytes>(a, n, output);
+}
+
+void WireFormatLite::WriteSInt64Array(const int64* a, int n,
+                                      io::CodedOutputStream* output) {
+  WriteVarintArray<int64, WriteSInt64NoTagToArray,
+                   kMaxVarintBytes>(a, n, output);
+}
+
+void WireFormatLite::WriteEnumArray(const int* a, int n,
+                                    io::CodedOutputStream* output) {
+  WriteVarintArray<int, WriteEnumNoTagToArray,
+                   kMaxVarintBytes>(a, n, output);
+}
+
 void WireFormatLite::WriteInt32(int field_number, int32 value,
                                 io::CodedOutputStream* output) {
   WriteTag(field_number, WIRETYPE_VARINT, output);
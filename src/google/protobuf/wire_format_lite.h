@@ -192,6 +192,14 @@ class PROTOBUF_EXPORT WireFormatLite {
   static bool SkipField(io::CodedInputStream* input, uint32 tag,
                         io::CodedOutputStream* output);
 
+  // Counts the length-delimited values with the given tag that follow one
+  // another in the input, which should start positioned immediately after
+  // the tag of the first one, like for SkipField().  Only the part of the
+  // input that is already buffered, up to the current limit, is looked at,
+  // and nothing is consumed, so the count is a lower bound meant for
+  // reserving room before the values are parsed.
+  static int CountLengthDelimitedRun(io::CodedInputStream* input, uint32 tag);
+
   // Reads and ignores a message from the input.  Skipped values are simply
   // discarded, not recorded anywhere.  See WireFormat::SkipMessage() for a
   // version that records to an UnknownFieldSet.
@@ -407,6 +415,22 @@ class PROTOBUF_EXPORT WireFormatLite {
                                  io::CodedOutputStream* output);
   static void WriteBoolArray(const bool* a, int n,
                              io::CodedOutputStream* output);
+  // The varint types are encoded straight into the stream's buffer in
+  // batches, instead of one bounds-checked write per element.
+  static void WriteInt32Array(const int32* a, int n,
+                              io::CodedOutputStream* output);
+  static void WriteInt64Array(const int64* a, int n,
+                              io::CodedOutputStream* output);
+  static void WriteUInt32Array(const uint32* a, int n,
+                               io::CodedOutputStream* output);
+  static void WriteUInt64Array(const uint64* a, int n,
+                               io::CodedOutputStream* output);
+  static void WriteSInt32Array(const int32* a, int n,
+                               io::CodedOutputStream* output);
+  static void WriteSInt64Array(const int64* a, int n,
+                               io::CodedOutputStream* output);
+  static void WriteEnumArray(const int* a, int n,
+                             io::CodedOutputStream* output);
 
   // Write fields, including tags.
   static void WriteInt32(int field_number, int32 value,
@@ -734,6 +758,28 @@ class PROTOBUF_EXPORT WireFormatLite {
   PROTOBUF_ALWAYS_INLINE static bool ReadPackedFixedSizePrimitive(
       io::CodedInputStream* input, RepeatedField<CType>* value);
 
+  // Reads a packed field of varint-encoded values.  When the whole packed run
+  // is in the input's current buffer, it is decoded in bulk straight into
+  // |value| after a single Reserve().
+  template <typename CType, enum FieldType DeclaredType>
+  static bool ReadPackedVarintPrimitive(io::CodedInputStream* input,
+                                        RepeatedField<CType>* value);
+
+  // Converts a decoded varint to the C++ type of the field, the same way
+  // ReadPrimitive() does.
+  template <typename CType, enum FieldType DeclaredType>
+  static CType DecodePackedVarint(uint64 value);
+
+  // Returns the number of varints that end in buffer[0, size), i.e. the
+  // number of bytes without the continuation bit set.
+  static int CountVarintTerminators(const uint8* buffer, int size);
+
+  // Decodes one varint from |buffer| without bounds checks; the caller must
+  // ensure that a terminating byte follows within the readable range.
+  // Returns NULL if the varint is longer than 10 bytes.
+  static const uint8* ReadVarint64FromTerminatedArray(const uint8* buffer,
+                                                      uint64* value);
+
   static const CppType kFieldTypeToCppTypeMap[];
   static const WireFormatLite::WireType kWireTypeForFieldType[];
 
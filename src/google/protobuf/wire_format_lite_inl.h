@@ -404,6 +404,135 @@ inline bool WireFormatLite::ReadPackedFixedSizePrimitive(
   return true;
 }
 
+template <>
+inline int32
+WireFormatLite::DecodePackedVarint<int32, WireFormatLite::TYPE_INT32>(
+    uint64 value) {
+  return static_cast<int32>(value);
+}
+template <>
+inline int64
+WireFormatLite::DecodePackedVarint<int64, WireFormatLite::TYPE_INT64>(
+    uint64 value) {
+  return static_cast<int64>(value);
+}
+template <>
+inline uint32
+WireFormatLite::DecodePackedVarint<uint32, WireFormatLite::TYPE_UINT32>(
+    uint64 value) {
+  return static_cast<uint32>(value);
+}
+template <>
+inline uint64
+WireFormatLite::DecodePackedVarint<uint64, WireFormatLite::TYPE_UINT64>(
+    uint64 value) {
+  return value;
+}
+template <>
+inline int32
+WireFormatLite::DecodePackedVarint<int32, WireFormatLite::TYPE_SINT32>(
+    uint64 value) {
+  return ZigZagDecode32(static_cast<uint32>(value));
+}
+template <>
+inline int64
+WireFormatLite::DecodePackedVarint<int64, WireFormatLite::TYPE_SINT64>(
+    uint64 value) {
+  return ZigZagDecode64(value);
+}
+template <>
+inline bool WireFormatLite::DecodePackedVarint<bool, WireFormatLite::TYPE_BOOL>(
+    uint64 value) {
+  return value != 0;
+}
+template <>
+inline int WireFormatLite::DecodePackedVarint<int, WireFormatLite::TYPE_ENUM>(
+    uint64 value) {
+  return static_cast<int>(static_cast<uint32>(value));
+}
+
+inline const uint8* WireFormatLite::ReadVarint64FromTerminatedArray(
+    const uint8* buffer, uint64* value) {
+  const uint8* ptr = buffer;
+  uint64 result = *ptr++;
+  if (PROTOBUF_PREDICT_TRUE(result < 0x80)) {
+    *value = result;
+    return ptr;
+  }
+  result -= 0x80;
+  for (int shift = 7; shift < 64; shift += 7) {
+    uint64 byte = *ptr++;
+    result += byte << shift;
+    if (byte < 0x80) {
+      *value = result;
+      return ptr;
+    }
+    result -= static_cast<uint64>(0x80) << shift;
+  }
+  // More than 10 bytes: data is corrupt.
+  return NULL;
+}
+
+template <typename CType, enum WireFormatLite::FieldType DeclaredType>
+bool WireFormatLite::ReadPackedVarintPrimitive(io::CodedInputStream* input,
+                                               RepeatedField<CType>* values) {
+  int length;
+  if (!input->ReadVarintSizeAsInt(&length)) return false;
+  const void* void_buffer;
+  int buffer_size;
+  input->GetDirectBufferPointerInline(&void_buffer, &buffer_size);
+  const uint8* buffer = static_cast<const uint8*>(void_buffer);
+  if (length > 0 && buffer_size >= length && buffer[length - 1] < 0x80) {
+    // Fast path: the whole run is in the buffer and its last varint is
+    // terminated, so every varint in it ends inside the buffer.  Count the
+    // values to allocate space for all of them at once, then decode without
+    // further bounds checks.  The count is bounded by the bytes actually
+    // present, so a malicious length can not cause a large allocation.
+    const uint8* end = buffer + length;
+    values->Reserve(values->size() + CountVarintTerminators(buffer, length));
+    while (buffer < end) {
+      uint64 temp;
+      buffer = ReadVarint64FromTerminatedArray(buffer, &temp);
+      if (buffer == NULL) return false;
+      values->AddAlreadyReserved(DecodePackedVarint<CType, DeclaredType>(temp));
+    }
+    input->Skip(length);
+    return true;
+  }
+
+  io::CodedInputStream::Limit limit = input->PushLimit(length);
+  while (input->BytesUntilLimit() > 0) {
+    CType value;
+    if (!ReadPrimitive<CType, DeclaredType>(input, &value)) return false;
+    values->Add(value);
+  }
+  input->PopLimit(limit);
+  return true;
+}
+
+// Specializations of ReadPackedPrimitive for the varint types, which decode
+// the packed run in bulk when possible.
+#define READ_REPEATED_PACKED_VARINT_PRIMITIVE(CPPTYPE, DECLARED_TYPE)          \
+template <>                                                                    \
+inline bool WireFormatLite::ReadPackedPrimitive<                               \
+  CPPTYPE, WireFormatLite::DECLARED_TYPE>(                                     \
+    io::CodedInputStream* input,                                               \
+    RepeatedField<CPPTYPE>* values) {                                          \
+  return ReadPackedVarintPrimitive<                                            \
+      CPPTYPE, WireFormatLite::DECLARED_TYPE>(input, values);                  \
+}
+
+READ_REPEATED_PACKED_VARINT_PRIMITIVE(int32, TYPE_INT32)
+READ_REPEATED_PACKED_VARINT_PRIMITIVE(int64, TYPE_INT64)
+READ_REPEATED_PACKED_VARINT_PRIMITIVE(uint32, TYPE_UINT32)
+READ_REPEATED_PACKED_VARINT_PRIMITIVE(uint64, TYPE_UINT64)
+READ_REPEATED_PACKED_VARINT_PRIMITIVE(int32, TYPE_SINT32)
+READ_REPEATED_PACKED_VARINT_PRIMITIVE(int64, TYPE_SINT64)
+READ_REPEATED_PACKED_VARINT_PRIMITIVE(bool, TYPE_BOOL)
+READ_REPEATED_PACKED_VARINT_PRIMITIVE(int, TYPE_ENUM)
+
+#undef READ_REPEATED_PACKED_VARINT_PRIMITIVE
+
 // Specializations of ReadPackedPrimitive for the fixed size types, which use
 // an optimized code path.
 #define READ_REPEATED_PACKED_FIXED_SIZE_PRIMITIVE(CPPTYPE, DECLARED_TYPE)      \
@@ -773,6 +773,142 @@ TEST(WireFormatTest, RepeatedScalarsDifferentTagSizes) {
   EXPECT_EQ(msg1.DebugString(), msg2.DebugString());
 }
 
+TEST(WireFormatTest, ParsePackedVarintsInBulk) {
+  // Packed varint fields are decoded in bulk when the whole run is in one
+  // buffer, and one value at a time otherwise.  Both must agree.
+  unittest::TestPackedTypes source;
+  for (int i = 0; i < 1000; ++i) {
+    int64 v = (i % 2 ? -1 : 1) * (LL(1) << (i % 63));
+    source.add_packed_int32(static_cast<int32>(v));
+    source.add_packed_int64(v);
+    source.add_packed_uint32(static_cast<uint32>(v));
+    source.add_packed_uint64(static_cast<uint64>(v));
+    source.add_packed_sint32(static_cast<int32>(v));
+    source.add_packed_sint64(v);
+    source.add_packed_bool(i % 3 == 0);
+    source.add_packed_enum(i % 2 ? unittest::FOREIGN_BAR
+                                 : unittest::FOREIGN_BAZ);
+  }
+  string data = source.SerializeAsString();
+
+  for (int block_size : {1, 7, 64, static_cast<int>(data.size())}) {
+    SCOPED_TRACE(block_size);
+    unittest::TestPackedTypes dest;
+    io::ArrayInputStream raw_input(data.data(), data.size(), block_size);
+    io::CodedInputStream input(&raw_input);
+    EXPECT_TRUE(dest.MergePartialFromCodedStream(&input));
+    EXPECT_EQ(source.SerializeAsString(), dest.SerializeAsString());
+  }
+}
+
+TEST(WireFormatTest, SerializePackedVarintsInBulk) {
+  // Packed varint fields are written to streams in batches that must split
+  // correctly at arbitrary buffer boundaries.
+  unittest::TestPackedTypes message;
+  for (int i = 0; i < 1000; ++i) {
+    int64 v = (i % 2 ? -1 : 1) * (LL(1) << (i % 63));
+    message.add_packed_int32(static_cast<int32>(v));
+    message.add_packed_int64(v);
+    message.add_packed_uint32(static_cast<uint32>(v));
+    message.add_packed_uint64(static_cast<uint64>(v));
+    message.add_packed_sint32(static_cast<int32>(v));
+    message.add_packed_sint64(v);
+    message.add_packed_enum(i % 2 ? unittest::FOREIGN_BAR
+                                  : unittest::FOREIGN_BAZ);
+  }
+  string expected;
+  expected.resize(message.ByteSizeLong());
+  message.SerializeWithCachedSizesToArray(
+      reinterpret_cast<uint8*>(string_as_array(&expected)));
+
+  for (int block_size : {1, 3, 11, 64, static_cast<int>(expected.size())}) {
+    SCOPED_TRACE(block_size);
+    string buffer(expected.size(), '\0');
+    {
+      io::ArrayOutputStream raw_output(string_as_array(&buffer),
+                                       buffer.size(), block_size);
+      io::CodedOutputStream output(&raw_output);
+      message.SerializeWithCachedSizes(&output);
+      ASSERT_FALSE(output.HadError());
+      EXPECT_EQ(static_cast<int>(expected.size()), output.ByteCount());
+    }
+    EXPECT_EQ(expected, buffer);
+  }
+}
+
+TEST(WireFormatTest, CountLengthDelimitedRun) {
+  unittest::TestAllTypes message;
+  for (int i = 0; i < 100; ++i) {
+    message.add_repeated_string(string(i, 'x'));
+  }
+  message.add_repeated_bytes("after");
+  string data = message.SerializeAsString();
+  const uint32 tag = WireFormatLite::MakeTag(
+      unittest::TestAllTypes::kRepeatedStringFieldNumber,
+      WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+
+  {
+    io::CodedInputStream input(reinterpret_cast<const uint8*>(data.data()),
+                               data.size());
+    ASSERT_EQ(tag, input.ReadTag());
+    EXPECT_EQ(100, WireFormatLite::CountLengthDelimitedRun(&input, tag));
+    // Nothing was consumed.
+    string value;
+    EXPECT_TRUE(WireFormatLite::ReadString(&input, &value));
+    EXPECT_EQ("", value);
+  }
+  {
+    // Only the current limit is looked at.
+    io::CodedInputStream input(reinterpret_cast<const uint8*>(data.data()),
+                               data.size());
+    ASSERT_EQ(tag, input.ReadTag());
+    // Values of 0, 1 and 2 bytes, each after a one-byte length and a
+    // two-byte tag.
+    input.PushLimit(12);
+    EXPECT_EQ(3, WireFormatLite::CountLengthDelimitedRun(&input, tag));
+  }
+  {
+    // Only the buffered input is looked at.
+    io::ArrayInputStream raw_input(data.data(), data.size(), 64);
+    io::CodedInputStream input(&raw_input);
+    ASSERT_EQ(tag, input.ReadTag());
+    EXPECT_EQ(9, WireFormatLite::CountLengthDelimitedRun(&input, tag));
+  }
+}
+
+TEST(WireFormatTest, ParsePackedVarintsInvalid) {
+  RepeatedField<int64> values;
+
+  // Last value is not terminated.
+  string truncated = "\x03\x01\x02\x83";
+  io::CodedInputStream truncated_input(
+      reinterpret_cast<const uint8*>(truncated.data()), truncated.size());
+  EXPECT_FALSE((WireFormatLite::ReadPackedPrimitive<
+                int64, WireFormatLite::TYPE_INT64>(&truncated_input, &values)));
+
+  // A varint longer than ten bytes.
+  string overlong = "\x0c\x01" + string(10, '\x80') + "\x01";
+  io::CodedInputStream overlong_input(
+      reinterpret_cast<const uint8*>(overlong.data()), overlong.size());
+  EXPECT_FALSE((WireFormatLite::ReadPackedPrimitive<
+                int64, WireFormatLite::TYPE_INT64>(&overlong_input, &values)));
+
+  // A valid run leaves the stream positioned right after it.
+  values.Clear();
+  string valid = "\x04\x01\x96\x01\x7f\x2a";
+  io::CodedInputStream valid_input(
+      reinterpret_cast<const uint8*>(valid.data()), valid.size());
+  EXPECT_TRUE((WireFormatLite::ReadPackedPrimitive<
+               int64, WireFormatLite::TYPE_INT64>(&valid_input, &values)));
+  ASSERT_EQ(3, values.size());
+  EXPECT_EQ(1, values.Get(0));
+  EXPECT_EQ(150, values.Get(1));
+  EXPECT_EQ(127, values.Get(2));
+  uint32 next;
+  EXPECT_TRUE(valid_input.ReadVarint32(&next));
+  EXPECT_EQ(42, next);
+}
+
 TEST(WireFormatTest, CompatibleTypes) {
   const int64 data = 0x100000000LL;
   unittest::Int64Message msg1;